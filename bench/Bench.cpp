@@ -0,0 +1,460 @@
+/****
+ * @file Bench.cpp
+ *
+ * Host-side benchmarks for the hot paths in the sketch and its libraries: SimpleWebServer taking
+ * in requests and looking things up in them, the sketch rendering its pages and JSON, following
+ * the schedule, checking group commands, and ObsSite's sun time calculations. Each benchmark reports the time per
+ * operation, the heap allocations per operation and, where it makes sense, the throughput.
+ *
+ * The whole sketch is compiled in (src/main.cpp is #included below) against the stand-ins for
+ * the ESP8266 core in bench/stubs, so what's measured is the real code. The host is, of course,
+ * a lot faster than an ESP8266, so the times are only good for comparing one build with
+ * another; allocation counts, on the other hand, carry over pretty well. To build and run:
+ *
+ *      pio run -e native && .pio/build/native/program [<substring of benchmark names>]
+ *
+ * It exits with status 1 if any benchmark's sanity check fails (e.g., a request didn't get the
+ * response it should have), so it can run in CI.
+ *
+ ****/
+#include <chrono>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include "../src/main.cpp"
+
+/*
+ * Miscellaneous constants
+ */
+#define BENCH_REQUEST_OPS           (20000)             // Times to do each request-sized benchmark operation
+#define BENCH_LOOKUP_OPS            (20000)             // Times to do each lookup benchmark operation
+#define BENCH_RENDER_OPS            (5000)              // Times to do each render benchmark operation
+#define BENCH_SCHEDULE_OPS          (20000)             // Times to do each followSchedule() benchmark operation
+#define BENCH_GROUP_OPS             (20000)             // Times to do each group command benchmark operation
+#define BENCH_GROUP_KEY             "bench-group-key-0123"  // The group key the benchmarks sign with
+#define BENCH_CALC_OPS              (20000)             // Times to do each ObsSite benchmark operation
+#define BENCH_CMD_OPS               (20000)             // Times to do each command line benchmark operation
+#define BENCH_CLOCK_SECS            (1700049600)        // The time the clock is set to: Nov 15, 2023, 12:00 UTC
+
+/*
+ * Heap allocation counting: every operator new counts.
+ */
+static unsigned long benchAllocs = 0;                   // The number of heap allocations so far
+
+void* operator new(size_t size) {
+    benchAllocs++;
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+void operator delete(void* p) noexcept {
+    free(p);
+}
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+/*
+ * The requests
+ */
+static const char* const benchHeaders =                 // What a browser sends along with a form POST
+    "Host: 192.168.1.2\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:119.0) Gecko/20100101 Firefox/119.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "Content-Length: %u\r\n"
+    "Origin: http://192.168.1.2\r\n"
+    "Connection: keep-alive\r\n"
+    "Referer: http://192.168.1.2/\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "\r\n";
+static const char* const benchHeaderNames[] = {         // The headers in benchHeaders, in a different case
+    "host", "user-agent", "accept", "accept-language", "accept-encoding", "content-type", "content-length",
+    "origin", "connection", "referer", "upgrade-insecure-requests", "cache-control"};
+#define BENCH_HEADER_COUNT          (sizeof(benchHeaderNames) / sizeof(benchHeaderNames[0]))
+
+static std::string schedulePost;                        // A POST of the home page's form with all 40 fields
+static std::string scriptSchedulePost;                  // The same, from the home page's script, asking for what changed
+static std::string scriptTogglePost;                    // The home page's script toggling the outlet
+static std::string homeGet;                             // A GET of the home page
+static std::string commandLineGet;                      // A GET of the commandline page
+static std::string stateGet;                            // A GET of /api/state
+static std::string scheduleGet;                         // A GET of /api/schedule
+
+/*
+ * The benchmark machinery
+ */
+using benchOp = bool (*)();                             // One benchmark operation. Returns false if it went wrong
+
+struct benchCtx_t {                                     // What the benchmarks share
+    const char* filter;                                 //  Only benchmarks whose names contain this are run
+    int failures;                                       //  The number of benchmarks whose operations went wrong
+};
+static benchCtx_t ctx {"", 0};
+
+SimpleWebServer benchServer;                            // A server with one route, for the parsing benchmarks
+WiFiServer benchWiFiServer {8080};                      // Its WiFiServer
+SimpleWebServer* lookupServer = nullptr;                // For the lookup benchmarks, the server with the request
+bool (*duringRequest)() = nullptr;                      // For the lookup benchmarks, what to do while serving one
+StubWire benchWire;                                     // The connection to benchServer
+StubWire appWire;                                       // The connection to the sketch's webServer
+StubWire sinkWire;                                      // Where rendered pages go
+volatile size_t benchSink = 0;                          // Where lookup results go, so they aren't optimized away
+
+/**
+ * @brief   Run the named benchmark: do op n times, then print the time per op, the heap
+ *          allocations per op and, if bytesPerOp isn't 0, the throughput.
+ *
+ * @param name          The benchmark's name
+ * @param n             The number of times to do op
+ * @param bytesPerOp    The number of bytes each op processes, or 0
+ * @param op            The op
+ */
+void bench(const char* name, unsigned long n, size_t bytesPerOp, benchOp op) {
+    if (strstr(name, ctx.filter) == nullptr) {
+        return;
+    }
+    bool ok = op();                                     // Warm up (and check) first
+    unsigned long startAllocs = benchAllocs;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < n && ok; i++) {
+        ok = op();
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double allocs = (double)(benchAllocs - startAllocs) / n;
+    if (!ok) {
+        printf("%-44s FAILED\n", name);
+        ctx.failures++;
+        return;
+    }
+    if (bytesPerOp == 0) {
+        printf("%-44s %9.0f ns/op %8.1f allocs/op\n", name, secs * 1e9 / n, allocs);
+    } else {
+        printf("%-44s %9.0f ns/op %8.1f allocs/op %8.1f MB/s\n", name, secs * 1e9 / n, allocs,
+            bytesPerOp * n / secs / 1e6);
+    }
+}
+
+/**
+ * @brief   Send the specified request on the specified wire and have the specified server
+ *          serve it. Connect first if the wire isn't connected, e.g., because the server closed
+ *          the connection.
+ *
+ * @param server    The server
+ * @param wire      The wire to its WiFiServer
+ * @param request   The request
+ * @param status    The status line the response must start with
+ * @return true     The response started with status
+ * @return false    It didn't
+ */
+bool serve(SimpleWebServer &server, StubWire &wire, const std::string &request, const char* status) {
+    if (!wire.open) {                                   // Not connected yet, or the server closed it
+        wire.in.clear();
+        wire.inPos = 0;
+        wire.open = true;
+        WiFiServer::connect(&wire);
+    } else if (wire.inPos == wire.in.size()) {
+        wire.in.clear();                                // Keeps its capacity, so no allocation
+        wire.inPos = 0;
+    }
+    wire.in.append(request);
+    wire.headLen = 0;
+    server.run();
+    return strncmp(wire.head, status, strlen(status)) == 0;
+}
+
+/**
+ * @brief   The route handler benchServer uses for everything. If there's something to do during
+ *          a request, do it. Then say there's no content.
+ *
+ */
+void benchHandler(SimpleWebServer* webServer, WiFiClient* httpClient, swsStringView trPath, swsStringView trQuery) {
+    bool ok = true;
+    if (duringRequest != nullptr) {
+        lookupServer = webServer;
+        ok = duringRequest();
+    }
+    webServer->sendResponseHead(httpClient, ok ? 204 : 500, ok ? "No Content" : "Internal Server Error", nullptr, 0);
+}
+
+/*
+ * The benchmark operations
+ */
+bool opParsePost() {
+    return serve(benchServer, benchWire, schedulePost, "HTTP/1.1 204");
+}
+bool opGetHeader() {
+    for (uint8_t i = 0; i < BENCH_HEADER_COUNT; i++) {
+        benchSink += lookupServer->getHeader(benchHeaderNames[i]).length();
+    }
+    return lookupServer->getHeader("Connection") == "keep-alive";
+}
+bool opHeaderValue() {
+    for (uint8_t i = 0; i < BENCH_HEADER_COUNT; i++) {
+        benchSink += strlen(lookupServer->headerValue(benchHeaderNames[i]));
+    }
+    return strcmp(lookupServer->headerValue("Connection"), "keep-alive") == 0;
+}
+bool opGetFormDatum() {
+    for (uint8_t i = 0; i < N_SCHED_FIELDS; i++) {
+        benchSink += lookupServer->getFormDatum(schedFields[i].name).length();
+    }
+    return lookupServer->getFormDatum("s0on") == "08:00";
+}
+bool opFormDatumValue() {
+    for (uint8_t i = 0; i < N_SCHED_FIELDS; i++) {
+        benchSink += strlen(lookupServer->formDatumValue(schedFields[i].name));
+    }
+    return strcmp(lookupServer->formDatumValue("s0on"), "08:00") == 0;
+}
+bool opLookups() {
+    bench("getHeader() x 12 headers", BENCH_LOOKUP_OPS, 0, opGetHeader);
+    bench("headerValue() x 12 headers", BENCH_LOOKUP_OPS, 0, opHeaderValue);
+    bench("getFormDatum() x 40 fields", BENCH_LOOKUP_OPS, 0, opGetFormDatum);
+    bench("formDatumValue() x 40 fields", BENCH_LOOKUP_OPS, 0, opFormDatumValue);
+    return true;
+}
+bool opHomeGet() {
+    return serve(webServer, appWire, homeGet, "HTTP/1.1 200");
+}
+bool opCommandLineGet() {
+    return serve(webServer, appWire, commandLineGet, "HTTP/1.1 200");
+}
+bool opStateGet() {
+    return serve(webServer, appWire, stateGet, "HTTP/1.1 200");
+}
+bool opScheduleGet() {
+    return serve(webServer, appWire, scheduleGet, "HTTP/1.1 200");
+}
+bool opSchedulePost() {
+    return serve(webServer, appWire, schedulePost, "HTTP/1.1 303");
+}
+bool opScriptSchedulePost() {
+    return serve(webServer, appWire, scriptSchedulePost, "HTTP/1.1 200");
+}
+bool opScriptTogglePost() {
+    return serve(webServer, appWire, scriptTogglePost, "HTTP/1.1 200");
+}
+bool opRenderCommandLine() {
+    WiFiClient client {&sinkWire};
+    size_t before = sinkWire.outCount;
+    sendCommandLinePage(&client, false);
+    return sinkWire.outCount > before;
+}
+bool opRenderState() {
+    WiFiClient client {&sinkWire};
+    size_t before = sinkWire.outCount;
+    sendStateJson(&client, false);
+    return sinkWire.outCount > before;
+}
+bool opRenderSchedule() {
+    WiFiClient client {&sinkWire};
+    size_t before = sinkWire.outCount;
+    sendScheduleJson(&client, false);
+    return sinkWire.outCount > before;
+}
+bool opFollowChanged() {
+    scheduleUpdated = true;
+    return followSchedule() <= MINS_PER_DAY;
+}
+bool opFollowSteady() {
+    return followSchedule() <= MINS_PER_DAY;
+}
+bool opCmdLoc() {
+    static const char line[] = "loc 40.7128 -74.0060 10";
+    return wc.doCommand({line, (uint16_t)(sizeof(line) - 1)}).startsWith("Location changed");
+}
+bool opCmdSsid() {
+    static const char line[] = "ssid The Bench Lab Network";
+    return wc.doCommand({line, (uint16_t)(sizeof(line) - 1)}).startsWith("SSID changed");
+}
+bool opCmdRuleDel() {
+    static const char line[] = "rule del 99";
+    return wc.doCommand({line, (uint16_t)(sizeof(line) - 1)}).startsWith("There's no rule");
+}
+
+/**
+ * @brief   Fill the sketch's schedule rules with SR_MAX_RULES of them, a mix of the kinds there are.
+ *
+ * @return true     Success
+ * @return false    A rule wouldn't parse or couldn't be added
+ */
+bool addBenchRules() {
+    static const char* const spec[] = {
+        "daily 06:30 07:15 5", "-MTWTF- sunrise-30 sunrise+20", "S-----S sunset-15 23:00 10",
+        "weekdays 12:00 12:05 0 11/01-02/28"};
+    for (uint8_t r = 0; r < SR_MAX_RULES; r++) {
+        srRule_t rule;
+        if (!ScheduleRules::parse(spec[r % (sizeof(spec) / sizeof(spec[0]))], &rule) || !rules.add(rule)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint8_t groupDatagram[sizeof(groupHeader_t) + 15 + GROUP_MAC_LEN]; // A signed {"outlet":true} group command
+bool opGroupRepeat() {
+    uint32_t repeats = groupDuplicates;
+    WiFiUDP::deliver(GROUP_PORT, groupDatagram, sizeof(groupDatagram));
+    groupTask();
+    return groupDuplicates == repeats + 1;
+}
+
+/**
+ * @brief   Have the sketch join a group, and make and have it accept groupDatagram, so that 
+ *          delivering it again is a repeat: checked all the way through the MAC and then ignored.
+ *
+ * @return true     Success
+ * @return false    The sketch didn't accept it
+ */
+bool joinBenchGroup() {
+    config.groupId = 1;
+    strcpy(config.groupKey, BENCH_GROUP_KEY);
+    netState = netUp;
+    groupHeader_t header {GROUP_MAGIC, GROUP_VERSION, gcState, 1, 15, (uint64_t)BENCH_CLOCK_SECS * 1000 + 1};
+    memcpy(groupDatagram, &header, sizeof(header));
+    memcpy(groupDatagram + sizeof(header), "{\"outlet\":true}", 15);
+    experimental::crypto::SHA256::hmac(groupDatagram, sizeof(header) + 15, BENCH_GROUP_KEY, strlen(BENCH_GROUP_KEY),
+        groupDatagram + sizeof(header) + 15, GROUP_MAC_LEN);
+    groupTask();
+    WiFiUDP::deliver(GROUP_PORT, groupDatagram, sizeof(groupDatagram));
+    groupTask();
+    return groupAccepted == 1;
+}
+
+ObsSite doubleSite {37.4, -122.1, 30.0, obsDoubleKernel};
+ObsSite floatSite {37.4, -122.1, 30.0, obsFloatKernel};
+int calcDay = 0;                                        // The yday the next ObsSite operation asks about
+bool opCalcDouble() {
+    calcDay = (calcDay + 1) % 365;                      // A different day each time, so calc() has to calculate
+    return doubleSite.getSunrise(123, calcDay) > 0;
+}
+bool opCalcFloat() {
+    calcDay = (calcDay + 1) % 365;
+    return floatSite.getSunrise(123, calcDay) > 0;
+}
+bool opSunriseMins() {
+    calcDay = (calcDay + 1) % 365;                      // Tomorrow is "today" next time, as it is for followSchedule()
+    return site.getSunriseMins(123, calcDay) >= 0;
+}
+
+/**
+ * @brief   Make the requests the benchmarks use.
+ *
+ */
+void makeRequests() {
+    std::string body;
+    for (uint8_t i = 0; i < N_SCHED_FIELDS; i++) {
+        const schedField_t &field = schedFields[i];
+        char value[8];
+        switch (field.kind) {
+            case sfEnable:
+                strcpy(value, "on");
+                break;
+            case sfType:
+                snprintf(value, sizeof(value), "%.2s%s", field.name, cycleTypeCode[i % _cycleTypeSize]);
+                break;
+            case sfTime:
+                strcpy(value, field.name[2] == 'o' && field.name[3] == 'n' ? "08%3A00" : "17%3A30");
+                break;
+            case sfDelta:
+            case sfFuzz:
+                strcpy(value, "15");
+                break;
+        }
+        body += (i == 0 ? "" : "&") + std::string(field.name) + "=" + value;
+    }
+    char headers[1024];
+    snprintf(headers, sizeof(headers), benchHeaders, (unsigned)body.size());
+    schedulePost = "POST /?" SCHED_UPDATE_QUERY " HTTP/1.1\r\n" + std::string(headers) + body;
+    std::string scriptHeaders = headers;
+    size_t accept = scriptHeaders.find("Accept: ");
+    scriptHeaders.replace(accept, scriptHeaders.find("\r\n", accept) - accept, "Accept: " DELTA_ACCEPT);
+    scriptSchedulePost = "POST /?" SCHED_UPDATE_QUERY " HTTP/1.1\r\n" + scriptHeaders + body;
+    snprintf(headers, sizeof(headers), benchHeaders, 0);
+    scriptHeaders = headers;
+    scriptHeaders.replace(accept, scriptHeaders.find("\r\n", accept) - accept, "Accept: " DELTA_ACCEPT);
+    scriptTogglePost = "POST /?" TOGGLE_QUERY " HTTP/1.1\r\n" + scriptHeaders;
+    std::string getHeaders = headers;
+    homeGet = "GET / HTTP/1.1\r\n" + getHeaders;
+    commandLineGet = "GET /commandline.html HTTP/1.1\r\n" + getHeaders;
+    stateGet = "GET /api/state HTTP/1.1\r\n" + getHeaders;
+    scheduleGet = "GET /api/schedule HTTP/1.1\r\n" + getHeaders;
+}
+
+int main(int argc, char** argv) {
+    ctx.filter = argc > 1 ? argv[1] : "";
+    makeRequests();
+
+    // Get the sketch going, with its clock set and its schedule fully enabled
+    setup();
+    struct timeval tv {BENCH_CLOCK_SECS, 0};
+    settimeofday(&tv, nullptr);
+    clockIsSet = true;
+    config.enabled = true;
+    for (uint8_t c = 0; c < N_CYCLES; c++) {
+        config.cycleEnable[c] = true;
+    }
+    benchServer.begin(benchWiFiServer);
+    benchWire.open = appWire.open = false;              // serve() connects them
+    benchServer.attachMethodHandler(swsPOST, benchHandler);
+
+    printf("%-44s %15s %18s\n", "benchmark", "time", "heap");
+    bench("SimpleWebServer: parse 40-field POST", BENCH_REQUEST_OPS, schedulePost.size(), opParsePost);
+    duringRequest = opLookups;
+    if (!opParsePost()) {
+        printf("Lookup benchmarks: FAILED\n");
+        ctx.failures++;
+    }
+    duringRequest = nullptr;
+    bench("GET / (home page asset)", BENCH_REQUEST_OPS, homeGet.size(), opHomeGet);
+    bench("GET /commandline.html", BENCH_RENDER_OPS, commandLineGet.size(), opCommandLineGet);
+    bench("GET /api/state", BENCH_RENDER_OPS, stateGet.size(), opStateGet);
+    bench("GET /api/schedule", BENCH_RENDER_OPS, scheduleGet.size(), opScheduleGet);
+    bench("POST /?schedule=update (40 fields)", BENCH_REQUEST_OPS, schedulePost.size(), opSchedulePost);
+    bench("POST /?schedule=update (40 fields, script)", BENCH_REQUEST_OPS, scriptSchedulePost.size(), opScriptSchedulePost);
+    bench("POST /?outlet=toggle (script)", BENCH_REQUEST_OPS, scriptTogglePost.size(), opScriptTogglePost);
+    bench("render: sendCommandLinePage()", BENCH_RENDER_OPS, 0, opRenderCommandLine);
+    bench("render: sendStateJson()", BENCH_RENDER_OPS, 0, opRenderState);
+    bench("render: sendScheduleJson()", BENCH_RENDER_OPS, 0, opRenderSchedule);
+    bench("followSchedule(): schedule changed", BENCH_SCHEDULE_OPS, 0, opFollowChanged);
+    bench("followSchedule(): nothing to do", BENCH_SCHEDULE_OPS, 0, opFollowSteady);
+    if (addBenchRules()) {
+        bench("followSchedule(): changed, 64 more rules", BENCH_SCHEDULE_OPS, 0, opFollowChanged);
+    } else {
+        printf("Schedule rule benchmarks: FAILED\n");
+        ctx.failures++;
+    }
+    rules.clear();
+    if (joinBenchGroup()) {
+        bench("group command: repeat, checked and ignored", BENCH_GROUP_OPS, sizeof(groupDatagram), opGroupRepeat);
+    } else {
+        printf("Group command benchmarks: FAILED\n");
+        ctx.failures++;
+    }
+    bench("command: loc <lat> <lon> <elev>", BENCH_CMD_OPS, 0, opCmdLoc);
+    bench("command: ssid <ssid with blanks>", BENCH_CMD_OPS, 0, opCmdSsid);
+    bench("command: rule del <n> (no such rule)", BENCH_CMD_OPS, 0, opCmdRuleDel);
+    bench("ObsSite::calc(): double kernel", BENCH_CALC_OPS, 0, opCalcDouble);
+    bench("ObsSite::calc(): float kernel", BENCH_CALC_OPS, 0, opCalcFloat);
+    bench("ObsSite::getSunriseMins(): day by day", BENCH_CALC_OPS, 0, opSunriseMins);
+
+    if (ctx.failures != 0) {
+        printf("%d benchmark(s) failed.\n", ctx.failures);
+    }
+    return ctx.failures == 0 ? 0 : 1;
+}
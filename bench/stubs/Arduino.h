@@ -0,0 +1,304 @@
+/****
+ * @file Arduino.h
+ *
+ * A thin host-side stand-in for the ESP8266 Arduino core, just enough of it for the sketch and
+ * its libraries to compile and run natively for the benchmarks in bench/. String is built on
+ * std::string, so its heap behavior is close to, but not the same as, the real one's: both keep
+ * short strings inline (std::string up to 15 chars, the ESP8266's up to 11). Serial goes to
+ * stderr so it stays out of the benchmark results.
+ *
+ ****/
+#pragma once
+#define Arduino_h
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include <ctime>                                        // Before the clock macros below: it #undefs time
+#include <string>
+
+/*
+ * PROGMEM and friends: on the host, flash is just memory
+ */
+#define PROGMEM
+#define PGM_P                       const char*
+#define PSTR(s)                     (s)
+#define F(s)                        ((const __FlashStringHelper*)(s))
+#define pgm_read_byte(p)            (*(const uint8_t*)(p))
+#define pgm_read_word(p)            (*(const uint16_t*)(p))
+#define pgm_read_dword(p)           (*(const uint32_t*)(p))
+#define pgm_read_ptr(p)             (*(void* const*)(p))
+#define memcpy_P                    memcpy
+#define strlen_P                    strlen
+#define strcmp_P                    strcmp
+#define strncmp_P                   strncmp
+#define strcasecmp_P                strcasecmp
+#define strncasecmp_P               strncasecmp
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+
+/*
+ * Pins and interrupts
+ */
+#define LOW                         (0)
+#define HIGH                        (1)
+#define INPUT                       (0)
+#define OUTPUT                      (1)
+#define INPUT_PULLUP                (2)
+#define RISING                      (1)
+#define FALLING                     (2)
+#define CHANGE                      (3)
+#ifndef PI
+#define PI                          (3.1415926535897932384626433832795)
+#endif
+
+/*
+ * The sketch's wall clock. It runs at the host's rate but is set separately, so that
+ * settimeofday() never touches the host's clock.
+ */
+#define time(t)                     stubTime(t)
+#define gettimeofday(tv, tz)        stubGettimeofday(tv, tz)
+#define settimeofday(tv, tz)        stubSettimeofday(tv, tz)
+time_t stubTime(time_t* t);
+int stubGettimeofday(struct timeval* tv, void* tz);
+int stubSettimeofday(const struct timeval* tv, const void* tz);
+
+class __FlashStringHelper;
+
+unsigned long millis();
+unsigned long micros();
+uint64_t micros64();
+void delay(unsigned long ms);
+void yield();
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int digitalPinToInterrupt(int pin);
+void attachInterrupt(int interrupt, void (*isr)(), int mode);
+void attachInterruptArg(uint8_t pin, void (*isr)(void*), void* arg, int mode);
+void detachInterrupt(int interrupt);
+inline void noInterrupts() {}
+inline void interrupts() {}
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+template<class T> const T& min(const T& a, const T& b) { return a < b ? a : b; }
+template<class T> const T& max(const T& a, const T& b) { return a > b ? a : b; }
+
+class String {
+    public:
+        String(const char* s = "") : s_(s == nullptr ? "" : s) {}
+        String(const String &) = default;
+        String(const __FlashStringHelper* s) : s_((const char*)s) {}
+        explicit String(char c) : s_(1, c) {}
+        explicit String(int v, unsigned char base = 10) { fmt(base == 16 ? "%x" : "%d", v); }
+        explicit String(unsigned int v, unsigned char base = 10) { fmt(base == 16 ? "%x" : "%u", v); }
+        explicit String(long v, unsigned char base = 10) { fmt(base == 16 ? "%lx" : "%ld", v); }
+        explicit String(unsigned long v, unsigned char base = 10) { fmt(base == 16 ? "%lx" : "%lu", v); }
+        explicit String(double v, unsigned char decimals = 2) { fmt("%.*f", (int)decimals, v); }
+        String &operator=(const String &) = default;
+        String &operator=(const char* s) { s_ = s == nullptr ? "" : s; return *this; }
+
+        unsigned int length() const { return s_.size(); }
+        const char* c_str() const { return s_.c_str(); }
+        char* begin() { return &s_[0]; }
+        bool reserve(unsigned int size) { s_.reserve(size); return true; }
+        char charAt(unsigned int ix) const { return ix < s_.size() ? s_[ix] : '\0'; }
+        char operator[](unsigned int ix) const { return charAt(ix); }
+        explicit operator bool() const { return true; }
+
+        bool concat(const String &s) { s_ += s.s_; return true; }
+        bool concat(const char* s) { s_ += s; return true; }
+        bool concat(const char* s, unsigned int n) { s_.append(s, n); return true; }
+        bool concat(char c) { s_ += c; return true; }
+        String &operator+=(const String &s) { s_ += s.s_; return *this; }
+        String &operator+=(const char* s) { s_ += s; return *this; }
+        String &operator+=(char c) { s_ += c; return *this; }
+        friend String operator+(const String &a, const String &b) { String r {a}; r += b; return r; }
+        friend String operator+(const String &a, const char* b) { String r {a}; r += b; return r; }
+        friend String operator+(const char* a, const String &b) { String r {a}; r += b; return r; }
+        friend String operator+(const String &a, char b) { String r {a}; r += b; return r; }
+
+        bool equals(const String &s) const { return s_ == s.s_; }
+        bool equals(const char* s) const { return s_ == s; }
+        bool operator==(const String &s) const { return s_ == s.s_; }
+        bool operator==(const char* s) const { return s_ == s; }
+        bool operator!=(const String &s) const { return s_ != s.s_; }
+        bool operator!=(const char* s) const { return s_ != s; }
+        bool equalsIgnoreCase(const String &s) const { return strcasecmp(s_.c_str(), s.c_str()) == 0; }
+        bool startsWith(const String &s) const { return s_.compare(0, s.length(), s.s_) == 0; }
+        bool endsWith(const String &s) const {
+            return s_.size() >= s.length() && s_.compare(s_.size() - s.length(), s.length(), s.s_) == 0;
+        }
+        int indexOf(char c, unsigned int from = 0) const { return pos(s_.find(c, from)); }
+        int indexOf(const String &s, unsigned int from = 0) const { return pos(s_.find(s.s_, from)); }
+        int lastIndexOf(char c) const { return pos(s_.rfind(c)); }
+        int lastIndexOf(const String &s) const { return pos(s_.rfind(s.s_)); }
+        String substring(unsigned int from) const { return substring(from, s_.size()); }
+        String substring(unsigned int from, unsigned int to) const {
+            return from >= s_.size() || to <= from ? String() : String(s_.substr(from, to - from).c_str());
+        }
+
+        void replace(const String &find, const String &with) {
+            for (size_t p = 0; find.length() != 0 && (p = s_.find(find.s_, p)) != std::string::npos; p += with.length()) {
+                s_.replace(p, find.length(), with.s_);
+            }
+        }
+        void remove(unsigned int ix) { if (ix < s_.size()) s_.erase(ix); }
+        void remove(unsigned int ix, unsigned int n) { if (ix < s_.size()) s_.erase(ix, n); }
+        void trim() {
+            size_t first = s_.find_first_not_of(" \t\r\n");
+            s_ = first == std::string::npos ? "" : s_.substr(first, s_.find_last_not_of(" \t\r\n") - first + 1);
+        }
+        void toLowerCase() { for (char &c : s_) c = tolower(c); }
+        void toUpperCase() { for (char &c : s_) c = toupper(c); }
+        long toInt() const { return atol(s_.c_str()); }
+        float toFloat() const { return atof(s_.c_str()); }
+
+    private:
+        std::string s_;
+        static int pos(size_t p) { return p == std::string::npos ? -1 : (int)p; }
+        template<class T> void fmt(const char* f, T v) { char b[34]; snprintf(b, sizeof(b), f, v); s_ = b; }
+        template<class T> void fmt(const char* f, int d, T v) { char b[64]; snprintf(b, sizeof(b), f, d, v); s_ = b; }
+};
+
+class Print {
+    public:
+        virtual ~Print() {}
+        virtual size_t write(uint8_t c) = 0;
+        virtual size_t write(const uint8_t* buffer, size_t size) {
+            size_t n = 0;
+            while (size-- > 0) {
+                n += write(*buffer++);
+            }
+            return n;
+        }
+        size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+        size_t write(const char* buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+        virtual void flush() {}
+
+        size_t print(const char* s) { return write(s); }
+        size_t print(const __FlashStringHelper* s) { return write((const char*)s); }
+        size_t print(const String &s) { return write(s.c_str(), s.length()); }
+        size_t print(char c) { return write((uint8_t)c); }
+        size_t print(int v, int base = 10) { return print(String(v, base)); }
+        size_t print(unsigned int v, int base = 10) { return print(String(v, base)); }
+        size_t print(long v, int base = 10) { return print(String(v, base)); }
+        size_t print(unsigned long v, int base = 10) { return print(String(v, base)); }
+        size_t print(double v, int decimals = 2) { return print(String(v, decimals)); }
+        size_t println() { return print("\r\n"); }
+        template<class T> size_t println(const T &v) { return print(v) + println(); }
+        size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+            va_list args;
+            va_start(args, format);
+            size_t n = vprintf(format, args);
+            va_end(args);
+            return n;
+        }
+        size_t printf_P(PGM_P format, ...) {
+            va_list args;
+            va_start(args, format);
+            size_t n = vprintf(format, args);
+            va_end(args);
+            return n;
+        }
+
+    private:
+        size_t vprintf(const char* format, va_list args) {
+            char buffer[512];
+            int n = vsnprintf(buffer, sizeof(buffer), format, args);
+            return n < 0 ? 0 : write(buffer, (size_t)n < sizeof(buffer) ? (size_t)n : sizeof(buffer) - 1);
+        }
+};
+
+class Stream : public Print {
+    public:
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() { return -1; }
+        virtual int read(uint8_t* buffer, size_t size) {
+            size_t n = 0;
+            int c;
+            while (n < size && (c = read()) >= 0) {
+                buffer[n++] = c;
+            }
+            return n;
+        }
+};
+
+class HardwareSerial : public Stream {
+    public:
+        void begin(unsigned long) {}
+        size_t write(uint8_t c) override { return fwrite(&c, 1, 1, stderr); }
+        size_t write(const uint8_t* buffer, size_t size) override { return fwrite(buffer, 1, size, stderr); }
+        using Print::write;
+        int available() override { return 0; }
+        int read() override { return -1; }
+};
+extern HardwareSerial Serial;
+
+struct ip_addr_t {                                      // lwIP's IPv4 address
+    uint32_t addr;
+};
+
+class IPAddress {
+    public:
+        IPAddress() : addr(0) {}
+        IPAddress(uint32_t a) : addr(a) {}
+        IPAddress(const ip_addr_t* a) : addr(a->addr) {}
+        IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : addr(a | b << 8 | c << 16 | (uint32_t)d << 24) {}
+        operator uint32_t() const { return addr; }
+        bool isSet() const { return addr != 0; }
+        bool fromString(const char* s) {
+            unsigned a, b, c, d;
+            if (sscanf(s, "%u.%u.%u.%u", &a, &b, &c, &d) != 4) {
+                return false;
+            }
+            addr = IPAddress(a, b, c, d);
+            return true;
+        }
+        String toString() const {
+            char b[16];
+            snprintf(b, sizeof(b), "%u.%u.%u.%u", addr & 0xFF, addr >> 8 & 0xFF, addr >> 16 & 0xFF, addr >> 24);
+            return String(b);
+        }
+
+    private:
+        uint32_t addr;
+};
+
+struct rst_info {
+    uint32_t reason, exccause, epc1, epc2, epc3, excvaddr, depc;
+};
+
+class EspClass {
+    public:
+        void restart();
+        void reset();
+        uint32_t getFreeHeap();
+        uint32_t getMaxFreeBlockSize();
+        uint8_t getHeapFragmentation();
+        uint32_t getChipId();
+        uint32_t getCycleCount();
+        struct rst_info* getResetInfoPtr();
+        String getResetReason();
+        bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size);
+        bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size);
+        uint32_t getFlashChipSize();
+        uint32_t getSketchSize();
+        uint32_t getFreeSketchSpace();
+        String getSketchMD5();
+        bool flashEraseSector(uint32_t sector);
+        bool flashWrite(uint32_t address, const uint32_t* data, size_t size);
+        bool flashWrite(uint32_t address, const uint8_t* data, size_t size);
+        bool flashRead(uint32_t address, uint32_t* data, size_t size);
+        bool flashRead(uint32_t address, uint8_t* data, size_t size);
+};
+extern EspClass ESP;
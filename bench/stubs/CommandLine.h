@@ -0,0 +1,36 @@
+/****
+ * @file CommandLine.h
+ *
+ * A thin host-side stand-in for the CommandLine library. Commands are only ever run by
+ * getHandlerFor()'s callers (WebCmd); nothing is read from Serial.
+ *
+ ****/
+#pragma once
+#include <Arduino.h>
+
+#define CMD_PROMPT                  "> "
+#define STUB_MAX_COMMANDS           (32)
+
+class CommandHandlerHelper {
+    public:
+        virtual ~CommandHandlerHelper() {}
+        virtual String getWord(uint8_t ix = 0) = 0;
+        virtual String getCommandLine() = 0;
+};
+typedef String (*commandHandler_t)(CommandHandlerHelper*);
+
+class CommandLine : public CommandHandlerHelper {
+    public:
+        bool attachCmdHandler(String cmd, commandHandler_t handler);
+        commandHandler_t getHandlerFor(String cmd);
+        bool run() { return false; }
+        void cancelCmd() {}
+        String getWord(uint8_t = 0) override { return ""; }
+        String getCommandLine() override { return ""; }
+
+    private:
+        String cmds[STUB_MAX_COMMANDS];
+        commandHandler_t handlers[STUB_MAX_COMMANDS];
+        commandHandler_t defaultHandler = nullptr;
+        uint8_t nCmds = 0;
+};
@@ -0,0 +1,130 @@
+/****
+ * @file Crypto.h
+ *
+ * A thin host-side stand-in for the ESP8266 core's Crypto.h. Only SHA256::hash() and
+ * SHA256::hmac() are here, and they're real: the sketch's group command datagrams are checked
+ * with the same HMAC-SHA256 a sender (tools/group_cmd.py) computes.
+ *
+ ****/
+#pragma once
+#include <Arduino.h>
+
+namespace experimental {
+namespace crypto {
+
+class SHA256 {
+    public:
+        static constexpr uint8_t NATURAL_LENGTH = 32;
+
+        static void* hash(const void* data, size_t dataLength, void* resultArray) {
+            context ctx;
+            ctx.update(data, dataLength);
+            ctx.finish((uint8_t*)resultArray);
+            return resultArray;
+        }
+
+        static void* hmac(const void* data, size_t dataLength, const void* hashKey, size_t hashKeyLength,
+            void* resultArray, size_t outputLength) {
+            uint8_t key[64] = {};
+            if (hashKeyLength > sizeof(key)) {
+                hash(hashKey, hashKeyLength, key);
+            } else {
+                memcpy(key, hashKey, hashKeyLength);
+            }
+            uint8_t pad[64];
+            uint8_t digest[32];
+            context inner;
+            for (int i = 0; i < 64; i++) {
+                pad[i] = key[i] ^ 0x36;
+            }
+            inner.update(pad, sizeof(pad));
+            inner.update(data, dataLength);
+            inner.finish(digest);
+            context outer;
+            for (int i = 0; i < 64; i++) {
+                pad[i] = key[i] ^ 0x5C;
+            }
+            outer.update(pad, sizeof(pad));
+            outer.update(digest, sizeof(digest));
+            outer.finish(digest);
+            memcpy(resultArray, digest, outputLength < sizeof(digest) ? outputLength : sizeof(digest));
+            return resultArray;
+        }
+
+    private:
+        struct context {
+            uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+            uint8_t block[64];
+            size_t used = 0;
+            uint64_t total = 0;
+
+            void update(const void* data, size_t len) {
+                const uint8_t* p = (const uint8_t*)data;
+                total += len;
+                while (len > 0) {
+                    size_t n = len < 64 - used ? len : 64 - used;
+                    memcpy(block + used, p, n);
+                    used += n;
+                    p += n;
+                    len -= n;
+                    if (used == 64) {
+                        compress(h, block);
+                        used = 0;
+                    }
+                }
+            }
+            void finish(uint8_t* out) {
+                // The 0x80 that ends the data and its length in bits, in this block or the next
+                uint64_t bits = total * 8;
+                block[used++] = 0x80;
+                if (used > 56) {
+                    memset(block + used, 0, 64 - used);
+                    compress(h, block);
+                    used = 0;
+                }
+                memset(block + used, 0, 56 - used);
+                for (int i = 0; i < 8; i++) {
+                    block[63 - i] = bits >> (8 * i);
+                }
+                compress(h, block);
+                for (int i = 0; i < 8; i++) {
+                    out[i * 4] = h[i] >> 24;
+                    out[i * 4 + 1] = h[i] >> 16;
+                    out[i * 4 + 2] = h[i] >> 8;
+                    out[i * 4 + 3] = h[i];
+                }
+            }
+        };
+
+        static uint32_t rotr(uint32_t x, int n) { return x >> n | x << (32 - n); }
+        static void compress(uint32_t* h, const uint8_t* block) {
+            static const uint32_t k[64] = {
+                0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+            uint32_t w[64];
+            for (int i = 0; i < 16; i++) {
+                w[i] = (uint32_t)block[i * 4] << 24 | block[i * 4 + 1] << 16 | block[i * 4 + 2] << 8 | block[i * 4 + 3];
+            }
+            for (int i = 16; i < 64; i++) {
+                uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ w[i - 15] >> 3;
+                uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ w[i - 2] >> 10;
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+            uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+            for (int i = 0; i < 64; i++) {
+                uint32_t t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+                uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                hh = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+            }
+            h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+        }
+};
+
+}
+}
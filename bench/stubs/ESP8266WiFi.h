@@ -0,0 +1,129 @@
+/****
+ * @file ESP8266WiFi.h
+ *
+ * A thin host-side stand-in for the ESP8266 WiFi library. The one part of it that does anything
+ * is the TCP side: a WiFiClient is one end of a StubWire, an in-memory connection the benchmarks
+ * script. What the "browser" sends is put in the wire's in, and WiFiServer::connect() makes the
+ * wire the next connection the server accepts. What the sketch writes back is counted, and the
+ * start of it is kept (without using the heap, so as not to upset allocation counts). The WiFi
+ * station itself is always connected.
+ *
+ ****/
+#pragma once
+#define ESP8266WiFi_h
+#include <Arduino.h>
+
+/**
+ * @brief   An in-memory TCP connection
+ *
+ */
+struct StubWire {
+    std::string in;                                     // What the client sends
+    size_t inPos = 0;                                   // How much of it has been read
+    size_t outCount = 0;                                // The number of bytes written back
+    char head[32] = "";                                 // The first of them since headLen was set to 0
+    size_t headLen = 0;                                 // The length of head
+    bool open = true;                                   // False once either end has closed it
+};
+
+class WiFiClient : public Stream {
+    public:
+        WiFiClient(StubWire* wire = nullptr) : wire(wire) {}
+        size_t write(uint8_t c) override { return write(&c, 1); }
+        size_t write(const uint8_t* buffer, size_t size) override {
+            if (wire == nullptr || !wire->open) {
+                return 0;
+            }
+            wire->outCount += size;
+            size_t n = min(size, sizeof(wire->head) - 1 - wire->headLen);
+            memcpy(wire->head + wire->headLen, buffer, n);
+            wire->headLen += n;
+            wire->head[wire->headLen] = '\0';
+            return size;
+        }
+        size_t write_P(PGM_P buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+        using Print::write;
+        int available() override { return wire == nullptr ? 0 : wire->in.size() - wire->inPos; }
+        int read() override { return available() > 0 ? (uint8_t)wire->in[wire->inPos++] : -1; }
+        int read(uint8_t* buffer, size_t size) override {
+            size_t n = min(size, (size_t)available());
+            if (n > 0) {
+                memcpy(buffer, wire->in.data() + wire->inPos, n);
+                wire->inPos += n;
+            }
+            return n;
+        }
+        int peek() override { return available() > 0 ? (uint8_t)wire->in[wire->inPos] : -1; }
+        int connect(const char*, uint16_t) { return 0; }   // Outgoing connections go nowhere
+        int connect(IPAddress, uint16_t) { return 0; }
+        uint8_t connected() { return wire != nullptr && (wire->open || available() > 0); }
+        void stop() { if (wire != nullptr) wire->open = false; }
+        void setNoDelay(bool) {}
+        void setTimeout(unsigned long) {}
+        void keepAlive(uint16_t = 0, uint16_t = 0, uint8_t = 0) {}
+        size_t availableForWrite() { return 1460; }
+        IPAddress remoteIP() { return IPAddress(127, 0, 0, 1); }
+        operator bool() { return wire != nullptr; }
+
+    private:
+        StubWire* wire;
+};
+
+class WiFiServer {
+    public:
+        WiFiServer(uint16_t) {}
+        void begin() {}
+        void setNoDelay(bool) {}
+        bool hasClient() { return pending != nullptr; }
+        WiFiClient accept() { WiFiClient client {pending}; pending = nullptr; return client; }
+        WiFiClient available() { return accept(); }
+
+        /**
+         * @brief   Make the specified wire the next connection accept() hands out.
+         *
+         * @param wire  The wire. Must stay around until it's been closed.
+         */
+        static void connect(StubWire* wire) { pending = wire; }
+
+    private:
+        static StubWire* pending;
+};
+
+enum wl_status_t {
+    WL_IDLE_STATUS, WL_NO_SSID_AVAIL, WL_SCAN_COMPLETED, WL_CONNECTED, WL_CONNECT_FAILED,
+    WL_CONNECTION_LOST, WL_WRONG_PASSWORD, WL_DISCONNECTED};
+enum WiFiMode_t {WIFI_OFF, WIFI_STA, WIFI_AP, WIFI_AP_STA};
+enum WiFiSleepType_t {WIFI_NONE_SLEEP, WIFI_LIGHT_SLEEP, WIFI_MODEM_SLEEP};
+
+class ESP8266WiFiClass {
+    public:
+        wl_status_t begin(const char*, const char* = nullptr, int32_t = 0, const uint8_t* = nullptr, bool = true) { return WL_CONNECTED; }
+        wl_status_t begin() { return WL_CONNECTED; }
+        bool config(IPAddress, IPAddress, IPAddress, IPAddress = IPAddress(), IPAddress = IPAddress()) { return true; }
+        wl_status_t status() { return WL_CONNECTED; }
+        bool isConnected() { return true; }
+        bool disconnect(bool = false) { return true; }
+        bool reconnect() { return true; }
+        bool mode(WiFiMode_t) { return true; }
+        bool persistent(bool) { return true; }
+        bool setAutoConnect(bool) { return true; }
+        bool setAutoReconnect(bool) { return true; }
+        bool setSleepMode(WiFiSleepType_t, uint8_t = 0) { return true; }
+        WiFiSleepType_t getSleepMode() { return WIFI_NONE_SLEEP; }
+        bool hostname(const char*) { return true; }
+        IPAddress localIP() { return IPAddress(192, 168, 1, 2); }
+        IPAddress gatewayIP() { return IPAddress(192, 168, 1, 1); }
+        IPAddress subnetMask() { return IPAddress(255, 255, 255, 0); }
+        IPAddress dnsIP(uint8_t = 0) { return IPAddress(192, 168, 1, 1); }
+        uint8_t* BSSID() { static uint8_t bssid[6] = {2, 0, 0, 0, 0, 1}; return bssid; }
+        String BSSIDstr() { return "02:00:00:00:00:01"; }
+        int32_t channel() { return 6; }
+        int32_t RSSI() { return -50; }
+        String macAddress() { return "02:00:00:00:00:02"; }
+        int hostByName(const char*, IPAddress &ip, uint32_t = 10000) { ip = IPAddress(127, 0, 0, 1); return 1; }
+};
+extern ESP8266WiFiClass WiFi;
+
+void configTime(const char* tz, const char* server1, const char* server2 = nullptr, const char* server3 = nullptr);
+void configTzTime(const char* tz, const char* server1, const char* server2 = nullptr, const char* server3 = nullptr);
+void setTZ(const char* tz);
@@ -0,0 +1,54 @@
+/****
+ * @file ESP8266mDNS.h
+ *
+ * A thin host-side stand-in for the ESP8266 core's mDNS responder (LEAmDNS): it keeps the
+ * services and TXT items it's given, and counts announcements, but never sends anything.
+ *
+ ****/
+#pragma once
+#include <Arduino.h>
+
+#define STUB_MDNS_MAX_TXTS          (8)                 // Most TXT items the stand-in keeps
+
+class MDNSResponder {
+    public:
+        typedef const void* hMDNSService;
+        typedef const void* hMDNSTxt;
+
+        bool begin(const char* hostname, const IPAddress& = IPAddress(), uint32_t = 120) {
+            host = hostname;
+            return true;
+        }
+        bool setHostname(const char* hostname) { host = hostname; return true; }
+        bool setInstanceName(const char* name) { instance = name; return true; }
+        hMDNSService addService(const char* name, const char*, const char*, uint16_t) {
+            service = name == nullptr ? "" : name;
+            return &service;
+        }
+        bool setServiceName(hMDNSService, const char* name) { service = name; return true; }
+        hMDNSTxt addServiceTxt(hMDNSService, const char* key, const char* value) {
+            uint8_t i = 0;
+            while (i < nTxts && txtKey[i] != key) {
+                i++;
+            }
+            if (i == STUB_MDNS_MAX_TXTS) {
+                return nullptr;
+            }
+            if (i == nTxts) {
+                txtKey[nTxts++] = key;
+            }
+            txtValue[i] = value;
+            return &txtValue[i];
+        }
+        bool announce() { announcements++; return true; }
+        bool update() { return true; }
+
+        String host;                                    // The host name we were given
+        String instance;                                // The default instance name
+        String service;                                 // The instance name of the (one) service
+        uint8_t nTxts = 0;                              // The number of TXT items
+        String txtKey[STUB_MDNS_MAX_TXTS];              // Their keys
+        String txtValue[STUB_MDNS_MAX_TXTS];            // And their values
+        uint32_t announcements = 0;                     // The number of times announce() has been called
+};
+extern MDNSResponder MDNS;
@@ -0,0 +1,30 @@
+/****
+ * @file ESP_EEPROM.h
+ *
+ * A thin host-side stand-in for the ESP_EEPROM library: the "EEPROM" is memory, and commit()
+ * copies it to more memory.
+ *
+ ****/
+#pragma once
+#include <Arduino.h>
+
+#define STUB_EEPROM_SIZE            (4096)
+
+class EEPROMClass {
+    public:
+        void begin(size_t size) { this->size = min(size, (size_t)STUB_EEPROM_SIZE); memcpy(mem, committed, sizeof(mem)); }
+        bool commit() { memcpy(committed, mem, sizeof(mem)); hasData = true; return true; }
+        int percentUsed() { return hasData ? (int)(size * 100 / STUB_EEPROM_SIZE) : -1; }
+        bool wipe() { memset(committed, 0xFF, sizeof(committed)); hasData = false; return true; }
+        uint8_t read(int address) { return mem[address]; }
+        void write(int address, uint8_t value) { mem[address] = value; }
+        template<class T> T &get(int address, T &t) { memcpy((void*)&t, mem + address, sizeof(T)); return t; }
+        template<class T> const T &put(int address, const T &t) { memcpy(mem + address, (const void*)&t, sizeof(T)); return t; }
+
+    private:
+        size_t size = 0;
+        bool hasData = false;
+        uint8_t mem[STUB_EEPROM_SIZE];
+        uint8_t committed[STUB_EEPROM_SIZE];
+};
+extern EEPROMClass EEPROM;
@@ -0,0 +1,17 @@
+/****
+ * @file StreamString.h
+ *
+ * A thin host-side stand-in for the ESP8266 core's StreamString: a String you can print to.
+ *
+ ****/
+#pragma once
+#include <Arduino.h>
+
+class StreamString : public Stream, public String {
+    public:
+        size_t write(uint8_t c) override { concat((char)c); return 1; }
+        size_t write(const uint8_t* buffer, size_t size) override { concat((const char*)buffer, size); return size; }
+        using Print::write;
+        int available() override { return 0; }
+        int read() override { return -1; }
+};
@@ -0,0 +1,228 @@
+/****
+ * @file Stubs.cpp
+ *
+ * The out-of-line parts of the host-side stand-ins in bench/stubs: the clocks, the pins, the
+ * ESP object (with RTC user memory and 1 MiB of flash in memory), and the globals the real core
+ * provides.
+ *
+ ****/
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include <ESP8266mDNS.h>
+#include <ESP_EEPROM.h>
+#include <Updater.h>
+#include <CommandLine.h>
+#include <user_interface.h>
+#include <flash_hal.h>
+#include <chrono>
+
+#define STUB_FLASH_SIZE             (0x100000)          // Size of the flash chip: 1 MiB
+#define STUB_RTC_MEM_WORDS          (192)               // Size of the RTC user memory in 4-byte blocks
+
+HardwareSerial Serial;
+EspClass ESP;
+ESP8266WiFiClass WiFi;
+MDNSResponder MDNS;
+EEPROMClass EEPROM;
+UpdaterClass Update;
+StubWire* WiFiServer::pending = nullptr;
+uint16_t WiFiUDP::pendingPort = 0;
+const uint8_t* WiFiUDP::pendingData = nullptr;
+size_t WiFiUDP::pendingLen = 0;
+
+static int64_t wallOffsetMicros = 0;                    // Sketch's wall clock - micros64()
+static uint8_t pinState[32];
+static uint32_t rtcMem[STUB_RTC_MEM_WORDS];
+static uint8_t flash[STUB_FLASH_SIZE];
+static bool flashErased = (memset(flash, 0xFF, sizeof(flash)), true);   // Flash starts out erased
+static rst_info resetInfo {REASON_DEFAULT_RST, 0, 0, 0, 0, 0, 0};
+
+/*
+ * Clocks. millis() and micros() wrap just as the real ones do.
+ */
+uint64_t micros64() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+unsigned long millis() {
+    return (uint32_t)(micros64() / 1000);
+}
+unsigned long micros() {
+    return (uint32_t)micros64();
+}
+void delay(unsigned long) {}
+void yield() {}
+
+time_t stubTime(time_t* t) {
+    time_t now = (time_t)((wallOffsetMicros + (int64_t)micros64()) / 1000000);
+    if (t != nullptr) {
+        *t = now;
+    }
+    return now;
+}
+int stubGettimeofday(struct timeval* tv, void*) {
+    int64_t now = wallOffsetMicros + (int64_t)micros64();
+    tv->tv_sec = now / 1000000;
+    tv->tv_usec = now % 1000000;
+    return 0;
+}
+int stubSettimeofday(const struct timeval* tv, const void*) {
+    wallOffsetMicros = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec - (int64_t)micros64();
+    return 0;
+}
+uint32_t system_get_rtc_time() {
+    return (uint32_t)(micros64() / 6);
+}
+uint32_t system_rtc_clock_cali_proc() {
+    return 6 << 12;                                     // 6 us per tick, as a 12-bit fixed point number
+}
+void configTime(const char* tz, const char*, const char*, const char*) {
+    setTZ(tz);
+}
+void configTzTime(const char* tz, const char*, const char*, const char*) {
+    setTZ(tz);
+}
+void setTZ(const char* tz) {
+    setenv("TZ", tz, 1);
+    tzset();
+}
+
+/*
+ * Pins and randomness
+ */
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t pin, uint8_t value) {
+    pinState[pin & 31] = value;
+}
+int digitalRead(uint8_t pin) {
+    return pinState[pin & 31];
+}
+int digitalPinToInterrupt(int pin) {
+    return pin;
+}
+void attachInterrupt(int, void (*)(), int) {}
+void attachInterruptArg(uint8_t, void (*)(void*), void*, int) {}
+void detachInterrupt(int) {}
+long random(long howBig) {
+    return howBig <= 0 ? 0 : rand() % howBig;
+}
+long random(long howSmall, long howBig) {
+    return howBig <= howSmall ? howSmall : howSmall + random(howBig - howSmall);
+}
+void randomSeed(unsigned long seed) {
+    srand(seed);
+}
+
+/*
+ * The ESP object
+ */
+void EspClass::restart() {
+    Serial.print("[ESP] restart() called.\n");
+}
+void EspClass::reset() {
+    Serial.print("[ESP] reset() called.\n");
+}
+uint32_t EspClass::getFreeHeap() {
+    return 40000;
+}
+uint32_t EspClass::getMaxFreeBlockSize() {
+    return 30000;
+}
+uint8_t EspClass::getHeapFragmentation() {
+    return 10;
+}
+uint32_t EspClass::getChipId() {
+    return 0x00C0FFEE;
+}
+uint32_t EspClass::getCycleCount() {
+    return (uint32_t)(micros64() * 80);
+}
+struct rst_info* EspClass::getResetInfoPtr() {
+    return &resetInfo;
+}
+String EspClass::getResetReason() {
+    return "Power On";
+}
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size) {
+    if (offset * 4 + size > sizeof(rtcMem)) {
+        return false;
+    }
+    memcpy(data, &rtcMem[offset], size);
+    return true;
+}
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size) {
+    if (offset * 4 + size > sizeof(rtcMem)) {
+        return false;
+    }
+    memcpy(&rtcMem[offset], data, size);
+    return true;
+}
+uint32_t EspClass::getFlashChipSize() {
+    return STUB_FLASH_SIZE;
+}
+uint32_t EspClass::getSketchSize() {
+    return 400000;
+}
+uint32_t EspClass::getFreeSketchSpace() {
+    return 90000;
+}
+String EspClass::getSketchMD5() {
+    return "00000000000000000000000000000000";
+}
+bool EspClass::flashEraseSector(uint32_t sector) {
+    if ((sector + 1) * SPI_FLASH_SEC_SIZE > STUB_FLASH_SIZE) {
+        return false;
+    }
+    memset(flash + sector * SPI_FLASH_SEC_SIZE, 0xFF, SPI_FLASH_SEC_SIZE);
+    return true;
+}
+bool EspClass::flashWrite(uint32_t address, const uint8_t* data, size_t size) {
+    if (address + size > STUB_FLASH_SIZE) {
+        return false;
+    }
+    for (size_t i = 0; i < size; i++) {
+        flash[address + i] &= data[i];                  // Like flash, writing can only clear bits
+    }
+    return true;
+}
+bool EspClass::flashWrite(uint32_t address, const uint32_t* data, size_t size) {
+    return flashWrite(address, (const uint8_t*)data, size);
+}
+bool EspClass::flashRead(uint32_t address, uint8_t* data, size_t size) {
+    if (address + size > STUB_FLASH_SIZE) {
+        return false;
+    }
+    memcpy(data, flash + address, size);
+    return true;
+}
+bool EspClass::flashRead(uint32_t address, uint32_t* data, size_t size) {
+    return flashRead(address, (uint8_t*)data, size);
+}
+
+/*
+ * CommandLine. Like the real one, an unknown command gets a handler that says so.
+ */
+static String onUnknownCmd(CommandHandlerHelper* helper) {
+    return "Unknown command \"" + helper->getWord(0) + "\".\n";
+}
+bool CommandLine::attachCmdHandler(String cmd, commandHandler_t handler) {
+    if (cmd.length() == 0) {
+        defaultHandler = handler;
+        return true;
+    }
+    if (nCmds >= STUB_MAX_COMMANDS) {
+        return false;
+    }
+    cmds[nCmds] = cmd;
+    handlers[nCmds++] = handler;
+    return true;
+}
+commandHandler_t CommandLine::getHandlerFor(String cmd) {
+    for (uint8_t i = 0; i < nCmds; i++) {
+        if (cmds[i] == cmd) {
+            return handlers[i];
+        }
+    }
+    return defaultHandler == nullptr ? onUnknownCmd : defaultHandler;
+}
@@ -0,0 +1,9 @@
+/****
+ * @file TZ.h
+ *
+ * A thin host-side stand-in for the ESP8266 core's TZ.h; just the timezone the sketch mentions.
+ *
+ ****/
+#pragma once
+
+#define TZ_America_Los_Angeles      PSTR("PST8PDT,M3.2.0,M11.1.0")
@@ -0,0 +1,26 @@
+/****
+ * @file Updater.h
+ *
+ * A thin host-side stand-in for the ESP8266 core's Updater. The benchmarks never update the 
+ * firmware, so there's never room for an image.
+ *
+ ****/
+#pragma once
+#include <Arduino.h>
+
+#define UPDATE_ERROR_OK             (0)
+#define UPDATE_ERROR_SPACE          (4)
+#define UPDATE_ERROR_MD5            (8)
+
+class UpdaterClass {
+    public:
+        bool begin(size_t) { error = UPDATE_ERROR_SPACE; return false; }
+        bool setMD5(const char*) { return true; }
+        size_t write(uint8_t*, size_t) { return 0; }
+        bool end(bool = false) { return false; }
+        bool isRunning() { return false; }
+        uint8_t getError() { return error; }
+    private:
+        uint8_t error = UPDATE_ERROR_OK;
+};
+extern UpdaterClass Update;
@@ -0,0 +1,69 @@
+/****
+ * @file WiFiUdp.h
+ *
+ * A thin host-side stand-in for the ESP8266's WiFiUDP: sends go nowhere and nothing arrives
+ * but what the benchmarks deliver(), one datagram at a time, to whichever WiFiUDP has begun on
+ * its port.
+ *
+ ****/
+#pragma once
+#include <ESP8266WiFi.h>
+
+class WiFiUDP : public Stream {
+    public:
+        uint8_t begin(uint16_t port) { this->port = port; return 1; }
+        uint8_t beginMulticast(IPAddress, IPAddress, uint16_t port) { this->port = port; return 1; }
+        void stop() { port = 0; }
+        int beginPacket(IPAddress, uint16_t) { return 1; }
+        int beginPacketMulticast(IPAddress, uint16_t, IPAddress, int = 1) { return 1; }
+        int endPacket() { return 1; }
+        size_t write(uint8_t) override { return 1; }
+        size_t write(const uint8_t*, size_t size) override { return size; }
+        using Print::write;
+        int parsePacket() {
+            if (port == 0 || pendingPort != port) {
+                return 0;
+            }
+            data = pendingData;
+            len = pendingLen;
+            pos = 0;
+            pendingPort = 0;
+            return len;
+        }
+        int available() override { return len - pos; }
+        int read() override { return pos < len ? data[pos++] : -1; }
+        int read(uint8_t* buffer, size_t size) override {
+            size_t n = size < len - pos ? size : len - pos;
+            memcpy(buffer, data + pos, n);
+            pos += n;
+            return n;
+        }
+        int read(char* buffer, size_t size) { return read((uint8_t*)buffer, size); }
+        int peek() override { return pos < len ? data[pos] : -1; }
+        void flush() override {}
+        IPAddress remoteIP() { return IPAddress(192, 168, 1, 3); }
+        uint16_t remotePort() { return 50000; }
+        IPAddress destinationIP() { return IPAddress(); }
+
+        /**
+         * @brief   Make the specified datagram the next one parsePacket() sees on the specified port.
+         *
+         * @param port  The port it's for
+         * @param data  The datagram. Must stay around until it's been read.
+         * @param len   Its length
+         */
+        static void deliver(uint16_t port, const uint8_t* data, size_t len) {
+            pendingPort = port;
+            pendingData = data;
+            pendingLen = len;
+        }
+
+    private:
+        uint16_t port = 0;                              // The port we've begun on; 0 if none
+        const uint8_t* data = nullptr;                  // The datagram being read
+        size_t len = 0;                                 // Its length
+        size_t pos = 0;                                 // How much of it has been read
+        static uint16_t pendingPort;                    // The port of the datagram deliver()ed; 0 if none
+        static const uint8_t* pendingData;
+        static size_t pendingLen;
+};
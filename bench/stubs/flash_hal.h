@@ -0,0 +1,14 @@
+/****
+ * @file flash_hal.h
+ *
+ * A thin host-side stand-in for the ESP8266 core's flash_hal.h, laid out as eagle.flash.1m64.ld
+ * lays out the real thing. ESP.flashRead() and friends work on 1 MiB of memory.
+ *
+ ****/
+#pragma once
+#include <stdint.h>
+
+#define FS_PHYS_ADDR                ((uint32_t)0x000EB000)
+#define FS_PHYS_SIZE                ((uint32_t)0x00010000)
+#define FS_PHYS_BLOCK               ((uint32_t)4096)
+#define SPI_FLASH_SEC_SIZE          (4096)
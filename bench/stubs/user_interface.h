@@ -0,0 +1,16 @@
+/****
+ * @file user_interface.h
+ *
+ * A thin host-side stand-in for the parts of the ESP8266 SDK's user_interface.h the sketch and
+ * its libraries use.
+ *
+ ****/
+#pragma once
+#include <stdint.h>
+
+enum rst_reason {
+    REASON_DEFAULT_RST, REASON_WDT_RST, REASON_EXCEPTION_RST, REASON_SOFT_WDT_RST,
+    REASON_SOFT_RESTART, REASON_DEEP_SLEEP_AWAKE, REASON_EXT_SYS_RST};
+
+uint32_t system_get_rtc_time();
+uint32_t system_rtc_clock_cali_proc();
@@ -0,0 +1,179 @@
+/****
+ * @file ButtonEvents.cpp
+ * @version 1.0.0
+ * @date November, 2023
+ *
+ * This file is a portion of the package ButtonEvents, a library that provides an ESP8266 Arduino
+ * sketch with clicks and long presses of a push button, caught by an interrupt handler so none
+ * are missed however long it is between looks. See ButtonEvents.h for details.
+ *
+ *****
+ *
+ * Copyright (C) 2023 D.L. Ehnebuske
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ ****/
+#include "ButtonEvents.h"
+
+#define BE_RING_MASK                (BE_RING_SIZE - 1)  // Ring index = head or tail & this
+
+/**
+ * Constructor
+ */
+ButtonEvents::ButtonEvents(uint8_t pin, bool activeLow, uint32_t debounceMillis, uint32_t longPressMillis) {
+    this->pin = pin;
+    this->activeLow = activeLow;
+    debounceMicros = debounceMillis * 1000;
+    longPressMicros = longPressMillis * 1000;
+    head = tail = 0;
+    lost = 0;
+    down = false;
+    changeMicros = 0;
+    longSeen = false;
+    clicks = 0;
+    longPending = false;
+    worstMicros = 0;
+}
+
+/**
+ * begin()
+ */
+void ButtonEvents::begin() {
+    pinMode(pin, activeLow ? INPUT_PULLUP : INPUT);
+    down = (digitalRead(pin) == LOW) == activeLow;
+    changeMicros = micros() - debounceMicros;           // So the first edge counts
+    longSeen = down;                                    // Held at power-up isn't a press
+    attachInterruptArg(digitalPinToInterrupt(pin), onEdge, this, CHANGE);
+}
+
+/**
+ * run()
+ */
+void ButtonEvents::run() {
+    // Deal with the edges in the ring. The copy of head makes the ones that arrive meanwhile wait.
+    uint8_t end = head;
+    while (tail != end) {
+        uint32_t edge = ring[tail & BE_RING_MASK];
+        tail = tail + 1;
+        bool pressed = ((edge & 1) == LOW) == activeLow;
+        uint32_t atMicros = edge & ~1UL;
+        if (pressed != down && (int32_t)(atMicros - changeMicros) >= (int32_t)debounceMicros) {
+            changeTo(pressed, atMicros);
+        }
+    }
+
+    // Catch a change the debounce time hid: the button settled other than the way it changed to.
+    // (Differences are signed because an edge noted since the copy of head can be later than now.)
+    uint32_t nowMicros = micros();
+    if ((int32_t)(nowMicros - changeMicros) >= (int32_t)debounceMicros) {
+        bool pressed = (digitalRead(pin) == LOW) == activeLow;
+        if (pressed != down) {
+            changeTo(pressed, nowMicros);
+        }
+    }
+
+    // See a long press as soon as it's long
+    if (down && !longSeen && nowMicros - changeMicros >= longPressMicros) {
+        longSeen = true;
+        longPending = true;
+    }
+
+    // While it's up, keep the time of the last change recent enough that the differences don't overflow
+    if (!down && (int32_t)(nowMicros - changeMicros) > (int32_t)(2 * debounceMicros)) {
+        changeMicros = nowMicros - 2 * debounceMicros;
+    }
+}
+
+/**
+ * isPressed()
+ */
+bool ButtonEvents::isPressed() {
+    return down;
+}
+
+/**
+ * clicked()
+ */
+bool ButtonEvents::clicked() {
+    if (clicks == 0) {
+        return false;
+    }
+    clicks--;
+    return true;
+}
+
+/**
+ * longPressed()
+ */
+bool ButtonEvents::longPressed() {
+    bool answer = longPending;
+    longPending = false;
+    return answer;
+}
+
+/**
+ * lostEdges()
+ */
+uint32_t ButtonEvents::lostEdges() {
+    return lost;
+}
+
+/**
+ * worstClickMicros()
+ */
+uint32_t ButtonEvents::worstClickMicros() {
+    return worstMicros;
+}
+
+/**
+ * onEdge()
+ */
+void IRAM_ATTR ButtonEvents::onEdge(void* arg) {
+    ButtonEvents* me = (ButtonEvents*)arg;
+    uint8_t at = me->head;
+    if ((uint8_t)(at - me->tail) >= BE_RING_SIZE) {
+        me->lost = me->lost + 1;
+        return;
+    }
+    me->ring[at & BE_RING_MASK] = (micros() & ~1UL) | (digitalRead(me->pin) == HIGH ? 1 : 0);
+    me->head = at + 1;                                  // Only now may run() look at it
+}
+
+/**
+ * changeTo()
+ */
+void ButtonEvents::changeTo(bool pressed, uint32_t atMicros) {
+    if (!pressed && !longSeen) {
+        // A release. If the press was long but run() didn't get to see it while it was held, it's
+        // still a long press; otherwise it's a click.
+        if (atMicros - changeMicros >= longPressMicros) {
+            longPending = true;
+        } else if (clicks < UINT8_MAX) {
+            clicks++;
+            uint32_t tookMicros = micros() - atMicros;
+            if (tookMicros > worstMicros) {
+                worstMicros = tookMicros;
+            }
+        }
+    }
+    down = pressed;
+    changeMicros = atMicros;
+    longSeen = false;
+}
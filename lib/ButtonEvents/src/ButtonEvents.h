@@ -0,0 +1,167 @@
+/****
+ * @file ButtonEvents.h
+ * @version 1.0.0
+ * @date November, 2023
+ *
+ * This file is a portion of the package ButtonEvents, a library that provides an ESP8266 Arduino
+ * sketch with clicks and long presses of a push button, caught by an interrupt handler so none
+ * are missed however long it is between looks.
+ *
+ * The interrupt handler does as little as it can: it notes the time and the pin's level at each
+ * edge in a small ring buffer. It's the only thing that adds to the ring and run() is the only
+ * thing that takes from it, so no locking is needed. run(), called every so often from the
+ * sketch, works through the edges, debouncing them and classifying the presses they add up to as
+ * clicks or long presses. Since it goes by the edges' times rather than by when it happens to be
+ * called, a click is a click and a long press is a long press even if run() is late.
+ *
+ * Typical use:
+ *
+ *      ButtonEvents button {0};
+ *      ...
+ *      button.begin();
+ *      ...
+ *      button.run();
+ *      if (button.clicked()) {
+ *          // Do the click thing
+ *      }
+ *      if (button.longPressed()) {
+ *          // Do the long press thing
+ *      }
+ *
+ * Debouncing is "leading edge": the first edge of a change counts right away and the bounces
+ * that follow it within the debounce time are ignored. If the button's settled in a different
+ * state when the debounce time is up (a press shorter than that), that counts, too.
+ *
+ *****
+ *
+ * Copyright (C) 2023 D.L. Ehnebuske
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ ****/
+
+#pragma once
+#ifndef Arduino_h
+#include <Arduino.h>
+#endif
+
+/*
+ * Miscellaneous constants
+ */
+#define BE_RING_SIZE                (16)                // Edges the ring holds. A power of two, at most 128
+#define BE_DEBOUNCE_MILLIS          (25)                // Default millis() after a change during which edges are bounces
+#define BE_LONG_PRESS_MILLIS        (1000)              // Default millis() a press must last to be a long press
+static_assert((BE_RING_SIZE & (BE_RING_SIZE - 1)) == 0 && BE_RING_SIZE <= 128, "BE_RING_SIZE must be a power of two <= 128");
+
+class ButtonEvents {
+    public:
+        /**
+         * @brief Construct a new ButtonEvents object.
+         *
+         * @param pin               The GPIO pin the button is attached to
+         * @param activeLow         True if pressing the button pulls the pin LOW
+         * @param debounceMillis    millis() after a change during which further edges are bounces
+         * @param longPressMillis   millis() a press must last to be a long press rather than a click
+         */
+        ButtonEvents(uint8_t pin, bool activeLow = true, uint32_t debounceMillis = BE_DEBOUNCE_MILLIS,
+            uint32_t longPressMillis = BE_LONG_PRESS_MILLIS);
+
+        /**
+         * @brief   Set the pin up and attach the interrupt handler. Call once, in setup().
+         *
+         */
+        void begin();
+
+        /**
+         * @brief   Work through the edges the interrupt handler has noted since the last time,
+         *          turning them into clicks and long presses. Call every so often: how often
+         *          decides how soon after the button's released a click is seen.
+         *
+         */
+        void run();
+
+        /**
+         * @brief   Return true if the button is (debounced) pressed, as of the last run().
+         *
+         */
+        bool isPressed();
+
+        /**
+         * @brief   Return true if there's a click not yet reported, and consider it reported. A
+         *          click is a press shorter than the long press time; it's seen as the button's
+         *          released.
+         *
+         */
+        bool clicked();
+
+        /**
+         * @brief   Return true if there's a long press not yet reported, and consider it
+         *          reported. A long press is seen as soon as the button's been held down for the
+         *          long press time; letting go of it afterward is not a click.
+         *
+         */
+        bool longPressed();
+
+        /**
+         * @brief   Return the number of edges lost because the ring was full. (run() isn't being
+         *          called often enough, or the button's very bouncy.)
+         *
+         * @return uint32_t
+         */
+        uint32_t lostEdges();
+
+        /**
+         * @brief   Return the most micros() it's taken run() to see a click, counting from the
+         *          edge that released the button.
+         *
+         * @return uint32_t
+         */
+        uint32_t worstClickMicros();
+
+    private:
+        /**
+         * @brief   The interrupt handler. Note the time and level of the edge that's just happened.
+         *
+         * @param arg       The ButtonEvents object whose pin it is
+         */
+        static void IRAM_ATTR onEdge(void* arg);
+
+        /**
+         * @brief   Utility function to deal with a (debounced) change in the button's state.
+         *
+         * @param pressed   The new state: true if it's now pressed
+         * @param atMicros  When it changed
+         */
+        void changeTo(bool pressed, uint32_t atMicros);
+
+        uint8_t pin;                                    // The GPIO pin
+        bool activeLow;                                 // True if LOW means pressed
+        uint32_t debounceMicros;                        // micros() after a change during which edges are bounces
+        uint32_t longPressMicros;                       // micros() a press must last to be a long press
+        volatile uint32_t ring[BE_RING_SIZE];           // The edges: micros() of each with the pin's level in bit 0
+        volatile uint8_t head;                          // Where the next edge goes. Only onEdge() changes it
+        volatile uint8_t tail;                          // The oldest edge not yet dealt with. Only run() changes it
+        volatile uint32_t lost;                         // Edges dropped because the ring was full
+        bool down;                                      // Debounced state: true if pressed
+        uint32_t changeMicros;                          // When it last changed
+        bool longSeen;                                  // True if the current press has already been seen to be long
+        uint8_t clicks;                                 // Clicks not yet reported by clicked()
+        bool longPending;                               // True if there's a long press not yet reported by longPressed()
+        uint32_t worstMicros;                           // What worstClickMicros() returns
+};
@@ -0,0 +1,189 @@
+/****
+ * @file FlashRing.cpp
+ * @version 1.0.0
+ * @date November, 2023
+ * 
+ * This file is a portion of the package FlashRing, a library that provides an ESP8266 Arduino 
+ * sketch with a ring of small fixed-size records kept directly in flash. See FlashRing.h for 
+ * details.
+ * 
+ *****
+ * 
+ * Copyright (C) 2023 D.L. Ehnebuske
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ * 
+ ****/
+#include "FlashRing.h"
+
+/**
+ * Constructor
+ */
+FlashRing::FlashRing(uint32_t startAddr, uint8_t nSectors) {
+    start = startAddr;
+    this->nSectors = nSectors < 2 ? 2 : nSectors > FR_MAX_SECTORS ? FR_MAX_SECTORS : nSectors;
+    head = 0;
+    nOlder = 0;
+    headUsed = 0;
+    headSeq = 0;
+}
+
+/**
+ * begin()
+ */
+bool FlashRing::begin() {
+    // Find the sector with the newest header
+    uint32_t seq[FR_MAX_SECTORS];
+    bool found = false;
+    for (uint8_t s = 0; s < nSectors; s++) {
+        uint32_t header[2];
+        if (!ESP.flashRead(slotAddr(s, 0), header, sizeof(header))) {
+            return false;
+        }
+        seq[s] = header[0] == FR_MAGIC ? header[1] : 0;
+        if (seq[s] != 0 && (!found || seq[s] > headSeq)) {
+            head = s;
+            headSeq = seq[s];
+            found = true;
+        }
+    }
+
+    // If there isn't one, we're starting from scratch
+    if (!found) {
+        return clear();
+    }
+
+    // The older sectors are the ones behind head with consecutive sequence numbers (an erased one has none)
+    nOlder = 0;
+    while (nOlder < nSectors - 1) {
+        uint8_t s = (head + nSectors - nOlder - 1) % nSectors;
+        if (seq[s] == 0 || seq[s] != headSeq - nOlder - 1) {
+            break;
+        }
+        nOlder++;
+    }
+
+    // Find the first free slot in head
+    headUsed = 0;
+    while (headUsed < FR_RECORDS_PER_SECTOR) {
+        uint32_t firstWord;
+        if (!ESP.flashRead(slotAddr(head, headUsed + 1), &firstWord, sizeof(firstWord))) {
+            return false;
+        }
+        if (firstWord == 0xFFFFFFFF) {
+            break;
+        }
+        headUsed++;
+    }
+    return true;
+}
+
+/**
+ * append()
+ */
+bool FlashRing::append(const void* record) {
+    if (headUsed == FR_RECORDS_PER_SECTOR) {
+        uint8_t next = (head + 1) % nSectors;
+        if (!startSector(next, headSeq + 1)) {
+            return false;
+        }
+        head = next;
+        headUsed = 0;
+        if (nOlder < nSectors - 1) {
+            nOlder++;
+        }
+    }
+    uint32_t buf[FR_RECORD_SIZE / 4];                   // flashWrite() needs 4-byte alignment
+    memcpy(buf, record, FR_RECORD_SIZE);
+    if (!ESP.flashWrite(slotAddr(head, headUsed + 1), buf, FR_RECORD_SIZE)) {
+        return false;
+    }
+    headUsed++;
+    return true;
+}
+
+/**
+ * read()
+ */
+bool FlashRing::read(uint16_t ix, void* record) {
+    if (ix >= count()) {
+        return false;
+    }
+    uint8_t sector = (head + nSectors - nOlder + ix / FR_RECORDS_PER_SECTOR) % nSectors;
+    uint32_t buf[FR_RECORD_SIZE / 4];
+    if (!ESP.flashRead(slotAddr(sector, ix % FR_RECORDS_PER_SECTOR + 1), buf, FR_RECORD_SIZE)) {
+        return false;
+    }
+    memcpy(record, buf, FR_RECORD_SIZE);
+    return true;
+}
+
+/**
+ * count()
+ */
+uint16_t FlashRing::count() {
+    return nOlder * FR_RECORDS_PER_SECTOR + headUsed;
+}
+
+/**
+ * room()
+ */
+uint16_t FlashRing::room() {
+    return (nSectors - 1 - nOlder) * FR_RECORDS_PER_SECTOR + FR_RECORDS_PER_SECTOR - headUsed;
+}
+
+/**
+ * clear()
+ */
+bool FlashRing::clear() {
+    // Erase everything and start over in the sector after the old head, to spread the wear
+    uint8_t next = (head + 1) % nSectors;
+    for (uint8_t s = 0; s < nSectors; s++) {
+        if (s != next && !ESP.flashEraseSector((start + s * FR_SECTOR_SIZE) / FR_SECTOR_SIZE)) {
+            return false;
+        }
+    }
+    if (!startSector(next, headSeq + 1)) {
+        return false;
+    }
+    head = next;
+    nOlder = 0;
+    headUsed = 0;
+    return true;
+}
+
+/**
+ * startSector()
+ */
+bool FlashRing::startSector(uint8_t sector, uint32_t seq) {
+    uint32_t header[2] = {FR_MAGIC, seq};
+    if (!ESP.flashEraseSector((start + sector * FR_SECTOR_SIZE) / FR_SECTOR_SIZE) || 
+        !ESP.flashWrite(slotAddr(sector, 0), header, sizeof(header))) {
+        return false;
+    }
+    headSeq = seq;
+    return true;
+}
+
+/**
+ * slotAddr()
+ */
+uint32_t FlashRing::slotAddr(uint8_t sector, uint16_t slot) {
+    return start + sector * FR_SECTOR_SIZE + slot * FR_RECORD_SIZE;
+}
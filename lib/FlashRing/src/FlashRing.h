@@ -0,0 +1,160 @@
+/****
+ * @file FlashRing.h
+ * @version 1.0.0
+ * @date November, 2023
+ * 
+ * This file is a portion of the package FlashRing, a library that provides an ESP8266 Arduino 
+ * sketch with a ring of small fixed-size records kept directly in flash.
+ * 
+ * A FlashRing uses a range of whole flash sectors given to it when it's constructed (typically 
+ * in the area the linker sets aside for a file system the sketch doesn't otherwise use). Records 
+ * are FR_RECORD_SIZE bytes. append() writes a record into the next free slot without erasing 
+ * anything, so appending is fast and wears the flash very little. Only when the newest sector 
+ * fills up is a sector erased: the oldest one, whose records are lost. Records are numbered from 
+ * 0, the oldest, to count() - 1, the newest.
+ * 
+ * The first slot of each sector holds a header saying where the sector is in the ring. A 
+ * record slot is free if its first four bytes are all 0xFF, so a record must never start that 
+ * way. Since an append that's interrupted by a power failure can leave a partly written record, 
+ * records should carry some way for their user to check them.
+ * 
+ * For example:
+ * 
+ *      FlashRing log {FS_PHYS_ADDR, 2};
+ *      ...
+ *      log.begin();
+ *      log.append(&myRecord);
+ *      for (uint16_t i = 0; i < log.count(); i++) {
+ *          log.read(i, &myRecord);
+ *          ...
+ *      }
+ * 
+ *****
+ * 
+ * Copyright (C) 2023 D.L. Ehnebuske
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ * 
+ ****/
+
+#pragma once
+#ifndef Arduino_h
+#include <Arduino.h>
+#endif
+
+/*
+ * Miscellaneous constants
+ */
+#define FR_SECTOR_SIZE              (4096)              // Size of a flash sector
+#define FR_RECORD_SIZE              (8)                 // The size of a record; a multiple of 4
+#define FR_SLOTS_PER_SECTOR         (FR_SECTOR_SIZE / FR_RECORD_SIZE)   // Slots in a sector; slot 0 is the header
+#define FR_RECORDS_PER_SECTOR       (FR_SLOTS_PER_SECTOR - 1)           // Records in a full sector
+#define FR_MAX_SECTORS              (16)                // The most sectors a FlashRing can use
+#define FR_MAGIC                    (0x676E5246)        // "FRng", the first word of a sector header
+
+class FlashRing {
+    public:
+        /**
+         * @brief Construct a new FlashRing object.
+         * 
+         * @param startAddr     The flash address of the first sector to use. Must be sector aligned.
+         * @param nSectors      The number of sectors to use. 2 to FR_MAX_SECTORS.
+         */
+        FlashRing(uint32_t startAddr, uint8_t nSectors);
+
+        /**
+         * @brief   Get the FlashRing ready to use, finding the records it holds. If the sectors 
+         *          don't look like a FlashRing, they're erased and the ring starts out empty.
+         * 
+         * @return true     Success
+         * @return false    A flash operation failed
+         */
+        bool begin();
+
+        /**
+         * @brief   Append the specified record to the ring, erasing the oldest sector's worth of 
+         *          records if the ring is full.
+         * 
+         * @param record    The FR_RECORD_SIZE bytes to append. The first 4 mustn't all be 0xFF.
+         * @return true     Success
+         * @return false    A flash operation failed
+         */
+        bool append(const void* record);
+
+        /**
+         * @brief   Read the specified record.
+         * 
+         * @param ix        The index of the record; 0 is the oldest.
+         * @param record    Where to put the FR_RECORD_SIZE bytes read.
+         * @return true     Success
+         * @return false    No such record or a flash operation failed
+         */
+        bool read(uint16_t ix, void* record);
+
+        /**
+         * @brief   Return the number of records in the ring.
+         * 
+         * @return uint16_t 
+         */
+        uint16_t count();
+
+        /**
+         * @brief   Return the number of records that can be appended before one has to be erased 
+         *          to make room.
+         * 
+         * @return uint16_t 
+         */
+        uint16_t room();
+
+        /**
+         * @brief   Erase all the records.
+         * 
+         * @return true     Success
+         * @return false    A flash operation failed
+         */
+        bool clear();
+
+    private:
+        uint32_t start;                                 // Flash address of sector 0 of the ring
+        uint8_t nSectors;                               // The number of sectors in the ring
+        uint8_t head;                                   // The sector records are currently appended to
+        uint8_t nOlder;                                 // The number of (full) sectors before head
+        uint16_t headUsed;                              // The number of records in head
+        uint32_t headSeq;                               // The sequence number in head's header
+
+        /**
+         * @brief   Utility function to erase the specified sector and give it a header with the 
+         *          specified sequence number
+         * 
+         * @param sector    The sector in the ring
+         * @param seq       The sequence number
+         * @return true     Success
+         * @return false    A flash operation failed
+         */
+        bool startSector(uint8_t sector, uint32_t seq);
+
+        /**
+         * @brief   Utility function to return the flash address of the specified slot
+         * 
+         * @param sector    The sector in the ring
+         * @param slot      The slot in the sector; 0 is the header
+         * @return uint32_t 
+         */
+        uint32_t slotAddr(uint8_t sector, uint16_t slot);
+};
@@ -0,0 +1,107 @@
+/****
+ * @file Metrics.cpp
+ * @version 1.0.0
+ * @date November, 2023
+ * 
+ * This file is a portion of the package Metrics, a library that provides an Arduino sketch with
+ * small fixed-size histograms and the means to report them. See Metrics.h for details.
+ * 
+ *****
+ * 
+ * Copyright (C) 2023 D.L. Ehnebuske
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ ****/
+#include "Metrics.h"
+
+const uint32_t mxMicrosBounds[MX_BUCKETS] = {100, 300, 1000, 3000, 10000, 30000, 100000, 1000000};
+const uint32_t mxBytesBounds[MX_BUCKETS] = {64, 128, 256, 512, 1024, 2048, 4096, 16384};
+
+/**
+ * Constructor
+ */
+MetricsHistogram::MetricsHistogram(const uint32_t* bounds) {
+    this->bounds = bounds;
+    memset(counts, 0, sizeof(counts));
+    n = 0;
+    maxValue = 0;
+    sum = 0;
+}
+
+/**
+ * record()
+ */
+void MetricsHistogram::record(uint32_t value) {
+    uint8_t b = 0;
+    while (b < MX_BUCKETS && value > bounds[b]) {
+        b++;
+    }
+    counts[b]++;
+    n++;
+    sum += value;
+    if (value > maxValue) {
+        maxValue = value;
+    }
+}
+
+/**
+ * count()
+ */
+uint32_t MetricsHistogram::count() {
+    return n;
+}
+
+/**
+ * largest()
+ */
+uint32_t MetricsHistogram::largest() {
+    return maxValue;
+}
+
+/**
+ * print()
+ * 
+ * The sum is printed via double because not every printf() does "%llu".
+ */
+void MetricsHistogram::print(Print* out, const char* name, const char* labels) {
+    const char* sep = labels == nullptr ? "" : ",";
+    labels = labels == nullptr ? "" : labels;
+    uint32_t cumulative = 0;
+    for (uint8_t b = 0; b < MX_BUCKETS; b++) {
+        cumulative += counts[b];
+        out->printf("%s_bucket{%s%sle=\"%lu\"} %lu\n", name, labels, sep,
+            (unsigned long)bounds[b], (unsigned long)cumulative);
+    }
+    out->printf("%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, labels, sep, (unsigned long)n);
+    if (*labels == '\0') {
+        out->printf("%s_sum %.0f\n%s_count %lu\n", name, (double)sum, name, (unsigned long)n);
+    } else {
+        out->printf("%s_sum{%s} %.0f\n%s_count{%s} %lu\n", name, labels, (double)sum,
+            name, labels, (unsigned long)n);
+    }
+}
+
+/**
+ * printSummary()
+ */
+void MetricsHistogram::printSummary(Print* out, const char* title, const char* unit) {
+    out->printf("%s: %lu, mean %lu %s, max %lu %s\n", title, (unsigned long)n,
+        (unsigned long)(n == 0 ? 0 : sum / n), unit, (unsigned long)maxValue, unit);
+}
@@ -0,0 +1,130 @@
+/****
+ * @file Metrics.h
+ * @version 1.0.0
+ * @date November, 2023
+ * 
+ * This file is a portion of the package Metrics, a library that provides an Arduino sketch with
+ * the small fixed-size histograms it needs to keep track of how long things take (or how big
+ * they are) and to report them, either as Prometheus-style text or as a one-line summary.
+ * 
+ * Metrics are meant to be compiled in only when wanted. By convention, everything that collects
+ * or reports them is inside "#ifdef METRICS" ... "#endif", and METRICS is defined, if at all, in
+ * the build flags, so that every library and the sketch agree. When it isn't defined, nothing is
+ * collected and nothing is spent.
+ * 
+ * A MetricsHistogram counts the values recorded in each of MX_BUCKETS buckets, whose upper
+ * bounds are given when it's constructed, along with their sum and the largest. For example:
+ * 
+ *      MetricsHistogram saveMicros;            // Uses mxMicrosBounds
+ *      ...
+ *      uint32_t startMicros = micros();
+ *      saveConfig();
+ *      saveMicros.record(micros() - startMicros);
+ *      ...
+ *      saveMicros.print(&out, "config_save_micros");
+ * 
+ *****
+ * 
+ * Copyright (C) 2023 D.L. Ehnebuske
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ ****/
+
+#pragma once
+#ifndef Arduino_h
+#include <Arduino.h>
+#endif
+
+/*
+ * Miscellaneous constants
+ */
+#define MX_BUCKETS                  (8)                 // Number of bounded buckets; there's also one for the rest
+
+/**
+ * @brief   Bucket upper bounds suited to durations in micros: 100 us to 1 s
+ * 
+ */
+extern const uint32_t mxMicrosBounds[MX_BUCKETS];
+
+/**
+ * @brief   Bucket upper bounds suited to sizes in bytes: 64 B to 16 KiB
+ * 
+ */
+extern const uint32_t mxBytesBounds[MX_BUCKETS];
+
+class MetricsHistogram {
+    public:
+        /**
+         * @brief Construct a new, empty, MetricsHistogram object.
+         * 
+         * @param bounds    The upper bounds of its MX_BUCKETS buckets, in increasing order. Must
+         *                  stay around.
+         */
+        MetricsHistogram(const uint32_t* bounds = mxMicrosBounds);
+
+        /**
+         * @brief   Record the specified value.
+         * 
+         * @param value     The value
+         */
+        void record(uint32_t value);
+
+        /**
+         * @brief   Return the number of values recorded.
+         * 
+         * @return uint32_t
+         */
+        uint32_t count();
+
+        /**
+         * @brief   Return the largest value recorded; 0 if none has been.
+         * 
+         * @return uint32_t
+         */
+        uint32_t largest();
+
+        /**
+         * @brief   Print the histogram to the specified Print in the Prometheus text format: a
+         *          cumulative "_bucket" line per bucket, then "_sum" and "_count". The "# TYPE"
+         *          line is up to the caller, since labeled histograms share one.
+         * 
+         * @param out       Where to print it
+         * @param name      The metric's name
+         * @param labels    The labels, e.g., "route=\"GET /\"", or nullptr for none
+         */
+        void print(Print* out, const char* name, const char* labels = nullptr);
+
+        /**
+         * @brief   Print a one-line summary of the histogram: the count, mean and largest value,
+         *          followed by a newline.
+         * 
+         * @param out       Where to print it
+         * @param title     What to call it
+         * @param unit      The unit the values are in, e.g., "us"
+         */
+        void printSummary(Print* out, const char* title, const char* unit);
+
+    private:
+        const uint32_t* bounds;                         // The buckets' upper bounds
+        uint32_t counts[MX_BUCKETS + 1];                // The number of values in each bucket; the last is for the rest
+        uint32_t n;                                     // The number of values recorded
+        uint32_t maxValue;                              // The largest of them
+        uint64_t sum;                                   // Their sum
+};
@@ -0,0 +1,478 @@
+/****
+ * @file NtpClock.cpp
+ * @version 1.0.0
+ * @date November, 2023
+ * 
+ * This file is a portion of the package NtpClock, a library that keeps an ESP8266 Arduino
+ * sketch's system clock set, using NTP, without ever waiting for the network. See NtpClock.h
+ * for details.
+ * 
+ *****
+ * 
+ * Copyright (C) 2023 D.L. Ehnebuske
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ ****/
+#include "NtpClock.h"
+#include <sys/time.h>
+#include <user_interface.h>
+
+/**
+ * Utility function to turn 8 bytes of NTP timestamp into micros since the Unix epoch. The 32-bit
+ * NTP seconds wrap in 2036; times with the top bit clear are taken to be after that.
+ */
+static int64_t ntpToMicros(const uint8_t* ts) {
+    uint32_t secs = (uint32_t)ts[0] << 24 | (uint32_t)ts[1] << 16 | (uint32_t)ts[2] << 8 | ts[3];
+    uint32_t frac = (uint32_t)ts[4] << 24 | (uint32_t)ts[5] << 16 | (uint32_t)ts[6] << 8 | ts[7];
+    int64_t unixSecs = (int64_t)secs - NC_NTP_UNIX_DELTA + ((secs & 0x80000000) == 0 ? 0x100000000LL : 0);
+    return unixSecs * 1000000 + (int64_t)(((uint64_t)frac * 1000000) >> 32);
+}
+
+/**
+ * Utility function to turn micros since the Unix epoch into 8 bytes of NTP timestamp.
+ */
+static void microsToNtp(int64_t micros, uint8_t* ts) {
+    uint32_t secs = (uint32_t)(micros / 1000000 + NC_NTP_UNIX_DELTA);
+    uint32_t frac = (uint32_t)((((uint64_t)(micros % 1000000)) << 32) / 1000000);
+    for (uint8_t i = 0; i < 4; i++) {
+        ts[i] = secs >> (24 - 8 * i);
+        ts[i + 4] = frac >> (24 - 8 * i);
+    }
+}
+
+/**
+ * Constructor
+ */
+NtpClock::NtpClock(uint8_t rtcOffset) {
+    this->rtcOffset = rtcOffset;
+    server = nullptr;
+    src = ncNotSet;
+    awaiting = false;
+    resolving = false;
+    driftKnown = false;
+    memset(request, 0, sizeof(request));
+    t1 = 0;
+    sentMillis = 0;
+    attemptMillis = 0;
+    waitMillis = 0;
+    savedMillis = 0;
+    lastRunMicros = 0;
+    lastSyncMicros = 0;
+    syncSecs = 0;
+    offsetMicros = 0;
+    rttMicros = 0;
+    driftPpb = 0;
+    driftRem = 0;
+    pendingMicros = 0;
+}
+
+/**
+ * begin()
+ */
+bool NtpClock::begin(const char* tz, const char* server) {
+    this->server = server;
+    setTimeZone(tz);
+    lastRunMicros = micros64();
+    attemptMillis = millis();
+    waitMillis = 0;                                     // Sync as soon as the network is up
+
+    // See whether RTC memory has what we saved before a reset. After a power-on, it doesn't.
+    ncRtcData_t data;
+    if (ESP.getResetInfoPtr()->reason == REASON_DEFAULT_RST ||
+        !ESP.rtcUserMemoryRead(rtcOffset, (uint32_t*)&data, sizeof(data)) ||
+        data.magic != NC_RTC_MAGIC || data.check != rtcCheck(data) || data.src == ncNotSet) {
+        #ifdef DEBUG
+        Serial.print("[NtpClock::begin] Nothing saved in RTC memory.\n");
+        #endif
+        return false;
+    }
+
+    // The RTC counter keeps going through a reset, except one from the reset pin. Its period, in
+    // micros, is system_rtc_clock_cali_proc() in 20.12 fixed point.
+    uint64_t elapsed = ((uint64_t)(system_get_rtc_time() - data.rtcTicks) * system_rtc_clock_cali_proc()) >> 12;
+    if (ESP.getResetInfoPtr()->reason == REASON_EXT_SYS_RST || elapsed > NC_MAX_RESTORE_SECS * 1000000ULL) {
+        elapsed = micros64();                           // Best we can do: at least we know how long we've been up
+    }
+    setMicros((int64_t)data.sec * 1000000 + data.usec + elapsed);
+    driftPpb = data.driftPpb;
+    driftKnown = data.driftKnown != 0;
+    pendingMicros = data.pendingMicros;
+    syncSecs = data.syncSec;
+    src = ncRestored;
+    save();
+    #ifdef DEBUG
+    Serial.printf("[NtpClock::begin] Restored the clock; %lu ms passed since it was saved. Drift %d ppb.\n",
+        (unsigned long)(elapsed / 1000), driftPpb);
+    #endif
+    return true;
+}
+
+/**
+ * run()
+ */
+uint32_t NtpClock::run(bool networkUp) {
+    // If we're waiting for a reply, see if it's here
+    if (awaiting) {
+        if (takeReply()) {
+            awaiting = false;
+            udp.stop();
+            scheduleSync(true);
+        } else if (millis() - sentMillis >= NC_REPLY_MILLIS || !networkUp) {
+            #ifdef DEBUG
+            Serial.print("[NtpClock::run] No good reply from the NTP server.\n");
+            #endif
+            awaiting = false;
+            udp.stop();
+            serverIp = IPAddress();                     // Look it up again next time; it might have changed
+            scheduleSync(false);
+        } else {
+            return NC_POLL_MILLIS;
+        }
+    }
+
+    // If we're waiting for the server's name to resolve, see if it has
+    if (resolving) {
+        if (serverIp.isSet()) {
+            resolving = false;
+            if (sendRequest()) {
+                awaiting = true;
+                return NC_POLL_MILLIS;
+            }
+            scheduleSync(false);
+        } else if (millis() - attemptMillis >= NC_DNS_MILLIS || !networkUp) {
+            #ifdef DEBUG
+            Serial.printf("[NtpClock::run] Couldn't resolve \"%s\".\n", server);
+            #endif
+            resolving = false;
+            scheduleSync(false);
+        } else {
+            return NC_POLL_MILLIS;
+        }
+    }
+
+    // Keep the clock right and, from time to time, save it
+    if (src != ncNotSet) {
+        discipline();
+        if (millis() - savedMillis >= NC_SAVE_MILLIS) {
+            save();
+        }
+    } else {
+        lastRunMicros = micros64();
+    }
+
+    // If it's time to sync, start the exchange, looking up the server's address first if need be
+    if (networkUp && millis() - attemptMillis >= waitMillis) {
+        attemptMillis = millis();
+        if (!serverIp.isSet() && startLookup() && !serverIp.isSet()) {
+            resolving = true;
+            return NC_POLL_MILLIS;
+        }
+        if (serverIp.isSet() && sendRequest()) {
+            awaiting = true;
+            return NC_POLL_MILLIS;
+        }
+        scheduleSync(false);
+    }
+    return NC_RUN_MILLIS;
+}
+
+/**
+ * save()
+ */
+void NtpClock::save() {
+    if (src == ncNotSet) {
+        return;
+    }
+    discipline();
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    ncRtcData_t data;
+    data.magic = NC_RTC_MAGIC;
+    data.rtcTicks = system_get_rtc_time();
+    data.sec = (uint32_t)tv.tv_sec;
+    data.usec = (uint32_t)tv.tv_usec;
+    data.driftPpb = driftPpb;
+    data.driftKnown = driftKnown;
+    data.pendingMicros = (int32_t)pendingMicros;
+    data.syncSec = (uint32_t)syncSecs;
+    data.src = src;
+    data.check = rtcCheck(data);
+    ESP.rtcUserMemoryWrite(rtcOffset, (uint32_t*)&data, sizeof(data));
+    savedMillis = millis();
+}
+
+/**
+ * setTimeZone()
+ */
+void NtpClock::setTimeZone(const char* tz) {
+    setenv("TZ", tz, 1);
+    tzset();
+}
+
+/**
+ * syncSoon()
+ */
+void NtpClock::syncSoon() {
+    waitMillis = 0;
+}
+
+/**
+ * isSet()
+ */
+bool NtpClock::isSet() {
+    return src != ncNotSet;
+}
+
+/**
+ * source()
+ */
+ncSource_t NtpClock::source() {
+    return src;
+}
+
+/**
+ * lastSync()
+ */
+time_t NtpClock::lastSync() {
+    return syncSecs;
+}
+
+/**
+ * lastOffset()
+ */
+int32_t NtpClock::lastOffset() {
+    return offsetMicros;
+}
+
+/**
+ * lastRoundTrip()
+ */
+uint32_t NtpClock::lastRoundTrip() {
+    return rttMicros;
+}
+
+/**
+ * drift()
+ */
+int32_t NtpClock::drift() {
+    return driftPpb;
+}
+
+/**
+ * startLookup()
+ */
+bool NtpClock::startLookup() {
+    if (server == nullptr) {
+        return false;
+    }
+    ip_addr_t addr;
+    err_t err = dns_gethostbyname(server, &addr, dnsFound, this);
+    if (err == ERR_OK) {
+        serverIp = IPAddress(&addr);
+    }
+    return err == ERR_OK || err == ERR_INPROGRESS;
+}
+
+/**
+ * dnsFound()
+ */
+void NtpClock::dnsFound(const char* name, const ip_addr_t* ipaddr, void* arg) {
+    NtpClock* clock = (NtpClock*)arg;
+    if (ipaddr != nullptr && clock->server != nullptr && strcmp(name, clock->server) == 0) {
+        clock->serverIp = IPAddress(ipaddr);
+    }
+}
+
+/**
+ * sendRequest()
+ */
+bool NtpClock::sendRequest() {
+    uint8_t packet[NC_NTP_PACKET_SIZE];
+    memset(packet, 0, sizeof(packet));
+    packet[0] = 0x23;                                   // Leap indicator 0, version 4, mode 3 (client)
+    if (!udp.begin(0) || !udp.beginPacket(serverIp, NC_NTP_PORT)) {
+        udp.stop();
+        return false;
+    }
+
+    // The transmit timestamp is our clock now. The server returns it as the originate timestamp,
+    // which is how we know a reply is to this request. (When the clock hasn't been set, it's
+    // only good for that.)
+    discipline();
+    t1 = nowMicros();
+    microsToNtp(t1, &packet[40]);
+    memcpy(request, &packet[40], sizeof(request));
+    udp.write(packet, sizeof(packet));
+    if (!udp.endPacket()) {
+        udp.stop();
+        return false;
+    }
+    sentMillis = millis();
+    return true;
+}
+
+/**
+ * takeReply()
+ */
+bool NtpClock::takeReply() {
+    if (udp.parsePacket() == 0) {
+        return false;
+    }
+    int64_t t4 = nowMicros();
+    uint8_t packet[NC_NTP_PACKET_SIZE];
+    if (udp.read(packet, sizeof(packet)) != NC_NTP_PACKET_SIZE || !(udp.remoteIP() == serverIp)) {
+        return false;
+    }
+
+    // Leap indicator 3 means the server isn't synchronized, mode 4 is server and stratum 0 is a
+    // "kiss o' death." The originate timestamp must be the transmit one we sent.
+    uint8_t leap = packet[0] >> 6;
+    uint8_t mode = packet[0] & 0x07;
+    if (leap == 3 || mode != 4 || packet[1] == 0 || memcmp(&packet[24], request, sizeof(request)) != 0) {
+        #ifdef DEBUG
+        Serial.printf("[NtpClock::takeReply] Unusable reply: leap %d, mode %d, stratum %d.\n", leap, mode, packet[1]);
+        #endif
+        return false;
+    }
+    int64_t t2 = ntpToMicros(&packet[32]);              // When the server got the request
+    int64_t t3 = ntpToMicros(&packet[40]);              // When it sent the reply
+    int64_t rtt = (t4 - t1) - (t3 - t2);
+    if (rtt < 0 || rtt > NC_MAX_RTT_MICROS) {
+        #ifdef DEBUG
+        Serial.printf("[NtpClock::takeReply] Round trip of %ld us is too long.\n", (long)rtt);
+        #endif
+        return false;
+    }
+    applySync(((t2 - t1) + (t3 - t4)) / 2, (uint32_t)rtt);
+    return true;
+}
+
+/**
+ * applySync()
+ */
+void NtpClock::applySync(int64_t offset, uint32_t rtt) {
+    uint64_t now = micros64();
+    bool stepped = src != ncSynced || offset > NC_STEP_MICROS || offset < -NC_STEP_MICROS;
+    if (stepped) {
+        adjustClock(offset);
+        pendingMicros = 0;
+    } else {
+        // With the old drift estimate applied, what's left of the offset, less whatever of the 
+        // last one is still to be slewed out, is the estimate's error over the time since the 
+        // last sync. Once there is an estimate, put half the error, but no more than 
+        // NC_DRIFT_STEP_PPB, into it. That smooths out the round trip's jitter and keeps one odd 
+        // sync from throwing it off.
+        uint64_t since = now - lastSyncMicros;
+        if (since >= NC_MIN_DRIFT_SECS * 1000000ULL) {
+            int64_t errPpb = (offset - pendingMicros) * 1000000000LL / (int64_t)since;
+            if (driftKnown) {
+                errPpb = errPpb / 2 > NC_DRIFT_STEP_PPB ? NC_DRIFT_STEP_PPB : 
+                    errPpb / 2 < -NC_DRIFT_STEP_PPB ? -NC_DRIFT_STEP_PPB : errPpb / 2;
+            }
+            int64_t newDrift = driftPpb + errPpb;
+            driftPpb = newDrift > NC_MAX_DRIFT_PPB ? NC_MAX_DRIFT_PPB :
+                newDrift < -NC_MAX_DRIFT_PPB ? -NC_MAX_DRIFT_PPB : (int32_t)newDrift;
+            driftKnown = true;
+        }
+        pendingMicros = offset;
+    }
+    lastSyncMicros = now;
+    offsetMicros = (int32_t)offset;
+    rttMicros = rtt;
+    syncSecs = time(nullptr);
+    src = ncSynced;
+    save();
+    #ifdef DEBUG
+    Serial.printf("[NtpClock::applySync] Offset %ld us (%s), round trip %lu us, drift %d ppb.\n",
+        (long)offset, stepped ? "stepped" : "slewing", (unsigned long)rtt, driftPpb);
+    #endif
+}
+
+/**
+ * scheduleSync()
+ */
+void NtpClock::scheduleSync(bool succeeded) {
+    if (succeeded) {
+        waitMillis = driftKnown ? NC_SYNC_MILLIS : NC_SYNC_FIRST_MILLIS;
+    } else {
+        waitMillis = waitMillis < NC_RETRY_MILLIS ? NC_RETRY_MILLIS :
+            waitMillis * 2 > NC_SYNC_MILLIS ? NC_SYNC_MILLIS : waitMillis * 2;
+    }
+}
+
+/**
+ * discipline()
+ */
+void NtpClock::discipline() {
+    uint64_t now = micros64();
+    int64_t elapsed = (int64_t)(now - lastRunMicros);
+    lastRunMicros = now;
+    if (src == ncNotSet || awaiting) {
+        return;                                         // Don't move the clock in the middle of an exchange
+    }
+    driftRem += elapsed * driftPpb;
+    int64_t adjust = driftRem / 1000000000LL;
+    driftRem -= adjust * 1000000000LL;
+    int64_t maxSlew = elapsed * NC_SLEW_PPM / 1000000;
+    int64_t slew = pendingMicros > maxSlew ? maxSlew : pendingMicros < -maxSlew ? -maxSlew : pendingMicros;
+    pendingMicros -= slew;
+    adjust += slew;
+    if (adjust != 0) {
+        adjustClock(adjust);
+    }
+}
+
+/**
+ * adjustClock()
+ */
+void NtpClock::adjustClock(int64_t micros) {
+    setMicros(nowMicros() + micros);
+}
+
+/**
+ * nowMicros()
+ */
+int64_t NtpClock::nowMicros() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/**
+ * setMicros()
+ */
+void NtpClock::setMicros(int64_t micros) {
+    struct timeval tv;
+    tv.tv_sec = (time_t)(micros / 1000000);
+    tv.tv_usec = (suseconds_t)(micros % 1000000);
+    settimeofday(&tv, nullptr);
+}
+
+/**
+ * rtcCheck()
+ */
+uint32_t NtpClock::rtcCheck(const ncRtcData_t &data) {
+    const uint32_t* w = (const uint32_t*)&data;
+    uint32_t check = NC_RTC_MAGIC;
+    for (uint8_t i = 0; i < sizeof(data) / sizeof(uint32_t) - 1; i++) {
+        check = (check << 5 | check >> 27) ^ w[i];
+    }
+    return check;
+}
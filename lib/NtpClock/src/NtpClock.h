@@ -0,0 +1,314 @@
+/****
+ * @file NtpClock.h
+ * @version 1.0.0
+ * @date November, 2023
+ * 
+ * This file is a portion of the package NtpClock, a library that keeps an ESP8266 Arduino
+ * sketch's system clock -- the one time() and gettimeofday() read -- set, using NTP, without
+ * ever waiting for the network.
+ * 
+ * An NtpClock does its own NTP over UDP. Each exchange measures the round trip and the
+ * clock's offset from the server's. Except for the first sync (or if the clock is way off),
+ * the offset isn't fixed by stepping the clock but by slewing it: nudging it a little at a
+ * time, at most NC_SLEW_PPM of the time that passes. Between syncs, the clock is corrected
+ * for its drift, as measured from the offsets successive syncs find.
+ * 
+ * The time, the drift and when the last sync was are kept in the ESP8266's RTC user memory,
+ * which survives everything but a loss of power. The RTC's own counter, which keeps counting
+ * through a reset, says how much time passed since they were saved. So, after a restart (or a
+ * crash), the clock is good right away, network or no network.
+ * 
+ * The typical usage pattern is to instantiate an NtpClock as a global, call begin() in
+ * setup() and then call run() whenever it says to. For example (using SimpleScheduler):
+ * 
+ *      NtpClock ntpClock;
+ *      ...
+ *      void clockTask() {
+ *          scheduler.runIn(clockTaskId, ntpClock.run(WiFi.status() == WL_CONNECTED));
+ *      }
+ *      ...
+ *      ntpClock.begin("PST8PDT,M3.2.0,M11.1.0", "pool.ntp.org");
+ *      clockTaskId = scheduler.addTask("clock", clockTask, 0);
+ *      scheduler.runIn(clockTaskId, 0);
+ * 
+ * Before a deliberate restart, call save() so no time is lost.
+ * 
+ *****
+ * 
+ * Copyright (C) 2023 D.L. Ehnebuske
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ ****/
+
+#pragma once
+#ifndef Arduino_h
+#include <Arduino.h>
+#endif
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include <lwip/dns.h>
+
+/*
+ * Miscellaneous constants
+ */
+#define NC_RTC_OFFSET               (32)                // Default RTC user memory block to use; 0..31 belong to OTA
+#define NC_RTC_MAGIC                (0x6B6C434E)        // "NClk", first word of what's kept in RTC memory
+#define NC_NTP_PORT                 (123)               // The NTP server's UDP port
+#define NC_NTP_PACKET_SIZE          (48)                // Size of an NTP packet without extensions
+#define NC_RUN_MILLIS               (1000)              // millis() run() normally asks to wait until it's run again
+#define NC_POLL_MILLIS              (1)                 // millis() run() asks to wait while waiting for a reply
+#define NC_REPLY_MILLIS             (2000)              // millis() to wait for a reply from the server
+#define NC_DNS_MILLIS               (2000)              // Most millis() to wait for the server's name to resolve (polling)
+#define NC_MAX_RTT_MICROS           (500000)            // Replies with a longer round trip are discarded
+#define NC_STEP_MICROS              (1000000)           // Offsets bigger than this are stepped, not slewed
+#define NC_SLEW_PPM                 (500)               // Fastest a slew corrects the clock (parts per million)
+#define NC_MAX_DRIFT_PPB            (500000)            // Biggest drift believed (parts per billion)
+#define NC_DRIFT_STEP_PPB           (5000)              // Most one sync changes a measured drift (parts per billion)
+#define NC_MIN_DRIFT_SECS           (600)               // Shortest time between syncs used to measure drift
+#define NC_SYNC_FIRST_MILLIS        (600000UL)          // millis() between syncs until we've measured the drift
+#define NC_SYNC_MILLIS              (3600000UL)         // millis() between syncs once we have
+#define NC_RETRY_MILLIS             (30000UL)           // millis() to wait after the first failed sync; doubles to NC_SYNC_MILLIS
+#define NC_SAVE_MILLIS              (10000UL)           // millis() between saves to RTC memory
+#define NC_MAX_RESTORE_SECS         (86400UL)           // Most the RTC counter is believed across a reset
+#define NC_NTP_UNIX_DELTA           (2208988800UL)      // Seconds from the NTP epoch (1900) to the Unix one (1970)
+
+/**
+ * @brief   Where the time on the clock came from
+ * 
+ */
+enum ncSource_t : uint8_t {
+    ncNotSet,                                           // Nowhere; the clock hasn't been set
+    ncRestored,                                         // RTC memory, across a reset
+    ncSynced};                                          // NTP, since the last reset
+
+class NtpClock {
+    public:
+        /**
+         * @brief Construct a new NtpClock object
+         * 
+         * @param rtcOffset     The first RTC user memory block (4 bytes each) to use. It uses 10.
+         */
+        NtpClock(uint8_t rtcOffset = NC_RTC_OFFSET);
+
+        /**
+         * @brief   Get the NtpClock going: set the timezone and, if RTC memory has what we kept
+         *          there before a reset, set the clock from it.
+         * 
+         * @param tz        The POSIX timezone string to use for local time
+         * @param server    The name of the NTP server to use. Must stay around.
+         * @return true     The clock has been set from RTC memory
+         * @return false    It hasn't; it will be once an NTP exchange succeeds
+         */
+        bool begin(const char* tz, const char* server);
+
+        /**
+         * @brief   Do what needs doing: correct the clock for drift, slew out whatever is left of
+         *          the last offset measured, save to RTC memory from time to time and, when a
+         *          sync is due and the network is up, carry out the NTP exchange. Never waits.
+         * 
+         * @param networkUp     True if the network is up
+         * @return uint32_t     The number of millis() until run() should be called again
+         */
+        uint32_t run(bool networkUp);
+
+        /**
+         * @brief   Save the time, drift and last sync time to RTC memory. Called as needed by
+         *          run(); call it before restarting.
+         * 
+         */
+        void save();
+
+        /**
+         * @brief   Change the timezone local time is in.
+         * 
+         * @param tz    The POSIX timezone string to use
+         */
+        void setTimeZone(const char* tz);
+
+        /**
+         * @brief   Arrange for the next run() to sync with the server as soon as it can.
+         * 
+         */
+        void syncSoon();
+
+        /**
+         * @brief   Return true if the clock has been set, from NTP or from RTC memory.
+         * 
+         */
+        bool isSet();
+
+        /**
+         * @brief   Return where the time on the clock came from.
+         * 
+         */
+        ncSource_t source();
+
+        /**
+         * @brief   Return the time_t of the last successful sync; 0 if there never was one.
+         * 
+         */
+        time_t lastSync();
+
+        /**
+         * @brief   Return the offset (server - clock) the last successful sync found, in micros.
+         * 
+         */
+        int32_t lastOffset();
+
+        /**
+         * @brief   Return the round trip the last successful sync measured, in micros.
+         * 
+         */
+        uint32_t lastRoundTrip();
+
+        /**
+         * @brief   Return the clock's measured drift, in parts per billion. Positive means the
+         *          clock runs slow and is being sped up.
+         * 
+         */
+        int32_t drift();
+
+    private:
+        struct ncRtcData_t {                            // What's kept in RTC memory
+            uint32_t magic;                             //  NC_RTC_MAGIC
+            uint32_t rtcTicks;                          //  The RTC counter when saved
+            uint32_t sec;                               //  The time when saved: Unix seconds
+            uint32_t usec;                              //  and micros
+            int32_t driftPpb;                           //  driftPpb
+            uint32_t driftKnown;                        //  driftKnown
+            int32_t pendingMicros;                      //  pendingMicros
+            uint32_t syncSec;                           //  syncSecs
+            uint32_t src;                               //  src
+            uint32_t check;                             //  Check word over all the rest
+        };
+
+        uint8_t rtcOffset;                              // The first RTC user memory block we use
+        const char* server;                             // The NTP server's name
+        IPAddress serverIp;                             // Its address; 0.0.0.0 until resolved
+        WiFiUDP udp;                                    // The UDP "connection" for NTP
+        ncSource_t src;                                 // Where the time came from
+        bool awaiting;                                  // True while waiting for a reply
+        bool resolving;                                 // True while waiting for the server's name to resolve
+        bool driftKnown;                                // True once driftPpb has been measured
+        uint8_t request[8];                             // The transmit timestamp we sent, as sent
+        int64_t t1;                                     // The clock, in micros, when we sent the request
+        unsigned long sentMillis;                       // millis() when we sent it
+        unsigned long attemptMillis;                    // millis() when the last sync was tried (and its lookup started)
+        unsigned long waitMillis;                       // millis() to wait after attemptMillis to sync again
+        unsigned long savedMillis;                      // millis() when last saved to RTC memory
+        uint64_t lastRunMicros;                         // micros64() when run() last disciplined the clock
+        uint64_t lastSyncMicros;                        // micros64() at the last successful sync
+        time_t syncSecs;                                // time_t of the last successful sync
+        int32_t offsetMicros;                           // The offset the last successful sync found
+        uint32_t rttMicros;                             // The round trip it measured
+        int32_t driftPpb;                               // The drift estimate, in parts per billion
+        int64_t driftRem;                               // Drift correction not yet applied, in micros * 10^-9
+        int64_t pendingMicros;                          // Offset not yet slewed out
+
+        /**
+         * @brief   Utility function to start looking up the server's address. The lookup is 
+         *          lwIP's; it doesn't wait. If the answer is cached (or the name is an address), 
+         *          serverIp is set right away. Otherwise, dnsFound() sets it when the answer 
+         *          comes, and resolving is set until run() sees it has.
+         * 
+         * @return true     Started, or done
+         * @return false    Couldn't start it
+         */
+        bool startLookup();
+
+        /**
+         * @brief   Utility function lwIP calls with the answer to a lookup startLookup() started.
+         * 
+         * @param name      The name that was looked up
+         * @param ipaddr    Its address, or nullptr if it couldn't be found
+         * @param arg       The NtpClock that looked it up
+         */
+        static void dnsFound(const char* name, const ip_addr_t* ipaddr, void* arg);
+
+        /**
+         * @brief   Utility function to send an NTP request to the server, whose address must be 
+         *          known.
+         * 
+         * @return true     Sent
+         * @return false    Couldn't send the request
+         */
+        bool sendRequest();
+
+        /**
+         * @brief   Utility function to deal with a reply to the request, if there is one.
+         * 
+         * @return true     A good reply arrived and was used
+         * @return false    There isn't one (yet), or it wasn't any good
+         */
+        bool takeReply();
+
+        /**
+         * @brief   Utility function to use the offset a sync found: step or slew the clock and
+         *          update the drift.
+         * 
+         * @param offset    The offset (server - clock) in micros
+         * @param rtt       The round trip in micros
+         */
+        void applySync(int64_t offset, uint32_t rtt);
+
+        /**
+         * @brief   Utility function to arrange for the next sync after the last one succeeded or
+         *          failed.
+         * 
+         * @param succeeded True if it succeeded
+         */
+        void scheduleSync(bool succeeded);
+
+        /**
+         * @brief   Utility function to correct the clock for the drift and slew over the time
+         *          since it was last done.
+         * 
+         */
+        void discipline();
+
+        /**
+         * @brief   Utility function to add the specified number of micros to the clock.
+         * 
+         * @param micros    The adjustment; may be negative
+         */
+        void adjustClock(int64_t micros);
+
+        /**
+         * @brief   Utility function to return the clock as micros since the Unix epoch.
+         * 
+         * @return int64_t
+         */
+        static int64_t nowMicros();
+
+        /**
+         * @brief   Utility function to set the clock to the specified micros since the Unix epoch.
+         * 
+         * @param micros
+         */
+        static void setMicros(int64_t micros);
+
+        /**
+         * @brief   Utility function to return the check word for the specified RTC memory data.
+         * 
+         * @param data      The data
+         * @return uint32_t The check word
+         */
+        static uint32_t rtcCheck(const ncRtcData_t &data);
+};
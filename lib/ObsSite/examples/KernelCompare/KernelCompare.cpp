@@ -0,0 +1,73 @@
+/****
+ * @file KernelCompare.cpp
+ * 
+ * Compare ObsSite's obsFloatKernel against its obsDoubleKernel. For every few days over many 
+ * years, at sites spread over the latitudes where the sun rises and sets every day, work out 
+ * sunrise, solar noon and sunset both ways and report the largest differences. Also report how 
+ * long each kernel takes per calculation. (That includes the date conversion both kernels share, 
+ * which on a desktop processor with a double-precision FPU is most of it.)
+ * 
+ * This is a host program, not a sketch. E.g.:
+ * 
+ *      g++ -O2 -I../../src KernelCompare.cpp ../../src/ObsSite.cpp -o KernelCompare && ./KernelCompare
+ * 
+ * It exits with status 1 if any difference is a minute or more.
+ * 
+ ****/
+#include <ObsSite.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#define FIRST_YEAR      (100)       // tm-style year to start with (2000)
+#define N_YEARS         (60)        // Number of years to compare
+#define DAY_STEP        (5)         // Compare every DAY_STEPth day
+#define MAX_LAT_DEG     (64)        // Compare latitudes from -MAX_LAT_DEG to MAX_LAT_DEG
+#define LAT_STEP_DEG    (8)
+#define LON_STEP_DEG    (90)        // Compare longitudes from -180 to 180 in these steps
+#define MAX_DIFF_SECS   (60)        // Differences this big or bigger are failures
+
+int main() {
+    long maxDiff[3] = {0, 0, 0};    // Sunrise, solar noon, sunset
+    long nCompared = 0;
+    long nFailed = 0;
+    double doubleSecs = 0;
+    double floatSecs = 0;
+
+    for (int lat = -MAX_LAT_DEG; lat <= MAX_LAT_DEG; lat += LAT_STEP_DEG) {
+        for (int lon = -180; lon < 180; lon += LON_STEP_DEG) {
+            double elev = (lat + 90) * 10.0;
+            ObsSite dSite {(double)lat, (double)lon, elev, obsDoubleKernel};
+            ObsSite fSite {(double)lat, (double)lon, elev, obsFloatKernel};
+            for (int year = FIRST_YEAR; year < FIRST_YEAR + N_YEARS; year++) {
+                for (int yday = 0; yday < 365; yday += DAY_STEP) {
+                    auto t0 = std::chrono::steady_clock::now();
+                    time_t d[3] = {dSite.getSunrise(year, yday), dSite.getSolarNoon(year, yday), dSite.getSunset(year, yday)};
+                    auto t1 = std::chrono::steady_clock::now();
+                    time_t f[3] = {fSite.getSunrise(year, yday), fSite.getSolarNoon(year, yday), fSite.getSunset(year, yday)};
+                    auto t2 = std::chrono::steady_clock::now();
+                    doubleSecs += std::chrono::duration<double>(t1 - t0).count();
+                    floatSecs += std::chrono::duration<double>(t2 - t1).count();
+                    bool failed = false;
+                    for (int i = 0; i < 3; i++) {
+                        long diff = labs((long)(f[i] - d[i]));
+                        if (diff > maxDiff[i]) {
+                            maxDiff[i] = diff;
+                        }
+                        failed = failed || diff >= MAX_DIFF_SECS;
+                    }
+                    if (failed) {
+                        nFailed++;
+                        printf("Mismatch: lat %d, lon %d, year %d, yday %d\n", lat, lon, year + 1900, yday);
+                    }
+                    nCompared++;
+                }
+            }
+        }
+    }
+    printf("Compared %ld site-days. %ld differed by %d seconds or more.\n", nCompared, nFailed, MAX_DIFF_SECS);
+    printf("Largest differences (seconds): sunrise %ld, solar noon %ld, sunset %ld\n", maxDiff[0], maxDiff[1], maxDiff[2]);
+    printf("Time per calculation (host): double %.3f us, float %.3f us\n", 
+        doubleSecs * 1e6 / nCompared, floatSecs * 1e6 / nCompared);
+    return nFailed == 0 ? 0 : 1;
+}
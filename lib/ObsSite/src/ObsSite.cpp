@@ -1,11 +1,49 @@
 #include "ObsSite.h"
 
+// Constants and polynomial approximations used by obsFloatKernel
+#define OBS_PI_F        (3.14159265f)
+#define OBS_HALF_PI_F   (1.57079633f)
+#define OBS_TWO_PI_F    (6.28318531f)
+#define OBS_DEG_TO_RAD_F    (OBS_PI_F / 180.0f)
+#define OBS_RAD_TO_DEG_F    (180.0f / OBS_PI_F)
+
+// sin(x) by range reduction to [-pi/2, pi/2] and a Taylor polynomial through x^9. |error| < 4e-6
+static float fastSin(float x) {
+    x -= OBS_TWO_PI_F * floorf((x + OBS_PI_F) / OBS_TWO_PI_F);
+    if (x > OBS_HALF_PI_F) {
+        x = OBS_PI_F - x;
+    } else if (x < -OBS_HALF_PI_F) {
+        x = -OBS_PI_F - x;
+    }
+    float x2 = x * x;
+    return x * (1.0f + x2 * (-1.0f / 6.0f + x2 * (1.0f / 120.0f + x2 * (-1.0f / 5040.0f + x2 * (1.0f / 362880.0f)))));
+}
+
+// acos(x) using Abramowitz and Stegun 4.4.46. |error| < 2e-8 (before float rounding). NAN if |x| > 1
+static float fastAcos(float x) {
+    if (x > 1.0f || x < -1.0f) {
+        return NAN;
+    }
+    float a = fabsf(x);
+    float r = sqrtf(1.0f - a) * (1.5707963050f + a * (-0.2145988016f + a * (0.0889789874f + a * (-0.0501743046f + 
+        a * (0.0308918810f + a * (-0.0170881256f + a * (0.0066700901f + a * -0.0012624911f)))))));
+    return x < 0 ? OBS_PI_F - r : r;
+}
+
 // Normal member functions
 
-ObsSite::ObsSite(double obsLatDeg, double obsLonDeg, double obsElevM) {
+ObsSite::ObsSite(double obsLatDeg, double obsLonDeg, double obsElevM, obsKernel_t calcKernel) {
     latDeg = obsLatDeg;
     lonDeg = obsLonDeg;
     elevM = obsElevM;
+    kernel = calcKernel;
+    lonFrac = static_cast <float> (0.0009 - lonDeg / 360.0);
+    sinLat = static_cast <float> (sin(degToRadian(latDeg)));
+    cosLat = static_cast <float> (cos(degToRadian(latDeg)));
+    sinH0 = static_cast <float> (sin(degToRadian(-0.833 - 2.076 * sqrt(elevM) / 60.0)));
+    julianDay = INT32_MIN;      // No calculation done yet
+    tableFirstDay = 0;
+    tableValid = false;
     #ifdef OBSSITE_DEBUG
     printf("Latitude     %f deg\n", latDeg);
     printf("Longitude    %f deg\n", lonDeg);
@@ -28,6 +66,48 @@ time_t ObsSite::getSunset(int year, int yday) {
     return sunsetTime;
 }
 
+int16_t ObsSite::getSunriseMins(int year, int yday) {
+    return tableEntry(year, yday).rise;
+}
+
+int16_t ObsSite::getSunsetMins(int year, int yday) {
+    return tableEntry(year, yday).set;
+}
+
+// Private function that looks up a day in the sun times table, moving the table if needed
+const ObsSite::sunMins_t& ObsSite::tableEntry(int year, int yday) {
+    int32_t day = dayNumber(year, yday);
+    if (!tableValid || day < tableFirstDay || day >= tableFirstDay + OBSSITE_TABLE_DAYS) {
+        // Move the table: forward just far enough that day is its last day or, if that leaves 
+        // nothing in it (or day is before it), to start with day. Calculate just the days that 
+        // weren't in it before.
+        int32_t newFirstDay = day;
+        if (tableValid && day >= tableFirstDay + OBSSITE_TABLE_DAYS && day < tableFirstDay + 2 * OBSSITE_TABLE_DAYS - 1) {
+            newFirstDay = day - OBSSITE_TABLE_DAYS + 1;
+        }
+        for (int32_t d = newFirstDay; d < newFirstDay + OBSSITE_TABLE_DAYS; d++) {
+            if (tableValid && d >= tableFirstDay && d < tableFirstDay + OBSSITE_TABLE_DAYS) {
+                continue;
+            }
+            calc(year, yday + (d - day));
+            sunMins_t &entry = table[d % OBSSITE_TABLE_DAYS];
+            struct tm *t = localtime(&sunriseTime);
+            entry.rise = t->tm_hour * 60 + t->tm_min;
+            t = localtime(&sunsetTime);
+            entry.set = t->tm_hour * 60 + t->tm_min;
+        }
+        tableFirstDay = newFirstDay;
+        tableValid = true;
+    }
+    return table[day % OBSSITE_TABLE_DAYS];
+}
+
+// Private function giving the number of days from Jan 1, 1970 to the tm-style year and yday
+int32_t ObsSite::dayNumber(int year, int yday) {
+    int32_t y = year + 1899;                    // The year before the one in question
+    return 365 * (y - 1969) + (y / 4 - 492) - (y / 100 - 19) + (y / 400 - 4) + yday;
+}
+
 // Private function ecapsulating the calculation of sunrise, solar noon and sunset
 void ObsSite::calc(int year, int yday) {
     // Calculate the julian day from year and yday
@@ -50,6 +130,16 @@ void ObsSite::calc(int year, int yday) {
     printf("julianDay    %d days\n", jDay);
     #endif
 
+    if (kernel == obsFloatKernel) {
+        calcFloat();
+    } else {
+        calcDouble();
+    }
+}
+
+// Private function doing calc()'s work in double using the math library
+void ObsSite::calcDouble() {
+
     // Calculate jStar, the approximate soalr time from julian day and longitude
     double jStar = julianDay + 0.0009 - lonDeg / 360.0;
     #ifdef OBSSITE_DEBUG
@@ -113,6 +203,54 @@ void ObsSite::calc(int year, int yday) {
     #endif
 }
 
+// Private function doing calc()'s work in float using polynomial approximations. To keep float's 
+// 24 bits from being swamped by the size of julian dates, everything is kept relative to julianDay, 
+// and the whole days are dealt with in integer arithmetic.
+void ObsSite::calcFloat() {
+    // jStar is julianDay + lonFrac. Mean anomaly is 357.5291 + 0.98560028 * jStar (mod 360), where 
+    // 0.98560028 * julianDay == julianDay - 0.01439972 * julianDay and julianDay == julianDay % 360 (mod 360)
+    float mDeg = 357.5291f + static_cast <float> (julianDay % 360) - 0.01439972f * julianDay + 0.98560028f * lonFrac;
+    mDeg -= 360.0f * floorf(mDeg / 360.0f);
+    float mRadian = mDeg * OBS_DEG_TO_RAD_F;
+    float sinM = fastSin(mRadian);
+    #ifdef OBSSITE_DEBUG
+    printf("mDeg         %f degrees\n", mDeg);
+    #endif
+
+    // Equation of the center and ecliptic longitude
+    float cDeg = 1.9148f * sinM + 0.02f * fastSin(2.0f * mRadian) + 0.0003f * fastSin(3.0f * mRadian);
+    float lambdaDeg = mDeg + cDeg + 180.0f + 102.9372f;
+    lambdaDeg -= 360.0f * floorf(lambdaDeg / 360.0f);
+    float lambdaRadian = lambdaDeg * OBS_DEG_TO_RAD_F;
+    #ifdef OBSSITE_DEBUG
+    printf("lambdaDeg    %f degrees\n", lambdaDeg);
+    #endif
+
+    // Solar transit, as days after julianDay
+    float transitOffset = lonFrac + 0.0053f * sinM - 0.0069f * fastSin(2.0f * lambdaRadian);
+
+    // Declination of the sun. It's never far from the equator, so cos(delta) > 0
+    float sinDelta = fastSin(lambdaRadian) * 0.397776995f;     // sin(23.4397 degrees)
+    float cosDelta = sqrtf(1.0f - sinDelta * sinDelta);
+
+    // The sun's hour angle
+    float w0Deg = fastAcos((sinH0 - sinLat * sinDelta) / (cosLat * cosDelta)) * OBS_RAD_TO_DEG_F;
+    #ifdef OBSSITE_DEBUG
+    printf("w0Deg        %f degrees\n", w0Deg);
+    #endif
+
+    // julianDay 0 is 2000-01-01 12:00 UTC, i.e., 10957.5 days after the unix epoch
+    time_t dayNoon = (static_cast <time_t> (julianDay) + 10957) * 86400 + 43200;
+    transitTime = dayNoon + static_cast <time_t> (floorf(transitOffset * 86400.0f));
+    sunriseTime = dayNoon + static_cast <time_t> (floorf((transitOffset - w0Deg / 360.0f) * 86400.0f));
+    sunsetTime = dayNoon + static_cast <time_t> (floorf((transitOffset + w0Deg / 360.0f) * 86400.0f));
+    #ifdef OBSSITE_DEBUG
+    printf("transitTime  %s\n", timeToString(transitTime).c_str());
+    printf("sunriseTime  %s\n", timeToString(sunriseTime).c_str());
+    printf("sunsetTime   %s\n", timeToString(sunsetTime).c_str());
+    #endif
+}
+
 // Convenience functions for converting between representations
 
 time_t julianDateToTime(double jDate) {
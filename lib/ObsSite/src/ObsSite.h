@@ -7,12 +7,29 @@
 using namespace std;
 
 //#define OBSSITE_DEBUG                               // Uncomment to turn on debug printing
+//#define OBSSITE_FLOAT_KERNEL                        // Uncomment (or -D) to make the float kernel the default
 #ifndef PI
 #define PI 3.1415926
 #endif
 #define degToRadian(deg)   ((deg) * (PI / 180.0))
 #define radianToDeg(rad)   ((rad) * (180.0 / PI)) 
 #define timegm _mkgmtime
+#define OBSSITE_TABLE_DAYS  (32)    // Number of days of sunrise and sunset times kept in the table
+
+/**
+ * @brief   The ways calc() can do its arithmetic. obsDoubleKernel is the original, done in double 
+ *          using the math library. obsFloatKernel does it in float using polynomial approximations 
+ *          of the trig functions and per-site constants worked out once by the constructor. On 
+ *          processors without a double-precision FPU (like the ESP8266), it's many times faster 
+ *          and its sunrise and sunset times agree with obsDoubleKernel's to within a few seconds.
+ * 
+ */
+enum obsKernel_t {obsDoubleKernel, obsFloatKernel};
+#ifdef OBSSITE_FLOAT_KERNEL
+#define OBSSITE_DEFAULT_KERNEL  (obsFloatKernel)
+#else
+#define OBSSITE_DEFAULT_KERNEL  (obsDoubleKernel)
+#endif
 
 class ObsSite {
 public:
@@ -22,8 +39,9 @@ public:
      * @param obsLatDeg     Observation site latitude in degrees
      * @param obsLonDeg     Observation site longitude in degrees
      * @param obsElevM      Observation site elevation in meters MSL
+     * @param calcKernel    The way calculations are to be done. Omitted ==> OBSSITE_DEFAULT_KERNEL
      */
-	ObsSite(double obsLatDeg, double obsLonDeg, double obsElevM);
+	ObsSite(double obsLatDeg, double obsLonDeg, double obsElevM, obsKernel_t calcKernel = OBSSITE_DEFAULT_KERNEL);
 
     /**
      * @brief   Get the time of sunrise for the specified year and yday (local time). 
@@ -61,14 +79,55 @@ public:
      */
 	time_t getSunset(int year, int yday);
 
+    /**
+     * @brief   Get the local time of day of sunrise for the specified year and yday, in minutes 
+     *          past midnight. The year and yday are as for getSunrise(), except that yday may run 
+     *          past the end of the year (e.g., to ask about "today + 3").
+     * 
+     *          The answer comes from a table of the sunrise and sunset times for 
+     *          OBSSITE_TABLE_DAYS consecutive days. When the day asked about is past the end of 
+     *          the table, the table slides forward just far enough to end with that day, 
+     *          calculating only the days that weren't already there. (When it's before the 
+     *          table, or so far past it nothing would be left, the table starts over with that 
+     *          day.) So asking each day about today and the next few days costs about one day's 
+     *          calculation a day, and asking about days already asked about costs nothing.
+     * 
+     * @param year 
+     * @param yday 
+     * @return int16_t 
+     */
+    int16_t getSunriseMins(int year, int yday);
+
+    /**
+     * @brief   Get the local time of day of sunset for the specified year and yday, in minutes 
+     *          past midnight. See getSunriseMins().
+     * 
+     * @param year 
+     * @param yday 
+     * @return int16_t 
+     */
+    int16_t getSunsetMins(int year, int yday);
+
 private:
     double latDeg;              // Observing site latitude in degrees
     double lonDeg;              // Observing site longitude in degrees
     double elevM;               // Observing site elevation in meters
+    obsKernel_t kernel;         // The way calc() does its calculations
+    float lonFrac;              // For obsFloatKernel: 0.0009 - lonDeg / 360, the site's share of jStar
+    float sinLat;               // For obsFloatKernel: sin(latitude)
+    float cosLat;               // For obsFloatKernel: cos(latitude)
+    float sinH0;                // For obsFloatKernel: sin(altitude of the sun at rise and set)
     int32_t julianDay;          // The number of days since Jan 1, 2000, 12:00:00 UTC of day used in calculations
     time_t sunriseTime;         // The time of sunrise at the site on julianDay
     time_t transitTime;         // The time of solar noon at the site on julianDay
     time_t sunsetTime;          // The time of sunset at the site on julianDay
+    struct sunMins_t {
+        int16_t rise;           // Local time of sunrise, minutes past midnight
+        int16_t set;            // Local time of sunset, minutes past midnight
+    };
+    sunMins_t table[OBSSITE_TABLE_DAYS];    // The sun times table. Day d is in table[d % OBSSITE_TABLE_DAYS]
+    int32_t tableFirstDay;      // dayNumber() of the first day in the table
+    bool tableValid;            // True if the table has been filled
 
     /**
      * @brief   Utility function to calculate sunriseTime, transitTime, and sunsetTime for the date
@@ -78,6 +137,42 @@ private:
      * @param yday 
      */
     void calc(int year, int yday);
+
+    /**
+     * @brief   Utility function to do calc()'s calculation for julianDay using obsDoubleKernel
+     * 
+     */
+    void calcDouble();
+
+    /**
+     * @brief   Utility function to do calc()'s calculation for julianDay using obsFloatKernel
+     * 
+     */
+    void calcFloat();
+
+    /**
+     * @brief   Utility function to return the table entry for the specified tm-style year and 
+     *          yday, first moving the table if the day isn't in it. If the day is past the 
+     *          table, the table slides forward just far enough to end with it, keeping the days 
+     *          it already had and calculating only the new ones. If the day is before the table, 
+     *          or so far past it that none of its days would be kept, the table starts over 
+     *          with the day as its first.
+     * 
+     * @param year 
+     * @param yday 
+     * @return const sunMins_t& 
+     */
+    const sunMins_t& tableEntry(int year, int yday);
+
+    /**
+     * @brief   Utility function to return the number of days between Jan 1, 1970 and the 
+     *          specified tm-style year and yday. The yday may run past the end of the year.
+     * 
+     * @param year 
+     * @param yday 
+     * @return int32_t 
+     */
+    static int32_t dayNumber(int year, int yday);
 };
 
 // Convenience functions for converting between representations
@@ -0,0 +1,442 @@
+/****
+ * @file OtaUpdate.cpp
+ * @version 1.0.0
+ * @date November, 2023
+ *
+ * This file is a portion of the package OtaUpdate, a library that lets an ESP8266 Arduino sketch
+ * update its own firmware over the air. See OtaUpdate.h for details.
+ *
+ *****
+ *
+ * Copyright (C) 2023 D.L. Ehnebuske
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ ****/
+#include "OtaUpdate.h"
+#include <user_interface.h>
+
+#define OU_URL_PREFIX               "http://"           // What an image's URL starts with
+#define OU_LENGTH_HDR               "Content-Length:"   // The response header that says how big the image is
+
+/**
+ * Constructor
+ */
+OtaUpdate::OtaUpdate(uint8_t rtcOffset) {
+    this->rtcOffset = rtcOffset;
+    bootKind = ouNormal;
+    memset(&trial, 0, sizeof(trial));
+    curState = ouIdle;
+    why = "";
+    whyText[0] = '\0';
+    nextOnTrial = true;
+    url[0] = '\0';
+    md5[0] = '\0';
+    host[0] = '\0';
+    port = 0;
+    pathAt = 0;
+    resolving = false;
+    heardMillis = 0;
+    lineLen = 0;
+    status = 0;
+    imageSize = 0;
+    written = 0;
+}
+
+/**
+ * begin()
+ */
+ouBoot_t OtaUpdate::begin() {
+    // After a power-on, RTC memory has nothing in it
+    bootKind = ouNormal;
+    if (ESP.getResetInfoPtr()->reason == REASON_DEFAULT_RST ||
+        !ESP.rtcUserMemoryRead(rtcOffset, (uint32_t*)&trial, sizeof(trial)) ||
+        trial.magic != OU_RTC_MAGIC || trial.check != rtcCheck(trial)) {
+        memset(&trial, 0, sizeof(trial));
+        return bootKind;
+    }
+
+    // The firmware is on trial. Count this boot.
+    trial.md5[OU_MD5_LEN] = '\0';
+    trial.url[OU_MAX_URL_LEN] = '\0';
+    if (trial.boots < UINT8_MAX) {
+        trial.boots++;
+    }
+    bootKind = trial.boots > OU_TRIAL_BOOTS ? ouRollback : ouTrial;
+    saveTrial(&trial);
+    #ifdef DEBUG
+    Serial.printf("[OtaUpdate::begin] Boot %u of firmware on trial from %s.\n", trial.boots, trial.url);
+    #endif
+    return bootKind;
+}
+
+/**
+ * start()
+ */
+bool OtaUpdate::start(const char* url, const char* md5, bool onTrial) {
+    if (curState == ouHead || curState == ouBody) {
+        return false;
+    }
+    why = "";
+    resolving = false;
+
+    // Pick the URL apart: "http://host[:port]/path"
+    size_t prefixLen = strlen(OU_URL_PREFIX);
+    if (strncmp(url, OU_URL_PREFIX, prefixLen) != 0 || strlen(url) > OU_MAX_URL_LEN) {
+        return fail("the URL must be \"http://...\" and not too long");
+    }
+    const char* host = url + prefixLen;
+    const char* path = strchr(host, '/');
+    if (path == nullptr) {
+        path = host + strlen(host);
+    }
+    const char* colon = (const char*)memchr(host, ':', path - host);
+    size_t hostLen = (colon == nullptr ? path : colon) - host;
+    long port = colon == nullptr ? 80 : strtol(colon + 1, nullptr, 10);
+    if (hostLen == 0 || hostLen > OU_MAX_HOST_LEN || port < 1 || port > 65535) {
+        return fail("the URL's host or port isn't right");
+    }
+
+    // The digest had better be 32 hex digits. The Updater wants them in lower case.
+    if (!isMd5(md5)) {
+        return fail("the MD5 digest must be 32 hex digits");
+    }
+    for (uint8_t i = 0; i < OU_MD5_LEN; i++) {
+        this->md5[i] = tolower(md5[i]);
+    }
+    this->md5[OU_MD5_LEN] = '\0';
+    strcpy(this->url, url);
+    nextOnTrial = onTrial;
+    memcpy(this->host, host, hostLen);
+    this->host[hostLen] = '\0';
+    this->port = port;
+    pathAt = path - url;
+    curState = ouHead;
+    heardMillis = millis();
+    lineLen = 0;
+    status = 0;
+    imageSize = 0;
+    written = 0;
+
+    // Look up the server's address. If it has to be asked for, run() connects once it's here.
+    ip_addr_t addr;
+    serverIp = IPAddress();
+    err_t err = dns_gethostbyname(this->host, &addr, dnsFound, this);
+    if (err == ERR_OK) {
+        serverIp = IPAddress(&addr);
+        return connect();
+    }
+    if (err != ERR_INPROGRESS) {
+        return fail("couldn't look up the server's address");
+    }
+    resolving = true;
+    return true;
+}
+
+/**
+ * run()
+ */
+bool OtaUpdate::run() {
+    if (curState != ouHead && curState != ouBody) {
+        return false;
+    }
+    if (resolving) {
+        if (serverIp.isSet()) {
+            return connect();
+        }
+        if (millis() - heardMillis >= OU_DNS_MILLIS) {
+            return fail("couldn't look up the server's address");
+        }
+        return true;
+    }
+    if (client.available() <= 0) {
+        if (!client.connected()) {
+            return fail("the server hung up before sending the whole image");
+        }
+        if (millis() - heardMillis >= OU_STALL_MILLIS) {
+            return fail("the server stopped sending");
+        }
+        return true;
+    }
+    heardMillis = millis();
+
+    // The head: the status line and the headers, a line at a time, up to the empty line that ends it
+    uint16_t nRead = 0;
+    while (curState == ouHead && nRead < OU_CHUNK_SIZE && client.available() > 0) {
+        int c = client.read();
+        nRead++;
+        if (c == '\r') {
+            continue;
+        }
+        if (c != '\n') {
+            if (lineLen < OU_MAX_LINE_LEN) {
+                line[lineLen++] = c;
+            }
+            continue;
+        }
+        line[lineLen] = '\0';
+        if (lineLen != 0) {
+            if (!headLine()) {
+                return false;
+            }
+            lineLen = 0;
+            continue;
+        }
+        if (status != 200) {
+            snprintf(whyText, sizeof(whyText), "the server answered %u", status);
+            return fail(whyText);
+        }
+        if (imageSize == 0) {
+            return fail("the server didn't say how big the image is");
+        }
+        if (!Update.begin(imageSize)) {
+            return fail("there isn't room in flash for the image");
+        }
+        Update.setMD5(md5);
+        curState = ouBody;
+    }
+    if (curState == ouHead) {
+        return true;
+    }
+
+    // The body: the image. Stream whatever's come of it, up to a chunk, into flash.
+    uint8_t buf[OU_CHUNK_SIZE];
+    int avail = client.available();
+    uint32_t want = imageSize - written;
+    if (want > (uint32_t)avail) {
+        want = avail;
+    }
+    if (want > OU_CHUNK_SIZE) {
+        want = OU_CHUNK_SIZE;
+    }
+    int n = want == 0 ? 0 : client.read(buf, want);
+    if (n > 0 && Update.write(buf, n) != (size_t)n) {
+        return fail("writing the image to flash didn't work");
+    }
+    if (n > 0) {
+        written += n;
+    }
+    if (written < imageSize) {
+        return true;
+    }
+
+    // It's all there. The Updater checks the digest; if it's right, the image is installed.
+    client.stop();
+    if (!Update.end()) {
+        return fail(Update.getError() == UPDATE_ERROR_MD5 ? "the image's MD5 digest isn't right" :
+            "the image isn't a firmware image that fits");
+    }
+    if (nextOnTrial) {
+        ouRtcData_t next;
+        memset(&next, 0, sizeof(next));
+        strcpy(next.md5, md5);
+        strcpy(next.url, url);
+        saveTrial(&next);
+    } else {
+        saveTrial(nullptr);
+    }
+    #ifdef DEBUG
+    Serial.printf("[OtaUpdate::run] Installed %lu-byte image from %s.\n", (unsigned long)imageSize, url);
+    #endif
+    curState = ouInstalled;
+    return false;
+}
+
+/**
+ * state()
+ */
+ouState_t OtaUpdate::state() {
+    return curState;
+}
+
+/**
+ * error()
+ */
+const char* OtaUpdate::error() {
+    return why;
+}
+
+/**
+ * progress()
+ */
+uint32_t OtaUpdate::progress() {
+    return written;
+}
+
+/**
+ * size()
+ */
+uint32_t OtaUpdate::size() {
+    return imageSize;
+}
+
+/**
+ * boot()
+ */
+ouBoot_t OtaUpdate::boot() {
+    return bootKind;
+}
+
+/**
+ * trialBoots()
+ */
+uint8_t OtaUpdate::trialBoots() {
+    return bootKind == ouNormal ? 0 : trial.boots;
+}
+
+/**
+ * trialUrl()
+ */
+const char* OtaUpdate::trialUrl() {
+    return trial.url;
+}
+
+/**
+ * trialMd5()
+ */
+const char* OtaUpdate::trialMd5() {
+    return trial.md5;
+}
+
+/**
+ * proven()
+ */
+void OtaUpdate::proven() {
+    if (bootKind == ouNormal) {
+        return;
+    }
+    bootKind = ouNormal;
+    saveTrial(nullptr);
+}
+
+/**
+ * endTrial()
+ */
+void OtaUpdate::endTrial() {
+    if (bootKind == ouNormal) {
+        return;
+    }
+    bootKind = ouNormal;
+    memset(&trial, 0, sizeof(trial));
+    saveTrial(nullptr);
+}
+
+/**
+ * isMd5()
+ */
+bool OtaUpdate::isMd5(const char* md5) {
+    if (strlen(md5) != OU_MD5_LEN) {
+        return false;
+    }
+    for (uint8_t i = 0; i < OU_MD5_LEN; i++) {
+        if (!isxdigit(md5[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * dnsFound()
+ */
+void OtaUpdate::dnsFound(const char* name, const ip_addr_t* ipaddr, void* arg) {
+    OtaUpdate* ota = (OtaUpdate*)arg;
+    if (ipaddr != nullptr && ota->resolving && strcmp(name, ota->host) == 0) {
+        ota->serverIp = IPAddress(ipaddr);
+    }
+}
+
+/**
+ * connect()
+ */
+bool OtaUpdate::connect() {
+    // Ask for the image. HTTP/1.0, so the answer isn't chunked and the server closes when it's done.
+    resolving = false;
+    client.setTimeout(OU_CONNECT_MILLIS);
+    if (!client.connect(serverIp, port)) {
+        return fail("couldn't connect to the server");
+    }
+    client.printf("GET %s HTTP/1.0\r\nHost: %s\r\nUser-Agent: OtaUpdate\r\n\r\n", url[pathAt] == '\0' ? "/" : url + pathAt, host);
+    #ifdef DEBUG
+    Serial.printf("[OtaUpdate::connect] Fetching %s.\n", url);
+    #endif
+    heardMillis = millis();
+    return true;
+}
+
+/**
+ * rtcCheck()
+ */
+uint32_t OtaUpdate::rtcCheck(const ouRtcData_t &data) {
+    const uint32_t* w = (const uint32_t*)&data;
+    uint32_t check = OU_RTC_MAGIC;
+    for (uint8_t i = 0; i < sizeof(data) / sizeof(uint32_t) - 1; i++) {
+        check = (check << 5 | check >> 27) ^ w[i];
+    }
+    return check;
+}
+
+/**
+ * saveTrial()
+ */
+void OtaUpdate::saveTrial(ouRtcData_t* data) {
+    if (data == nullptr) {
+        uint32_t nothing = 0;                           // Not OU_RTC_MAGIC
+        ESP.rtcUserMemoryWrite(rtcOffset, &nothing, sizeof(nothing));
+        return;
+    }
+    data->magic = OU_RTC_MAGIC;
+    data->check = rtcCheck(*data);
+    ESP.rtcUserMemoryWrite(rtcOffset, (uint32_t*)data, sizeof(*data));
+}
+
+/**
+ * fail()
+ */
+bool OtaUpdate::fail(const char* why) {
+    if (Update.isRunning()) {
+        Update.end();                                   // Not finished, so this abandons it
+    }
+    client.stop();
+    resolving = false;
+    this->why = why;
+    curState = ouFailed;
+    #ifdef DEBUG
+    Serial.printf("[OtaUpdate::fail] Update failed: %s.\n", why);
+    #endif
+    return false;
+}
+
+/**
+ * headLine()
+ */
+bool OtaUpdate::headLine() {
+    if (status == 0) {
+        const char* code = strchr(line, ' ');
+        if (strncmp(line, "HTTP/", 5) != 0 || code == nullptr || (status = atoi(code + 1)) == 0) {
+            return fail("the server's answer isn't HTTP");
+        }
+        return true;
+    }
+    size_t hdrLen = strlen(OU_LENGTH_HDR);
+    if (strncasecmp(line, OU_LENGTH_HDR, hdrLen) == 0) {
+        imageSize = strtoul(line + hdrLen, nullptr, 10);
+    }
+    return true;
+}
@@ -0,0 +1,320 @@
+/****
+ * @file OtaUpdate.h
+ * @version 1.0.0
+ * @date November, 2023
+ *
+ * This file is a portion of the package OtaUpdate, a library that lets an ESP8266 Arduino sketch
+ * update its own firmware over the air: it fetches a new image from a URL and installs it, and
+ * then watches over the first boots of the new firmware so it can be replaced if it turns out
+ * not to work.
+ *
+ * The image is fetched with a plain HTTP/1.0 GET and streamed into flash by the ESP8266 core's
+ * Updater as it arrives, OU_CHUNK_SIZE bytes at a time, so it's never all in RAM. Each call to
+ * run() deals with at most one chunk, so the sketch carries on while it's downloading. The 
+ * server's address is looked up without waiting, too. The one wait is for the server to accept 
+ * the connection, which is bounded by OU_CONNECT_MILLIS. Until the
+ * whole image is there and its MD5 digest matches the one it's supposed to have, nothing changes:
+ * the firmware that's running stays in place. Once it matches, the bootloader copies the new
+ * image over the old one at the next restart.
+ *
+ * A 1 MB ESP8266 doesn't have room for two images side by side, so there's no old image to go
+ * back to. Instead, the new firmware boots "on trial." Across restarts (but not loss of power),
+ * RTC memory remembers that it's being tried and where it came from. The sketch calls begin()
+ * first thing in setup(); it counts the boot. When the sketch decides the new firmware is
+ * working, it calls proven() and remembers the URL and MD5 for itself as the last known good
+ * image. If the sketch instead restarts without calling proven() -- because it crashed, the
+ * watchdog bit or it simply gave up waiting -- OU_TRIAL_BOOTS times, the next begin() says it's
+ * time to roll back: the sketch is to fetch its last known good image again and install that.
+ *
+ * Typical use:
+ *
+ *      OtaUpdate ota;
+ *      ...
+ *      ouBoot_t boot = ota.begin();            // In setup()
+ *      ...
+ *      ota.start(url, md5);                    // Say, in a command handler
+ *      ...
+ *      if (!ota.run() && ota.state() == ouInstalled) {    // Every few millis()
+ *          ESP.restart();
+ *      }
+ *      ...
+ *      if (boot == ouTrial && everythingWorks) {
+ *          ota.proven();
+ *      }
+ *
+ *****
+ *
+ * Copyright (C) 2023 D.L. Ehnebuske
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ ****/
+
+#pragma once
+#ifndef Arduino_h
+#include <Arduino.h>
+#endif
+#include <ESP8266WiFi.h>
+#include <Updater.h>
+#include <lwip/dns.h>
+
+/*
+ * Miscellaneous constants
+ */
+#define OU_RTC_OFFSET               (48)                // Default RTC user memory block to use; 0..31 are eboot's, 32..41 NtpClock's
+#define OU_RTC_MAGIC                (0x7441544FUL)      // "OTAt", first word of what's kept in RTC memory
+#define OU_MAX_URL_LEN              (95)                // Longest image URL, "http://host[:port]/path"
+#define OU_MAX_HOST_LEN             (63)                // Longest host name in one
+#define OU_MD5_LEN                  (32)                // Length of an MD5 digest in hex
+#define OU_CHUNK_SIZE               (512)               // Most bytes of the image run() reads and writes to flash at once
+#define OU_MAX_LINE_LEN             (127)               // Longest response header line looked at; longer are truncated
+#define OU_STALL_MILLIS             (15000UL)           // millis() without anything from the server before giving up
+#define OU_DNS_MILLIS               (5000UL)            // millis() to wait for the server's address to be looked up
+#define OU_CONNECT_MILLIS           (500)               // Most millis() start() or run() waits for the server to accept the connection
+#define OU_TRIAL_BOOTS              (3)                 // Boots new firmware gets to be proven() before it's rolled back
+
+/**
+ * @brief   The kinds of boot begin() can report.
+ */
+enum ouBoot_t : uint8_t {
+    ouNormal,                                           // The firmware isn't new, or it's been proven
+    ouTrial,                                            // New firmware, not yet proven
+    ouRollback};                                        // New firmware that's had OU_TRIAL_BOOTS and wasn't proven
+
+/**
+ * @brief   The states of an update.
+ */
+enum ouState_t : uint8_t {
+    ouIdle,                                             // No update has been started
+    ouHead,                                             // Finding the server, or waiting for or reading the response's head
+    ouBody,                                             // Streaming the image into flash
+    ouInstalled,                                        // Done: the new image will be put in place at the next restart
+    ouFailed};                                          // Didn't work; error() says why. What's running is unchanged
+
+class OtaUpdate {
+    public:
+        /**
+         * @brief Construct a new OtaUpdate object
+         *
+         * @param rtcOffset     The first RTC user memory block (4 bytes each) to use. It uses 36.
+         */
+        OtaUpdate(uint8_t rtcOffset = OU_RTC_OFFSET);
+
+        /**
+         * @brief   Find out from RTC memory whether the firmware is on trial and, if so, count
+         *          this boot. Call first thing in setup(), before anything that might not work.
+         *
+         * @return ouBoot_t     ouNormal, ouTrial or, if this is boot OU_TRIAL_BOOTS + 1 of firmware
+         *                      on trial, ouRollback
+         */
+        ouBoot_t begin();
+
+        /**
+         * @brief   Start updating the firmware with the image at the specified URL. It's
+         *          fetched and installed by subsequent calls to run().
+         *
+         * @param url       The image's URL, "http://host[:port]/path"
+         * @param md5       The image's MD5 digest in hex
+         * @param onTrial   If true, the new firmware boots on trial. If false -- e.g., when
+         *                  rolling back to a known good image -- it's taken to be good
+         * @return true     Started. If the server's address has to be looked up, run() connects 
+         *                  once it has been; otherwise start() does.
+         * @return false    An update's already going or, failing the update, the URL or 
+         *                  digest is malformed or the server couldn't be reached (error() says 
+         *                  which)
+         */
+        bool start(const char* url, const char* md5, bool onTrial = true);
+
+        /**
+         * @brief   Move the update along: read what's arrived of the response, at most
+         *          OU_CHUNK_SIZE bytes, and, if it's the image, write it to flash. Call every
+         *          few millis() while it returns true.
+         *
+         * @return true     The update is still going
+         * @return false    It's not: see state()
+         */
+        bool run();
+
+        /**
+         * @brief   Return the update's state.
+         *
+         * @return ouState_t
+         */
+        ouState_t state();
+
+        /**
+         * @brief   Return why the update failed, or "" if it didn't.
+         *
+         * @return const char*
+         */
+        const char* error();
+
+        /**
+         * @brief   Return the number of bytes of the image written to flash so far.
+         *
+         * @return uint32_t
+         */
+        uint32_t progress();
+
+        /**
+         * @brief   Return the image's size, or 0 if the server hasn't said yet.
+         *
+         * @return uint32_t
+         */
+        uint32_t size();
+
+        /**
+         * @brief   Return what begin() said about this boot, as it stands: once proven() or
+         *          endTrial() is called, it's ouNormal.
+         *
+         * @return ouBoot_t
+         */
+        ouBoot_t boot();
+
+        /**
+         * @brief   Return the number of this boot of the firmware on trial, 1 for the first.
+         *          0 if it isn't on trial.
+         *
+         * @return uint8_t
+         */
+        uint8_t trialBoots();
+
+        /**
+         * @brief   Return the URL the firmware on trial -- or, after proven(), the firmware that
+         *          was on trial -- came from; "" if there's no such firmware.
+         *
+         * @return const char*
+         */
+        const char* trialUrl();
+
+        /**
+         * @brief   Return the MD5 digest of the firmware trialUrl() is for, in hex, or "".
+         *
+         * @return const char*
+         */
+        const char* trialMd5();
+
+        /**
+         * @brief   Say that the firmware on trial works. It's no longer on trial.
+         *
+         */
+        void proven();
+
+        /**
+         * @brief   Give up on the trial without saying the firmware works, e.g., when there's
+         *          no known good image to roll back to. It's no longer on trial.
+         *
+         */
+        void endTrial();
+
+        /**
+         * @brief   Return whether the specified string is an MD5 digest as start() wants it:
+         *          exactly OU_MD5_LEN hex digits, in either case.
+         *
+         * @param md5       The string to check
+         * @return true     It is
+         * @return false    It isn't
+         */
+        static bool isMd5(const char* md5);
+
+    private:
+        struct ouRtcData_t {                            // What's kept in RTC memory
+            uint32_t magic;                             //  OU_RTC_MAGIC
+            uint8_t boots;                              //  Boots of the firmware on trial so far
+            uint8_t reserved[3];                        //  Always 0
+            char md5[OU_MD5_LEN + 4];                   //  The firmware's MD5 digest, '\0'-terminated
+            char url[OU_MAX_URL_LEN + 1];               //  The URL it came from, '\0'-terminated
+            uint32_t check;                             //  rtcCheck() of all of the foregoing
+        };
+        static_assert(sizeof(ouRtcData_t) % 4 == 0, "ouRtcData_t must be a whole number of RTC memory blocks");
+
+        /**
+         * @brief   Utility function to calculate the check word for what's kept in RTC memory.
+         *
+         * @param data      What's to be kept
+         * @return uint32_t Its check word
+         */
+        static uint32_t rtcCheck(const ouRtcData_t &data);
+
+        /**
+         * @brief   Utility function to save the specified trial in RTC memory or, if there isn't
+         *          one, to make RTC memory say there's no trial.
+         *
+         * @param data      The trial or nullptr
+         */
+        void saveTrial(ouRtcData_t* data);
+
+        /**
+         * @brief   Utility function lwIP calls with the answer to the lookup of the server's 
+         *          address that start() started.
+         *
+         * @param name      The name that was looked up
+         * @param ipaddr    Its address, or nullptr if it couldn't be found
+         * @param arg       The OtaUpdate that looked it up
+         */
+        static void dnsFound(const char* name, const ip_addr_t* ipaddr, void* arg);
+
+        /**
+         * @brief   Utility function to connect to the server, once its address is known, and ask 
+         *          for the image. Waits at most OU_CONNECT_MILLIS for the server to accept.
+         *
+         * @return true     Asked
+         * @return false    Couldn't connect; the update's failed
+         */
+        bool connect();
+
+        /**
+         * @brief   Utility function to fail the update for the specified reason.
+         *
+         * @param why       The reason, for error()
+         * @return false    Always, for the convenience of the caller
+         */
+        bool fail(const char* why);
+
+        /**
+         * @brief   Utility function to deal with the line of the response's head in line[]: the
+         *          status line or a header.
+         *
+         * @return true     Carry on
+         * @return false    The head's unusable; the update's failed
+         */
+        bool headLine();
+
+        uint8_t rtcOffset;                              // The first RTC memory block we use
+        ouBoot_t bootKind;                              // What boot() returns
+        ouRtcData_t trial;                              // The trial: used if bootKind isn't ouNormal
+        ouState_t curState;                             // What state() returns
+        const char* why;                                // What error() returns
+        char whyText[40];                               // Where it is when it has to be formatted
+        bool nextOnTrial;                               // Whether the image being fetched boots on trial
+        char url[OU_MAX_URL_LEN + 1];                   // The URL of the image being fetched
+        char md5[OU_MD5_LEN + 1];                       // And its MD5 digest
+        char host[OU_MAX_HOST_LEN + 1];                 // The name of the server it's being fetched from
+        uint16_t port;                                  // The server's port
+        uint8_t pathAt;                                 // Where in url the image's path starts
+        bool resolving;                                 // True while waiting for the server's address to be looked up
+        IPAddress serverIp;                             // The server's address; 0.0.0.0 until it has been
+        WiFiClient client;                              // The connection to the server it's being fetched from
+        unsigned long heardMillis;                      // millis() when we last heard from the server (or started the lookup)
+        char line[OU_MAX_LINE_LEN + 1];                 // The line of the response's head being read
+        uint8_t lineLen;                                // Its length so far
+        uint16_t status;                                // The response's HTTP status code; 0 until it's been read
+        uint32_t imageSize;                             // The Content-Length; 0 until it's been read
+        uint32_t written;                               // Bytes of the image written to flash
+};
@@ -0,0 +1,356 @@
+/****
+ * @file ScheduleRules.cpp
+ * @version 1.0.0
+ * @date November, 2023
+ *
+ * This file is a portion of the package ScheduleRules, a library that provides an ESP8266 Arduino
+ * sketch with a list of on/off schedule rules, each packed into 8 bytes, kept in a flash sector.
+ * See ScheduleRules.h for details.
+ *
+ *****
+ *
+ * Copyright (C) 2023 D.L. Ehnebuske
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ ****/
+#include "ScheduleRules.h"
+
+#define SR_MAX_TEXT                 (64)                // Longest rule text parse() accepts
+#define SR_MAX_WORDS                (5)                 // Most words in a rule's text form
+
+static const char dayLetters[] = "SMTWTFS";             // The days in a days mask, starting with Sunday
+
+/**
+ * Constructor
+ */
+ScheduleRules::ScheduleRules(uint32_t flashAddr) {
+    addr = flashAddr;
+    nRules = 0;
+}
+
+/**
+ * begin()
+ */
+bool ScheduleRules::begin() {
+    srHeader_t header;
+    nRules = 0;
+    if (!ESP.flashRead(addr, (uint32_t*)&header, sizeof(header))) {
+        return false;
+    }
+    if (header.magic != SR_MAGIC || header.count > SR_MAX_RULES) {
+        return true;
+    }
+    if (header.count > 0 && !ESP.flashRead(addr + sizeof(header), (uint32_t*)rules, header.count * sizeof(srRule_t))) {
+        return false;
+    }
+    if (rulesCheck(header.count) == header.check) {
+        nRules = header.count;
+    }
+    return true;
+}
+
+/**
+ * count()
+ */
+uint8_t ScheduleRules::count() {
+    return nRules;
+}
+
+/**
+ * get()
+ */
+srRule_t ScheduleRules::get(uint8_t ix) {
+    srRule_t answer {};
+    if (ix < nRules) {
+        answer = rules[ix];
+    }
+    return answer;
+}
+
+/**
+ * add()
+ */
+bool ScheduleRules::add(const srRule_t &rule) {
+    if (nRules >= SR_MAX_RULES) {
+        return false;
+    }
+    rules[nRules++] = rule;
+    return save();
+}
+
+/**
+ * remove()
+ */
+bool ScheduleRules::remove(uint8_t ix) {
+    if (ix >= nRules) {
+        return false;
+    }
+    memmove(&rules[ix], &rules[ix + 1], (nRules - ix - 1) * sizeof(srRule_t));
+    nRules--;
+    return save();
+}
+
+/**
+ * clear()
+ */
+bool ScheduleRules::clear() {
+    nRules = 0;
+    return save();
+}
+
+/**
+ * parse()
+ */
+bool ScheduleRules::parse(const char* text, srRule_t* rule) {
+    // Split a copy of the text into words
+    char buf[SR_MAX_TEXT + 1];
+    if (strnlen(text, sizeof(buf)) == sizeof(buf)) {
+        return false;
+    }
+    strcpy(buf, text);
+    char* word[SR_MAX_WORDS];
+    uint8_t nWords = 0;
+    char* p = buf;
+    while (*p != '\0') {
+        while (*p == ' ') {
+            *p++ = '\0';
+        }
+        if (*p == '\0') {
+            break;
+        }
+        if (nWords == SR_MAX_WORDS) {
+            return false;
+        }
+        word[nWords++] = p;
+        while (*p != ' ' && *p != '\0') {
+            p++;
+        }
+    }
+    if (nWords < 3) {
+        return false;
+    }
+
+    // The days
+    srRule_t answer {};
+    answer.enabled = 1;
+    if (strcasecmp(word[0], "daily") == 0) {
+        answer.days = SR_ALL_DAYS;
+    } else if (strcasecmp(word[0], "weekdays") == 0) {
+        answer.days = SR_WEEKDAYS;
+    } else if (strcasecmp(word[0], "weekends") == 0) {
+        answer.days = SR_WEEKENDS;
+    } else if (strlen(word[0]) == 7) {
+        uint8_t days = 0;
+        for (uint8_t d = 0; d < 7; d++) {
+            if (toupper(word[0][d]) == dayLetters[d]) {
+                days |= 1 << d;
+            } else if (word[0][d] != '-') {
+                return false;
+            }
+        }
+        answer.days = days;
+    } else {
+        return false;
+    }
+    if (answer.days == 0) {
+        return false;
+    }
+
+    // The on and off times
+    uint8_t anchor;
+    int16_t mins;
+    if (!parseTime(word[1], &anchor, &mins)) {
+        return false;
+    }
+    answer.onAnchor = anchor;
+    answer.onMins = mins;
+    if (!parseTime(word[2], &anchor, &mins)) {
+        return false;
+    }
+    answer.offAnchor = anchor;
+    answer.offMins = mins;
+
+    // The optional fuzz and date range, in that order
+    uint8_t w = 3;
+    if (w < nWords && strchr(word[w], '/') == nullptr) {
+        char* end;
+        long fuzz = strtol(word[w], &end, 10);
+        if (!isdigit(word[w][0]) || *end != '\0' || fuzz > SR_MAX_FUZZ) {
+            return false;
+        }
+        answer.fuzz = fuzz;
+        w++;
+    }
+    if (w < nWords) {
+        int fromMonth, fromDay, toMonth, toDay, n;
+        if (sscanf(word[w], "%d/%d-%d/%d%n", &fromMonth, &fromDay, &toMonth, &toDay, &n) != 4 || word[w][n] != '\0' ||
+            fromMonth < 1 || fromMonth > 12 || fromDay < 1 || fromDay > 31 ||
+            toMonth < 1 || toMonth > 12 || toDay < 1 || toDay > 31) {
+            return false;
+        }
+        answer.fromDate = SR_DATE(fromMonth, fromDay);
+        answer.toDate = SR_DATE(toMonth, toDay);
+        w++;
+    }
+    if (w != nWords) {
+        return false;
+    }
+    *rule = answer;
+    return true;
+}
+
+/**
+ * print()
+ */
+void ScheduleRules::print(Print* out, const srRule_t &rule) {
+    if (rule.days == SR_ALL_DAYS) {
+        out->print("daily");
+    } else if (rule.days == SR_WEEKDAYS) {
+        out->print("weekdays");
+    } else if (rule.days == SR_WEEKENDS) {
+        out->print("weekends");
+    } else {
+        for (uint8_t d = 0; d < 7; d++) {
+            out->print((rule.days & (1 << d)) != 0 ? dayLetters[d] : '-');
+        }
+    }
+    out->print(' ');
+    printTime(out, rule.onAnchor, rule.onMins);
+    out->print(' ');
+    printTime(out, rule.offAnchor, rule.offMins);
+    if (rule.fuzz != 0) {
+        out->printf(" %u", (unsigned)rule.fuzz);
+    }
+    if (rule.fromDate != 0) {
+        out->printf(" %02u/%02u-%02u/%02u", (unsigned)rule.fromDate / 32, (unsigned)rule.fromDate % 32,
+            (unsigned)rule.toDate / 32, (unsigned)rule.toDate % 32);
+    }
+}
+
+/**
+ * appliesOn()
+ */
+bool ScheduleRules::appliesOn(const srRule_t &rule, const struct tm &day) {
+    if (!rule.enabled || (rule.days & (1 << day.tm_wday)) == 0) {
+        return false;
+    }
+    if (rule.fromDate == 0) {
+        return true;
+    }
+    uint16_t date = SR_DATE(day.tm_mon + 1, day.tm_mday);
+    if (rule.fromDate <= rule.toDate) {
+        return date >= rule.fromDate && date <= rule.toDate;
+    }
+    return date >= rule.fromDate || date <= rule.toDate;
+}
+
+/**
+ * resolve()
+ */
+int16_t ScheduleRules::resolve(uint8_t anchor, int16_t mins, int16_t sunrise, int16_t sunset) {
+    int16_t answer = mins + (anchor == srSunrise ? sunrise : anchor == srSunset ? sunset : 0);
+    answer %= SR_MINS_PER_DAY;
+    return answer < 0 ? answer + SR_MINS_PER_DAY : answer;
+}
+
+/**
+ * save()
+ */
+bool ScheduleRules::save() {
+    srHeader_t header {SR_MAGIC, nRules, rulesCheck(nRules)};
+    if (!ESP.flashEraseSector(addr / SR_SECTOR_SIZE) ||
+        !ESP.flashWrite(addr, (uint32_t*)&header, sizeof(header))) {
+        #ifdef DEBUG
+        Serial.print("[ScheduleRules::save] Unable to write the rules header.\n");
+        #endif
+        return false;
+    }
+    if (nRules > 0 && !ESP.flashWrite(addr + sizeof(header), (uint32_t*)rules, nRules * sizeof(srRule_t))) {
+        #ifdef DEBUG
+        Serial.print("[ScheduleRules::save] Unable to write the rules.\n");
+        #endif
+        return false;
+    }
+    return true;
+}
+
+/**
+ * rulesCheck()
+ */
+uint32_t ScheduleRules::rulesCheck(uint8_t n) {
+    // FNV-1a over the rules' bytes
+    uint32_t answer = 2166136261;
+    const uint8_t* p = (const uint8_t*)rules;
+    for (uint16_t i = 0; i < n * sizeof(srRule_t); i++) {
+        answer = (answer ^ p[i]) * 16777619;
+    }
+    return answer;
+}
+
+/**
+ * parseTime()
+ */
+bool ScheduleRules::parseTime(const char* word, uint8_t* anchor, int16_t* mins) {
+    const char* p;
+    if (strncasecmp(word, "sunrise", 7) == 0) {
+        *anchor = srSunrise;
+        p = word + 7;
+    } else if (strncasecmp(word, "sunset", 6) == 0) {
+        *anchor = srSunset;
+        p = word + 6;
+    } else {
+        int hours, minutes, n;
+        if (sscanf(word, "%2d:%2d%n", &hours, &minutes, &n) != 2 || word[n] != '\0' ||
+            hours < 0 || hours > 23 || minutes < 0 || minutes > 59) {
+            return false;
+        }
+        *anchor = srMidnight;
+        *mins = hours * 60 + minutes;
+        return true;
+    }
+    if (*p == '\0') {
+        *mins = 0;
+        return true;
+    }
+    if ((*p != '+' && *p != '-') || !isdigit(p[1])) {
+        return false;
+    }
+    char* end;
+    long offset = strtol(p, &end, 10);
+    if (*end != '\0' || offset > SR_MAX_OFFSET || offset < -SR_MAX_OFFSET) {
+        return false;
+    }
+    *mins = offset;
+    return true;
+}
+
+/**
+ * printTime()
+ */
+void ScheduleRules::printTime(Print* out, uint8_t anchor, int16_t mins) {
+    if (anchor == srMidnight) {
+        out->printf("%02d:%02d", mins / 60, mins % 60);
+        return;
+    }
+    out->print(anchor == srSunrise ? "sunrise" : "sunset");
+    if (mins != 0) {
+        out->printf("%+d", mins);
+    }
+}
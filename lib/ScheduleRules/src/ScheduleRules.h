@@ -0,0 +1,256 @@
+/****
+ * @file ScheduleRules.h
+ * @version 1.0.0
+ * @date November, 2023
+ *
+ * This file is a portion of the package ScheduleRules, a library that provides an ESP8266 Arduino
+ * sketch with a list of on/off schedule rules, each packed into 8 bytes, kept in a flash sector.
+ *
+ * A rule turns something on at one time of day and off at another. Each of the two times is
+ * either a time of day or a number of minutes (possibly negative) from sunrise or sunset. A rule
+ * applies on the days of the week in its mask and, optionally, only between two dates (which may
+ * wrap around the end of the year, e.g., November 1 to February 28). It may also have some
+ * minutes of randomness to be added to both times each day.
+ *
+ * Rules have a text form, which parse() reads and print() writes:
+ *
+ *      <days> <on> <off> [<fuzz>] [<mm/dd>-<mm/dd>]
+ *
+ * where <days> is "daily", "weekdays", "weekends" or seven characters, one per day starting with
+ * Sunday, each either the day's letter (SMTWTFS) or "-"; <on> and <off> are "hh:mm", "sunrise",
+ * "sunset", or one of the latter followed by +<minutes> or -<minutes>; and <fuzz> is the minutes
+ * of randomness (0 if omitted). For example:
+ *
+ *      -MTWTF- 06:30 sunrise+20
+ *      daily sunset-15 23:00 10 11/01-02/28
+ *
+ * The ScheduleRules object holds up to SR_MAX_RULES of them. It doesn't know what they're for or
+ * when they should be followed; the sketch works that out with appliesOn() and resolve(). Adding
+ * or removing a rule writes the whole list to flash right away: an erase and one write. So, use
+ * a sector the sketch doesn't use for anything else, typically in the flash area the linker sets
+ * aside for a file system. For example:
+ *
+ *      ScheduleRules rules {FS_PHYS_ADDR + FS_PHYS_SIZE - FR_SECTOR_SIZE};
+ *      ...
+ *      rules.begin();
+ *      srRule_t rule;
+ *      if (ScheduleRules::parse("daily sunset-15 23:00", &rule)) {
+ *          rules.add(rule);
+ *      }
+ *
+ *****
+ *
+ * Copyright (C) 2023 D.L. Ehnebuske
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ ****/
+
+#pragma once
+#ifndef Arduino_h
+#include <Arduino.h>
+#endif
+#include <time.h>
+
+/*
+ * Miscellaneous constants
+ */
+#define SR_MAX_RULES                (64)                // The most rules a ScheduleRules holds
+#define SR_MAGIC                    (0x6C755253)        // "SRul", the first word of the flash sector
+#define SR_SECTOR_SIZE              (4096)              // Size of a flash sector
+#define SR_MINS_PER_DAY             (1440)              // Minutes in a day
+#define SR_MAX_OFFSET               (720)               // Most minutes a time may be from sunrise or sunset
+#define SR_MAX_FUZZ                 (60)                // Most minutes of randomness a rule may have
+#define SR_ALL_DAYS                 (0x7F)              // Days mask for every day
+#define SR_WEEKDAYS                 (0x3E)              // Days mask for Monday through Friday
+#define SR_WEEKENDS                 (0x41)              // Days mask for Saturday and Sunday
+#define SR_DATE(month, day)         ((month) * 32 + (day))  // A rule's fromDate or toDate
+
+/**
+ * @brief   What a rule's on or off time is measured from
+ *
+ */
+enum srAnchor_t : uint8_t {
+    srMidnight,                                         // Midnight; the time is a time of day
+    srSunrise,                                          // Sunrise
+    srSunset};                                          // Sunset
+
+/**
+ * @brief   A schedule rule, packed into 8 bytes
+ *
+ */
+struct srRule_t {
+    uint32_t enabled : 1;                               // 1 if the rule is to be followed
+    uint32_t onAnchor : 2;                              // What onMins is from: an srAnchor_t
+    uint32_t offAnchor : 2;                             // What offMins is from: an srAnchor_t
+    uint32_t days : 7;                                  // The days of the week it applies: bit 0 is Sunday
+    int32_t onMins : 12;                                // The turn-on time: minutes from onAnchor
+    uint32_t fuzz : 6;                                  // Minutes of randomness: 0 to SR_MAX_FUZZ
+    uint32_t : 2;
+    int32_t offMins : 12;                               // The turn-off time: minutes from offAnchor
+    uint32_t fromDate : 9;                              // The first date it applies: SR_DATE(); 0 if all year
+    uint32_t toDate : 9;                                // The last date it applies: SR_DATE(); 0 if all year
+    uint32_t : 2;
+};
+static_assert(sizeof(srRule_t) == 8, "srRule_t must pack into 8 bytes");
+
+class ScheduleRules {
+    public:
+        /**
+         * @brief Construct a new ScheduleRules object.
+         *
+         * @param flashAddr     The flash address of the sector to keep the rules in. Must be
+         *                      sector aligned.
+         */
+        ScheduleRules(uint32_t flashAddr);
+
+        /**
+         * @brief   Get the rules kept in flash. If the sector doesn't hold any, there are none.
+         *
+         * @return true     Success
+         * @return false    A flash operation failed
+         */
+        bool begin();
+
+        /**
+         * @brief   Return the number of rules.
+         *
+         * @return uint8_t
+         */
+        uint8_t count();
+
+        /**
+         * @brief   Return the specified rule.
+         *
+         * @param ix            The index of the rule. 0 to count() - 1.
+         * @return srRule_t     The rule. If there's no such rule, one that's not enabled.
+         */
+        srRule_t get(uint8_t ix);
+
+        /**
+         * @brief   Add the specified rule after the others and save the rules in flash.
+         *
+         * @param rule      The rule
+         * @return true     Success
+         * @return false    There are already SR_MAX_RULES or a flash operation failed
+         */
+        bool add(const srRule_t &rule);
+
+        /**
+         * @brief   Remove the specified rule and save the rules in flash.
+         *
+         * @param ix        The index of the rule
+         * @return true     Success
+         * @return false    There's no such rule or a flash operation failed
+         */
+        bool remove(uint8_t ix);
+
+        /**
+         * @brief   Remove all the rules and save that in flash.
+         *
+         * @return true     Success
+         * @return false    A flash operation failed
+         */
+        bool clear();
+
+        /**
+         * @brief   Parse the text form of a rule.
+         *
+         * @param text      The text, e.g., "-MTWTF- 06:30 sunrise+20"
+         * @param rule      Where to put the rule, enabled. Unchanged if the text isn't acceptable.
+         * @return true     The text was acceptable
+         * @return false    It wasn't
+         */
+        static bool parse(const char* text, srRule_t* rule);
+
+        /**
+         * @brief   Print the text form of the specified rule (without a newline).
+         *
+         * @param out       Where to print it
+         * @param rule      The rule
+         */
+        static void print(Print* out, const srRule_t &rule);
+
+        /**
+         * @brief   Return true if the specified rule is enabled and applies on the specified day.
+         *
+         * @param rule      The rule
+         * @param day       The day, as localtime() gives it
+         */
+        static bool appliesOn(const srRule_t &rule, const struct tm &day);
+
+        /**
+         * @brief   Return the time of day, in minutes past midnight, that the specified number of
+         *          minutes from the specified anchor is. Wraps around midnight.
+         *
+         * @param anchor        An srAnchor_t
+         * @param mins          Minutes from it
+         * @param sunrise       The time of sunrise, in minutes past midnight
+         * @param sunset        The time of sunset, in minutes past midnight
+         * @return int16_t      0 to SR_MINS_PER_DAY - 1
+         */
+        static int16_t resolve(uint8_t anchor, int16_t mins, int16_t sunrise, int16_t sunset);
+
+    private:
+        struct srHeader_t {                             // What's at the start of the flash sector
+            uint32_t magic;                             //  SR_MAGIC
+            uint32_t count;                             //  The number of rules that follow
+            uint32_t check;                             //  rulesCheck() of them
+        };
+
+        uint32_t addr;                                  // The flash address of our sector
+        uint8_t nRules;                                 // The number of rules
+        srRule_t rules[SR_MAX_RULES];                   // The rules
+
+        /**
+         * @brief   Utility function to write the rules to flash.
+         *
+         * @return true     Success
+         * @return false    A flash operation failed
+         */
+        bool save();
+
+        /**
+         * @brief   Utility function to return the check word for the first n rules.
+         *
+         * @param n         The number of rules
+         * @return uint32_t The check word
+         */
+        uint32_t rulesCheck(uint8_t n);
+
+        /**
+         * @brief   Utility function to parse a rule's on or off time.
+         *
+         * @param word      The text of it, e.g., "sunset-15"
+         * @param anchor    Where to put its srAnchor_t
+         * @param mins      Where to put its minutes from the anchor
+         * @return true     It was acceptable
+         * @return false    It wasn't
+         */
+        static bool parseTime(const char* word, uint8_t* anchor, int16_t* mins);
+
+        /**
+         * @brief   Utility function to print a rule's on or off time.
+         *
+         * @param out       Where to print it
+         * @param anchor    Its srAnchor_t
+         * @param mins      Its minutes from the anchor
+         */
+        static void printTime(Print* out, uint8_t anchor, int16_t mins);
+};
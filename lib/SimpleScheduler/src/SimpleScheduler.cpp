@@ -0,0 +1,136 @@
+/****
+ * @file SimpleScheduler.cpp
+ * @version 1.0.0
+ * @date November, 2023
+ * 
+ * This file is a portion of the package SimpleScheduler, a library that provides an Arduino 
+ * sketch with a lightweight cooperative task scheduler. See SimpleScheduler.h for details.
+ * 
+ *****
+ * 
+ * Copyright (C) 2023 D.L. Ehnebuske
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ * 
+ ****/
+#include "SimpleScheduler.h"
+
+/**
+ * Constructor
+ */
+SimpleScheduler::SimpleScheduler() {
+    nTasks = 0;
+}
+
+/**
+ * addTask()
+ */
+ssTaskId_t SimpleScheduler::addTask(const char* name, ssTask task, unsigned long periodMillis) {
+    if (nTasks == SS_MAX_TASKS) {
+        return SS_NO_TASK;
+    }
+    tasks[nTasks] = {name, task, periodMillis, millis(), periodMillis != 0, 0, 0, 0, 0};
+    return nTasks++;
+}
+
+/**
+ * runIn()
+ */
+void SimpleScheduler::runIn(ssTaskId_t id, unsigned long delayMillis) {
+    if (id < 0 || id >= nTasks) {
+        return;
+    }
+    tasks[id].dueMillis = millis() + delayMillis;
+    tasks[id].scheduled = true;
+}
+
+/**
+ * setPeriod()
+ */
+void SimpleScheduler::setPeriod(ssTaskId_t id, unsigned long periodMillis) {
+    if (id < 0 || id >= nTasks) {
+        return;
+    }
+    tasks[id].periodMillis = periodMillis;
+}
+
+/**
+ * run()
+ */
+unsigned long SimpleScheduler::run() {
+    for (uint8_t i = 0; i < nTasks; i++) {
+        ssTaskInfo_t &t = tasks[i];
+        unsigned long now = millis();
+        if (!t.scheduled || (long)(now - t.dueMillis) < 0) {
+            continue;
+        }
+        // It's due. Figure out when it's next due before running it, so the task can change that.
+        uint32_t lateMillis = now - t.dueMillis;
+        if (t.periodMillis == 0) {
+            t.scheduled = false;
+        } else {
+            // Keep to the original cadence unless we've fallen a whole period or more behind.
+            t.dueMillis = lateMillis < t.periodMillis ? t.dueMillis + t.periodMillis : now + t.periodMillis;
+        }
+        uint32_t startMicros = micros();
+        (*t.task)();
+        uint32_t runMicros = micros() - startMicros;
+        t.runCount++;
+        t.totalMicros += runMicros;
+        if (runMicros > t.maxMicros) {
+            t.maxMicros = runMicros;
+        }
+        if (lateMillis > t.maxLateMillis) {
+            t.maxLateMillis = lateMillis;
+        }
+    }
+
+    // Figure out how long until the next task is due.
+    unsigned long waitMillis = SS_MAX_IDLE_MILLIS;
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < nTasks; i++) {
+        if (!tasks[i].scheduled) {
+            continue;
+        }
+        long untilDue = (long)(tasks[i].dueMillis - now);
+        if (untilDue <= 0) {
+            return 0;
+        }
+        if ((unsigned long)untilDue < waitMillis) {
+            waitMillis = untilDue;
+        }
+    }
+    return waitMillis;
+}
+
+/**
+ * statsReport()
+ */
+String SimpleScheduler::statsReport() {
+    String answer = "Task        runs       avg us   max us   max late ms\n";
+    char line[80];
+    for (uint8_t i = 0; i < nTasks; i++) {
+        ssTaskInfo_t &t = tasks[i];
+        snprintf(line, sizeof(line), "%-10.10s %10lu %8lu %8lu %8lu\n", t.name, (unsigned long)t.runCount, 
+            (unsigned long)(t.runCount == 0 ? 0 : t.totalMicros / t.runCount), (unsigned long)t.maxMicros, 
+            (unsigned long)t.maxLateMillis);
+        answer += line;
+    }
+    return answer;
+}
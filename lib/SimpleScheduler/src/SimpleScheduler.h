@@ -0,0 +1,149 @@
+/****
+ * @file SimpleScheduler.h
+ * @version 1.0.0
+ * @date November, 2023
+ * 
+ * This file is a portion of the package SimpleScheduler, a library that provides an Arduino 
+ * sketch with a lightweight cooperative task scheduler.
+ * 
+ * The typical usage pattern is to instantiate a SimpleScheduler as a global in the sketch and 
+ * then, in the sketch's setup() function, to add the sketch's tasks to it. A task is a function 
+ * that does one small piece of work and returns. Each task is added with the period, in millis(), 
+ * at which it is to be run. A task with a period of 0 isn't run periodically; it's run only when 
+ * something (often the task itself) says when it should next be run by calling runIn().
+ * 
+ * The sketch's loop() function then just calls run() and waits for as long as run() says nothing 
+ * needs doing. For example:
+ * 
+ *      void loop() {
+ *          delay(scheduler.run());
+ *      }
+ * 
+ * run() runs each task whose time has come and returns the number of millis() until the next one 
+ * is due (but never more than SS_MAX_IDLE_MILLIS). On the ESP8266, delay() gives the time to the 
+ * WiFi stack and lets the processor idle, so a sketch built this way spends most of its time 
+ * asleep rather than spinning through loop() looking for something to do.
+ * 
+ * As it goes, the SimpleScheduler keeps track of how many times it has run each task, how long 
+ * the task took and how late it was run compared to when it was due. statsReport() returns these 
+ * as text.
+ * 
+ *****
+ * 
+ * Copyright (C) 2023 D.L. Ehnebuske
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ * 
+ ****/
+
+#pragma once
+#ifndef Arduino_h
+#include <Arduino.h>
+#endif
+
+/*
+ * Miscellaneous constants
+ */
+#define SS_MAX_TASKS                (12)                // Maximum number of tasks a SimpleScheduler can have
+#define SS_MAX_IDLE_MILLIS          (1000)              // Maximum millis() run() ever says to wait
+#define SS_NO_TASK                  (-1)                // The ssTaskId_t that isn't a task
+
+/**
+ * @brief   Type definition for the identifier of a task. addTask() returns one.
+ * 
+ */
+typedef int8_t ssTaskId_t;
+
+/**
+ * @brief   Type definition of a task function.
+ * 
+ */
+using ssTask = void (*)();
+
+class SimpleScheduler {
+    public:
+        /**
+         * @brief Construct a new SimpleScheduler object.
+         * 
+         */
+        SimpleScheduler();
+
+        /**
+         * @brief   Add the specified task, to be run every periodMillis millis(), starting now. 
+         *          A task with a periodMillis of 0 is run only as arranged by runIn().
+         * 
+         * @param name          The name of the task (for reporting). Must last as long as the task.
+         * @param task          The task function.
+         * @param periodMillis  How often to run the task or 0 if it's not periodic.
+         * @return ssTaskId_t   The task's id or SS_NO_TASK if there's no room for it.
+         */
+        ssTaskId_t addTask(const char* name, ssTask task, unsigned long periodMillis);
+
+        /**
+         * @brief   Arrange for the specified task to next be run delayMillis millis() from now, 
+         *          replacing whatever was previously arranged. If called from within the task 
+         *          itself, this overrides its period for this one time.
+         * 
+         * @param id            The task.
+         * @param delayMillis   How long from now it's to be run.
+         */
+        void runIn(ssTaskId_t id, unsigned long delayMillis);
+
+        /**
+         * @brief   Change the period of the specified task. The change takes effect after the 
+         *          next time the task is run.
+         * 
+         * @param id            The task.
+         * @param periodMillis  The new period or 0 if it's no longer periodic.
+         */
+        void setPeriod(ssTaskId_t id, unsigned long periodMillis);
+
+        /**
+         * @brief   Run all the tasks that are due and return how long it is until the next one 
+         *          is. Call from loop().
+         * 
+         * @return unsigned long    The number of millis() until the next task is due to be run, 
+         *                          but no more than SS_MAX_IDLE_MILLIS.
+         */
+        unsigned long run();
+
+        /**
+         * @brief   Return the run statistics for all the tasks as text, one line per task: name, 
+         *          number of runs, average and maximum run time (in micros()) and maximum 
+         *          lateness (in millis()).
+         * 
+         * @return String 
+         */
+        String statsReport();
+
+    private:
+        struct ssTaskInfo_t {
+            const char* name;                               // The name of the task
+            ssTask task;                                    // The task function
+            unsigned long periodMillis;                     // How often it's to be run; 0 if not periodic
+            unsigned long dueMillis;                        // When it's next due
+            bool scheduled;                                 // True if it's due at dueMillis; false if not scheduled
+            uint32_t runCount;                              // Number of times it's been run
+            uint32_t totalMicros;                           // Total micros() spent running it (wraps eventually)
+            uint32_t maxMicros;                             // Longest run in micros()
+            uint32_t maxLateMillis;                         // Latest it's been run compared to when it was due
+        };
+        ssTaskInfo_t tasks[SS_MAX_TASKS];                   // The tasks
+        uint8_t nTasks;                                     // The number of tasks in tasks[]
+};
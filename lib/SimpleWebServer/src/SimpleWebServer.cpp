@@ -32,15 +32,200 @@
  ****/
 #include "SimpleWebServer.h"
 
-// Public member functions.
+// The names of the HTTP methods, in swsHttpMethod_t order
+static const char* const swsMethodNames[SWS_METHOD_COUNT - 1] = {"GET", "HEAD", "POST", "PUT", "DELETE",
+                                                                 "CONNECT", "OPTIONS", "TRACE", "PATCH"};
+
+#ifdef METRICS
+static uint32_t swsSentBytes = 0;                           // Bytes sent to clients so far, for the metrics
+#endif
+
+/**
+ * @brief   Utility function: Return true if the specified comma-separated header value contains 
+ *          the specified token, ignoring case. E.g., "keep-alive, Upgrade" contains "upgrade".
+ * 
+ * @param value     The header value; may be nullptr
+ * @param token     The token to look for
+ * @return true     It does
+ * @return false    It doesn't
+ */
+static bool headerHasToken(const char* value, const char* token) {
+    size_t tokenLen = strlen(token);
+    while (value != nullptr && *value != '\0') {
+        while (*value == ' ' || *value == ',') {
+            value++;
+        }
+        const char* end = value;
+        while (*end != '\0' && *end != ',' && *end != ' ') {
+            end++;
+        }
+        if ((size_t)(end - value) == tokenLen && strncasecmp(value, token, tokenLen) == 0) {
+            return true;
+        }
+        value = end;
+    }
+    return false;
+}
+
+// swsStringView member functions
+
+/**
+ * equals()
+ */
+bool swsStringView::equals(const char* str) const {
+    return ptr != nullptr && strnlen(str, len + 1) == len && memcmp(ptr, str, len) == 0;
+}
+
+/**
+ * equalsIgnoreCase()
+ */
+bool swsStringView::equalsIgnoreCase(const char* str) const {
+    return ptr != nullptr && strnlen(str, len + 1) == len && strncasecmp(ptr, str, len) == 0;
+}
+
+/**
+ * startsWith()
+ */
+bool swsStringView::startsWith(const char* str) const {
+    size_t strLen = strlen(str);
+    return ptr != nullptr && strLen <= len && memcmp(ptr, str, strLen) == 0;
+}
+
+/**
+ * toString()
+ */
+String swsStringView::toString() const {
+    String answer;
+    if (ptr != nullptr) {
+        answer.concat(ptr, len);
+    }
+    return answer;
+}
+
+/**
+ * copyTo()
+ */
+bool swsStringView::copyTo(char* buf, size_t size) const {
+    if (ptr == nullptr || len >= size) {
+        return false;
+    }
+    memcpy(buf, ptr, len);
+    buf[len] = '\0';
+    return true;
+}
+
+/**
+ * toInt()
+ */
+long swsStringView::toInt() const {
+    char num[SWS_NUMBER_MAX_LEN + 1];
+    swsStringView head {ptr, len > SWS_NUMBER_MAX_LEN ? (uint16_t)SWS_NUMBER_MAX_LEN : len};
+    return head.copyTo(num, sizeof(num)) ? atol(num) : 0;
+}
+
+/**
+ * toFloat()
+ */
+float swsStringView::toFloat() const {
+    char num[SWS_NUMBER_MAX_LEN + 1];
+    swsStringView head {ptr, len > SWS_NUMBER_MAX_LEN ? (uint16_t)SWS_NUMBER_MAX_LEN : len};
+    return head.copyTo(num, sizeof(num)) ? atof(num) : 0;
+}
+
+// swsBufferedPrint member functions
+
+/**
+ * Constructor
+ */
+swsBufferedPrint::swsBufferedPrint(WiFiClient* httpClient, bool chunked) {
+    client = httpClient;
+    isChunked = chunked;
+    used = 0;
+}
+
+/**
+ * Destructor
+ */
+swsBufferedPrint::~swsBufferedPrint() {
+    flush();
+    if (isChunked) {
+        client->print("0\r\n\r\n");
+    }
+}
+
+/**
+ * write() a single character
+ */
+size_t swsBufferedPrint::write(uint8_t c) {
+    if (used == SWS_OUT_BUFFER_SIZE) {
+        flush();
+    }
+    buf[used++] = c;
+    return 1;
+}
+
+/**
+ * write() a block of characters
+ */
+size_t swsBufferedPrint::write(const uint8_t *buffer, size_t size) {
+    size_t remaining = size;
+    while (remaining > 0) {
+        if (used == SWS_OUT_BUFFER_SIZE) {
+            flush();
+        }
+        size_t n = SWS_OUT_BUFFER_SIZE - used < remaining ? SWS_OUT_BUFFER_SIZE - used : remaining;
+        memcpy(buf + used, buffer, n);
+        used += n;
+        buffer += n;
+        remaining -= n;
+    }
+    return size;
+}
+
+/**
+ * flush()
+ */
+void swsBufferedPrint::flush() {
+    if (used > 0) {
+        if (isChunked) {
+            client->printf("%x\r\n", (unsigned int)used);
+        }
+        #ifdef METRICS
+        swsSentBytes += client->write(buf, used);
+        #else
+        client->write(buf, used);
+        #endif
+        if (isChunked) {
+            client->print("\r\n");
+        }
+        used = 0;
+    }
+}
+
+// SimpleWebServer public member functions.
 
 /**
  * Constructor
  */
 SimpleWebServer::SimpleWebServer() {
-    trPath = "";
-    trQuery = "";
+    trPath = trQuery = {"", 0};
     trMethod = swsBAD_REQ;
+    trRouteTag = 0;
+    nRoutes = 0;
+    #ifdef METRICS
+    for (uint8_t i = 0; i <= SWS_MAX_ROUTES; i++) {
+        routeMetrics[i].sentBytes = 0;
+    }
+    #endif
+    memset(routeSlots, 0, sizeof(routeSlots));
+    clientIsHttp11 = clientWantsKeepAlive = responseKeepsAlive = responseIsEventStream = false;
+    nextSlot = 0;
+    reader = nullptr;
+    nServed = 0;
+    for (uint8_t i = 0; i < SWS_MAX_CONNECTIONS; i++) {
+        connections[i].state = swsSlotFree;
+    }
+    clearClientMessage();
     handlers[swsGET] = defaultGetAndHeadHandler;
     handlers[swsHEAD] = defaultGetAndHeadHandler;
     for (uint8_t i = swsPOST; i < SWS_METHOD_COUNT - 1; i++) {
@@ -63,63 +248,292 @@ void SimpleWebServer::attachMethodHandler(swsHttpMethod_t method, swsMethodHandl
     handlers[method] = handler;
 }
 
+/**
+ * attachRoute()
+ */
+bool SimpleWebServer::attachRoute(swsHttpMethod_t method, const char* path, swsRouteHandler handler, uint8_t tag) {
+    uint16_t pathLen = strlen(path);
+    int8_t ix = findRoute(method, path, pathLen);
+    if (ix >= 0) {
+        routes[ix].handler = handler;
+        routes[ix].tag = tag;
+        return true;
+    }
+    if (nRoutes == SWS_MAX_ROUTES) {
+        Serial.printf("[attachRoute] No room for route to \"%s\".\n", path);
+        return false;
+    }
+    uint16_t hash = hashRoute(method, path, pathLen);
+    routes[nRoutes] = {path, handler, pathLen, hash, (uint8_t)method, tag};
+    nRoutes++;
+    uint8_t slot = hash & (SWS_ROUTE_SLOTS - 1);
+    while (routeSlots[slot] != 0) {
+        slot = (slot + 1) & (SWS_ROUTE_SLOTS - 1);
+    }
+    routeSlots[slot] = nRoutes;
+    return true;
+}
+
 /**
  * run()
  */
 void SimpleWebServer::run() {
-    const char* swsMethodNames[SWS_METHOD_COUNT] = {"GET", "HEAD", "POST", "PUT", "DELETE",
-                                                    "CONNECT", "OPTIONS", "TRACE", "PATCH"};
-
-    // Get the next waiting client, if any.
-    WiFiClient client = server->accept();
-
-    // The existence of a client means there's a request to process.
-    if (client) {
+    // Take in any newly arrived clients. If all the slots are in use, make room by closing the 
+    // connection that's been idle the longest. (Event streams aren't idle, they're just quiet, and 
+    // the reader is busy. There are never so many of them that there's no idle connection to close.)
+    while (server->hasClient()) {
+        swsConnection_t* slot = nullptr;
+        for (uint8_t i = 0; i < SWS_MAX_CONNECTIONS; i++) {
+            swsConnection_t &conn = connections[i];
+            if (conn.state == swsSlotFree) {
+                slot = &conn;
+                break;
+            }
+            if (conn.state == swsSlotEventStream || conn.state == swsSlotReading) {
+                continue;
+            }
+            if (slot == nullptr || millis() - conn.lastActiveMillis > millis() - slot->lastActiveMillis) {
+                slot = &conn;
+            }
+        }
+        if (slot->state != swsSlotFree) {
+            #ifdef SWS_DEBUG
+            Serial.print("[run] Out of connection slots. Closed the one idle the longest.\n");
+            #endif
+            closeConnection(*slot);
+        }
+        slot->client = server->accept();
+        slot->client.setNoDelay(true);
+        slot->state = swsSlotIdle;
+        slot->nRequests = 0;
+        slot->headIn = false;
+        slot->pendingLen = slot->scannedLen = 0;
+        slot->lastActiveMillis = millis();
         #ifdef SWS_DEBUG
-        Serial.print("Client connected.\n");
+        Serial.printf("[run] Client connected in slot %d.\n", (int)(slot - connections));
         #endif
+    }
 
-        // Get the request block into clientMessageStartLine and clientMessageHeaders
-        getClientMessage(&client);
-        #ifdef SWS_DEBUG
-        Serial.print("Got this request:\n");
-        Serial.print(clientMessageStartLine);
+    // Go through the connections, starting after the one most recently serviced, collecting what's 
+    // arrived of their requests, closing the ones that are gone or have been idle or slow too long 
+    // and noting the first one whose request is ready to be read. That's when the head is all in 
+    // or there's no room for more of it. Event streams just get a comment if they've been quiet too 
+    // long.
+    swsConnection_t* ready = nullptr;
+    uint8_t readyIx = 0;
+    for (uint8_t n = 0; n < SWS_MAX_CONNECTIONS; n++) {
+        uint8_t i = (nextSlot + n) % SWS_MAX_CONNECTIONS;
+        swsConnection_t &conn = connections[i];
+        if (conn.state == swsSlotFree) {
+            continue;
+        }
+        if (conn.state == swsSlotEventStream) {
+            if (!conn.client.connected()) {
+                closeConnection(conn);
+            } else if (millis() - conn.lastActiveMillis >= SWS_EVENT_KEEPALIVE_MILLIS) {
+                if (conn.client.print(":\n\n") != 3) {
+                    closeConnection(conn);
+                } else {
+                    conn.lastActiveMillis = millis();
+                }
+            }
+            continue;
+        }
+        if (conn.state == swsSlotReading) {
+            continue;
+        }
+        collectHead(conn);
+        if (conn.headIn || conn.pendingLen == SWS_SLOT_BUFFER_SIZE) {
+            if (ready == nullptr) {
+                ready = &conn;
+                readyIx = i;
+            }
+        } else if (conn.pendingLen > 0) {
+            if (!conn.client.connected() && conn.client.available() == 0) {
+                closeConnection(conn);
+            } else if (millis() - conn.requestMillis >= SWS_REQUEST_MILLIS) {
+                Serial.printf("[run] Client in slot %d timed out before sending a whole request head. Closed.\n", i);
+                closeConnection(conn);
+            }
+        } else if (!conn.client.connected() || 
+            millis() - conn.lastActiveMillis > (conn.nRequests == 0 ? SWS_CLIENT_WAIT_MILLIS : SWS_KEEP_ALIVE_MILLIS)) {
+            closeConnection(conn);
+        }
+    }
+
+    // If no request is being read, start reading the one we found. Then read what's arrived of 
+    // the one being read and, if that's all of it, service it. Any other ready one waits its turn.
+    if (reader == nullptr && ready != nullptr) {
+        reader = ready;
+        ready = nullptr;
+        nextSlot = (readyIx + 1) % SWS_MAX_CONNECTIONS;
+        reader->state = swsSlotReading;
+        reader->part = swsInStartLine;
+        reader->expectedBodyLen = 0;
+        reader->requestMillis = reader->lastActiveMillis = millis();
+        #ifdef METRICS
+        readMicros = 0;
         #endif
+    }
+    if (reader != nullptr) {
+        #ifdef METRICS
+        uint32_t startMicros = micros();
+        #endif
+        swsReadStatus_t readStatus = readRequest(*reader, ready != nullptr);
+        #ifdef METRICS
+        readMicros += micros() - startMicros;
+        #endif
+        if (readStatus != swsReadMore) {
+            serviceRequest(*reader, readStatus);
+        }
+    }
+}
 
-        // Analyze the request
-        String reqMethod = getWord(clientMessageStartLine);         // The first word in the request is the HTTP method.
+/**
+ * requestsServed()
+ */
+uint32_t SimpleWebServer::requestsServed() {
+    return nServed;
+}
 
-        trPath = getWord(clientMessageStartLine, 1);                // The second word in the request is the "origin form" URI.
-        trQuery = "";                                               // From the URI, extract the query portion, if any.
-        int queryStart = trPath.indexOf("?");
-        if (queryStart != -1) {
-            trQuery = trPath.substring(queryStart + 1);
-            trPath = trPath.substring(0, queryStart);               // What remains is the path portion.
-        }
-        #ifdef SWS_DEBUG
-        Serial.printf("The request method is %s. The resource path is \"%s\" and the query is \"%s\".\n", 
-            reqMethod.c_str(), trPath.c_str(), trQuery.c_str());
-        #endif
+/**
+ * countSent()
+ */
+size_t SimpleWebServer::countSent(size_t n) {
+    #ifdef METRICS
+    swsSentBytes += n;
+    #endif
+    return n;
+}
 
-        // Find the methodHandler for the requested method and dispatch it to send the response message to the client.
-        for (uint8_t i = 0; i < SWS_METHOD_COUNT; i++) {
-            if (i == SWS_METHOD_COUNT - 1 || reqMethod.equals(swsMethodNames[i])) {
-                trMethod = (swsHttpMethod_t)i;
-                (*handlers[i])(this, &client, trPath, trQuery);
-                break;
+#ifdef METRICS
+/**
+ * printMetrics()
+ */
+void SimpleWebServer::printMetrics(Print* out, bool summary) {
+    char label[SWS_MAX_START_LINE_LEN + 16];
+    if (summary) {
+        parseMicros.printSummary(out, "Request read and parse", "us");
+        for (uint8_t i = 0; i <= nRoutes; i++) {
+            if (routeLabel(i, label, sizeof(label), summary)) {
+                swsRouteMetrics_t &rm = routeMetrics[i == nRoutes ? SWS_MAX_ROUTES : i];
+                rm.handlerMicros.printSummary(out, label, "us");
+                out->printf("%s: %lu bytes sent\n", label, (unsigned long)rm.sentBytes);
             }
         }
-        // That's it. We're done. Clean things up for when the next request comes.
-        client.stop();
-        clientMessageHeaders = "";
-        clientMessageStartLine = "";
-        trPath = "";
-        trQuery = "";
-        trMethod = swsBAD_REQ;
-        #ifdef SWS_DEBUG
-        Serial.print("Client disconnected.\n");
-        #endif
+        return;
+    }
+    out->print("# TYPE sws_parse_micros histogram\n");
+    parseMicros.print(out, "sws_parse_micros");
+    out->print("# TYPE sws_handler_micros histogram\n");
+    for (uint8_t i = 0; i <= nRoutes; i++) {
+        if (routeLabel(i, label, sizeof(label), summary)) {
+            routeMetrics[i == nRoutes ? SWS_MAX_ROUTES : i].handlerMicros.print(out, "sws_handler_micros", label);
+        }
+    }
+    out->print("# TYPE sws_sent_bytes counter\n");
+    for (uint8_t i = 0; i <= nRoutes; i++) {
+        if (routeLabel(i, label, sizeof(label), summary)) {
+            out->printf("sws_sent_bytes{%s} %lu\n", label, (unsigned long)routeMetrics[i == nRoutes ? SWS_MAX_ROUTES : i].sentBytes);
+        }
+    }
+}
+
+/**
+ * routeLabel()
+ */
+bool SimpleWebServer::routeLabel(uint8_t ix, char* label, size_t size, bool summary) {
+    if (routeMetrics[ix == nRoutes ? SWS_MAX_ROUTES : ix].handlerMicros.count() == 0) {
+        return false;                                       // Keep it short: only routes that were used
+    }
+    if (ix == nRoutes) {
+        snprintf(label, size, summary ? "other" : "route=\"other\"");
+    } else {
+        snprintf(label, size, summary ? "%s %s" : "route=\"%s %s\"", swsMethodNames[routes[ix].method], routes[ix].path);
+    }
+    return true;
+}
+#endif
+
+/**
+ * sendResponseHead()
+ */
+bool SimpleWebServer::sendResponseHead(WiFiClient* httpClient, uint16_t status, const char* reason, const char* contentType, 
+    long contentLength, const char* extraHeaders) {
+    bool noContent = status == 204 || status == 304;    // Responses that never have content
+    bool chunked = !noContent && contentLength == SWS_UNKNOWN_LENGTH && clientIsHttp11;
+    responseKeepsAlive = clientWantsKeepAlive && (noContent || contentLength != SWS_UNKNOWN_LENGTH || chunked);
+
+    swsBufferedPrint out {httpClient};
+    out.printf("HTTP/1.1 %u %s\r\n", status, reason);
+    if (contentType != nullptr) {
+        out.printf("Content-Type: %s\r\n", contentType);
+    }
+    if (contentLength != SWS_UNKNOWN_LENGTH && !noContent) {
+        out.printf("Content-Length: %ld\r\n", contentLength);
+    } else if (chunked) {
+        out.print("Transfer-Encoding: chunked\r\n");
+    }
+    if (extraHeaders != nullptr) {
+        out.print(extraHeaders);
+    }
+    if (responseKeepsAlive) {
+        out.printf("Connection: keep-alive\r\nKeep-Alive: timeout=%d\r\n\r\n", SWS_KEEP_ALIVE_MILLIS / 1000);
+    } else {
+        out.print("Connection: close\r\n\r\n");
     }
+    return chunked;
+}
+
+/**
+ * beginEventStream()
+ */
+bool SimpleWebServer::beginEventStream(WiFiClient* httpClient) {
+    uint8_t nStreams = 0;
+    for (uint8_t i = 0; i < SWS_MAX_CONNECTIONS; i++) {
+        if (connections[i].state == swsSlotEventStream) {
+            nStreams++;
+        }
+    }
+    if (nStreams >= SWS_MAX_EVENT_STREAMS) {
+        countSent(httpClient->print(swsUnavailableResponse));
+        return false;
+    }
+    countSent(httpClient->printf("HTTP/1.1 200 OK\r\n"
+                       "Content-Type: text/event-stream\r\n"
+                       "Cache-Control: no-store\r\n"
+                       "Connection: keep-alive\r\n\r\n"
+                       "retry: %d\n\n", SWS_EVENT_RETRY_MILLIS));
+    responseIsEventStream = true;
+    return true;
+}
+
+/**
+ * broadcastEvent()
+ */
+uint8_t SimpleWebServer::broadcastEvent(const char* event, const char* data) {
+    uint8_t nSent = 0;
+    for (uint8_t i = 0; i < SWS_MAX_CONNECTIONS; i++) {
+        swsConnection_t &conn = connections[i];
+        if (conn.state != swsSlotEventStream) {
+            continue;
+        }
+        size_t len = strlen(data) + 8 + (event == nullptr ? 0 : strlen(event) + 8);
+        if (!conn.client.connected() || printEvent(&conn.client, event, data) != len) {
+            closeConnection(conn);
+            continue;
+        }
+        conn.lastActiveMillis = millis();
+        nSent++;
+    }
+    return nSent;
+}
+
+/**
+ * printEvent()
+ */
+size_t SimpleWebServer::printEvent(Print* out, const char* event, const char* data) {
+    return event == nullptr ? out->printf("data: %s\n\n", data) : out->printf("event: %s\ndata: %s\n\n", event, data);
 }
 
 /**
@@ -129,253 +543,749 @@ swsHttpMethod_t SimpleWebServer::httpMethod() {
     return trMethod;
 }
 
+/**
+ * routeTag()
+ */
+uint8_t SimpleWebServer::routeTag() {
+    return trRouteTag;
+}
+
 /**
  * clientStartLine()
  */
 String SimpleWebServer::clientStartLine() {
-    return clientMessageStartLine;
+    return startLineView().toString();
+}
+
+/**
+ * startLineView()
+ */
+swsStringView SimpleWebServer::startLineView() {
+    return {requestBuffer, startLineLen};
 }
 
 /**
  * clientHeadrs() 
  */
 String SimpleWebServer::clientHeaders() {
-    return clientMessageHeaders;
+    // The header block was split up in place when it was indexed, so put it back together.
+    String answer;
+    answer.reserve(headersLen);
+    for (uint8_t i = 0; i < nHeaders; i++) {
+        answer += requestBuffer + headerFields[i].name;
+        answer += ": ";
+        answer += requestBuffer + headerFields[i].value;
+        answer += '\n';
+    }
+    return answer;
 }
 
 /**
  * clientBody()
  */
 String SimpleWebServer::clientBody() {
-    return clientMessageBody;
+    if (!bodyIsFormData) {
+        return bodyView().toString();
+    }
+    // Form data was split up and decoded in place when it was indexed, so put it back together.
+    String answer;
+    answer.reserve(bodyLen);
+    for (uint8_t i = 0; i < nFormData; i++) {
+        if (i != 0) {
+            answer += '&';
+        }
+        answer += requestBuffer + formFields[i].name;
+        answer += '=';
+        answer += requestBuffer + formFields[i].value;
+    }
+    return answer;
+}
+
+/**
+ * bodyView()
+ */
+swsStringView SimpleWebServer::bodyView() {
+    if (bodyIsFormData) {
+        return {nullptr, 0};
+    }
+    return {requestBuffer + SWS_BODY_START, bodyLen};
+}
+
+/**
+ * clientBodyText()
+ */
+const char* SimpleWebServer::clientBodyText() {
+    return bodyIsFormData ? nullptr : requestBuffer + SWS_BODY_START;
 }
 
 /**
  * getHeader()
  */
 String SimpleWebServer::getHeader(String headerName) {
-    unsigned int cursor = 0;
-    String answer = "";
-    while (cursor < clientMessageHeaders.length()) {
-        // cursor is the index of the first character of the current header line
-        int lineEndIx = clientMessageHeaders.indexOf("\n", cursor + headerName.length() + 1);
-        if (lineEndIx == -1) {
-            #ifdef SWS_DEBUG
-            Serial.printf("[getHeader] Header \"%s\" not found in\n",
-                headerName.c_str());
-            for (unsigned int i = 0; i < clientMessageHeaders.length(); i++) {
-                char c = clientMessageHeaders.charAt(i);
-                if (c <= ' ' || c == '%' || c > '~') {
-                    Serial.printf("%%%02x", (uint8_t)c);
-                } else {
-                    Serial.print(c);
-                }
-            }
-            Serial.print("\n");
-            #endif
-            break;
-        }
-        // lineEndIx is the index of the '\n' character at the end of the line
-        if (headerName.equalsIgnoreCase(clientMessageHeaders.substring(cursor, cursor + headerName.length()))) {
-            // answer is the value of the header named neaderName. (The +2 skips the ": " following the name)
-            answer = clientMessageHeaders.substring(cursor + headerName.length() + 2, lineEndIx);
-            break;
-        }
-        cursor = lineEndIx + 1;
+    const char* value = headerValue(headerName.c_str());
+    return value == nullptr ? String("") : String(value);
+}
+
+/**
+ * headerValue()
+ */
+const char* SimpleWebServer::headerValue(const char* headerName) {
+    const char* answer = findField(headerFields, headerSlots, SWS_HEADER_SLOTS, headerName, true);
+    #ifdef SWS_DEBUG
+    if (answer == nullptr) {
+        Serial.printf("[headerValue] Header \"%s\" not found.\n", headerName);
     }
+    #endif
     return answer;
 }
 
+/**
+ * headerCount()
+ */
+uint8_t SimpleWebServer::headerCount() {
+    return nHeaders;
+}
+
+/**
+ * headerNameAt()
+ */
+const char* SimpleWebServer::headerNameAt(uint8_t ix) {
+    return ix < nHeaders ? requestBuffer + headerFields[ix].name : nullptr;
+}
+
+/**
+ * headerValueAt()
+ */
+const char* SimpleWebServer::headerValueAt(uint8_t ix) {
+    return ix < nHeaders ? requestBuffer + headerFields[ix].value : nullptr;
+}
+
 /**
  * getFormDatum()
  */
 String SimpleWebServer::getFormDatum(String datumName) {
     // If the message body doesn't contain the right kind of data we won't find what's asked for
-    if (!getHeader(SWS_CONTENT_TYPE_HDR).equals(SWS_FORM_CONTENT_HDR)) {
+    if (!bodyIsFormData) {
         Serial.print("[getFormDatum] Message body not the right type to contain form data.\n");;
         return "";
     }
-    unsigned int cursor = 0;
-    String item;
-    String lookFor = datumName + "=";
-
-    // Go through the clientMessagebody
-    while (cursor < clientMessageBody.length()) {
-        // Get the next form data item
-        int ampIx = clientMessageBody.indexOf("&", cursor + 1);
-        if (ampIx == -1) {
-            item = clientMessageBody.substring(cursor);
-            cursor = clientMessageBody.length();
-        } else {
-            item = clientMessageBody.substring(cursor, ampIx);
-            cursor = ampIx + 1;
-        }
-        // Check this item to see if it's the one we're looking for
-        if (lookFor.equals(item.substring(0, lookFor.length()))) {
-            item = item.substring(lookFor.length());
-            // un-URLencode item
-            item.replace("+", " ");
-            int pctIx = item.indexOf('%');
-            while (pctIx != -1){
-                if (item.charAt(pctIx + 1) == '%') {
-                    // "%%" --> "%"
-                    item = item.substring(0, pctIx) + item.substring(pctIx + 1);
-                } else {
-                    // "%xx" -> hexStringToChar("xx")
-                    char converted = 0;
-                    for (uint8_t i = 0; i < 2; i++) {
-                        char c = item.charAt(pctIx + i + 1);
-                        converted *= 16;
-                        if (c >= '0' && c <= '9') {
-                            converted += c - '0';
-                        } else if (c >= 'A' && c <= 'F') {
-                            converted += c - 'A' + 10;
-                        } else if (c >= 'a' && c <= 'f') {
-                            converted += c - 'a' + 10;
-                        } else {
-                            Serial.printf("[getFormDatum] Bad URL encoding char '%c' ignored\n", c);
-                        }
-                    }
-                    item = item.substring(0, pctIx) + String(converted) + item.substring(pctIx + 3);
-                }
-                pctIx = item.indexOf('%');
-            }
-            #ifdef SWS_DEBUG
-            Serial.printf("[getFormDatum] Found form datum \"%s\". Value is \"%s\".\n", 
-                datumName.c_str(), item.c_str());
-            #endif
-            return item;
-        }
-    }
+    const char* value = formDatumValue(datumName.c_str());
+    return value == nullptr ? String("") : String(value);
+}
+
+/**
+ * formDatumValue()
+ */
+const char* SimpleWebServer::formDatumValue(const char* datumName) {
+    const char* answer = bodyIsFormData ? findField(formFields, formSlots, SWS_FORM_DATA_SLOTS, datumName, false) : nullptr;
     #ifdef SWS_DEBUG
-    Serial.printf("[getFormDatum] Couldn't find a form datum named \"%s\".\n", datumName.c_str());
+    if (answer == nullptr) {
+        Serial.printf("[formDatumValue] Couldn't find a form datum named \"%s\".\n", datumName);
+    } else {
+        Serial.printf("[formDatumValue] Found form datum \"%s\". Value is \"%s\".\n", datumName, answer);
+    }
     #endif
-    return "";
+    return answer;
+}
+
+/**
+ * formDataCount()
+ */
+uint8_t SimpleWebServer::formDataCount() {
+    return nFormData;
+}
+
+/**
+ * formDatumNameAt()
+ */
+const char* SimpleWebServer::formDatumNameAt(uint8_t ix) {
+    return ix < nFormData ? requestBuffer + formFields[ix].name : nullptr;
+}
+
+/**
+ * formDatumValueAt()
+ */
+const char* SimpleWebServer::formDatumValueAt(uint8_t ix) {
+    return ix < nFormData ? requestBuffer + formFields[ix].value : nullptr;
 }
 
 /**
  * getWord()
  */
 String SimpleWebServer::getWord(String source, uint8_t ix) {
-    int16_t startAt = 0;
-    int16_t len = source.length();
-    String answer = "";
-    for (int16_t i = 0; i < ix; i++){
-        while (startAt < len && source.charAt(startAt) == ' ') {
+    return wordView({source.c_str(), (uint16_t)source.length()}, ix).toString();
+}
+
+/**
+ * wordView()
+ */
+swsStringView SimpleWebServer::wordView(swsStringView source, uint8_t ix) {
+    uint16_t startAt = 0;
+    for (uint8_t i = 0; i < ix; i++) {
+        while (startAt < source.len && source.ptr[startAt] == ' ') {
             startAt++;
         }
-        while (startAt < len && source.charAt(startAt) != ' ') {
+        while (startAt < source.len && source.ptr[startAt] != ' ') {
             startAt++;
         }
     }
-    while (startAt < len && source.charAt(startAt) == ' ') {
+    while (startAt < source.len && source.ptr[startAt] == ' ') {
         startAt++;
     }
-    while (startAt < len && source.charAt(startAt) != ' ') {
-        answer += source.charAt(startAt++);
+    uint16_t endAt = startAt;
+    while (endAt < source.len && source.ptr[endAt] != ' ') {
+        endAt++;
+    }
+    return {source.ptr + startAt, (uint16_t)(endAt - startAt)};
+}
+
+/**
+ * sendTemplate()
+ */
+void SimpleWebServer::sendTemplate(WiFiClient* httpClient, PGM_P tmpl, swsTemplateVarHandler varHandler, bool chunked) {
+    swsBufferedPrint out {httpClient, chunked};
+    char varName[SWS_TEMPLATE_VAR_MAX_LEN + 1];
+    size_t ix = 0;
+    char c = pgm_read_byte(tmpl);
+    while (c != '\0') {
+        if (c != '@') {
+            out.write(c);
+            c = pgm_read_byte(tmpl + ++ix);
+            continue;
+        }
+        // Collect the name of the variable that starts here.
+        size_t nameLen = 0;
+        c = pgm_read_byte(tmpl + ++ix);
+        while (isalnum(c) && nameLen <= SWS_TEMPLATE_VAR_MAX_LEN) {
+            if (nameLen < SWS_TEMPLATE_VAR_MAX_LEN) {
+                varName[nameLen] = c;
+            }
+            nameLen++;
+            c = pgm_read_byte(tmpl + ++ix);
+        }
+        if (nameLen == 0 || nameLen > SWS_TEMPLATE_VAR_MAX_LEN) {
+            // Not a variable after all; send the "@" and let the loop send the rest as-is.
+            #ifdef SWS_DEBUG
+            if (nameLen > SWS_TEMPLATE_VAR_MAX_LEN) {
+                Serial.print("[sendTemplate] Variable name too long. Sent as-is.\n");
+            }
+            #endif
+            ix -= nameLen;
+            c = pgm_read_byte(tmpl + ix);
+            out.write('@');
+            continue;
+        }
+        varName[nameLen] = '\0';
+        (*varHandler)(&out, varName);
     }
-    return answer;
 }
 
 // Private member functions
 
 /**
- * getClientMessage()
+ * serviceRequest()
  */
-void SimpleWebServer::getClientMessage(WiFiClient* client) {
-    unsigned long curMillis = millis();
-    unsigned long lastMillis = curMillis;
+void SimpleWebServer::serviceRequest(swsConnection_t &conn, swsReadStatus_t readStatus) {
+    WiFiClient* client = &conn.client;
+    #ifdef METRICS
+    uint32_t startMicros = micros();
+    #endif
+    reader = nullptr;
+    conn.state = swsSlotIdle;
 
+    // If the request was too big for us, say so and be done.
+    if (readStatus == swsStartLineTooLong || readStatus == swsHeadersTooLong || readStatus == swsBodyTooLong) {
+        countSent(client->print(readStatus == swsStartLineTooLong ? swsUriTooLongResponse : 
+            readStatus == swsHeadersTooLong ? swsHeadersTooLargeResponse : swsPayloadTooLargeResponse));
+        closeConnection(conn);
+        clearClientMessage();
+        nServed++;
+        return;
+    }
     #ifdef SWS_DEBUG
-    Serial.print("[getMessage] Getting start-line\n");
+    Serial.print("Got this request:\n");
+    Serial.print(requestBuffer);
     #endif
 
-    // Get the start-line from the message. It's the first line.
-    clientMessageStartLine = "";
-    while (client->connected() && curMillis - lastMillis < SWS_CLIENT_WAIT_MILLIS) {
-        if (client->available()) {
-            char c = client->read();
-            if (c != '\r') {
-                if (c != '\n') {
-                    clientMessageStartLine += c;
-                    lastMillis = curMillis;
-                } else {
-                    break;
-                }
-            }
+    // Analyze the request. The start-line is "<method> <request-target> <HTTP-version>"; the 
+    // request-target is in "origin form," i.e., the path, optionally followed by "?" and the query.
+    const char* method = requestBuffer;
+    const char* methodEnd = method + strcspn(method, " ");
+    const char* target = *methodEnd == ' ' ? methodEnd + 1 : methodEnd;
+    const char* targetEnd = target + strcspn(target, " ");
+    const char* version = *targetEnd == ' ' ? targetEnd + 1 : targetEnd;
+    const char* queryStart = (const char*)memchr(target, '?', targetEnd - target);
+    if (queryStart == nullptr) {
+        trPath = {target, (uint16_t)(targetEnd - target)};
+        trQuery = {targetEnd, 0};
+    } else {
+        trPath = {target, (uint16_t)(queryStart - target)};
+        trQuery = {queryStart + 1, (uint16_t)(targetEnd - queryStart - 1)};
+    }
+    trMethod = swsBAD_REQ;
+    for (uint8_t i = 0; i < SWS_METHOD_COUNT - 1; i++) {
+        swsStringView methodView = {method, (uint16_t)(methodEnd - method)};
+        if (methodView.equals(swsMethodNames[i])) {
+            trMethod = (swsHttpMethod_t)i;
+            break;
         }
     }
     #ifdef SWS_DEBUG
-    Serial.printf("[getMessage] Got start-line: \"%s\"\n", clientMessageStartLine.c_str());
+    Serial.printf("The request method is %.*s. The resource path is \"%.*s\" and the query is \"%.*s\".\n", 
+        (int)(methodEnd - method), method, (int)trPath.len, trPath.ptr, (int)trQuery.len, trQuery.ptr);
     #endif
-    
-    // Get the HTTP Headers from the message. The end of these is marked by a blank line
-    lastMillis = curMillis = millis();
-    clientMessageHeaders = "";
-    while(client->connected() && curMillis - lastMillis < SWS_CLIENT_WAIT_MILLIS) {
-        curMillis = millis();
-        if (client->available()) {
-            char c = client->read();
-            if (c != '\r') {    // Ignore <CR> chars
-                if (c == '\n' && clientMessageHeaders.charAt(clientMessageHeaders.length() - 1) == '\n') {
-                    break;
+
+    // HTTP/1.1 clients keep the connection unless they say otherwise; HTTP/1.0 ones only if they ask.
+    const char* connectionHdr = headerValue("Connection");
+    clientIsHttp11 = strcmp(version, "HTTP/1.1") == 0;
+    clientWantsKeepAlive = readStatus == swsReadOK && conn.nRequests + 1 < SWS_MAX_KEEP_ALIVE_REQUESTS && 
+        (clientIsHttp11 ? !headerHasToken(connectionHdr, "close") : headerHasToken(connectionHdr, "keep-alive"));
+    responseKeepsAlive = false;
+
+    // If there's a route for the method and path, dispatch its routeHandler. Otherwise dispatch the 
+    // methodHandler for the method. Either way, it sends the response message to the client.
+    int8_t routeIx = trMethod == swsBAD_REQ ? -1 : findRoute(trMethod, trPath.ptr, trPath.len);
+    #ifdef METRICS
+    uint32_t handlerMicros = micros();
+    uint32_t sentBefore = swsSentBytes;
+    parseMicros.record(readMicros + handlerMicros - startMicros);
+    #endif
+    if (routeIx >= 0) {
+        trRouteTag = routes[routeIx].tag;
+        (*routes[routeIx].handler)(this, client, trPath, trQuery);
+    } else {
+        (*handlers[trMethod])(this, client, trPath, trQuery);
+    }
+    #ifdef METRICS
+    swsRouteMetrics_t &rm = routeMetrics[routeIx >= 0 ? routeIx : SWS_MAX_ROUTES];
+    rm.handlerMicros.record(micros() - handlerMicros);
+    rm.sentBytes += swsSentBytes - sentBefore;
+    #endif
+
+    // That's it. We're done. Keep the connection if we can, and clean things up for the next request.
+    conn.nRequests++;
+    nServed++;
+    conn.lastActiveMillis = millis();
+    if (responseIsEventStream && conn.client.connected()) {
+        conn.state = swsSlotEventStream;
+        #ifdef SWS_DEBUG
+        Serial.printf("[serviceRequest] Connection in slot %d is now an event stream.\n", (int)(&conn - connections));
+        #endif
+    } else if (!(clientWantsKeepAlive && responseKeepsAlive && conn.client.connected())) {
+        closeConnection(conn);
+    }
+    clearClientMessage();
+    trPath = trQuery = {"", 0};
+    trMethod = swsBAD_REQ;
+    trRouteTag = 0;
+    clientIsHttp11 = clientWantsKeepAlive = responseKeepsAlive = responseIsEventStream = false;
+}
+
+/**
+ * closeConnection()
+ */
+void SimpleWebServer::closeConnection(swsConnection_t &conn) {
+    conn.client.stop();
+    conn.state = swsSlotFree;
+    #ifdef SWS_DEBUG
+    Serial.printf("[closeConnection] Client in slot %d disconnected.\n", (int)(&conn - connections));
+    #endif
+}
+
+/**
+ * readRequest()
+ */
+swsReadStatus_t SimpleWebServer::readRequest(swsConnection_t &conn, bool othersWaiting) {
+    WiFiClient* client = &conn.client;
+    char* headers = requestBuffer + SWS_HEADERS_START;
+    char* body = requestBuffer + SWS_BODY_START;
+    swsReadStatus_t status = swsReadMore;
+
+    #ifdef SWS_DEBUG
+    Serial.printf("[readRequest] Reading request message in slot %d\n", (int)(&conn - connections));
+    #endif
+
+    // First what the connection collected, then what's arrived since, but no more.
+    if (conn.pendingLen > 0) {
+        uint16_t pendingLen = conn.pendingLen;
+        conn.pendingLen = conn.scannedLen = 0;
+        conn.headIn = false;
+        status = sortChunk(conn, conn.pending, pendingLen);
+    }
+    int avail = client->available();
+    while (status == swsReadMore && avail > 0) {
+        int n;
+        if (conn.part == swsInBody) {
+            // The body is read straight into place; we know exactly how much of it there should be.
+            n = client->read((uint8_t*)body + bodyLen, min(avail, conn.expectedBodyLen - bodyLen));
+            if (n > 0) {
+                bodyLen += n;
+                if (bodyLen == conn.expectedBodyLen) {
+                    status = swsReadOK;
                 }
-                clientMessageHeaders += c;
-                lastMillis = curMillis;
             }
+        } else {
+            // The start-line and headers are read a chunk at a time and sorted out as we go.
+            uint8_t chunk[SWS_READ_CHUNK_SIZE];
+            n = client->read(chunk, avail < SWS_READ_CHUNK_SIZE ? avail : SWS_READ_CHUNK_SIZE);
+            if (n > 0) {
+                status = sortChunk(conn, chunk, n);
+            }
+        }
+        if (n <= 0) {
+            break;
         }
+        avail -= n;
+        conn.lastActiveMillis = millis();
     }
+    if (status == swsReadMore) {
+        // Don't hold requestBuffer for a client that's gone quiet if someone else could use it.
+        bool stalled = othersWaiting && millis() - conn.lastActiveMillis >= SWS_READ_IDLE_MILLIS;
+        if (!stalled && millis() - conn.requestMillis < SWS_REQUEST_MILLIS && 
+            (client->connected() || client->available() > 0)) {
+            return swsReadMore;
+        }
+        status = swsReadTimedOut;
+    }
+
+    if (status != swsReadOK) {
+        if (status == swsReadTimedOut) {
+            requestBuffer[startLineLen] = headers[headersLen] = '\0';
+            Serial.print("[readRequest] Client timed out before we all data recieved.\n");
+            Serial.printf("Start-line: \"%s\"\n", requestBuffer);
+            Serial.printf("Headers: \"%s\"\n", headers);
+            Serial.printf("Message body: \"%.*s\"\n", bodyLen, body);
+        } else {
+            Serial.printf("[readRequest] Client request too large (status %d). Refused.\n", status);
+        }
+        clearClientMessage();
+        return status;
+    }
+    body[bodyLen] = '\0';
     #ifdef SWS_DEBUG
-    Serial.printf("[getMessage] Got headers: \"%s\"\n", clientMessageHeaders.c_str());
+    if (bodyLen > 0) {
+        Serial.printf("[readRequest] Got message body: \"%s\"\n", body);
+    } else {
+        Serial.print("[readRequest] No message body present.\n");
+    }
     #endif
 
-    // Get the message body, if any. Gotten as-is, no '\r' removal.
-    int bodyLength = getHeader(SWS_CONTENT_LENGTH_HDR).toInt();
-    clientMessageBody = "";
-    int charsRead = 0;
-    while(client->connected() && charsRead < bodyLength && curMillis - lastMillis < SWS_CLIENT_WAIT_MILLIS) {
-        curMillis = millis();
-        if (client->available()) {
-            clientMessageBody += (char)client->read();
-            charsRead++;
-            lastMillis = curMillis;
+    // If the body is form data, index it too.
+    const char* contentType = headerValue(SWS_CONTENT_TYPE_HDR);
+    if (contentType != nullptr && strncasecmp(contentType, SWS_FORM_CONTENT_HDR, strlen(SWS_FORM_CONTENT_HDR)) == 0) {
+        indexFormData();
+    }
+    return status;
+}
+
+/**
+ * sortChunk()
+ */
+swsReadStatus_t SimpleWebServer::sortChunk(swsConnection_t &conn, const uint8_t* chunk, uint16_t len) {
+    char* headers = requestBuffer + SWS_HEADERS_START;
+    char* body = requestBuffer + SWS_BODY_START;
+    for (uint16_t i = 0; i < len; i++) {
+        char c = chunk[i];
+        bool ended = false;
+        if (conn.part == swsInBody) {
+            // Whatever came in the same chunk as the end of the headers is the start of the body.
+            body[bodyLen++] = c;
+            ended = bodyLen == conn.expectedBodyLen;
+        } else if (c == '\r') {
+            // Ignore <CR> chars
+        } else if (conn.part == swsInStartLine) {
+            if (c == '\n') {
+                requestBuffer[startLineLen] = '\0';
+                conn.part = swsInHeaders;
+                #ifdef SWS_DEBUG
+                Serial.printf("[sortChunk] Got start-line: \"%s\"\n", requestBuffer);
+                #endif
+            } else if (startLineLen == SWS_MAX_START_LINE_LEN) {
+                return swsStartLineTooLong;
+            } else {
+                requestBuffer[startLineLen++] = c;
+            }
+        } else if (c == '\n' && (headersLen == 0 || headers[headersLen - 1] == '\n')) {
+            // The end of the HTTP Headers is marked by a blank line. After them is the body, if any.
+            headers[headersLen] = '\0';
+            #ifdef SWS_DEBUG
+            Serial.printf("[sortChunk] Got headers: \"%s\"\n", headers);
+            #endif
+            indexHeaders();
+            const char* contentLength = headerValue(SWS_CONTENT_LENGTH_HDR);
+            long expectedBodyLen = contentLength == nullptr ? 0 : atol(contentLength);
+            if (expectedBodyLen > SWS_MAX_BODY_LEN) {
+                return swsBodyTooLong;
+            }
+            conn.expectedBodyLen = expectedBodyLen <= 0 ? 0 : expectedBodyLen;
+            conn.part = swsInBody;
+            ended = conn.expectedBodyLen == 0;
+        } else if (headersLen == SWS_MAX_HEADERS_LEN) {
+            return swsHeadersTooLong;
+        } else {
+            headers[headersLen++] = c;
+        }
+        if (ended) {
+            // Keep whatever's left for the connection's next request.
+            conn.pendingLen = len - i - 1;
+            memmove(conn.pending, chunk + i + 1, conn.pendingLen);
+            if (conn.pendingLen > 0) {
+                conn.requestMillis = millis();
+            }
+            return swsReadOK;
+        }
+    }
+    return swsReadMore;
+}
+
+/**
+ * collectHead()
+ */
+void SimpleWebServer::collectHead(swsConnection_t &conn) {
+    if (!conn.headIn && conn.pendingLen < SWS_SLOT_BUFFER_SIZE) {
+        int avail = conn.client.available();
+        if (avail > 0) {
+            int n = conn.client.read(conn.pending + conn.pendingLen, min(avail, SWS_SLOT_BUFFER_SIZE - conn.pendingLen));
+            if (n > 0) {
+                if (conn.pendingLen == 0) {
+                    conn.requestMillis = millis();
+                }
+                conn.pendingLen += n;
+                conn.lastActiveMillis = millis();
+            }
+        }
+    }
+
+    // Look for the blank line, backing up a little in case it began in what was looked at last time.
+    for (uint16_t i = conn.scannedLen < 2 ? 0 : conn.scannedLen - 2; !conn.headIn && i + 1 < conn.pendingLen; i++) {
+        if (conn.pending[i] == '\n') {
+            conn.headIn = conn.pending[i + 1] == '\n' || 
+                (conn.pending[i + 1] == '\r' && i + 2 < conn.pendingLen && conn.pending[i + 2] == '\n');
         }
     }
     #ifdef SWS_DEBUG
-    if (bodyLength > 0) {
-        Serial.printf("[getMessage] Got message body: \"%s\"\n", clientMessageBody.c_str());
-    } else {
-        Serial.print("[getMessage] No message body present.\n");
+    if (conn.headIn && conn.scannedLen != conn.pendingLen) {
+        Serial.printf("[collectHead] Request head is in on slot %d.\n", (int)(&conn - connections));
     }
     #endif
-    if (curMillis - lastMillis >= SWS_CLIENT_WAIT_MILLIS) {
-        Serial.print("[getMessage] Client timed out before we all data recieved.\n");
-        Serial.printf("Start-line: \"%s\"\n", clientMessageStartLine.c_str());
-        Serial.printf("Headers: \"%s\"\n", clientMessageHeaders.c_str());
-        Serial.printf("Message body: \"%s\"\n", clientMessageBody.c_str());
-        clientMessageStartLine = "";
-        clientMessageHeaders = "";
-        clientMessageBody = "";
+    conn.scannedLen = conn.pendingLen;
+}
+
+/**
+ * clearClientMessage()
+ */
+void SimpleWebServer::clearClientMessage() {
+    startLineLen = headersLen = bodyLen = 0;
+    requestBuffer[0] = requestBuffer[SWS_HEADERS_START] = requestBuffer[SWS_BODY_START] = '\0';
+    nHeaders = nFormData = 0;
+    memset(headerSlots, 0, sizeof(headerSlots));
+    memset(formSlots, 0, sizeof(formSlots));
+    bodyIsFormData = false;
+}
+
+/**
+ * indexHeaders()
+ */
+void SimpleWebServer::indexHeaders() {
+    char* line = requestBuffer + SWS_HEADERS_START;
+    char* headersEnd = line + headersLen;
+    while (line < headersEnd) {
+        // line points to the first character of the current header line. Find its end and the ':' 
+        // separating the name from the value.
+        char* lineEnd = (char*)memchr(line, '\n', headersEnd - line);
+        if (lineEnd == nullptr) {
+            lineEnd = headersEnd;
+        }
+        *lineEnd = '\0';
+        char* colon = (char*)memchr(line, ':', lineEnd - line);
+        if (colon != nullptr && colon != line) {
+            *colon = '\0';
+            char* value = colon + 1;
+            while (*value == ' ' || *value == '\t') {
+                value++;
+            }
+            char* valueEnd = lineEnd;
+            while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')) {
+                *--valueEnd = '\0';
+            }
+            if (!addField(headerFields, nHeaders, SWS_MAX_HEADER_COUNT, headerSlots, SWS_HEADER_SLOTS, 
+                line - requestBuffer, value - requestBuffer, true)) {
+                Serial.print("[indexHeaders] Too many headers. The rest are ignored.\n");
+                return;
+            }
+        }
+        line = lineEnd + 1;
+    }
+}
+
+/**
+ * indexFormData()
+ */
+void SimpleWebServer::indexFormData() {
+    char* item = requestBuffer + SWS_BODY_START;
+    char* bodyEnd = item + bodyLen;
+    bodyIsFormData = true;
+    while (item < bodyEnd) {
+        // Split off the current item and, within it, the name from the value.
+        char* itemEnd = (char*)memchr(item, '&', bodyEnd - item);
+        if (itemEnd == nullptr) {
+            itemEnd = bodyEnd;
+        }
+        *itemEnd = '\0';
+        if (itemEnd != item) {
+            char* value = (char*)memchr(item, '=', itemEnd - item);
+            if (value == nullptr) {
+                value = itemEnd;            // No "=": the value is ""
+            } else {
+                *value++ = '\0';
+            }
+            urlDecodeInPlace(item);
+            urlDecodeInPlace(value);
+            if (!addField(formFields, nFormData, SWS_MAX_FORM_DATA_COUNT, formSlots, SWS_FORM_DATA_SLOTS, 
+                item - requestBuffer, value - requestBuffer, false)) {
+                Serial.print("[indexFormData] Too many form data items. The rest are ignored.\n");
+                return;
+            }
+        }
+        item = itemEnd + 1;
+    }
+}
+
+/**
+ * addField()
+ */
+bool SimpleWebServer::addField(swsField_t* fields, uint8_t &nFields, uint8_t maxFields, uint8_t* slots, uint8_t nSlots, 
+    uint16_t nameOffset, uint16_t valueOffset, bool ignoreCase) {
+    if (nFields == maxFields) {
+        return false;
+    }
+    const char* name = requestBuffer + nameOffset;
+    uint16_t hash = hashName(name, ignoreCase);
+    fields[nFields] = {nameOffset, valueOffset, hash};
+    nFields++;
+
+    // Put it in the hash table unless there's already a field with the same name there.
+    uint8_t slot = hash & (nSlots - 1);
+    while (slots[slot] != 0) {
+        swsField_t &f = fields[slots[slot] - 1];
+        if (f.hash == hash && (ignoreCase ? strcasecmp(requestBuffer + f.name, name) : strcmp(requestBuffer + f.name, name)) == 0) {
+            return true;
+        }
+        slot = (slot + 1) & (nSlots - 1);
+    }
+    slots[slot] = nFields;
+    return true;
+}
+
+/**
+ * findField()
+ */
+const char* SimpleWebServer::findField(swsField_t* fields, uint8_t* slots, uint8_t nSlots, const char* name, bool ignoreCase) {
+    uint16_t hash = hashName(name, ignoreCase);
+    uint8_t slot = hash & (nSlots - 1);
+    while (slots[slot] != 0) {
+        swsField_t &f = fields[slots[slot] - 1];
+        if (f.hash == hash && (ignoreCase ? strcasecmp(requestBuffer + f.name, name) : strcmp(requestBuffer + f.name, name)) == 0) {
+            return requestBuffer + f.value;
+        }
+        slot = (slot + 1) & (nSlots - 1);
+    }
+    return nullptr;
+}
+
+/**
+ * hashName()
+ */
+uint16_t SimpleWebServer::hashName(const char* name, bool ignoreCase) {
+    uint32_t hash = 2166136261UL;
+    for (const char* p = name; *p != '\0'; p++) {
+        hash ^= (uint8_t)(ignoreCase ? tolower(*p) : *p);
+        hash *= 16777619UL;
+    }
+    return (uint16_t)(hash ^ (hash >> 16));
+}
+
+/**
+ * hashRoute()
+ */
+uint16_t SimpleWebServer::hashRoute(uint8_t method, const char* path, uint16_t len) {
+    uint32_t hash = (2166136261UL ^ method) * 16777619UL;
+    for (uint16_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)path[i];
+        hash *= 16777619UL;
+    }
+    return (uint16_t)(hash ^ (hash >> 16));
+}
+
+/**
+ * findRoute()
+ */
+int8_t SimpleWebServer::findRoute(uint8_t method, const char* path, uint16_t len) {
+    uint16_t hash = hashRoute(method, path, len);
+    uint8_t slot = hash & (SWS_ROUTE_SLOTS - 1);
+    while (routeSlots[slot] != 0) {
+        swsRoute_t &r = routes[routeSlots[slot] - 1];
+        if (r.hash == hash && r.method == method && r.pathLen == len && memcmp(r.path, path, len) == 0) {
+            return routeSlots[slot] - 1;
+        }
+        slot = (slot + 1) & (SWS_ROUTE_SLOTS - 1);
+    }
+    return -1;
+}
+
+/**
+ * urlDecodeInPlace()
+ */
+void SimpleWebServer::urlDecodeInPlace(char* text) {
+    char* out = text;
+    for (char* p = text; *p != '\0'; p++) {
+        if (*p == '+') {
+            *out++ = ' ';
+        } else if (*p == '%' && p[1] == '%') {
+            // "%%" --> "%"
+            *out++ = '%';
+            p++;
+        } else if (*p == '%') {
+            // "%xx" -> hexStringToChar("xx")
+            char converted = 0;
+            for (uint8_t i = 0; i < 2 && p[1] != '\0'; i++) {
+                char c = *++p;
+                converted *= 16;
+                if (c >= '0' && c <= '9') {
+                    converted += c - '0';
+                } else if (c >= 'A' && c <= 'F') {
+                    converted += c - 'A' + 10;
+                } else if (c >= 'a' && c <= 'f') {
+                    converted += c - 'a' + 10;
+                } else {
+                    Serial.printf("[urlDecodeInPlace] Bad URL encoding char '%c' ignored\n", c);
+                }
+            }
+            *out++ = converted;
+        } else {
+            *out++ = *p;
+        }
     }
+    *out = '\0';
 }
 
 /**
  * defaultGetAndHeadHandler()
  */
-void SimpleWebServer::defaultGetAndHeadHandler(SimpleWebServer* server, WiFiClient* httpClient, String path, String query) {
-    httpClient->print(swsNotFoundResponse);
+void SimpleWebServer::defaultGetAndHeadHandler(SimpleWebServer* server, WiFiClient* httpClient, swsStringView path, swsStringView query) {
+    server->countSent(httpClient->print(swsNotFoundResponse));
 }
 
 /**
  * defaultUnimplementedHandler()
  */
-void SimpleWebServer::defaultUnimplementedHandler(SimpleWebServer* server, WiFiClient* httpClient, String path, String query) {
-    httpClient->print(swsNotImplementedResponse);
+void SimpleWebServer::defaultUnimplementedHandler(SimpleWebServer* server, WiFiClient* httpClient, swsStringView path, swsStringView query) {
+    server->countSent(httpClient->print(swsNotImplementedResponse));
 }
 
 /**
  * defaultBadHandler
  */
-void SimpleWebServer::defaultBadHandler(SimpleWebServer* server, WiFiClient* httpClient, String path, String query) {
-    httpClient->print(swsBadRequestResponse);
+void SimpleWebServer::defaultBadHandler(SimpleWebServer* server, WiFiClient* httpClient, swsStringView path, swsStringView query) {
+    server->countSent(httpClient->print(swsBadRequestResponse));
 }
\ No newline at end of file
@@ -16,10 +16,34 @@
  * responsible for two things 1) assembling the message that is the SimleWebServer's response to 
  * the request and 2) the sending the assembled message to the client.
  * 
+ * A sketch that serves more than a page or two can, in addition, attach routeHandlers for 
+ * particular (method, path) pairs using attachRoute(). The routes are kept in a hash table, so 
+ * finding the one for a request costs the same however many there are. A request for which 
+ * there's a route goes to its routeHandler; any other request goes to the methodHandler for its 
+ * method, which typically just says "404 Not Found."
+ * 
+ * A handler can also turn the connection its request came in on into an "event stream" (see 
+ * beginEventStream()). The connection is then kept open, and whatever the sketch later sends 
+ * using broadcastEvent() is pushed to the client as a Server-Sent Event. That lets a page see 
+ * changes as they happen without polling for them.
+ * 
  * With the handlers attached, the SimpleWebServer is ready to go.
  * 
  * As the sketch runs, it should call the SimpleWebServer's run() member function often. Calling 
- * run() lets the SimpleWebServer do its thing.
+ * run() lets the SimpleWebServer do its thing. The SimpleWebServer keeps a small pool of 
+ * connections (SWS_MAX_CONNECTIONS of them). Each call to run() accepts any newly arrived clients, 
+ * collects whatever has arrived of each connection's request and, once one's all there, services 
+ * it. It never waits for a client: a request that's slow to arrive is taken in a bit at a time 
+ * over many calls, and one that isn't all there within SWS_REQUEST_MILLIS is given up on. Each 
+ * connection gathers the start-line and headers of its request in a small buffer of its own, so a 
+ * slow client doesn't hold up the others. But there's only room to sort out and service one 
+ * request at a time, so the connections whose request heads are in take turns at that, in 
+ * rotation. A request that stalls on its turn for SWS_READ_IDLE_MILLIS while another is waiting 
+ * is given up on too. Connections whose clients 
+ * ask for it (HTTP/1.1 clients do by default) are kept open for further requests until they've 
+ * been idle for SWS_KEEP_ALIVE_MILLIS. For that to work, the response has to say how long it is 
+ * (or be sent chunked); methodHandlers that use sendResponseHead() get that taken care of. 
+ * Responses sent any other way, e.g., using the ready-made responses below, close the connection.
  * 
  * For example, suppose the sketch only wants to serve pages. In that case it need only attach 
  * two methodHandlers, one for the GET method and one for the HEAD method. (A conforming web 
@@ -34,6 +58,13 @@
  * messageHandler support facilities. See the definition of the messageHandler type, below for 
  * more details.
  * 
+ * One of these facilities is sendTemplate(). It sends a page described by a template held in 
+ * PROGMEM. The template is the literal text of the page in which each variable portion is marked 
+ * by a name beginning with "@", e.g., "The outlet is @outletIs." As sendTemplate() walks through 
+ * the template it sends the literal text to the client and, for each variable, calls a sketch-
+ * supplied function to print the variable's current value. Nothing but a small, fixed-size 
+ * buffer is needed no matter how big the page is.
+ * 
  *****
  * 
  * Copyright (C) 2023 D.L. Ehnebuske
@@ -65,15 +96,44 @@
 #ifndef ESP8266WiFi_h
 #include <ESP8266WiFi.h>
 #endif
+#ifdef METRICS
+#include <Metrics.h>
+#endif
 
 /*
  * Miscellaneous constants
  */
 //#define SWS_DEBUG                                       // Uncomment to enable debug printing.
 #define SWS_CLIENT_WAIT_MILLIS      (10000)             // Maximum millis() to wait for client.
+#define SWS_REQUEST_MILLIS          (2000)              // Max millis() to collect a request's head, and to read it in on its turn
+#define SWS_READ_IDLE_MILLIS        (250)               // Max millis() a request may stall on its turn while another waits
+#define SWS_MAX_CONNECTIONS         (4)                 // Number of client connections serviced at once
+#define SWS_KEEP_ALIVE_MILLIS       (5000)              // millis() a kept-alive connection may be idle before we close it
+#define SWS_MAX_KEEP_ALIVE_REQUESTS (100)               // Max requests on one connection before we close it
+#define SWS_UNKNOWN_LENGTH          (-1)                // For sendResponseHead(): content length isn't known in advance
 #define SWS_CONTENT_LENGTH_HDR      "Content-length"    // Name of the HTTP Content-length header
 #define SWS_CONTENT_TYPE_HDR        "Content-Type"      // Name of the HTTP Content-type header
 #define SWS_FORM_CONTENT_HDR        "application/x-www-form-urlencoded" // The kind of data a form POST contains
+#define SWS_OUT_BUFFER_SIZE         (512)               // Size of the buffer swsBufferedPrint collects output in
+#define SWS_READ_CHUNK_SIZE         (128)               // Max bytes readRequest() reads from the client at a time
+#define SWS_SLOT_BUFFER_SIZE        (640)               // Size of the buffer each connection collects its request head in
+#define SWS_MAX_START_LINE_LEN      (256)               // Max length of a request's start-line
+#define SWS_MAX_HEADERS_LEN         (1024)              // Max length of a request's header block
+#define SWS_MAX_BODY_LEN            (4096)              // Max length of a request's message body
+#define SWS_MAX_HEADER_COUNT        (24)                // Max number of headers in a request that are indexed
+#define SWS_HEADER_SLOTS            (32)                // Header hash table slots. Power of 2 > SWS_MAX_HEADER_COUNT
+#define SWS_MAX_FORM_DATA_COUNT     (48)                // Max number of form data items in a request that are indexed
+#define SWS_FORM_DATA_SLOTS         (64)                // Form data hash table slots. Power of 2 > SWS_MAX_FORM_DATA_COUNT
+#define SWS_HEADERS_START           (SWS_MAX_START_LINE_LEN + 1)                // Where the headers go in requestBuffer
+#define SWS_BODY_START              (SWS_HEADERS_START + SWS_MAX_HEADERS_LEN + 1)   // Where the body goes in requestBuffer
+#define SWS_REQ_BUFFER_SIZE         (SWS_BODY_START + SWS_MAX_BODY_LEN + 1)     // Size of requestBuffer
+#define SWS_TEMPLATE_VAR_MAX_LEN    (16)                // Maximum length of a template variable name (without the "@")
+#define SWS_MAX_ROUTES              (48)                // Max number of (method, path) routes that can be attached
+#define SWS_ROUTE_SLOTS             (64)                // Route hash table slots. Power of 2 > SWS_MAX_ROUTES
+#define SWS_MAX_EVENT_STREAMS       (2)                 // Max connections that can be event streams. < SWS_MAX_CONNECTIONS
+#define SWS_EVENT_KEEPALIVE_MILLIS  (15000)             // millis() of quiet after which an event stream is sent a comment
+#define SWS_EVENT_RETRY_MILLIS      (5000)              // millis() an event stream's client is to wait before reconnecting
+#define SWS_NUMBER_MAX_LEN          (23)                // Max characters of a swsStringView toInt() or toFloat() look at
 
 /**
  * @brief   Type definition enumerating the HTTP methods together with swsBAD_REQ for requests that come to us 
@@ -83,6 +143,81 @@
 enum swsHttpMethod_t {swsGET, swsHEAD, swsPOST, swsPUT, swsDELETE,
                                 swsCONNECT, swsOPTIONS, swsTRACE, swsPATCH, swsBAD_REQ, SWS_METHOD_COUNT};
 
+/**
+ * @brief   A non-owning view of a run of characters, typically a portion of the request message. 
+ *          It's just a pointer and a length; the characters it refers to needn't be 
+ *          '\0'-terminated, and they're good only as long as what they're in is. For a view 
+ *          into the request, that's until the handler returns.
+ * 
+ */
+struct swsStringView {
+    const char* ptr;                                        // The first character of the view
+    uint16_t len;                                           // The number of characters in it
+
+    /**
+     * @brief   Return true if the view holds exactly the same characters as the specified 
+     *          '\0'-terminated string.
+     * 
+     * @param str       The string to compare with
+     * @return true     Same
+     * @return false    Different
+     */
+    bool equals(const char* str) const;
+
+    /**
+     * @brief   Return true if the view holds the same characters as the specified '\0'-terminated 
+     *          string, ignoring case.
+     * 
+     * @param str       The string to compare with
+     * @return true     Same
+     * @return false    Different
+     */
+    bool equalsIgnoreCase(const char* str) const;
+
+    /**
+     * @brief   Return true if the view begins with the specified '\0'-terminated string.
+     * 
+     * @param str       The string to look for
+     * @return true     It does
+     * @return false    It doesn't
+     */
+    bool startsWith(const char* str) const;
+
+    /**
+     * @brief   Return a String holding a copy of the characters in the view.
+     * 
+     * @return String 
+     */
+    String toString() const;
+
+    /**
+     * @brief   Copy the characters in the view to the specified buffer as a '\0'-terminated 
+     *          string, if they fit. If they don't, the buffer is left as it was.
+     * 
+     * @param buf       The buffer
+     * @param size      Its size, including room for the '\0'
+     * @return true     Copied
+     * @return false    The view is too long
+     */
+    bool copyTo(char* buf, size_t size) const;
+
+    /**
+     * @brief   Return the number the view begins with, as String::toInt() would, or 0 if it 
+     *          doesn't begin with one.
+     * 
+     * @return long 
+     */
+    long toInt() const;
+
+    /**
+     * @brief   Return the number the view begins with, as String::toFloat() would, or 0 if it 
+     *          doesn't begin with one.
+     * 
+     * @return float 
+     */
+    float toFloat() const;
+};
+
 /**
  * @brief   Typical header block for an HTTP GET or POST serving up an HTML page. A methodHandler 
  *          can simply use this as the first part of the messages it sends.
@@ -109,6 +244,40 @@ const char swsNotFoundResponse[] =   "HTTP/1.1 404 Not Found\r\n"
                                      "Connection: close\r\n\r\n"
                                      "404 Not Found\r\n\r\n";
 
+/**
+ * @brief   Response to a request whose start-line is longer than SWS_MAX_START_LINE_LEN.
+ * 
+ */
+const char swsUriTooLongResponse[] = "HTTP/1.1 414 URI Too Long\r\n"
+                                     "Connection: close\r\n\r\n"
+                                     "414 URI Too Long\r\n\r\n";
+
+/**
+ * @brief   Response to a request whose headers are longer than SWS_MAX_HEADERS_LEN.
+ * 
+ */
+const char swsHeadersTooLargeResponse[] = "HTTP/1.1 431 Request Header Fields Too Large\r\n"
+                                          "Connection: close\r\n\r\n"
+                                          "431 Request Header Fields Too Large\r\n\r\n";
+
+/**
+ * @brief   Response to a request whose message body is longer than SWS_MAX_BODY_LEN.
+ * 
+ */
+const char swsPayloadTooLargeResponse[] = "HTTP/1.1 413 Payload Too Large\r\n"
+                                          "Connection: close\r\n\r\n"
+                                          "413 Payload Too Large\r\n\r\n";
+
+/**
+ * @brief   Typical response when the server can't take on the request just now, e.g., because 
+ *          beginEventStream() found all the event stream connections in use.
+ * 
+ */
+const char swsUnavailableResponse[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                     "Retry-After: 30\r\n"
+                                     "Connection: close\r\n\r\n"
+                                     "503 Service Unavailable\r\n\r\n";
+
 /**
  * @brief   Typical response when either the server does not recognize the request method, or 
  *          lacks the ability to fulfill the request.
@@ -118,6 +287,68 @@ const char swsNotImplementedResponse[] = "HTTP/1.1 501 Not Implemented\r\n"
                                                 "Connection: close\r\n\r\n"
                                                 "501 Not Implemented\r\n\r\n";
 
+/**
+ * @brief   A Print that collects what's printed to it in a small fixed-size buffer and sends it to 
+ *          a WiFiClient a buffer-full at a time. Whatever is left in the buffer is sent when 
+ *          flush() is called or when the swsBufferedPrint goes out of scope.
+ * 
+ * @details If it's told to, the swsBufferedPrint sends what it's given using HTTP "chunked" 
+ *          transfer coding, one chunk per buffer-full, and sends the final, empty, chunk when 
+ *          it's destroyed. That's how a response whose length isn't known in advance is sent on 
+ *          a connection that's to be kept alive.
+ * 
+ */
+class swsBufferedPrint : public Print {
+    public:
+        /**
+         * @brief Construct a new swsBufferedPrint object that sends to the specified client.
+         * 
+         * @param httpClient    The client to which the output is to be sent.
+         * @param chunked       If true, send using chunked transfer coding.
+         */
+        swsBufferedPrint(WiFiClient* httpClient, bool chunked = false);
+
+        /**
+         * @brief Destroy the swsBufferedPrint object, sending any buffered output (and, if 
+         *        chunked, the final chunk) first.
+         * 
+         */
+        ~swsBufferedPrint();
+
+        size_t write(uint8_t c) override;
+        size_t write(const uint8_t *buffer, size_t size) override;
+
+        /**
+         * @brief   Send whatever is in the buffer to the client.
+         * 
+         */
+        void flush() override;
+
+    private:
+        WiFiClient* client;                                 // The client we send to
+        bool isChunked;                                     // True if we're sending using chunked transfer coding
+        uint8_t buf[SWS_OUT_BUFFER_SIZE];                   // The output buffer
+        size_t used;                                        // The number of bytes of buf in use
+};
+
+/**
+ * @brief   Type definition enumerating the ways getting a client's request message can turn out.
+ * 
+ */
+enum swsReadStatus_t {swsReadOK, swsReadTimedOut, swsStartLineTooLong, swsHeadersTooLong, swsBodyTooLong, swsReadMore};
+
+/**
+ * @brief   Type definition for the entries in the indexes SimpleWebServer makes of a request's 
+ *          headers and form data. The name and value are offsets into the request buffer of 
+ *          '\0'-terminated strings; hash is the hash of the name.
+ * 
+ */
+struct swsField_t {
+    uint16_t name;
+    uint16_t value;
+    uint16_t hash;
+};
+
 class SimpleWebServer {
     public:
         /**
@@ -144,7 +375,8 @@ class SimpleWebServer {
          *          When called, a methodHandler is passed a pointer to the SimpleWebServer it's 
          *          the handler for, a pointer to the WiFiClient representing the client that made 
          *          the request, and the path and query string from the URI of the resource the 
-         *          client requested. 
+         *          client requested. The path and query are swsStringViews into the request 
+         *          message, not copies, so they're good only until the methodHandler returns.
          * 
          *          A methodHandler's job is to send the client the complete message that forms 
          *          the response to the client's request. A WiFiClient is, among other things, a 
@@ -158,7 +390,7 @@ class SimpleWebServer {
          *          HTTP method the client used in making the request. (Useful for methodHandlers 
          *          that handle more than one method.)
          */
-        using swsMethodHandler = void (*)(SimpleWebServer*, WiFiClient*, String, String);
+        using swsMethodHandler = void (*)(SimpleWebServer*, WiFiClient*, swsStringView, swsStringView);
 
         /**
          * @brief   Attach the sketch-supplied handler for the specified HTTP method. Calling 
@@ -170,12 +402,140 @@ class SimpleWebServer {
          */
         void attachMethodHandler(swsHttpMethod_t method, swsMethodHandler handler);
 
+        /**
+         * @brief   This is the definition of the function type routeHandlers must have.
+         * 
+         * @details A routeHandler is just a methodHandler that's called only for requests for 
+         *          the (method, path) it was attached for. The query view is empty (len == 0) if 
+         *          the URI has no query.
+         */
+        using swsRouteHandler = swsMethodHandler;
+
+        /**
+         * @brief   Attach the sketch-supplied handler for requests using the specified HTTP method 
+         *          for the resource at the specified path. Calling this for a (method, path) that 
+         *          already has a handler replaces the existing handler with the new one.
+         * 
+         * @details The path is compared exactly, case and all, with the path portion of the 
+         *          request URI. The path is not copied, so it must stay put (be a literal, say) 
+         *          for as long as the SimpleWebServer is in use. The tag is for the handler's own 
+         *          use; it gets it back from routeTag() for the route that matched. That lets one 
+         *          handler serve several similar resources.
+         * 
+         * @param method    The method for the route.
+         * @param path      The path of the resource for the route, e.g., "/index.html".
+         * @param handler   The routeHandler for the route.
+         * @param tag       The value routeTag() returns while the handler is servicing the route.
+         * @return true     Attached
+         * @return false    Not attached: there are already SWS_MAX_ROUTES routes
+         */
+        bool attachRoute(swsHttpMethod_t method, const char* path, swsRouteHandler handler, uint8_t tag = 0);
+
         /**
          * @brief   The typical run() method. let's the web server do its thing. Call often. 
          * 
+         * @details Accepts newly arrived clients, closes connections that have gone away or have 
+         *          been idle too long and reads what's arrived of at most one request, servicing 
+         *          it once it's all there. It doesn't wait for anything.
          */
         void run();
+
+        /**
+         * @brief   Return the number of requests that have been serviced, whatever the response.
+         * 
+         * @return uint32_t 
+         */
+        uint32_t requestsServed();
+
+        /**
+         * @brief   methodHandler support member function: Count the specified number of bytes 
+         *          as sent in response to the current request. Bytes sent using swsBufferedPrint 
+         *          or the SimpleWebServer's own member functions are counted already; this is for 
+         *          the ones a handler writes to the client directly. Does nothing unless METRICS 
+         *          is defined.
+         * 
+         * @param n         The number of bytes
+         * @return size_t   n, so it can wrap the write, e.g., countSent(httpClient->print(...))
+         */
+        size_t countSent(size_t n);
+
+        #ifdef METRICS
+        /**
+         * @brief   Print the request metrics: how long reading and parsing requests took and, for 
+         *          each route (plus one, "other," for everything dispatched to a methodHandler), 
+         *          how long its handler took and how many bytes it sent. 
+         * 
+         * @param out       Where to print them
+         * @param summary   If true, print a line per metric for people. Otherwise print them in 
+         *                  the Prometheus text format.
+         */
+        void printMetrics(Print* out, bool summary = false);
+        #endif
+
+        /**
+         * @brief   methodHandler support member function: Send the status line and headers of the 
+         *          response to the current request, arranging for the connection to be kept alive 
+         *          if the client wants that.
+         * 
+         * @details The "Connection", "Content-Length" or "Transfer-Encoding" headers are supplied 
+         *          as appropriate. If contentLength is SWS_UNKNOWN_LENGTH and the client speaks 
+         *          HTTP/1.1, the response is marked as chunked and true is returned. In that case 
+         *          the content must be sent through an swsBufferedPrint (or sendTemplate()) 
+         *          constructed with chunked set true. For a HEAD request just the headers are sent. 
+         *          A 204 or 304 response never has content, so neither header is sent for them 
+         *          and contentLength is ignored.
+         * 
+         * @param httpClient    The client to send to.
+         * @param status        The HTTP status code, e.g., 200.
+         * @param reason        The reason phrase that goes with the status code, e.g., "OK".
+         * @param contentType   The value for the Content-Type header or nullptr if none.
+         * @param contentLength The length of the content to follow or SWS_UNKNOWN_LENGTH.
+         * @param extraHeaders  Any additional header lines, each ending in "\r\n", or nullptr.
+         * @return true         The content is to be sent chunked
+         * @return false        The content is to be sent as-is
+         */
+        bool sendResponseHead(WiFiClient* httpClient, uint16_t status, const char* reason, const char* contentType, 
+            long contentLength, const char* extraHeaders = nullptr);
         
+        /**
+         * @brief   methodHandler support member function: Turn the connection the current request 
+         *          came in on into an event stream, sending the client the response head for a 
+         *          "text/event-stream."
+         * 
+         * @details Once the handler returns, the connection is kept open and nothing more is read 
+         *          from it. Each broadcastEvent() is sent on it, and a comment is sent on it if 
+         *          it's been quiet for SWS_EVENT_KEEPALIVE_MILLIS, so a client that's gone away 
+         *          is noticed. The handler may send the client initial events of its own using 
+         *          printEvent(). If SWS_MAX_EVENT_STREAMS connections are already event streams, 
+         *          "503 Service Unavailable" is sent instead and false is returned.
+         * 
+         * @param httpClient    The client to send to.
+         * @return true         The connection will be an event stream
+         * @return false        No room; the response has been sent
+         */
+        bool beginEventStream(WiFiClient* httpClient);
+
+        /**
+         * @brief   Send the specified event to the clients of all the event streams. Event streams 
+         *          that can't be sent to are closed.
+         * 
+         * @param event     The event name, or nullptr for an unnamed ("message") event.
+         * @param data      The event's data; a single line.
+         * @return uint8_t  The number of clients the event was sent to.
+         */
+        uint8_t broadcastEvent(const char* event, const char* data);
+
+        /**
+         * @brief   Print the specified event to the specified Print in the text/event-stream 
+         *          format, i.e., "event: <event>\ndata: <data>\n\n".
+         * 
+         * @param out       Where to print it.
+         * @param event     The event name, or nullptr for an unnamed ("message") event.
+         * @param data      The event's data; a single line.
+         * @return size_t   The number of bytes printed
+         */
+        static size_t printEvent(Print* out, const char* event, const char* data);
+
         /**
          * @brief   methodHandler support member function: Returns the HTTP Method used by the 
          *          client in its request.
@@ -186,21 +546,45 @@ class SimpleWebServer {
          */
         swsHttpMethod_t httpMethod();
 
+        /**
+         * @brief   routeHandler support member function: Returns the tag given to attachRoute() 
+         *          for the route being serviced.
+         * 
+         * @details Returns 0 if called when no route is being serviced.
+         * 
+         * @return uint8_t 
+         */
+        uint8_t routeTag();
+
         /**
          * @brief   methodHandler support member function: Returns the start-line portion of the client's 
          *          request message.
          * 
-         * @details Returns "" if called when no request is being processed. 
+         * @details Returns "" if called when no request is being processed. This is a thin 
+         *          wrapper around startLineView(); use that to avoid making a String.
          * 
          * @return String 
          */
         String clientStartLine();
 
+        /**
+         * @brief   methodHandler support member function: Returns a view of the start-line of the 
+         *          client's request message.
+         * 
+         * @details The view is empty if called when no request is being processed. 
+         * 
+         * @return swsStringView 
+         */
+        swsStringView startLineView();
+
         /**
          * @brief   methodHandler support member function: Return the http headers portion of the client's 
          *          request message.
          * 
-         * @details Returns "" if called when no request is being processed. 
+         * @details Returns "" if called when no request is being processed. The header block 
+         *          was split up in place when it was indexed, so this has to put it back together 
+         *          in a new String. To avoid that, use headerValue() or headerNameAt() and 
+         *          headerValueAt().
          * 
          * @return String
          */
@@ -210,24 +594,92 @@ class SimpleWebServer {
          * @brief   methodHandler support member function: Return the message body portion of the 
          *          client's request message.
          * 
-         * @details Returns "" if called when no request is being processed. 
+         * @details Returns "" if called when no request is being processed. This is a thin 
+         *          wrapper around bodyView() except for form data, which has to be put back 
+         *          together in a new String because it was decoded in place when it was indexed.
          * 
          * @return String
          */
         String clientBody();
 
+        /**
+         * @brief   methodHandler support member function: Returns a view of the message body of 
+         *          the client's request just as it arrived.
+         * 
+         * @details If the body was form data, it was decoded in place when it was indexed, so 
+         *          the view's ptr is nullptr; use formDatumValue() and friends for it. The view is 
+         *          empty if there's no body or no request is being processed.
+         * 
+         * @return swsStringView 
+         */
+        swsStringView bodyView();
+
+        /**
+         * @brief   methodHandler support member function: Return the message body of the client's 
+         *          request just as it arrived, '\0'-terminated in place, without making a String.
+         * 
+         * @details Returns nullptr if the body was form data; that was decoded in place when it 
+         *          was indexed, so use formDatumValue() and friends for it. Returns "" if there's 
+         *          no body or no request is being processed.
+         * 
+         * @return const char* 
+         */
+        const char* clientBodyText();
+
         /**
          * @brief   methodHandler support member function: Return the value of the HTTP header in 
          *          the client's message having the specified name, or "" if the the request has 
          *          no header with the specified name.
          * 
-         * @details Returns "" if called when no request is being processed. 
+         * @details Returns "" if called when no request is being processed. This is a thin 
+         *          wrapper around headerValue(); use that to avoid making a String.
          * 
          * @param headerName    Name of the HTTP header whose value is desired
          * @return String
          */
         String getHeader(String headerName);
 
+        /**
+         * @brief   methodHandler support member function: Return a pointer to the value of the 
+         *          HTTP header having the specified name (ignoring case), or nullptr if the 
+         *          request has no such header.
+         * 
+         * @details The headers are indexed once, as the request is read, so this is a hash table 
+         *          lookup and allocates nothing. The pointer points into the request buffer and 
+         *          is good until the methodHandler returns.
+         * 
+         * @param headerName    Name of the HTTP header whose value is desired
+         * @return const char*
+         */
+        const char* headerValue(const char* headerName);
+
+        /**
+         * @brief   methodHandler support member function: Return the number of headers in the 
+         *          client's request. With headerNameAt() and headerValueAt() this lets a 
+         *          methodHandler go through all of them.
+         * 
+         * @return uint8_t 
+         */
+        uint8_t headerCount();
+
+        /**
+         * @brief   methodHandler support member function: Return the name of the ix-th header in 
+         *          the client's request or nullptr if there is no such header.
+         * 
+         * @param ix    The index of the header, 0 .. headerCount() - 1
+         * @return const char* 
+         */
+        const char* headerNameAt(uint8_t ix);
+
+        /**
+         * @brief   methodHandler support member function: Return the value of the ix-th header in 
+         *          the client's request or nullptr if there is no such header.
+         * 
+         * @param ix    The index of the header, 0 .. headerCount() - 1
+         * @return const char* 
+         */
+        const char* headerValueAt(uint8_t ix);
+
         /**
          * @brief   Get the value of the named from datum from the application/x-www-form-urlencoded
          *          message body in a POST request.
@@ -241,51 +693,376 @@ class SimpleWebServer {
          *          request is being processed. The result is "un-URL-encoded," so you won't see 
          *          things like "%20" in what's returned.
          * 
+         *          This is a thin wrapper around formDatumValue(); use that to avoid making a 
+         *          String.
+         * 
          * @param datumName     The name of the requested datum.
          * @return String
          */
         String getFormDatum(String datumName);
 
+        /**
+         * @brief   methodHandler support member function: Return a pointer to the (un-URL-encoded) 
+         *          value of the named form datum, or nullptr if there is no such datum or the 
+         *          message body isn't application/x-www-form-urlencoded data.
+         * 
+         * @details The form data are decoded in place and indexed once, as the request is read, 
+         *          so this is a hash table lookup and allocates nothing. The pointer points into 
+         *          the request buffer and is good until the methodHandler returns.
+         * 
+         * @param datumName     The name of the requested datum.
+         * @return const char*
+         */
+        const char* formDatumValue(const char* datumName);
+
+        /**
+         * @brief   methodHandler support member function: Return the number of form data items in 
+         *          the client's request. With formDatumNameAt() and formDatumValueAt() this lets a 
+         *          methodHandler go through all of them in one pass, in the order they were sent.
+         * 
+         * @return uint8_t 
+         */
+        uint8_t formDataCount();
+
+        /**
+         * @brief   methodHandler support member function: Return the name of the ix-th form 
+         *          datum in the client's request or nullptr if there is no such datum.
+         * 
+         * @param ix    The index of the datum, 0 .. formDataCount() - 1
+         * @return const char* 
+         */
+        const char* formDatumNameAt(uint8_t ix);
+
+        /**
+         * @brief   methodHandler support member function: Return the value of the ix-th form 
+         *          datum in the client's request or nullptr if there is no such datum.
+         * 
+         * @param ix    The index of the datum, 0 .. formDataCount() - 1
+         * @return const char* 
+         */
+        const char* formDatumValueAt(uint8_t ix);
+
         /**
          * @brief   methodHandler support member function: : Return the ix-th word in source 
          *          where "words" are ' '-separated strings of characters. Returns "" if no 
          *          ix-th word exists in source.
          * 
+         * @details This is a thin wrapper around wordView(); use that to avoid making Strings.
+         * 
          * @param source    The string from which the words are extracted.
          * @param ix        The index of the word being requwested. The first word is word 0.
          * @return String
          */
         static String getWord(String source, uint8_t ix = 0);
 
+        /**
+         * @brief   methodHandler support member function: Return a view of the ix-th word in 
+         *          source where "words" are ' '-separated strings of characters. The view is 
+         *          empty if no ix-th word exists in source.
+         * 
+         * @param source    The characters from which the words are extracted.
+         * @param ix        The index of the word being requested. The first word is word 0.
+         * @return swsStringView
+         */
+        static swsStringView wordView(swsStringView source, uint8_t ix = 0);
+
+        /**
+         * @brief   This is the definition of the function type sendTemplate() calls to get the 
+         *          value of a template variable printed.
+         * 
+         * @details The function is passed the Print to which it is to print the variable's value 
+         *          and the name of the variable without the leading "@". E.g., for "@outletIs" 
+         *          varName is "outletIs". If the function doesn't know the variable, it should 
+         *          print nothing.
+         */
+        using swsTemplateVarHandler = void (*)(Print* out, const char* varName);
+
+        /**
+         * @brief   methodHandler support member function: Send the page described by the 
+         *          specified PROGMEM template to the client, substituting the values of the 
+         *          variables it contains as it goes.
+         * 
+         * @details A variable is an "@" followed by one or more letters and digits; the name 
+         *          ends at the first character that is neither. An "@" that isn't followed by a 
+         *          letter or digit, or whose name is longer than SWS_TEMPLATE_VAR_MAX_LEN, is 
+         *          sent as-is. The template is gone through exactly once, and the text is sent 
+         *          via an swsBufferedPrint, so the amount of RAM needed doesn't depend on the 
+         *          size of the page.
+         * 
+         * @param httpClient    The client to send the page to.
+         * @param tmpl          The template (in PROGMEM).
+         * @param varHandler    The function to call to print the value of each variable.
+         * @param chunked       If true, send the page using chunked transfer coding.
+         */
+        static void sendTemplate(WiFiClient* httpClient, PGM_P tmpl, swsTemplateVarHandler varHandler, bool chunked = false);
+
     private:
+        /**
+         * @brief   Type definition for a connection slot. A slot is either free or holds the 
+         *          connection to a client. The connection is idle -- waiting for the client to 
+         *          send a request, or collecting the start of one in its pending buffer -- or 
+         *          reading one. A request is read into requestBuffer, so at most one connection at 
+         *          a time is reading. The others collect what their clients send in pending until 
+         *          it holds the whole head of a request (the start-line and headers) or there's no 
+         *          room for more, and then wait their turn. Once the whole request has been read 
+         *          it is serviced, and the connection goes back to being idle or is closed and the 
+         *          slot freed. A connection that's become an event stream stays that way until 
+         *          it's closed.
+         * 
+         */
+        enum swsSlotState_t : uint8_t {swsSlotFree, swsSlotIdle, swsSlotReading, swsSlotEventStream};
+        enum swsPart_t : uint8_t {swsInStartLine, swsInHeaders, swsInBody};
+        struct swsConnection_t {
+            WiFiClient client;                              // The connection to the client
+            swsSlotState_t state;                           // What's going on with it
+            swsPart_t part;                                 // When reading, the part of the request we're in
+            uint8_t nRequests;                              // The number of requests serviced on it so far
+            bool headIn;                                    // True if pending holds the whole head of a request
+            uint16_t pendingLen;                            // The number of bytes in pending
+            uint16_t scannedLen;                            // How many of them have been looked at for the end of the head
+            uint16_t expectedBodyLen;                       // When reading the body, its length per the Content-length header
+            unsigned long lastActiveMillis;                 // millis() when it was last active: connected, sent or was sent something
+            unsigned long requestMillis;                    // millis() when the request started arriving, or when it started being read
+            uint8_t pending[SWS_SLOT_BUFFER_SIZE];          // What's arrived of the next request and hasn't been read yet
+        };
+
         /**
          * @brief Instance variables.
          * 
          */
         WiFiServer* server;                                 // The WiFiServer we talk to.
+        swsConnection_t connections[SWS_MAX_CONNECTIONS];   // The connection slots
+        uint8_t nextSlot;                                   // The slot to look at first for the next request
+        swsConnection_t* reader;                            // The connection that's reading into requestBuffer, or nullptr
+        uint32_t nServed;                                   // The number of requests serviced so far
+        #ifdef METRICS
+        struct swsRouteMetrics_t {                          // The metrics kept for a route
+            MetricsHistogram handlerMicros;                 //  How long its handler took
+            uint32_t sentBytes;                             //  How many bytes its responses came to
+        };
+        MetricsHistogram parseMicros;                       // How long getting and parsing requests took
+        uint32_t readMicros;                                // How long reading the request being read has taken so far
+        swsRouteMetrics_t routeMetrics[SWS_MAX_ROUTES + 1]; // The routes' metrics; the last is for "other"
+        #endif
+        bool clientIsHttp11;                                // When servicing a request, true if the client speaks HTTP/1.1
+        bool clientWantsKeepAlive;                          // When servicing a request, true if the client asked to keep the connection
+        bool responseKeepsAlive;                            // When servicing a request, true if the response was sent such that
+                                                            //  the connection can be kept alive
+        bool responseIsEventStream;                         // When servicing a request, true if beginEventStream() was called
+        /**
+         * @brief   Type definition for the entries in the route table. The hash is of the method and 
+         *          the path together.
+         * 
+         */
+        struct swsRoute_t {
+            const char* path;                               // The path for the route
+            swsRouteHandler handler;                        // The routeHandler for it
+            uint16_t pathLen;                               // strlen(path)
+            uint16_t hash;                                  // hashRoute(method, path, pathLen)
+            uint8_t method;                                 // The swsHttpMethod_t for the route
+            uint8_t tag;                                    // The tag attachRoute() was given
+        };
+
         swsMethodHandler handlers[SWS_METHOD_COUNT];        // The list of handlers for the various HTTP methods.
                                                             //  plus one for requests specifying an undefined method.
+        swsRoute_t routes[SWS_MAX_ROUTES];                  // The routes, in the order attached
+        uint8_t nRoutes;                                    // The number of entries in routes
+        uint8_t routeSlots[SWS_ROUTE_SLOTS];                // Hash table of routes; 0 = empty, else routes index + 1
+        uint8_t trRouteTag;                                 // When servicing a route, its tag, else 0.
         swsHttpMethod_t trMethod;                           // When servicing a request, the method asked for, else swsBAD_REQ.
-        String clientMessageStartLine;                      // When servicing a request, the HTTP start line, else "".
-        String clientMessageHeaders;                        // When servicing a request, the header block, else "".
-        String clientMessageBody;                           // When servicing a request, the body text, else "".
-        String trPath;                                      // When servicing a request, the path to the target resource, else "".
-        String trQuery;                                     // When servicing a request, the query foe the target resource, else "".
+        char requestBuffer[SWS_REQ_BUFFER_SIZE];            // The client's request message: start-line at 0, headers at 
+                                                            //  SWS_HEADERS_START and body at SWS_BODY_START, each '\0'-terminated
+        uint16_t startLineLen;                              // When servicing a request, the length of the start-line, else 0.
+        uint16_t headersLen;                                // When servicing a request, the length of the header block, else 0.
+        uint16_t bodyLen;                                   // When servicing a request, the length of the body, else 0.
+        swsField_t headerFields[SWS_MAX_HEADER_COUNT];      // The index of the request's headers, in the order received
+        uint8_t nHeaders;                                   // The number of entries in headerFields
+        uint8_t headerSlots[SWS_HEADER_SLOTS];              // Hash table of headerFields; 0 = empty, else headerFields index + 1
+        swsField_t formFields[SWS_MAX_FORM_DATA_COUNT];     // The index of the request's form data, in the order received
+        uint8_t nFormData;                                  // The number of entries in formFields
+        uint8_t formSlots[SWS_FORM_DATA_SLOTS];             // Hash table of formFields; 0 = empty, else formFields index + 1
+        bool bodyIsFormData;                                // True if the body has been indexed as form data
+        swsStringView trPath;                               // When servicing a request, the path to the target resource, else "".
+        swsStringView trQuery;                              // When servicing a request, the query for the target resource, else "".
+
+        /**
+         * @brief   Utility member function: Read what's arrived of the request on the specified 
+         *          connection, the reader, into requestBuffer, filling in startLineLen, headersLen 
+         *          and bodyLen.
+         * 
+         * @details readRequest takes what the connection collected in its pending buffer and 
+         *          then as much as the client's available() says has arrived, and no more; it 
+         *          doesn't wait for the rest. It reads from the client up to SWS_READ_CHUNK_SIZE 
+         *          bytes at a time and sorts what it gets directly into the start-line, header 
+         *          and body portions of requestBuffer (see sortChunk()). Reading times out if 
+         *          the request isn't all there SWS_REQUEST_MILLIS after its turn started, if 
+         *          the client goes away before it is, or if nothing has arrived for 
+         *          SWS_READ_IDLE_MILLIS while another connection is waiting its turn. If that 
+         *          happens or one of the portions won't fit in the space set aside for it, all 
+         *          three are set to "" and the reason is returned.
+         * 
+         * @param conn              The connection whose request is being read.
+         * @param othersWaiting     True if another connection has a request waiting its turn.
+         * @return swsReadStatus_t  swsReadOK if it's all been read, swsReadMore if there's more 
+         *                          to come, otherwise what went wrong.
+         */
+        swsReadStatus_t readRequest(swsConnection_t &conn, bool othersWaiting);
+
+        /**
+         * @brief   Utility member function: Sort the specified bytes of the request being read on 
+         *          the specified connection into place in requestBuffer. <CR> characters in the 
+         *          start-line and headers are discarded, leaving the <LF> ('\n') characters as 
+         *          line endings. The body is kept as-is. If the request ends before the bytes do, 
+         *          the rest -- the start of a pipelined request -- goes in the connection's pending 
+         *          buffer.
+         * 
+         * @param conn              The connection whose request is being read.
+         * @param chunk             The bytes; may be the connection's pending buffer.
+         * @param len               The number of bytes; at most SWS_SLOT_BUFFER_SIZE.
+         * @return swsReadStatus_t  swsReadOK if the request ended, swsReadMore if it didn't, 
+         *                          otherwise what went wrong.
+         */
+        swsReadStatus_t sortChunk(swsConnection_t &conn, const uint8_t* chunk, uint16_t len);
+
+        /**
+         * @brief   Utility member function: Collect what's arrived on the specified idle 
+         *          connection in its pending buffer, as long as there's room and it doesn't yet 
+         *          hold the whole head of a request, and note whether it now does.
+         * 
+         * @details The head ends with a blank line: two <LF>s in a row, with or without a <CR> 
+         *          between them. Only what's been added to pending since last time is looked at.
+         * 
+         * @param conn  The connection.
+         */
+        void collectHead(swsConnection_t &conn);
+
+        /**
+         * @brief   Utility member function: Service the request that's been read on the specified 
+         *          connection, then either leave the connection idle or close it.
+         * 
+         * @param conn          The connection whose request has been read.
+         * @param readStatus    How reading it turned out.
+         */
+        void serviceRequest(swsConnection_t &conn, swsReadStatus_t readStatus);
 
         /**
-         * @brief   Utility member function: Get the HTTP client's entire message,filling in 
-         *          clientMessageStartLine, clientMessageHeaders and clientMessageBody
+         * @brief   Utility member function: Close the connection in the specified slot and mark 
+         *          the slot free.
          * 
-         * @details getClientMessage fetches everything the client has to say until it reads the 
-         *          whole message or times out. In processing the input, it discards <CR> 
-         *          characters, leaving the <LF> ('\n') characters as line endings. It then breaks 
-         *          the result into the instance variable Strings clientMessageStartLine, 
-         *          clientMessageHeaders and clientMessageBody. If reading from the client times 
-         *          out, they are all set to "".
+         * @param conn  The connection to close.
+         */
+        void closeConnection(swsConnection_t &conn);
+
+        /**
+         * @brief   Utility member function: Set the request message to be empty.
+         * 
+         */
+        void clearClientMessage();
+
+        /**
+         * @brief   Utility member function: Index the header block in requestBuffer, filling in 
+         *          headerFields and headerSlots. The header lines are split into '\0'-terminated 
+         *          names and values in place.
+         * 
+         */
+        void indexHeaders();
+
+        /**
+         * @brief   Utility member function: Index the application/x-www-form-urlencoded body in 
+         *          requestBuffer, filling in formFields and formSlots. The items are split into 
+         *          '\0'-terminated names and values and un-URL-encoded in place.
+         * 
+         */
+        void indexFormData();
+
+        /**
+         * @brief   Utility member function: Add the field whose name and value are at the 
+         *          specified offsets in requestBuffer to the specified index and its hash table. 
+         *          If the index already has a field with the same name, the new one can be gotten 
+         *          only by position; lookups by name find the first one.
+         * 
+         * @param fields        The index
+         * @param nFields       The number of entries in the index; incremented
+         * @param maxFields     The capacity of the index
+         * @param slots         The hash table
+         * @param nSlots        The number of slots in the hash table; a power of 2
+         * @param nameOffset    Where the '\0'-terminated name is
+         * @param valueOffset   Where the '\0'-terminated value is
+         * @param ignoreCase    Whether names differing only in case are the same
+         * @return true         Added
+         * @return false        No room
+         */
+        bool addField(swsField_t* fields, uint8_t &nFields, uint8_t maxFields, uint8_t* slots, uint8_t nSlots, 
+            uint16_t nameOffset, uint16_t valueOffset, bool ignoreCase);
+
+        /**
+         * @brief   Utility member function: Look up the named field in the specified index.
+         * 
+         * @param fields        The index
+         * @param slots         The hash table
+         * @param nSlots        The number of slots in the hash table; a power of 2
+         * @param name          The name of the field to find
+         * @param ignoreCase    Whether names differing only in case are the same
+         * @return const char*  The value of the field or nullptr if there is no such field
+         */
+        const char* findField(swsField_t* fields, uint8_t* slots, uint8_t nSlots, const char* name, bool ignoreCase);
+
+        /**
+         * @brief   Utility function: Return the hash of the specified name (FNV-1a, folded to 
+         *          16 bits), optionally ignoring case.
+         * 
+         * @param name          The name to be hashed
+         * @param ignoreCase    Whether to treat upper and lower case letters as the same
+         * @return uint16_t 
+         */
+        static uint16_t hashName(const char* name, bool ignoreCase);
+
+        /**
+         * @brief   Utility function: Return the hash of the specified method and path together 
+         *          (FNV-1a, folded to 16 bits).
+         * 
+         * @param method    The HTTP method
+         * @param path      The path; needn't be '\0'-terminated
+         * @param len       The length of the path
+         * @return uint16_t 
+         */
+        static uint16_t hashRoute(uint8_t method, const char* path, uint16_t len);
+
+        #ifdef METRICS
+        /**
+         * @brief   Utility member function: Put the label printMetrics() uses for the specified 
+         *          route into the specified buffer.
+         * 
+         * @param ix        The index of the route in routes; nRoutes means "other"
+         * @param label     Where to put the label
+         * @param size      The size of label
+         * @param summary   True for the form used in summaries, "GET /", false for the Prometheus 
+         *                  one, route="GET /"
+         * @return true     Done
+         * @return false    The route hasn't been used, so it gets no label
+         */
+        bool routeLabel(uint8_t ix, char* label, size_t size, bool summary);
+        #endif
+
+        /**
+         * @brief   Utility member function: Return the index in routes of the route for the 
+         *          specified method and path, or -1 if there isn't one.
+         * 
+         * @param method    The HTTP method
+         * @param path      The path
+         * @param len       The length of the path
+         * @return int8_t 
+         */
+        int8_t findRoute(uint8_t method, const char* path, uint16_t len);
+
+        /**
+         * @brief   Utility function: Un-URL-encode the string starting at text in place and 
+         *          '\0'-terminate the result. "+" becomes " ", "%%" becomes "%" and "%xx" 
+         *          becomes the character whose hex code is xx.
          * 
-         * @param client    The  HTTP client who has a request.
+         * @param text  The '\0'-terminated text to be decoded
          */
-        void getClientMessage(WiFiClient* client);
+        static void urlDecodeInPlace(char* text);
         
         /**
          * @brief   The default HTTP GET and HEAD handler. It just sends the HTTP client 
@@ -296,7 +1073,7 @@ class SimpleWebServer {
          * @param path          The path portion of the requested resource URI.
          * @param query         The query portion of the same; "" if none.
          */
-        static void defaultGetAndHeadHandler(SimpleWebServer* server, WiFiClient* httpClient, String path, String query);
+        static void defaultGetAndHeadHandler(SimpleWebServer* server, WiFiClient* httpClient, swsStringView path, swsStringView query);
 
         /**
          * @brief   The default HTTP handler for unimplemented methods. It just sends the HTTP client 
@@ -307,7 +1084,7 @@ class SimpleWebServer {
          * @param path          The path portion of the requested resource URI.
          * @param query         The query portion of the same; "" if none.
          */
-        static void defaultUnimplementedHandler(SimpleWebServer* server, WiFiClient* httpClient, String path, String query);
+        static void defaultUnimplementedHandler(SimpleWebServer* server, WiFiClient* httpClient, swsStringView path, swsStringView query);
 
         /**
          * @brief   The default HTTP handler for a request that's not one of the defined 
@@ -317,5 +1094,5 @@ class SimpleWebServer {
          * @param path      The path portion of the requested resource URI.
          * @param query     The query portion of the same; "" if none.
          */
-        static void defaultBadHandler(SimpleWebServer* server, WiFiClient* httpClient, String path, String query);
+        static void defaultBadHandler(SimpleWebServer* server, WiFiClient* httpClient, swsStringView path, swsStringView query);
 };
\ No newline at end of file
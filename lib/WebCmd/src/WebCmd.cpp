@@ -38,55 +38,213 @@
 /**
  * Constructor 
  */
-WebCmd::WebCmd(CommandLine* clo) {
-    commandLineObject = clo;
+WebCmd::WebCmd() {
+    commands = nullptr;
+    commandCount = 0;
+    unknownHandler = nullptr;
+    commandLine = {"", 0};
+    nWords = 0;
+}
+
+/**
+ * begin()
+ */
+void WebCmd::begin(const wcCommand_t* table, uint8_t count, wcHandler_t onUnknown) {
+    commands = table;
+    commandCount = count;
+    unknownHandler = onUnknown;
 }
 
 /**
  * doCommand()
  */
-String WebCmd::doCommand(String inputLine) {
-    commandLine = inputLine;
-    commandLine.trim();
-    String cmd = getWord();
+String WebCmd::doCommand(swsStringView inputLine) {
+    // Trim the line
+    while (inputLine.len > 0 && isspace(inputLine.ptr[0])) {
+        inputLine.ptr++;
+        inputLine.len--;
+    }
+    while (inputLine.len > 0 && isspace(inputLine.ptr[inputLine.len - 1])) {
+        inputLine.len--;
+    }
     // Ignore zero-length commands
-    if(cmd.length() == 0) {
+    if(inputLine.len == 0) {
         return "";
     }
-    // Dispatch whatever commandHandler commandLineObject->getHandlerFor says is correct for the 
-    // one named by cmd, and use its result as our answer.
-    String answer = commandLineObject->getHandlerFor(cmd)(this);
-    commandLine = "";
+
+    // Split it into words, once and for all
+    commandLine = inputLine;
+    nWords = 0;
+    uint16_t at = 0;
+    while (at < inputLine.len && nWords < WC_MAX_WORDS) {
+        while (at < inputLine.len && inputLine.ptr[at] == ' ') {
+            at++;
+        }
+        if (at == inputLine.len) {
+            break;
+        }
+        uint16_t startAt = at;
+        while (at < inputLine.len && inputLine.ptr[at] != ' ') {
+            at++;
+        }
+        words[nWords++] = {inputLine.ptr + startAt, (uint16_t)(at - startAt)};
+    }
+
+    // Binary search the table in flash for the command, comparing as strcmp() would.
+    swsStringView cmd = words[0];
+    wcHandler_t handler = unknownHandler;
+    int16_t lo = 0;
+    int16_t hi = commandCount - 1;
+    while (lo <= hi) {
+        int16_t mid = (lo + hi) / 2;
+        const char* name = commands[mid].name;
+        int diff = 0;
+        uint16_t i = 0;
+        for (; diff == 0 && i < cmd.len; i++) {
+            diff = (int)(uint8_t)cmd.ptr[i] - (int)pgm_read_byte(name + i);
+        }
+        if (diff == 0) {
+            diff = -(int)pgm_read_byte(name + i);       // The command's a prefix of the name or equal to it
+        }
+        if (diff == 0) {
+            handler = (wcHandler_t)pgm_read_ptr(&commands[mid].handler);
+            break;
+        }
+        if (diff < 0) {
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    // Have the handler do it and use its result as our answer.
+    String answer = handler == nullptr ? "Unknown command \"" + cmd.toString() + "\". Type \"help\" for a list of them.\n" :
+        handler(this);
+    commandLine = {"", 0};
+    nWords = 0;
     return answer;
 }
 
+/**
+ * doCommand() for a String
+ */
+String WebCmd::doCommand(String inputLine) {
+    return doCommand({inputLine.c_str(), (uint16_t)inputLine.length()});
+}
+
 /**
  * getWord()
  */
 String WebCmd::getWord(uint8_t ix) {
-    int16_t startAt = 0;
-    int16_t len = commandLine.length();
-    String answer = "";
-    for (int16_t i = 0; i < ix; i++){
-        while (startAt < len && commandLine.charAt(startAt) == ' ') {
-            startAt++;
-        }
-        while (startAt < len && commandLine.charAt(startAt) != ' ') {
-            startAt++;
-        }
-    }
-    while (startAt < len && commandLine.charAt(startAt) == ' ') {
-        startAt++;
-    }
-    while (startAt < len && commandLine.charAt(startAt) != ' ') {
-        answer += commandLine.charAt(startAt++);
+    return wordView(ix).toString();
+}
+
+/**
+ * wordView()
+ */
+swsStringView WebCmd::wordView(uint8_t ix) {
+    return ix < nWords ? words[ix] : swsStringView {"", 0};
+}
+
+/**
+ * restView()
+ */
+swsStringView WebCmd::restView(uint8_t ix) {
+    if (ix >= nWords) {
+        return {"", 0};
     }
-    return answer;
+    return {words[ix].ptr, (uint16_t)(commandLine.ptr + commandLine.len - words[ix].ptr)};
+}
+
+/**
+ * wordCount()
+ */
+uint8_t WebCmd::wordCount() {
+    return nWords;
 }
 
 /**
  * getCommandLine()
  */
 String WebCmd::getCommandLine() {
-    return commandLine;
+    return commandLine.toString();
+}
+
+// WebCmdScreen member functions
+
+/**
+ * Constructor
+ */
+WebCmdScreen::WebCmdScreen() {
+    clear();
+}
+
+/**
+ * write() a single character
+ */
+size_t WebCmdScreen::write(uint8_t c) {
+    if (c == '\r') {
+        return 1;
+    }
+    if (c == '\n' || lineLen[last] == WC_SCREEN_COLS) {
+        last = (last + 1) % WC_SCREEN_LINES;
+        lineLen[last] = 0;
+    }
+    if (c != '\n') {
+        text[last][lineLen[last]++] = c;
+    }
+    return 1;
+}
+
+/**
+ * write() a block of characters
+ */
+size_t WebCmdScreen::write(const uint8_t* buffer, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        write(buffer[i]);
+    }
+    return size;
+}
+
+/**
+ * freshLine()
+ */
+void WebCmdScreen::freshLine() {
+    if (lineLen[last] != 0) {
+        write('\n');
+    }
+}
+
+/**
+ * clear()
+ */
+void WebCmdScreen::clear() {
+    memset(lineLen, 0, sizeof(lineLen));
+    last = WC_SCREEN_LINES - 1;
+}
+
+/**
+ * printTo()
+ */
+void WebCmdScreen::printTo(Print* out, bool htmlEscape) {
+    for (uint8_t i = 1; i <= WC_SCREEN_LINES; i++) {
+        uint8_t line = (last + i) % WC_SCREEN_LINES;
+        const char* p = text[line];
+        const char* end = p + lineLen[line];
+        while (p < end) {
+            // Send the run of characters up to the next one that needs escaping all at once.
+            const char* run = p;
+            while (p < end && !(htmlEscape && (*p == '&' || *p == '<' || *p == '>'))) {
+                p++;
+            }
+            out->write((const uint8_t*)run, p - run);
+            if (p < end) {
+                out->print(*p == '&' ? "&amp;" : *p == '<' ? "&lt;" : "&gt;");
+                p++;
+            }
+        }
+        if (i != WC_SCREEN_LINES) {
+            out->write('\n');
+        }
+    }
 }
@@ -5,7 +5,8 @@
  * 
  * This file is a portion of the package WebCmd, a library that provides an Arduino sketch 
  * with the ability to provide a simple command line UI on a web page. It is meant to work with 
- * the packages SimpleWebServer and Commandline. See them for more details.
+ * the package SimpleWebServer; the lines from a CommandLine (for Serial input) can be handed to it 
+ * as well, so both use the same table of commands. See them for more details.
  * 
  *****
  * 
@@ -36,18 +37,184 @@
 #ifndef Arduino_h
 #include <Arduino.h>
 #endif
-#include <CommandLine.h>
+#include <SimpleWebServer.h>
 
-class WebCmd : public CommandHandlerHelper {
+/*
+ * Miscellaneous constants
+ */
+#define WC_SCREEN_LINES     (30)                // The number of lines a WebCmdScreen holds
+#define WC_SCREEN_COLS      (120)               // The number of characters in a WebCmdScreen line; longer ones wrap
+#define WC_MAX_WORDS        (8)                 // The number of words of a command line wordView() can get at
+#define WC_MAX_NAME_LEN     (11)                // The longest a command's name can be
+
+/**
+ * @brief   A WebCmdScreen is the "screen" of a web command line: a Print holding the last 
+ *          WC_SCREEN_LINES lines printed to it, like a terminal does. The lines are kept in a 
+ *          fixed-size ring, so printing to it never allocates anything and only ever touches the 
+ *          line being printed on; starting a new line just reuses the oldest one.
+ * 
+ * @details A '\n' starts a new line, '\r' is ignored and a line that gets longer than 
+ *          WC_SCREEN_COLS wraps onto the next line. The screen starts out with WC_SCREEN_LINES 
+ *          empty lines, so what's printed shows up at the bottom, as on a terminal.
+ * 
+ */
+class WebCmdScreen : public Print {
+    public:
+        /**
+         * @brief Construct a new, blank, WebCmdScreen object.
+         * 
+         */
+        WebCmdScreen();
+
+        size_t write(uint8_t c) override;
+        size_t write(const uint8_t *buffer, size_t size) override;
+
+        /**
+         * @brief   Unless the line being printed on is empty, start a new one.
+         * 
+         */
+        void freshLine();
+
+        /**
+         * @brief   Make the screen blank.
+         * 
+         */
+        void clear();
+
+        /**
+         * @brief   Print the screen's lines, oldest first, separated by '\n', to the specified 
+         *          Print, optionally escaping the characters that are special in HTML text. (Use 
+         *          this to send the screen as the content of a <textarea>.)
+         * 
+         * @param out           Where to print the lines.
+         * @param htmlEscape    If true, print '&', '<' and '>' as "&amp;", "&lt;" and "&gt;". 
+         */
+        void printTo(Print* out, bool htmlEscape = true);
+
+    private:
+        char text[WC_SCREEN_LINES][WC_SCREEN_COLS];     // The lines; not '\0'-terminated
+        uint8_t lineLen[WC_SCREEN_LINES];               // The length of each line
+        uint8_t last;                                   // The index of the line being printed on; the oldest follows it
+};
+
+class WebCmd;
+
+/**
+ * @brief   The type of a command handler: a function that does the command whose words the 
+ *          specified WebCmd has, and returns what it has to say about it.
+ * 
+ */
+typedef String (*wcHandler_t)(WebCmd* cmd);
+
+/**
+ * @brief   One entry in a WebCmd's table of commands: a command's name and its handler. The 
+ *          name is held in the entry itself, so a table can be a single constexpr PROGMEM array 
+ *          that lives entirely in flash, e.g.,
+ * 
+ *              static constexpr wcCommand_t commands[] PROGMEM = {
+ *                  {"help", onHelp},
+ *                  {"status", onStatus},
+ *              };
+ *              static_assert(wcIsSorted(commands), "commands[] must be sorted by name");
+ *              ...
+ *              wc.begin(commands);
+ * 
+ *          The entries must be in strictly increasing order of name, as strcmp() sees it, since 
+ *          doCommand() finds a command by a binary search. wcIsSorted() lets the compiler check.
+ * 
+ */
+struct wcCommand_t {
+    char name[WC_MAX_NAME_LEN + 1];                     // The command's name, '\0'-terminated
+    wcHandler_t handler;                                // Its handler
+};
+
+/**
+ * @brief   Compare two '\0'-terminated strings as strcmp() does, but at compile time if need be.
+ * 
+ */
+constexpr int wcCompare(const char* a, const char* b) {
+    while (*a != '\0' && *a == *b) {
+        a++;
+        b++;
+    }
+    return (int)(uint8_t)*a - (int)(uint8_t)*b;
+}
+
+/**
+ * @brief   Return true if the specified table of commands is in strictly increasing order of name. 
+ *          Meant for a static_assert() on the table.
+ * 
+ */
+template <size_t N>
+constexpr bool wcIsSorted(const wcCommand_t (&table)[N]) {
+    for (size_t i = 1; i < N; i++) {
+        if (wcCompare(table[i - 1].name, table[i].name) >= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief   A WebCmd does command lines -- from a web page or any other source -- using a fixed, 
+ *          sorted table of commands.
+ * 
+ * @details doCommand() splits the line into words once, noting where each is in the one 
+ *          array of views, so handlers get at any of them without rescanning the line or 
+ *          allocating anything. It looks the command up in the table by binary search, reading 
+ *          the table from flash.
+ * 
+ */
+class WebCmd {
 
     public:
         /**
-         * @brief Construct a new WebCmd object
+         * @brief Construct a new WebCmd object. It has no commands until begin() is called.
+         * 
+         */
+        WebCmd();
+
+        /**
+         * @brief   Set the table of commands to use: a sorted array of wcCommand_t, typically 
+         *          constexpr and PROGMEM. See wcCommand_t.
+         * 
+         * @param table     The table. It isn't copied, so it must stay put.
+         * @param count     The number of commands in it
+         * @param onUnknown The handler for commands not in it, or nullptr to just say the 
+         *                  command is unknown
+         */
+        void begin(const wcCommand_t* table, uint8_t count, wcHandler_t onUnknown = nullptr);
+
+        /**
+         * @brief   Set the table of commands to use, counting them for us.
          * 
-         * @param clo   The CommandLine object that has the list of commands and command handlers
          */
-        WebCmd (CommandLine* clo);
+        template <size_t N>
+        void begin(const wcCommand_t (&table)[N], wcHandler_t onUnknown = nullptr) {
+            static_assert(N <= UINT8_MAX, "A WebCmd can have at most 255 commands");
+            begin(table, N, onUnknown);
+        }
 
+        /**
+         * @brief   Do the command in the specified line of input, returning what the command 
+         *          handler has to say about it.
+         * 
+         * @details The line isn't copied. The view needn't be '\0'-terminated, but it must stay 
+         *          good until doCommand() returns, since the command handler's requests for 
+         *          words are answered from it.
+         * 
+         * @param inputLine The command line the user input
+         * @return String   The command handler's result; "" if the line is blank
+         */
+        String doCommand(swsStringView inputLine);
+
+        /**
+         * @brief   Do the command in the specified line of input. This is a thin wrapper around 
+         *          doCommand(swsStringView).
+         * 
+         * @param inputLine The command line the user input
+         * @return String   The command handler's result; "" if the line is blank
+         */
         String doCommand(String inputLine);
 
         // The following are command handler helper member functions
@@ -57,8 +224,8 @@ class WebCmd : public CommandHandlerHelper {
         * @brief    Command handler helper: Return, as a String, the specified "word" from the 
         *           text the user has input. 
         * 
-        * @details  A "word" is a white-space-bounded sequence of characters. The words are 
-        *           numbered starting with 0. Word 0 is the command. If the user has not input the 
+        * @details  A "word" is a blank-bounded sequence of characters. The words are numbered 
+        *           starting with 0. Word 0 is the command. If the user has not input the 
         *           specified word, an empty String is returned.
         * 
         * @param    int16_t     The number of the word to be returned. Defaults to 0.
@@ -66,6 +233,37 @@ class WebCmd : public CommandHandlerHelper {
         **/
         String getWord(uint8_t ix = 0);
 
+        /**
+        * 
+        * @brief    Command handler helper: Return a view of the specified "word" from the text the 
+        *           user has input, as for getWord(), but without making a String. The view is 
+        *           good until the command handler returns. Only the first WC_MAX_WORDS words 
+        *           are available this way; use restView() to get at the ones after that.
+        * 
+        * @param    int16_t     The number of the word to be returned. Defaults to 0.
+        * 
+        **/
+        swsStringView wordView(uint8_t ix = 0);
+
+        /**
+        * 
+        * @brief    Command handler helper: Return a view of the text the user has input from 
+        *           the beginning of the specified word to the end of the line, e.g., for a 
+        *           command whose argument can contain blanks. It's empty if there's no such word.
+        * 
+        * @param    int16_t     The number of the word to start with
+        * 
+        **/
+        swsStringView restView(uint8_t ix);
+
+        /**
+        * 
+        * @brief    Command handler helper: Return the number of words the user has input, at 
+        *           most WC_MAX_WORDS.
+        * 
+        **/
+        uint8_t wordCount();
+
         /**
         * 
         * @brief    Command handler helper: Return, as a String, the trimmed sequence of 
@@ -75,6 +273,10 @@ class WebCmd : public CommandHandlerHelper {
         String getCommandLine();
 
     private:
-    CommandLine* commandLineObject;     // Pointer to the CommandLine object we can ask about the commands
-    String commandLine;                 // The command line we're processing or "" if not processing a command
+    const wcCommand_t* commands;        // The table of commands, in flash, sorted by name
+    uint8_t commandCount;               // The number of commands in it
+    wcHandler_t unknownHandler;         // The handler for commands that aren't in it; nullptr for the default
+    swsStringView commandLine;          // The (trimmed) command line we're processing or "" if not processing a command
+    swsStringView words[WC_MAX_WORDS];  // The words of commandLine
+    uint8_t nWords;                     // The number of them
 };
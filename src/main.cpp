@@ -24,13 +24,16 @@
  * The other page, /commandline.html, shows a "dumb terminal" with the same command line 
  * interface that's presented over the Serial interface. 
  * 
- * There's a button on the device. Clicking it toggles the outlet on or off.
+ * There's a button on the device. Clicking it toggles the outlet on or off. ButtonEvents catches
+ * its presses with an interrupt handler, so a click is never missed. It takes effect the next 
+ * time the button task runs: within a few milliseconds, unless flash is being written or a 
+ * firmware update is waiting for its server to accept the connection.
  * 
  * The implementation uses -- in addition to all the ESP8266 WiFi stuff -- a super simple web 
  * server I wrote for the purpose. See SimpleWebServer.h for details. It also uses two other 
  * libraries I wrote for other projects, Commandline, which makes implementing a commandline 
- * interpreter easy to do, PushButton, for simple clicky-button support, and ObsSite for 
- * calculating sunrise and sunset times for a specified site. See them for more information.
+ * interpreter easy to do, and ObsSite for calculating sunrise and sunset times for a specified 
+ * site. See them for more information.
  * 
  * Notes on the hardware
  * =====================
@@ -120,13 +123,26 @@
 #include <Arduino.h>                                // The base Arduino framework
 #include <ESP8266WiFi.h>                            // The ESP8266 WiFi support
 #include <TZ.h>                                     // POSIX timezone strings (for reference)
-#include <WiFiUdp.h>                                // UDP support needed by SmartCOnfig
+#include <WiFiUdp.h>                                // UDP support needed by SmartCOnfig and the group command listener
+#include <Crypto.h>                                 // HMAC-SHA256, to check group command datagrams
+#include <ESP8266mDNS.h>                            // mDNS and DNS-SD, so outlets can be found without scanning for them
 #include <ESP_EEPROM.h>                             // Enhanced EEPROM emulator for ESP8266
-#include <PushButton.h>                             // My pushbutton support library
+#include <flash_hal.h>                              // Where the linker put the (otherwise unused) file system area
+#include <ButtonEvents.h>                           // Button clicks and long presses, caught by an interrupt handler
 #include <CommandLine.h>                            // My simple command line support library
 #include <SimpleWebServer.h>                        // The web server library
-#include <WebCmd.h>                                 // The "friend" extension of CommandLine for SimpleWebServer
+#include <WebCmd.h>                                 // The table-driven command line the web page and CommandLine share
 #include <ObsSite.h>                                // The observing site sunrise / sunset calculator
+#include <SimpleScheduler.h>                        // The cooperative task scheduler that runs everything from loop()
+#include <FlashRing.h>                              // Rings of small records kept in flash
+#include <NtpClock.h>                               // The system clock, kept set by NTP and across resets
+#include <ScheduleRules.h>                          // The schedule rules beyond the home page's cycles, kept in flash
+#include <OtaUpdate.h>                              // Firmware updates over the air, tried out before they're trusted
+#ifdef METRICS
+#include <Metrics.h>                                // Histograms for the metrics served on /metrics
+#endif
+#include <StreamString.h>                           // A Print that collects into a String, for the "stats" and "rule" commands
+#include <webAssets.h>                              // The gzipped static web assets. Generated from web/ at build time
 
 //#define DEBUG                                       // Uncomment to enable debug code
 
@@ -141,7 +157,8 @@
 #define TOGGLE_QUERY        "outlet=toggle"         // The URI query string to cause the outlet to toggle state
 #define SCHED_UPDATE_QUERY  "schedule=update"       // The URI query string to cause the schedule parms to be updated
 #define SCHED_TOGGLE_QUERY  "schedule=toggle"       // The URI query string to cause the schedule enable/disable toggle
-#define CMD_SCREEN_LINES    (30)                    // The number of lines of text in the commandline.html "screen"
+#define STATE_EVENT_LEN     (40)                    // Big enough for the data of a "state" event plus the '\0'
+#define DELTA_ACCEPT        "application/json"      // In a home page POST's Accept header: answer with what changed, not a 303
 #define LED_LIT             (LOW)                   // digitalWrite value to light the LED
 #define LED_DARK            (HIGH)                  // digitalWrite value to turn the LED off
 #define RELAY_OPEN          (LOW)                   // digitlWrite value to open the relay
@@ -151,26 +168,141 @@
 #define N_TIMED_CYCLES      (4)                     // Number of cycles that are time-on time-off
 #define N_SUN_CYLCLES       (4)                     // Number oc cycles that are sunrise/set dependent
 #define N_CYCLES            (N_TIMED_CYCLES + N_SUN_CYLCLES)    // Total number of on/off cycles
+#define SCHED_MAX_DELTA     (120)                   // Most minutes a sun cycle may be from sunrise or sunset
+#define SCHED_MAX_FUZZ      (60)                    // Most minutes of variability a cycle may have
 #define SERIAL_CONN_MILLIS  (4000)                  // millis() to wait after Serial.begin() before using it
-#define WIFI_DELAY_MILLIS   (500)                   // millis() to delay between printing "." while waiting for WiFi and NTP
-#define WIFI_CONN_MILLIS    (15000)                 // millis() to wait for WiFi connect before giving up
-#define NTP_SET_MILLIS      (10000)                 // millis() to wait for NTP server to set the time
-#define NOT_RUNNING_MINS    (5UL)                   // minutes to wait before restarting if internet not available
-#define NOT_RUNNING_MILLIS  (NOT_RUNNING_MINS * 60000) // same as NOT_RUNNING_MINS but in micros()
-#define DAWN_OF_HISTORY     (1533081600)            // Well, actually time_t for August 1st, 2018
+#define WIFI_CONN_MILLIS    (15000)                 // millis() to wait for WiFi connect before giving up for now
+#define WIFI_RETRY_MIN_MILLIS (10000UL)             // millis() to wait after the first failure to connect before retrying
+#define WIFI_RETRY_MAX_MILLIS (300000UL)            // Most millis() to wait between retries; the wait doubles up to this
+#define NTP_SET_MILLIS      (10000)                 // millis() connected without the time being set before we say so
+#define UI_TASK_MILLIS      (20)                    // millis() between runs of the ui task (9600 baud is about 1 char/ms)
+#define BUTTON_TASK_MILLIS  (10)                    // millis() between runs of the button task
+#define WEB_TASK_MILLIS     (10)                    // millis() between runs of the web server task
+#define NET_TASK_MILLIS     (500)                   // millis() between runs of the network connection manager task
+#define GROUP_TASK_MILLIS   (10)                    // millis() between runs of the group command listener task
+#define MDNS_TASK_MILLIS    (50)                    // millis() between runs of the mDNS responder task
+#define MDNS_HOST_FORMAT    "wifi-outlet-%06x"      // mDNS host name (.local), from the chip id; unique even if names aren't
+#define OTA_TASK_MILLIS     (2)                     // millis() between runs of the firmware update task while it's updating
+#define OTA_TRIAL_MILLIS    (180000UL)              // millis() after boot new firmware has to get running, or it's restarted
+#define OTA_RETRY_MILLIS    (60000UL)               // millis() to wait before trying again to go back to the known good firmware
+#define PM_BEACON_MILLIS    (102)                   // millis() between an access point's beacons (the usual 100 TU, rounded)
+#define PM_MAX_LISTEN       (10)                    // Most beacon intervals the radio may sleep through in light sleep mode
+#define PM_BUTTON_MILLIS    (40)                    // millis() between runs of the button task in light sleep mode; < 50 ms to a click
+#define PM_ACTIVE_DMA       (800)                   // Current (0.1 mA) while running tasks: CPU and radio on (datasheet)
+#define PM_NONE_DMA         (560)                   // Current (0.1 mA) idling with the radio always receiving
+#define PM_MODEM_DMA        (150)                   // Current (0.1 mA) idling in modem sleep, between beacons
+#define PM_LIGHT_DMA        (9)                     // Current (0.1 mA) idling in light sleep, between beacons
+#define PM_BEACON_MICROS    (3000)                  // micros() the radio is awake to receive each beacon it listens for
+#define SCHED_SLOP_MILLIS   (10)                    // millis() past the minute boundary to run the schedule task
+#define SCHED_MAX_SLEEP_MINS (10UL)                 // Maximum minutes between runs of the schedule task
+#define SUN_TIMES_DAYS      (7)                     // Number of days of upcoming sun times shown on the home page
+#define JSON_MAX_KEY_LEN    (15)                    // Longest JSON member name the API accepts
+#define JSON_MAX_VALUE_LEN  (47)                    // Longest JSON member value the API accepts (decoded)
 #define MINS_PER_DAY        (1440)                  // Number of minutes in one day
-#define CONFIG_SIG          (0x34A7)                // Our "signature" in EEPROM to know the data is (probably) ours
+#define CONFIG_SIG          (0x34AB)                // Our "signature" in EEPROM to know the data is (probably) ours
+#define CONFIG_FIRST_SIG    (0x34A7)                // The first signature we had. They count up from it
+#define CONFIG_SIG_COUNT    (256)                   // How many signatures there can be, so anything else (e.g., 0xFFFF) isn't ours
+#define CONFIG_KEPT_SIG     (0x34AB)                // The first signature with everything up to otaMd5 in its kept place
+#define CONFIG_KEPT_LEN     (228)                   // Bytes at the start of eepromData_t kept across a change of signature
+#define CONFIG_34AA_URL_AT  (329)                   // Where signature 0x34AA's layout had otaUrl
+#define CONFIG_34AA_MD5_AT  (425)                   // And otaMd5
+#define CONFIG_LOG_ADDR     (FS_PHYS_ADDR)          // Flash address of the config change log
+#define CONFIG_LOG_SECTORS  (2)                     // Number of flash sectors in the config change log
+#define CONFIG_LOG_CHECK    (0xA5)                  // Seed for the check byte in config change log records
+#define CONFIG_COMMIT_MILLIS (3000)                 // millis() saveConfigSoon() waits for more changes before saving
+#define WIFI_CACHE_ADDR     (CONFIG_LOG_ADDR + CONFIG_LOG_SECTORS * FR_SECTOR_SIZE) // Flash address of the WiFi connection cache
+#define WIFI_CACHE_MAGIC    (0x57694669UL)          // "WiFi": marks the WiFi connection cache as (probably) valid
+#define WIFI_FAST_CONN_MILLIS (4000)                // millis() to wait for a connect using the cached BSSID and channel
+//#define WIFI_REUSE_LEASE                          // Uncomment to reuse the cached DHCP lease as a static IP at startup
+#define EVENT_LOG_ADDR      (WIFI_CACHE_ADDR + FR_SECTOR_SIZE)  // Flash address of the outlet event log
+#define EVENT_LOG_SECTORS   (2)                     // Number of flash sectors in the outlet event log: 511 to 1022 events
+#define EVENT_LOG_CHECK     (0x5A)                  // Seed for the check byte in outlet event log records
+#define EVENT_BATCH         (16)                    // Most events held in RAM waiting to be written to the log together
+#define EVENT_COMMIT_MILLIS (60000UL)               // millis() the first of them waits for others before they're written
+#define EVENT_ON            (0x80)                  // In an event's what: the outlet turned on (otherwise off)
+#define EVENT_UPTIME        (0x40)                  // In an event's what: its when is seconds since boot, not since the epoch
+#define EVENT_CAUSE_MASK    (0x3F)                  // In an event's what: the eventCause_t
+#define EVENT_PAGE_DEFAULT  (20)                    // Events GET /api/log sends if the query doesn't say
+#define EVENT_PAGE_MAX      (100)                   // Most events GET /api/log sends at once
+#define EVENT_CMD_DEFAULT   (10)                    // Events the "log" command prints if it isn't told
+#define GROUP_PORT          (7011)                  // UDP port group command datagrams are sent to
+#define GROUP_MCAST_IP      239, 255, 70, 11        // The multicast address they're sent to
+#define GROUP_ALL           (0xFFFF)                // The group number that addresses every outlet with the key
+#define GROUP_MAGIC         (0x4F57)                // "WO" as a little-endian uint16_t: starts every group datagram
+#define GROUP_VERSION       (1)                     // The version of the group datagram format
+#define GROUP_MAC_LEN       (16)                    // Bytes of (truncated) HMAC-SHA256 that end a group datagram
+#define GROUP_MAX_JSON      (640)                   // Longest JSON object a group datagram may carry
+#define GROUP_MAX_SKEW_MILLIS (30000)               // Most a group datagram's stamp may differ from our clock
+#define GROUP_MIN_KEY_LEN   (16)                    // Shortest group key the "group" command accepts
+#define GROUP_MAX_PER_RUN   (4)                     // Most datagrams groupTask() handles per run
+#define RULE_MAX_SPEC_LEN   (63)                    // Longest rule the "rule add" command accepts
+#define RULES_ADDR          (FS_PHYS_ADDR + FS_PHYS_SIZE - FR_SECTOR_SIZE)   // Flash address of the schedule rules: the last FS sector
 
 typedef unsigned int minPastMidnight_t;             // Minutes past midnight: 0 --> 1399
 enum cycleType_t : uint8_t {daily, weekDay, weekEnd, _cycleTypeSize};   // The cycle types we support
+struct scheduleEvent_t {                            // An outlet on/off transition in today's schedule
+    uint16_t when;                                  // When the transition happens: minutes past midnight
+    bool turnOn;                                    // OUTLET_ON or OUTLET_OFF
+    uint8_t source;                                 // The cycle it's from (0 to N_CYCLES - 1) or N_CYCLES + the rule
+};
 #ifdef DEBUG
 String cycleTypeName[_cycleTypeSize] = {"daily", "weekday", "weekend"};
 #endif
+const char* const cycleTypeCode[_cycleTypeSize] = {"dy", "wd", "we"};  // How cycle types appear in forms and JSON
+enum apiResource_t : uint8_t {apiState, apiSchedule};  // The machine API's resources; the tags of their routes
+enum groupCmd_t : uint8_t {gcState = 1, gcSchedule = 2};    // What a group datagram's JSON updates: /api/state or /api/schedule
+enum powerMode_t : uint8_t {pmModem, pmLight, pmNone, _powerModeSize};  // How the WiFi radio (and CPU) sleep while we're idle
+const char* const powerModeName[_powerModeSize] = {"modem", "light", "none"};  // How power modes appear in the "power" command
+struct groupHeader_t {                              // The start of a group command datagram; its JSON and MAC follow
+    uint16_t magic;                                 // GROUP_MAGIC. Like everything here, little-endian
+    uint8_t version;                                // GROUP_VERSION
+    uint8_t command;                                // A groupCmd_t
+    uint16_t group;                                 // The group it's for, or GROUP_ALL
+    uint16_t jsonLen;                               // The length of the JSON object that follows
+    uint64_t stamp;                                 // When it was sent: ms since the epoch. Must be later than the last
+};
+static_assert(sizeof(groupHeader_t) == 16, "groupHeader_t must have the wire format's layout");
+
+enum eventCause_t : uint8_t {ecBoot, ecButton, ecSchedule, ecHomePage, ecApi, ecGroup, _eventCauseSize};  // Why the outlet switched
+const char* const eventCauseName[_eventCauseSize] = {"boot", "button", "schedule", "web", "api", "group"};
+struct eventRec_t {                                 // An outlet event log record: the outlet switched on or off
+    uint32_t when;                                  // When: seconds since the epoch or, with EVENT_UPTIME, since boot
+    uint8_t what;                                   // The eventCause_t, | EVENT_ON if it turned on, | EVENT_UPTIME
+    uint8_t detail;                                 // ecSchedule: the scheduleEvent_t's source; ecBoot: the reset reason
+    uint8_t reserved;                               // Always 0
+    uint8_t check;                                  // EVENT_LOG_CHECK ^ all the other bytes, to catch torn writes
+};
+static_assert(sizeof(eventRec_t) == FR_RECORD_SIZE, "eventRec_t must be a FlashRing record");
+
+struct configLogRec_t {                             // A config change log record: the new value of some bytes of config
+    uint16_t offset;                                // The offset in config of the first byte. Never 0xFFFF
+    uint8_t len;                                    // The number of bytes, 1 to sizeof(data)
+    uint8_t check;                                  // CONFIG_LOG_CHECK ^ all the other bytes, to catch torn writes
+    uint8_t data[FR_RECORD_SIZE - 4];               // The bytes
+};
+
+struct wiFiCache_t {                                // What we remember about the last successful WiFi connection
+    uint32_t magic;                                 // WIFI_CACHE_MAGIC
+    uint32_t ssidHash;                              // wiFiCacheHash() of the SSID it's for
+    uint8_t bssid[6];                               // The BSSID of the access point we were connected to
+    uint8_t channel;                                // The channel it was on
+    uint8_t reserved;                               // Always 0
+    uint32_t ip;                                    // The DHCP lease we got: our IP address,
+    uint32_t gateway;                               //  the gateway,
+    uint32_t subnet;                                //  the subnet mask
+    uint32_t dns;                                   //  and the DNS server
+    uint32_t check;                                 // wiFiCacheHash() of all of the foregoing
+};
 
 struct eepromData_t {
-    uint16_t signature;                             // Random integer identifying the data as ours. Change when shape changes
+    uint16_t signature;                             // Integer identifying the data as ours. Count it up when the shape changes
+    // These stay put whatever else changes, so a change of signature doesn't lose what new firmware 
+    // needs to connect and, if it's on trial, to go back. See migrateConfig(). Add new members at the end.
     char ssid[33];                                  // SSID of the WiFi network we should use.
     char password[64];                              // Password to use to connect to the WiFi
+    char otaUrl[OU_MAX_URL_LEN + 1];                // Where the known good firmware's image is; "" if we don't know
+    char otaMd5[OU_MD5_LEN + 1];                    // And its MD5 digest, in hex
+    // These are set to their defaults when the signature changes
     char timeZone[32];                              // The POSIX timezone string for the timezone we use (see TZ.h)
     float latDeg;                                   // The locale latitude (degrees)
     float lonDeg;                                   // The locale longitude (degrees)
@@ -184,18 +316,44 @@ struct eepromData_t {
     minPastMidnight_t sunTime[N_SUN_CYLCLES];       // The turn-on time for the sunrise, turn-off time for sunset on/off cycle
     int sunDelta[N_SUN_CYLCLES];                    // The number of minutes after sunrise to turn off or before sunset to turn on
     int cycleFuzz[N_CYCLES];                        // The number of minutes of randomness in each of the cycles
+    uint16_t groupId;                               // The group we take group commands for; 0 if none
+    char groupKey[33];                              // The key group commands are signed with
+    powerMode_t powerMode;                          // How to sleep while idle; pmModem is what the SDK does by default
+    uint8_t listenInterval;                         // Beacon intervals to sleep through in light sleep; 0 for the AP's DTIM
 };
+static_assert(offsetof(eepromData_t, otaMd5) + OU_MD5_LEN + 1 == CONFIG_KEPT_LEN, "The kept part of eepromData_t mustn't change");
+static_assert(sizeof(eepromData_t) >= CONFIG_34AA_MD5_AT + OU_MD5_LEN + 1, "A 0x34AA config must fit in EEPROM");
 
 WiFiServer wiFiServer {80};                         // The WiFi server on port 80
 SimpleWebServer webServer;                          // The web server object
-PushButton button {BUTTON};                         // The PushButtone encapsulating the device's push button switch
+ButtonEvents button {BUTTON};                       // The ButtonEvents encapsulating the device's push button switch
 CommandLine ui {};                                  // The command line interpreter object
-WebCmd wc {&ui};                                    // The web command extension
-String screenContents;                              // For the web command page, the screen contents
+WebCmd wc;                                          // Does the command lines, from the web page and, via ui, from Serial
+WebCmdScreen cmdScreen;                             // For the web command page, the screen contents
+SimpleScheduler scheduler;                          // The task scheduler loop() uses to run everything
+ObsSite site {0.0, 0.0, 0.0};                       // The outlet's location, for sun times. Set from config in setup()
+ssTaskId_t scheduleTaskId = SS_NO_TASK;             // The scheduler's id for the schedule follower task
+ssTaskId_t commitTaskId = SS_NO_TASK;               // The scheduler's id for the deferred config commit task
+ssTaskId_t clockTaskId = SS_NO_TASK;                // The scheduler's id for the clock task
+ssTaskId_t uiTaskId = SS_NO_TASK;                   // The scheduler's ids for the polling tasks, whose periods
+ssTaskId_t buttonTaskId = SS_NO_TASK;               //  applyPowerMode() stretches in light sleep mode
+ssTaskId_t webTaskId = SS_NO_TASK;
+ssTaskId_t groupTaskId = SS_NO_TASK;
+ssTaskId_t mdnsTaskId = SS_NO_TASK;
+NtpClock ntpClock;                                  // The system clock's keeper
+FlashRing configLog {CONFIG_LOG_ADDR, CONFIG_LOG_SECTORS};  // Changes to config made since it was put in EEPROM
+ScheduleRules rules {RULES_ADDR};                   // The schedule rules followed along with config's cycles
+FlashRing eventLog {EVENT_LOG_ADDR, EVENT_LOG_SECTORS}; // The outlet's on/off history
+ssTaskId_t eventTaskId = SS_NO_TASK;                // The scheduler's id for the deferred event log write task
+eventRec_t eventPending[EVENT_BATCH];               // Events not yet written to eventLog, oldest first
+uint8_t nEventsPending = 0;                         // The number of them
+OtaUpdate ota;                                      // Over-the-air firmware updates and the trials of new firmware
+ssTaskId_t otaTaskId = SS_NO_TASK;                  // The scheduler's id for the firmware update task
+bool otaUpdating = false;                           // True from when an update starts until otaTask() says how it went
 
 // The configuration we'll use, preset with default values
 //                   sig ssid pw  ------- timezone -------  lon  lat  elv  outletName  enabled 
-eepromData_t config {0,  "",  "", "PST8PDT,M3.2.0,M11.1.0", 0.0, 0.0, 0.0, "McOutlet", false, 
+eepromData_t config {0,  "",  "", "", "", "PST8PDT,M3.2.0,M11.1.0", 0.0, 0.0, 0.0, "McOutlet", false, 
 //                   ---------------------- cycleEnable --------------------
                      false, false, false, false, false, false, false, false, 
 //                   ---------------------- cycleType ---------------------- 
@@ -207,23 +365,111 @@ eepromData_t config {0,  "",  "", "PST8PDT,M3.2.0,M11.1.0", 0.0, 0.0, 0.0, "McOu
 //                   ---------- cycleFuzz ---------
                      10, 10, 10, 10, 10, 10, 10, 10};
 
-// The field names in the home page's form. A POST request uses these to report form field values.
-enum formDataName_t : uint8_t 
-    {fdS0en, fdS1en, fdS2en, fdS3en, fdS4en, fdS5en, fdS6en, fdS7en, 
-    fdS0ty, fdS1ty, fdS2ty, fdS3ty, fdS4ty, fdS5ty, fdS6ty, fdS7ty, 
-    fdS0on, fdS1on, fdS2on, fdS3on, fdS4on, fdS5ond, fdS6on, fdS7ond, 
-    fdS0of, fdS1of, fdS2of, fdS3of, fdS4ofd, fdS5of, fdS6ofd, fdS7of, 
-    fdS0fz, fdS1fz, fdS2fz, fdS3fz, fdS4fz, fdS5fz, fdS6fz, fdS7fz, _formDataNameSize_};
-String formDataNames[_formDataNameSize_] =
-    {"s0en", "s1en", "s2en", "s3en", "s4en", "s5en", "s6en", "s7en", 
-    "s0ty", "s1ty", "s2ty", "s3ty", "s4ty", "s5ty", "s6ty", "s7ty", 
-    "s0on", "s1on", "s2on", "s3on", "s4on", "s5ond", "s6on", "s7ond", 
-    "s0of", "s1of", "s2of", "s3of", "s4ofd", "s5of", "s6ofd", "s7of", 
-    "s0fz", "s1fz", "s2fz", "s3fz", "s4fz", "s5fz", "s6fz", "s7fz"};
-
-unsigned long noWiFiMillis = 0;                     // millis() when we noticed the WiFi wasn't available; 0 otherwise
-bool running = false;                               // True if we have a config, connect to WiFi and successfully set the time.
+// The schedule's fields: the home page's form fields, which are also /api/schedule's JSON members
+enum schedFieldKind_t : uint8_t {                   // The kinds of schedule field
+    sfEnable,                                       //  A cycle's enable (bool): "on" in a form, true or false in JSON
+    sfType,                                         //  A cycle's type (cycleType_t): "s<c>dy" etc. in a form, "dy" etc. in JSON
+    sfTime,                                         //  A time of day (minPastMidnight_t): "hh:mm"
+    sfDelta,                                        //  Minutes after sunrise or before sunset (int): 0 to SCHED_MAX_DELTA
+    sfFuzz};                                        //  Minutes of variability (int): 0 to SCHED_MAX_FUZZ
+struct schedField_t {                               // What there is to know about one schedule field
+    const char* name;                               //  Its name, e.g., "s0en"
+    schedFieldKind_t kind;                          //  Its kind
+    uint16_t offset;                                //  The offset in eepromData_t of the config member it's for
+};
+constexpr schedField_t schedFields[] = {            // All of them, per cycle, in the order sendScheduleJson() sends them
+    {"s0en", sfEnable, offsetof(eepromData_t, cycleEnable[0])},
+    {"s0ty", sfType, offsetof(eepromData_t, cycleType[0])},
+    {"s0on", sfTime, offsetof(eepromData_t, cycleOnTime[0])},
+    {"s0of", sfTime, offsetof(eepromData_t, cycleOffTime[0])},
+    {"s0fz", sfFuzz, offsetof(eepromData_t, cycleFuzz[0])},
+    {"s1en", sfEnable, offsetof(eepromData_t, cycleEnable[1])},
+    {"s1ty", sfType, offsetof(eepromData_t, cycleType[1])},
+    {"s1on", sfTime, offsetof(eepromData_t, cycleOnTime[1])},
+    {"s1of", sfTime, offsetof(eepromData_t, cycleOffTime[1])},
+    {"s1fz", sfFuzz, offsetof(eepromData_t, cycleFuzz[1])},
+    {"s2en", sfEnable, offsetof(eepromData_t, cycleEnable[2])},
+    {"s2ty", sfType, offsetof(eepromData_t, cycleType[2])},
+    {"s2on", sfTime, offsetof(eepromData_t, cycleOnTime[2])},
+    {"s2of", sfTime, offsetof(eepromData_t, cycleOffTime[2])},
+    {"s2fz", sfFuzz, offsetof(eepromData_t, cycleFuzz[2])},
+    {"s3en", sfEnable, offsetof(eepromData_t, cycleEnable[3])},
+    {"s3ty", sfType, offsetof(eepromData_t, cycleType[3])},
+    {"s3on", sfTime, offsetof(eepromData_t, cycleOnTime[3])},
+    {"s3of", sfTime, offsetof(eepromData_t, cycleOffTime[3])},
+    {"s3fz", sfFuzz, offsetof(eepromData_t, cycleFuzz[3])},
+    {"s4en", sfEnable, offsetof(eepromData_t, cycleEnable[4])},     // On at a time, off after sunrise
+    {"s4ty", sfType, offsetof(eepromData_t, cycleType[4])},
+    {"s4on", sfTime, offsetof(eepromData_t, sunTime[0])},
+    {"s4ofd", sfDelta, offsetof(eepromData_t, sunDelta[0])},
+    {"s4fz", sfFuzz, offsetof(eepromData_t, cycleFuzz[4])},
+    {"s5en", sfEnable, offsetof(eepromData_t, cycleEnable[5])},     // On before sunset, off at a time
+    {"s5ty", sfType, offsetof(eepromData_t, cycleType[5])},
+    {"s5ond", sfDelta, offsetof(eepromData_t, sunDelta[1])},
+    {"s5of", sfTime, offsetof(eepromData_t, sunTime[1])},
+    {"s5fz", sfFuzz, offsetof(eepromData_t, cycleFuzz[5])},
+    {"s6en", sfEnable, offsetof(eepromData_t, cycleEnable[6])},     // On at a time, off after sunrise
+    {"s6ty", sfType, offsetof(eepromData_t, cycleType[6])},
+    {"s6on", sfTime, offsetof(eepromData_t, sunTime[2])},
+    {"s6ofd", sfDelta, offsetof(eepromData_t, sunDelta[2])},
+    {"s6fz", sfFuzz, offsetof(eepromData_t, cycleFuzz[6])},
+    {"s7en", sfEnable, offsetof(eepromData_t, cycleEnable[7])},     // On before sunset, off at a time
+    {"s7ty", sfType, offsetof(eepromData_t, cycleType[7])},
+    {"s7ond", sfDelta, offsetof(eepromData_t, sunDelta[3])},
+    {"s7of", sfTime, offsetof(eepromData_t, sunTime[3])},
+    {"s7fz", sfFuzz, offsetof(eepromData_t, cycleFuzz[7])}};
+#define N_SCHED_FIELDS      (sizeof(schedFields) / sizeof(schedFields[0]))  // The number of schedule fields
+static_assert(N_SCHED_FIELDS == 5 * N_CYCLES, "Every cycle has five schedule fields");
+
+eepromData_t savedConfig;                           // What's in EEPROM and the config change log
+bool configPending = false;                         // True if saveConfigSoon() has arranged for a save
+eepromData_t apiConfig;                             // Where an API update is assembled before it's applied to config
+int8_t apiOutlet = -1;                              // Outlet state an API update asked for: 1 on, 0 off or -1 unchanged
+
+// A function called by parseJsonObject() for each member of the object. Returns false to reject it.
+using jsonMemberHandler = bool (*)(const char* key, const char* value, bool isString);
+enum netState_t : uint8_t {                         // The states of the network connection manager, netTask()
+    netNoCredentials,                               //  No SSID and password; nothing to do
+    netStarting,                                    //  About to start connecting
+    netFastConnecting,                              //  Connecting to the access point in wiFiCache
+    netConnecting,                                  //  Connecting the ordinary way, scanning for the access point
+    netRetryWait,                                   //  Couldn't connect; waiting netRetryMillis to try again
+    netUp,                                          //  Connected
+    netLost};                                       //  Was connected, but the connection went away
+const char* const netStateName[] = {"no credentials", "starting", "connecting to the cached access point", 
+    "connecting", "waiting to retry", "up", "lost"};
+netState_t netState = netNoCredentials;             // The network connection manager's state
+unsigned long netStateMillis = 0;                   // millis() when netState last changed
+unsigned long netRetryMillis = WIFI_RETRY_MIN_MILLIS;   // millis() to wait after the next failure to connect
+bool clockIsSet = false;                            // True once ntpClock has set the clock. It stays set.
+#ifdef METRICS
+MetricsHistogram loopMicros;                        // How long each loop() took, not counting the delay()
+MetricsHistogram configSaveMicros;                  // How long each saveConfig() took
+MetricsHistogram followMicros;                      // How long each followSchedule() took
+uint32_t heapLow = UINT32_MAX;                      // The least free heap seen
+uint32_t heapLowMaxBlock = 0;                       // The largest free block when heapLow was seen
+uint8_t heapLowFrag = 0;                            // The heap fragmentation (%) when heapLow was seen
+#endif
+wiFiCache_t wiFiCache;                              // The WiFi connection cache as it is in flash
+unsigned long wiFiReadyMillis = 0;                  // millis() when the WiFi connection came up; 0 if it hasn't
+bool wiFiWasFast = false;                           // True if the WiFi connection came up using wiFiCache
+unsigned long firstRequestMillis = 0;               // millis() when the first web request had been served; 0 if none has
 bool scheduleUpdated = true;                        // True when schedule updated since last looked at by followSchedule()
+WiFiUDP groupUdp;                                   // Where group command datagrams arrive
+bool groupListening = false;                        // True while groupUdp is listening for them
+uint64_t groupLastStamp = 0;                        // The stamp of the last group command accepted
+uint32_t groupAccepted = 0;                         // The number of group commands accepted
+uint32_t groupDuplicates = 0;                       // The number ignored because they'd been seen (or were out of order)
+uint32_t groupRejected = 0;                         // The number rejected as malformed, unsigned or out of date
+bool mdnsStarted = false;                           // True once the mDNS responder is going
+char mdnsHost[24] = "";                             // Our mDNS host name, without the ".local"
+MDNSResponder::hMDNSService mdnsService = nullptr;  // Our DNS-SD _http._tcp service
+uint64_t pmAwakeMicros = 0;                         // micros() spent running tasks since applyPowerMode()
+uint64_t pmIdleMicros = 0;                          // micros() spent in loop()'s delay() since then
+uint64_t pmLongIdleMicros = 0;                      // Those of them in delay()s of a beacon interval or more
+uint64_t pmLateMicros = 0;                          // Total micros() those delay()s overran what was asked for
+uint32_t pmLateMaxMicros = 0;                       // The most any one of them overran
+uint32_t pmWakes = 0;                               // The number of them
 minPastMidnight_t sunrise = 0;                      // Time (mins past midnight) of today's sunrise
 minPastMidnight_t sunset = 0;                       // Time (mins past midnight) of today's sunset
 
@@ -235,8 +481,8 @@ minPastMidnight_t sunset = 0;                       // Time (mins past midnight)
  * @param hhcmm                 The string "hh:mm" that's to be converted
  * @return minPastMidnight_t    The equivalent in minutes past midnight
  */
-minPastMidnight_t toMinsPastMidnight(String hhcmm) {
-    return (hhcmm.substring(0, 2).toInt() * 60) + hhcmm.substring(3, 5).toInt();
+minPastMidnight_t toMinsPastMidnight(const char* hhcmm) {
+    return atoi(hhcmm) * 60 + (strlen(hhcmm) > 3 ? atoi(hhcmm + 3) : 0);
 }
 
 /**
@@ -269,46 +515,98 @@ inline void setLEDto(int state) {
 }
 
 /**
+ * @brief   Utility function to calculate the check byte for a config change log record
  * 
- * @brief Set the system clock to the current local time and date using an NTP server. 
- * 
- * @return true   Time set successfully
- * @return false  Unable to set the time. Don't trust the system time
+ * @param rec       The record
+ * @return uint8_t  Its check byte
+ */
+uint8_t configLogCheck(const configLogRec_t &rec) {
+    const uint8_t* b = (const uint8_t*)&rec;
+    uint8_t check = CONFIG_LOG_CHECK;
+    for (uint8_t i = 0; i < sizeof(rec); i++) {
+        check ^= &b[i] == &rec.check ? 0 : b[i];
+    }
+    return check;
+}
+
+/**
+ * @brief   Utility function to put all of config in EEPROM and empty the config change log.
  * 
+ * @return true     Success
+ * @return false    Failure
  */
-bool setClock() {
-    configTzTime(config.timeZone, NTP_SERVER);
-    time_t nowSecs = 0;
-    unsigned long startMillis = millis();
-    Serial.print(F("Waiting for NTP time sync..."));
-    do {
-        nowSecs = time(nullptr);
-        Serial.print(".");
-        toggleLED();
-        delay(WIFI_DELAY_MILLIS);
-    } while (nowSecs < DAWN_OF_HISTORY && millis() - startMillis < NTP_SET_MILLIS);
-    if (nowSecs > DAWN_OF_HISTORY) {
-        Serial.printf("Sync successful. Current time: %s", ctime(&nowSecs)); // ctime() appends a "\n", just because.
-        setLEDto(LED_LIT);
-        return true;
-    } else {
-        Serial.print("Unable to set the time.\n");
-        setLEDto(LED_DARK);
+bool compactConfig() {
+    EEPROM.put(0, config);
+    if (!EEPROM.commit()) {
         return false;
     }
+    savedConfig = config;
+    // If the log can't be cleared, what's in it would be replayed over the new base at boot. 
+    // That's harmless -- the base already has the last value of everything the log changed.
+    if (!configLog.clear()) {
+        Serial.print("[compactConfig] Unable to clear the config change log.\n");
+    }
+    return true;
 }
 
 /**
- * @brief Utility function to save the config data and optionally print a message upon success
+ * @brief   Utility function to save the config data and optionally print a message upon success. 
+ * 
+ *          The parts of config that changed since the last save are appended to the config 
+ *          change log, FR_RECORD_SIZE - 4 bytes per record. That's a small flash write without 
+ *          an erase. Only when the log is full, or there's no base copy in EEPROM yet, is all of 
+ *          config put in EEPROM and the log emptied.
  * 
  * @param successMessage    The message to print to Serial if save succeeds. omitted ==> no message
  * @return true             Save succeeded
  * @return false            Save failed
  */
 bool saveConfig(String successMessage = "") {
+    #ifdef METRICS
+    uint32_t startMicros = micros();
+    #endif
+    configPending = false;
     config.signature = CONFIG_SIG;
-    EEPROM.put(0, config);
-    if (EEPROM.commit()) {
+    const uint8_t* cur = (const uint8_t*)&config;
+    const uint8_t* old = (const uint8_t*)&savedConfig;
+    const uint16_t chunk = sizeof(configLogRec_t::data);
+
+    // Count the chunks of config that changed
+    uint16_t nChanged = 0;
+    for (uint16_t offset = 0; offset < sizeof(config); offset += chunk) {
+        uint16_t len = sizeof(config) - offset < chunk ? sizeof(config) - offset : chunk;
+        if (memcmp(cur + offset, old + offset, len) != 0) {
+            nChanged++;
+        }
+    }
+
+    // Log them if we can. Otherwise, put it all in EEPROM.
+    bool success = true;
+    if (savedConfig.signature != CONFIG_SIG || nChanged > configLog.room()) {
+        success = compactConfig();
+    } else {
+        for (uint16_t offset = 0; offset < sizeof(config) && success; offset += chunk) {
+            configLogRec_t rec;
+            rec.len = sizeof(config) - offset < chunk ? sizeof(config) - offset : chunk;
+            if (memcmp(cur + offset, old + offset, rec.len) == 0) {
+                continue;
+            }
+            rec.offset = offset;
+            memset(rec.data, 0, sizeof(rec.data));
+            memcpy(rec.data, cur + offset, rec.len);
+            rec.check = configLogCheck(rec);
+            success = configLog.append(&rec);
+        }
+        // If logging failed part way, fall back to saving everything
+        success = success ? true : compactConfig();
+        if (success) {
+            savedConfig = config;
+        }
+    }
+    #ifdef METRICS
+    configSaveMicros.record(micros() - startMicros);
+    #endif
+    if (success) {
         if (successMessage.length() != 0) {
             Serial.print(successMessage);
         }
@@ -319,1064 +617,2719 @@ bool saveConfig(String successMessage = "") {
 }
 
 /**
- * @brief Return the state of the outlet.
+ * @brief   Utility function to arrange for config to be saved CONFIG_COMMIT_MILLIS from now, so 
+ *          that a burst of changes is saved all at once.
  * 
- * @return true     The outlet is turned on
- * @return false    The outlet is turned off
  */
-bool outletIsOn() {
-    return digitalRead(RELAY) == RELAY_CLOSED;
+void saveConfigSoon() {
+    configPending = true;
+    scheduler.runIn(commitTaskId, CONFIG_COMMIT_MILLIS);
 }
 
 /**
- * @brief Invert the state of the outlet. I.e., if it was on, turn it (and the LED) off and vice versa.
+ * @brief   Utility function to save config now if a save has been arranged by saveConfigSoon(). 
+ *          Call before resetting or restarting.
  * 
  */
-void toggleOutlet() {
-    uint8_t newRelayState = digitalRead(RELAY) == RELAY_CLOSED ? RELAY_OPEN : RELAY_CLOSED;
-    digitalWrite(RELAY, newRelayState);
+void flushConfig() {
+    if (configPending) {
+        saveConfig();
+    }
 }
 
 /**
- * @brief   Turn the outlet on or off as specified by outletOn value
+ * @brief   Utility function to calculate the check byte for an outlet event log record
  * 
- * @param outletOn  true ==> outlet turns on, false ==> outlet turns off
+ * @param rec       The record
+ * @return uint8_t  Its check byte
  */
-void setOutletTo(bool outletOn) {
-    digitalWrite(RELAY, outletOn ? RELAY_CLOSED : RELAY_OPEN);
-
-    #ifdef DEBUG
-    Serial.printf("  Turned outlet %s.\n", outletOn ? "on" : "off");
-    #endif
+uint8_t eventCheck(const eventRec_t &rec) {
+    const uint8_t* b = (const uint8_t*)&rec;
+    uint8_t check = EVENT_LOG_CHECK;
+    for (uint8_t i = 0; i < sizeof(rec); i++) {
+        check ^= &b[i] == &rec.check ? 0 : b[i];
+    }
+    return check;
 }
 
 /**
- * @brief Assemble the current state of our commandline page and send it to the httpClient. 
- * 
- * @param httpClient    The HTTP client we are to send the assembled page to.
- */
-void sendCommandLinePage(WiFiClient* httpClient) {
-    String pageHtml =   "<!doctype html>\n"
-                    "<html>\n"
-                    "<head>\n"
-                    "<meta charset=\"utf-8\">\n"
-                    "<title>WiFi Outlet Command Processor</title>\n"
-                    "<style>\n"
-                    "body {\n"
-                    "background-color: black;\n"
-                    "color: antiquewhite;\n"
-                    "font-family: \"Gill Sans\", \"Gill Sans MT\", \"Myriad Pro\", \"DejaVu Sans Condensed\", Helvetica, Arial, \"sans-serif\";\n"
-                    "}\n"
-                    "h1 {\n"
-                    "text-align: center;\n"
-                    "font-family: Cambria, \"Hoefler Text\", \"Liberation Serif\", Times, \"Times New Roman\", \"serif\";\n"
-                    "}\n"
-                    ".screen {\n"
-                    "font-family: Consolas, \"Andale Mono\", \"Lucida Console\", \"Lucida Sans Typewriter\", Monaco, \"Courier New\", \"monospace\";\n"
-                    "font-size: 12pt;\n"
-                    "color: lightgreen;\n"
-                    "}\n"
-                    "textarea {\n"
-                    "background-color: black;\n"
-                    "font-family: Consolas, \"Andale Mono\", \"Lucida Console\", \"Lucida Sans Typewriter\", Monaco, \"Courier New\", \"monospace\";\n"
-                    "font-size: 12pt;\n"
-                    "color: lightgreen;\n"
-                    "border-style: none;\n"
-                    "}\n"
-                    "input {\n"
-                    "background-color: black;\n"
-                    "font-family: Consolas, \"Andale Mono\", \"Lucida Console\", \"Lucida Sans Typewriter\", Monaco, \"Courier New\", \"monospace\";\n"
-                    "font-size: 12pt;\n"
-                    "color: lightgreen;\n"
-                    "border-style: none;\n"
-                    "}\n"
-                    "input:focus {\n"
-                    "outline: none!important\n"
-                    "}\n"
-                    "</style>\n"
-                    "</head>\n"
-                    "<body>\n"
-                    "<h1>WiFi Outlet &ldquo;@outletName&rdquo; Command Processor</h1>\n"
-                    "<p>Using this page you can interact with the Outlet's command processor.</p>\n"
-                    "<form method=\"post\">\n"
-                    "<textarea class=\"screen\" name=\"screen\" cols=\"120\" rows=\"@rows\" tabindex=\"0\">\n"
-                    "@display\n"
-                    "</textarea><br />\n"
-                    "<span class=\"screen\">@prompt </span><input type=\"text\" name=\"cmd\" maxlength=\"120\" size=\"120\" tabindex=\"0\" autofocus />\n"
-                    "<input type=\"submit\" tabindex=\"0\" hidden />\n"
-                    "</form>\n"
-                    "<p>&nbsp;</p>\n"
-                    "<p style=\"font-size: 80%\" >@outletBanner Copyright &copy; 2023 by D. L. Ehnebuske.</p>\n"
-                    "</body>\n"
-                    "</html>\r\n"
-                    "\r\n";
-
-    // Replace all the variable informaton in the html with the current values
-    pageHtml.replace("@outletName", config.outletName);
-    pageHtml.replace("@rows", String(CMD_SCREEN_LINES));
-    pageHtml.replace("@display", screenContents);
-    pageHtml.replace("@prompt", CMD_PROMPT);
-    pageHtml.replace("@outletBanner", BANNER);
-
-    httpClient->print(pageHtml);
-}
-
-/**
- * @brief Assemble the current state of our home page and send it to the httpClient.
- * 
- * @param httpClient    The HTTP client we are to send the assembled home page to.
- */
-void sendHomePage(WiFiClient* httpClient) {
-// The HTML for the device's "home page"
-    String pageHtml = "<!doctype html>\n"
-        "<html>\n"
-        "<head>\n"
-        "<meta charset=\"utf-8\">\n"
-        "<title>WiFi Outlet</title>\n"
-        "<style>\n"
-        "body {\n"
-        "background-color: black;\n"
-        "color: antiquewhite;\n"
-        "font-family: \"Gill Sans\", \"Gill Sans MT\", \"Myriad Pro\", \"DejaVu Sans Condensed\", Helvetica, Arial, \"sans-serif\";\n"
-        "}\n"
-        "h1 {\n"
-        "text-align: center;\n"
-        "font-family: Cambria, \"Hoefler Text\", \"Liberation Serif\", Times, \"Times New Roman\", \"serif\";\n"
-        "}\n"
-        "td {\n"
-        "text-align: center;\n"
-        "}\n"
-        ".hdr {\n"
-        "background-color: #3A3A3A;\n"
-        "}\n"
-        "</style>\n"
-        "</head>\n"
-        "<body>\n"
-        "<h1>WiFi Outlet &ldquo;@outletName&rdquo; Control Panel</h1>\n"
-        "<form method=\"post\">\n"
-        "<table width=\"100%\" border=\"0\" cellpadding=\"10\">\n"
-        "<tbody>\n"
-        "<tr>\n"
-        "<td class=\"hdr\">\n"
-        "<input type=\"checkbox\" name=\"s0en\" @s0en>\n"
-        "<label for=\"s0en\">Enable</label>\n"
-        "</td>\n"
-        "<td class=\"hdr\">\n"
-        "<input type=\"checkbox\" name=\"s1en\" @s1en>\n"
-        "<label for=\"s1en\">Enable</label>\n"
-        "</td>\n"
-        "</tr>\n"
-        "<tr>\n"
-        "<td>\n"
-        "<input type=\"radio\" name=\"s0ty\" value=\"s0dy\" @s0dy><label for=\"s0dy\">Daily</label>\n"
-        "<input type=\"radio\" name=\"s0ty\" value=\"s0wd\" @s0wd><label for=\"s0wd\">Weekday</label>   \n"
-        "<input type=\"radio\" name=\"s0ty\" value=\"s0we\" @s0we><label for=\"s0we\">Weekend</label>\n"
-        "</td>\n"
-        "<td>\n"
-        "<input type=\"radio\" name=\"s1ty\" value=\"s1dy\" @s1dy><label for=\"s1dy\">Daily</label>\n"
-        "<input type=\"radio\" name=\"s1ty\" value=\"s1wd\" @s1wd><label for=\"s1wd\">Weekday</label>\n"
-        "<input type=\"radio\" name=\"s1ty\" value=\"s1we\" @s1we><label for=\"s1we\">Weekend</label>\n"
-        "</td>\n"
-        "</tr>\n"
-        "<tr>\n"
-        "<td>\n"
-        "From&nbsp;<input type=\"time\" name=\"s0on\" value=\"@s0on\">\n"
-        "to&nbsp;<input type=\"time\" name=\"s0of\" value=\"@s0of\">\n"
-        "with&nbsp;<input type=\"number\" size=\"4\" min=\"0\" max=\"60\" name=\"s0fz\" value=\"@s0fz\">&nbsp;min&nbsp;variability\n"
-        "</td>\n"
-        "<td>\n"
-        "From&nbsp;<input type=\"time\" name=\"s1on\" value=\"@s1on\">\n"
-        "to&nbsp;<input type=\"time\" name=\"s1of\" value=\"@s1of\">\n"
-        "with&nbsp;<input type=\"number\" size=\"4\" min=\"0\" max=\"60\" name=\"s1fz\" value=\"@s1fz\">&nbsp;min&nbsp;variability\n"
-        "</td>\n"
-        "</tr>\n"
-        "<tr>\n"
-        "<td><p>&nbsp;</p></td>\n"
-        "</tr>\n"
-        "<tr>\n"
-        "<td class=\"hdr\">\n"
-        "<input type=\"checkbox\" name=\"s2en\" @s2en>\n"
-        "<label for=\"s2en\">Enable</label>\n"
-        "</td>\n"
-        "<td class=\"hdr\">\n"
-        "<input type=\"checkbox\" name=\"s3en\" @s3en>\n"
-        "<label for=\"s3en\">Enable</label>\n"
-        "</td>\n"
-        "</tr>\n"
-        "<tr>\n"
-        "<td>\n"
-        "<input type=\"radio\" name=\"s2ty\" value=\"s2dy\" @s2dy><label for=\"s2dy\">Daily</label>\n"
-        "<input type=\"radio\" name=\"s2ty\" value=\"s2wd\" @s2wd><label for=\"s2wd\">Weekday</label>   \n"
-        "<input type=\"radio\" name=\"s2ty\" value=\"s2we\" @s2we><label for=\"s2we\">Weekend</label>\n"
-        "</td>\n"
-        "<td>\n"
-        "<input type=\"radio\" name=\"s3ty\" value=\"s3dy\" @s3dy><label for=\"s3dy\">Daily</label>\n"
-        "<input type=\"radio\" name=\"s3ty\" value=\"s3wd\" @s3wd><label for=\"s3wd\">Weekday</label>\n"
-        "<input type=\"radio\" name=\"s3ty\" value=\"s3we\" @s3we><label for=\"s3we\">Weekend</label>\n"
-        "</td>\n"
-        "</tr>\n"
-        "<tr>\n"
-        "<td>\n"
-        "From&nbsp;<input type=\"time\" name=\"s2on\" value=\"@s2on\">\n"
-        "to&nbsp;<input type=\"time\" name=\"s2of\" value=\"@s2of\">\n"
-        "with&nbsp;<input type=\"number\" size=\"4\" min=\"0\" max=\"60\" name=\"s2fz\" value=\"@s2fz\">&nbsp;min&nbsp;variability\n"
-        "</td>\n"
-        "<td>\n"
-        "From&nbsp;<input type=\"time\" name=\"s3on\" value=\"@s3on\">\n"
-        "to&nbsp;<input type=\"time\" name=\"s3of\" value=\"@s3of\">\n"
-        "with&nbsp;<input type=\"number\" size=\"4\" min=\"0\" max=\"60\" name=\"s3fz\" value=\"@s3fz\">&nbsp;min&nbsp;variability\n"
-        "</td>\n"
-        "</tr>\n"
-        "<tr>\n"
-        "<td><p>&nbsp;</p></td>\n"
-        "</tr>\n"
-        "<tr>\n"
-        "<td class=\"hdr\">\n"
-        "<input type=\"checkbox\" name=\"s4en\" @s4en>\n"
-        "<label for=\"s4en\">Enable</label>\n"
-        "</td>\n"
-        "<td class=\"hdr\">\n"
-        "<input type=\"checkbox\" name=\"s5en\" @s5en>\n"
-        "<label for=\"s5en\">Enable</label>\n"
-        "</td>\n"
-        "</tr>\n"
-        "<tr>\n"
-        "<td>\n"
-        "<input type=\"radio\" name=\"s4ty\" value=\"s4dy\" @s4dy><label for=\"s4dy\">Daily</label>\n"
-        "<input type=\"radio\" name=\"s4ty\" value=\"s4wd\" @s4wd><label for=\"s4wd\">Weekday</label>   \n"
-        "<input type=\"radio\" name=\"s4ty\" value=\"s4we\" @s4we><label for=\"s4we\">Weekend</label>\n"
-        "</td>\n"
-        "<td>\n"
-        "<input type=\"radio\" name=\"s5ty\" value=\"s5dy\" @s5dy><label for=\"s5dy\">Daily</label>\n"
-        "<input type=\"radio\" name=\"s5ty\" value=\"s5wd\" @s5wd><label for=\"s5wd\">Weekday</label>\n"
-        "<input type=\"radio\" name=\"s5ty\" value=\"s5we\" @s5we><label for=\"s5we\">Weekend</label>\n"
-        "</td>\n"
-        "</tr>\n"
-        "<tr>\n"
-        "<td>\n"
-        "From&nbsp;<input type=\"time\" name=\"s4on\" value=\"@s4on\">\n"
-        "to&nbsp;<input type=\"number\" size=\"6\" min=\"0\" max=\"120\" name=\"s4ofd\" value=\"@s4ofd\">&nbsp;min&nbsp;after&nbsp;sunrise\n"
-        "with&nbsp;<input type=\"number\" size=\"4\" min=\"0\" max=\"60\" name=\"s4fz\" value=\"@s4fz\">&nbsp;min&nbsp;variability\n"
-        "</td>\n"
-        "<td>\n"
-        "From <input type=\"number\" size=\"6\" min=\"0\" max=\"120\" name=\"s5ond\" value=\"@s5ond\">&nbsp;min&nbsp;before&nbsp;sunset\n"
-        "to&nbsp;<input type=\"time\" name=\"s5of\" value=\"@s5of\">\n"
-        "with&nbsp;<input type=\"number\" size=\"4\" min=\"0\" max=\"60\" name=\"s5fz\" value=\"@s5fz\">&nbsp;min&nbsp;variability\n"
-        "</td>\n"
-        "</tr>\n"
-        "<tr>\n"
-        "<td><p>&nbsp;</p></td>\n"
-        "</tr>\n"
-        "<tr>\n"
-        "<td class=\"hdr\">\n"
-        "<input type=\"checkbox\" name=\"s6en\" @s6en>\n"
-        "<label for=\"s6en\">Enable</label>\n"
-        "</td>\n"
-        "<td class=\"hdr\">\n"
-        "<input type=\"checkbox\" name=\"s7en\" @s7en>\n"
-        "<label for=\"s7en\">Enable</label>\n"
-        "</td>\n"
-        "</tr>\n"
-        "<tr>\n"
-        "<td>\n"
-        "<input type=\"radio\" name=\"s6ty\" value=\"s6dy\" @s6dy><label for=\"s6dy\">Daily</label>\n"
-        "<input type=\"radio\" name=\"s6ty\" value=\"s6wd\" @s6wd><label for=\"s6wd\">Weekday</label>   \n"
-        "<input type=\"radio\" name=\"s6ty\" value=\"s6we\" @s6we><label for=\"s6we\">Weekend</label>\n"
-        "</td>\n"
-        "<td>\n"
-        "<input type=\"radio\" name=\"s7ty\" value=\"s7dy\" @s7dy><label for=\"s7dy\">Daily</label>\n"
-        "<input type=\"radio\" name=\"s7ty\" value=\"s7wd\" @s7wd><label for=\"s7wd\">Weekday</label>\n"
-        "<input type=\"radio\" name=\"s7ty\" value=\"s7we\" @s7we><label for=\"s7we\">Weekend</label>\n"
-        "</td>\n"
-        "</tr>\n"
-        "<tr>\n"
-        "<td>\n"
-        "From&nbsp;<input type=\"time\" name=\"s6on\" value=\"@s6on\">\n"
-        "to&nbsp;<input type=\"number\" size=\"6\" min=\"0\" max=\"120\" name=\"s6ofd\" value=\"@s6ofd\">&nbsp;min&nbsp;after&nbsp;sunrise\n"
-        "with&nbsp;<input type=\"number\" size=\"4\" min=\"0\" max=\"60\" name=\"s6fz\" value=\"@s6fz\">&nbsp;min&nbsp;variability\n"
-        "</td>\n"
-        "<td>\n"
-        "From <input type=\"number\" size=\"6\" min=\"0\" max=\"120\" name=\"s7ond\" value=\"@s7ond\">&nbsp;min&nbsp;before&nbsp;sunset\n"
-        "to&nbsp;<input type=\"time\" name=\"s7of\" value=\"@s7of\">\n"
-        "with&nbsp;<input type=\"number\" size=\"4\" min=\"0\" max=\"60\" name=\"s7fz\" value=\"@s7fz\">&nbsp;min&nbsp;variability\n"
-        "</td>\n"
-        "</tr>\n"
-        "<tr>\n"
-        "<td><p>&nbsp;</p></td>\n"
-        "</tr>\n"
-        "</tbody>\n"
-        "</table>\n"
-        "<p><input type=\"submit\" value=\"Save schedule\" formaction=\"/index.html?" SCHED_UPDATE_QUERY "\" /></p>\n"
-        "<p>The shedule is currently @schedIs. To @schedWillBe it, click the button below.</p>\n"
-        "<p><input type=\"submit\" value=\"@schEnButton schedule\" formaction=\"/index.html?" SCHED_TOGGLE_QUERY "\" /></p>\n"
-        "<h2>Manual Control</h2>\n"
-        "<p>The outlet is currently @outletIs. To turn it @outletWillBe click the button below.</p>\n"
-        "<input type=\"submit\" value=\"Turn outlet @outletWillBe\" formaction=\"/index.html?" TOGGLE_QUERY "\" />\n"
-        "</form>\n"
-        "<p>&nbsp;</p>\n"
-        "<p style=\"font-size: 80%\" >@outletBanner Copyright &copy; 2023 by D. L. Ehnebuske.</p>\n"
-        "</body>\n"
-        "</html>\r\n"
-        "\r\n";
-
-    // Substitute all the variable information needed in the HTLM. Each variable in the text is a name beginning with "@"
-    pageHtml.replace("@outletName", config.outletName);
-    pageHtml.replace("@s0en", config.cycleEnable[0] ? "checked" : "");
-    pageHtml.replace("@s1en", config.cycleEnable[1] ? "checked" : "");
-    pageHtml.replace("@s2en", config.cycleEnable[2] ? "checked" : "");
-    pageHtml.replace("@s3en", config.cycleEnable[3] ? "checked" : "");
-    pageHtml.replace("@s4en", config.cycleEnable[4] ? "checked" : "");
-    pageHtml.replace("@s5en", config.cycleEnable[5] ? "checked" : "");
-    pageHtml.replace("@s6en", config.cycleEnable[6] ? "checked" : "");
-    pageHtml.replace("@s7en", config.cycleEnable[7] ? "checked" : "");
-
-    pageHtml.replace("@s0dy", config.cycleType[0] == daily ? "checked" : "");
-    pageHtml.replace("@s0wd", config.cycleType[0] == weekDay ? "checked" : "");
-    pageHtml.replace("@s0we", config.cycleType[0] == weekEnd ? "checked" : "");
-    pageHtml.replace("@s1dy", config.cycleType[1] == daily ? "checked" : "");
-    pageHtml.replace("@s1wd", config.cycleType[1] == weekDay ? "checked" : "");
-    pageHtml.replace("@s1we", config.cycleType[1] == weekEnd ? "checked" : "");
-    pageHtml.replace("@s2dy", config.cycleType[2] == daily ? "checked" : "");
-    pageHtml.replace("@s2wd", config.cycleType[2] == weekDay ? "checked" : "");
-    pageHtml.replace("@s2we", config.cycleType[2] == weekEnd ? "checked" : "");
-    pageHtml.replace("@s3dy", config.cycleType[3] == daily ? "checked" : "");
-    pageHtml.replace("@s3wd", config.cycleType[3] == weekDay ? "checked" : "");
-    pageHtml.replace("@s3we", config.cycleType[3] == weekEnd ? "checked" : "");
-    pageHtml.replace("@s4dy", config.cycleType[4] == daily ? "checked" : "");
-    pageHtml.replace("@s4wd", config.cycleType[4] == weekDay ? "checked" : "");
-    pageHtml.replace("@s4we", config.cycleType[4] == weekEnd ? "checked" : "");
-    pageHtml.replace("@s5dy", config.cycleType[5] == daily ? "checked" : "");
-    pageHtml.replace("@s5wd", config.cycleType[5] == weekDay ? "checked" : "");
-    pageHtml.replace("@s5we", config.cycleType[5] == weekEnd ? "checked" : "");
-    pageHtml.replace("@s6dy", config.cycleType[3] == daily ? "checked" : "");
-    pageHtml.replace("@s6wd", config.cycleType[6] == weekDay ? "checked" : "");
-    pageHtml.replace("@s6we", config.cycleType[6] == weekEnd ? "checked" : "");
-    pageHtml.replace("@s7dy", config.cycleType[7] == daily ? "checked" : "");
-    pageHtml.replace("@s7wd", config.cycleType[7] == weekDay ? "checked" : "");
-    pageHtml.replace("@s7we", config.cycleType[7] == weekEnd ? "checked" : "");
-
-    pageHtml.replace("@s0on", fromMinsPastMidnight(config.cycleOnTime[0]));
-    pageHtml.replace("@s0of", fromMinsPastMidnight(config.cycleOffTime[0]));
-    pageHtml.replace("@s1on", fromMinsPastMidnight(config.cycleOnTime[1]));
-    pageHtml.replace("@s1of", fromMinsPastMidnight(config.cycleOffTime[1]));
-    pageHtml.replace("@s2on", fromMinsPastMidnight(config.cycleOnTime[2]));
-    pageHtml.replace("@s2of", fromMinsPastMidnight(config.cycleOffTime[2]));
-    pageHtml.replace("@s3on", fromMinsPastMidnight(config.cycleOnTime[3]));
-    pageHtml.replace("@s3of", fromMinsPastMidnight(config.cycleOffTime[3]));
-
-    pageHtml.replace("@s4on", fromMinsPastMidnight(config.sunTime[0]));
-    pageHtml.replace("@s4ofd", String(config.sunDelta[0]));
-    pageHtml.replace("@s5ond", String(config.sunDelta[1]));
-    pageHtml.replace("@s5of", fromMinsPastMidnight(config.sunTime[1]));
-    pageHtml.replace("@s6on", fromMinsPastMidnight(config.sunTime[2]));
-    pageHtml.replace("@s6ofd", String(config.sunDelta[2]));
-    pageHtml.replace("@s7ond", String(config.sunDelta[3]));
-    pageHtml.replace("@s7of", fromMinsPastMidnight(config.sunTime[3]));
-    
-    pageHtml.replace("@s0fz", String(config.cycleFuzz[0]));
-    pageHtml.replace("@s1fz", String(config.cycleFuzz[1]));
-    pageHtml.replace("@s2fz", String(config.cycleFuzz[2]));
-    pageHtml.replace("@s3fz", String(config.cycleFuzz[3]));
-    pageHtml.replace("@s4fz", String(config.cycleFuzz[4]));
-    pageHtml.replace("@s5fz", String(config.cycleFuzz[5]));
-    pageHtml.replace("@s6fz", String(config.cycleFuzz[6]));
-    pageHtml.replace("@s7fz", String(config.cycleFuzz[7]));
-
-    pageHtml.replace("@schedIs", config.enabled ? "enabled" : "disabled");
-    pageHtml.replace("@schedWillBe", config.enabled ? "disable" : "enable");
-    pageHtml.replace("@schEnButton", config.enabled ? "Disable" : "Enable");
-    pageHtml.replace("@outletIs", outletIsOn() ? "on" : "off");
-    pageHtml.replace("@outletWillBe", outletIsOn() ? "off" : "on");
-    pageHtml.replace("@outletBanner", BANNER);
-
-    httpClient->print(pageHtml);        // Send the complete text to the client.
-}
-
-/**
- * @brief   HTTP GET and HEAD method handler for webServer. Send the complete message for the 
- *          request -- headers and, if applicable, content -- that is the response to a GET (or 
- *          HEAD) request for the specified trPath and trQuery to the httpClient.
+ * @brief   Write the events waiting in eventPending[] to the event log. Any that were stamped with
+ *          the time since boot because the clock wasn't set yet get the real time, if it's now 
+ *          known. The event task; also call before resetting or restarting.
  * 
- * @param webServer         The SimpleWebServer for which we're acting as the GET and HEAD handlers.
- * @param httpClient        The HTTP Client making the request.
- * @param trPath            The path portion of the URI of the resource being requested.
- * @param trQuery           The trQuery (if any).
  */
-void handleGetAndHead(SimpleWebServer* webServer, WiFiClient* httpClient, String trPath, String trQuery) {
-
-    // We have a "home page." If that's what was asked for, proceed.
-    if (trPath.equals("/") || trPath.equals("/index.html") || trPath.equals("index.htm")) {
-        httpClient->print(swsNormalResponseHeaders);
-        // If this is a GET request, add the content; for HEAD requests the headers are all there is.
-        if (webServer->httpMethod() == swsGET) {
-            sendHomePage(httpClient);
-        #ifdef DEBUG
-            Serial.print("GET request for home page received and processed.\n");
-            ui.cancelCmd();
-        } else {
-            Serial.print("HEAD request received and processed.\n");
-            ui.cancelCmd();
-        #endif
+void flushEvents() {
+    uint32_t upSecs = millis() / 1000;
+    for (uint8_t i = 0; i < nEventsPending; i++) {
+        eventRec_t rec = eventPending[i];
+        if ((rec.what & EVENT_UPTIME) != 0 && clockIsSet) {
+            rec.when = (uint32_t)time(nullptr) - (upSecs - rec.when);
+            rec.what &= ~EVENT_UPTIME;
+            rec.check = eventCheck(rec);
         }
-    } else if (trPath.equals("/commandline.html") || (trPath.equals("/commandline.htm")) ) {
-        httpClient->print(swsNormalResponseHeaders);
-        if (webServer->httpMethod() == swsGET) {
-            sendCommandLinePage(httpClient);
-        #ifdef DEBUG
-            Serial.print("GET request for commandline page received and processed.\n");
-            ui.cancelCmd();
-        } else {
-            Serial.print("HEAD request for commandline page received and processed.\n");
-            ui.cancelCmd();
-        #endif
+        if (!eventLog.append(&rec)) {
+            Serial.printf("[flushEvents] Couldn't write %u events to the log.\n", nEventsPending - i);
+            break;
         }
-
-    // Otherwise, they asked for some other resource. We don't have it. Respond with "404 Not Found" message.
-    } else {
-        httpClient->print(swsNotFoundResponse);
-        Serial.print("GET or HEAD request received for some page we don't have. Sent \"404 not found\"\n");
-        ui.cancelCmd();
     }
+    nEventsPending = 0;
 }
 
 /**
- * @brief   HTTP POST method handler for webServer. Send the complete message for the 
- *          request -- headers and, if applicable, content -- that is the response to a 
- *          POST for the specified trPath and trQuery to the httpClient.
+ * @brief   Note that the outlet just switched, and why, in the event log. The event waits in RAM
+ *          with any others that come along in the next EVENT_COMMIT_MILLIS (or until there are 
+ *          EVENT_BATCH of them), and then they're all written to flash together.
  * 
- * @param webServer         The SimpleWebServer for which we're acting as the POST handler.
- * @param httpClient        The HTTP client making the request.
- * @param trPath            The path portion of the URI of the resource being requested.
- * @param trQuery           The trQuery portion of the URI (if any).
+ * @param cause     Why it switched
+ * @param turnedOn  True if it turned on, false if off
+ * @param detail    For ecSchedule, the transition's source; for ecBoot, the reset reason; else 0
  */
-void handlePost(SimpleWebServer* webServer, WiFiClient* httpClient, String trPath, String trQuery) {
-    // Deal with a POST to the "home page".
-    if (trPath.equals("/") || trPath.equals("/index.html") || trPath.equals("index.htm")) {
-
-        // Deal with TOGGLE_QUERY -- flip the state of the outlet on --> off or vice versa
-        if (trQuery.equalsIgnoreCase(TOGGLE_QUERY)) {
-            toggleOutlet();
-            #ifdef DEBUG
-            Serial.printf("[handlePost] Outlet has been turned %s.\n", outletIsOn() ? "on" : "off");
-            #endif
-
-        // Deal with SCHED_TOGGLE_QUERY -- flip the state of the schedule enabled --> disabled or vice versa
-        } else if (trQuery.equalsIgnoreCase(SCHED_TOGGLE_QUERY)) {
-            config.enabled = !config.enabled;
-            saveConfig();
-            #ifdef DEBUG
-            Serial.printf("[handlePost] Schedule has been %s.\n", config.enabled ? "enabled" : "disabled");
-            #endif
-
-        // Deal with SCHED_UPDATE_QUERY -- store the state of the schedule in EEPROM
-        } else if (trQuery.equalsIgnoreCase(SCHED_UPDATE_QUERY)) {
-            #ifdef DEBUG
-            Serial.printf("[handlePost] Update schedule. Message headers: \"%s\"\nForm data: ", webServer->clientHeaders().c_str());
-            #endif
-            config.cycleEnable[0] = config.cycleEnable[1] = false;
-            config.cycleEnable[2] = config.cycleEnable[3] = false;
-            config.cycleEnable[4] = config.cycleEnable[5] = false;
-            config.cycleEnable[6] = config.cycleEnable[7] = false;  // N.B. Only sent in POST data when "on"
-            for (uint8_t i = 0; i < _formDataNameSize_; i++) {
-                String formValue = webServer->getFormDatum(formDataNames[i]);
-                if (formValue.length() != 0) {
-                    #ifdef DEBUG
-                    Serial.printf("%s = \"%s\" ", formDataNames[i].c_str(), formValue.c_str());
-                    #endif
-                    switch ((formDataName_t)i) {
-                        case fdS0en:
-                            config.cycleEnable[0] = formValue == "on" ? true : false;
-                            break;
-                        case fdS1en:
-                            config.cycleEnable[1] = formValue == "on" ? true : false;
-                            break;
-                        case fdS2en:
-                            config.cycleEnable[2] = formValue == "on" ? true : false;
-                            break;
-                        case fdS3en:
-                            config.cycleEnable[3] = formValue == "on" ? true : false;
-                            break;
-                        case fdS4en:
-                            config.cycleEnable[4] = formValue == "on" ? true : false;
-                            break;
-                        case fdS5en:
-                            config.cycleEnable[5] = formValue == "on" ? true : false;
-                            break;
-                        case fdS6en:
-                            config.cycleEnable[6] = formValue == "on" ? true : false;
-                            break;
-                        case fdS7en:
-                            config.cycleEnable[7] = formValue == "on" ? true : false;
-                            break;
-                        case fdS0ty:
-                            config.cycleType[0] = formValue == "s0dy" ? daily : formValue == "s0wd" ? weekDay : weekEnd;
-                            break;
-                        case fdS1ty:
-                            config.cycleType[1] = formValue == "s1dy" ? daily : formValue == "s1wd" ? weekDay : weekEnd;
-                            break;
-                        case fdS2ty:
-                            config.cycleType[2] = formValue == "s2dy" ? daily : formValue == "s2wd" ? weekDay : weekEnd;
-                            break;
-                        case fdS3ty:
-                            config.cycleType[3] = formValue == "s3dy" ? daily : formValue == "s3wd" ? weekDay : weekEnd;
-                            break;
-                        case fdS4ty:
-                            config.cycleType[4] = formValue == "s4dy" ? daily : formValue == "s4wd" ? weekDay : weekEnd;
-                            break;
-                        case fdS5ty:
-                            config.cycleType[5] = formValue == "s5dy" ? daily : formValue == "s5wd" ? weekDay : weekEnd;
-                            break;
-                        case fdS6ty:
-                            config.cycleType[6] = formValue == "s6dy" ? daily : formValue == "s6wd" ? weekDay : weekEnd;
-                            break;
-                        case fdS7ty:
-                            config.cycleType[7] = formValue == "s7dy" ? daily : formValue == "s7wd" ? weekDay : weekEnd;
-                            break;
-                        case fdS0on:
-                            config.cycleOnTime[0] = toMinsPastMidnight(formValue);
-                            break;
-                        case fdS1on:
-                            config.cycleOnTime[1] = toMinsPastMidnight(formValue);
-                            break;
-                        case fdS2on:
-                            config.cycleOnTime[2] = toMinsPastMidnight(formValue);
-                            break;
-                        case fdS3on:
-                            config.cycleOnTime[3] = toMinsPastMidnight(formValue);
-                            break;
-                        case fdS4on:
-                            config.sunTime[0] = toMinsPastMidnight(formValue);
-                            break;
-                        case fdS5ond:
-                            config.sunDelta[1] = formValue.toInt();
-                            break;
-                        case fdS6on:
-                            config.sunTime[2] = toMinsPastMidnight(formValue);
-                            break;
-                        case fdS7ond:
-                            config.sunDelta[3] = formValue.toInt();
-                            break;
-                        case fdS0of:
-                            config.cycleOffTime[0] = toMinsPastMidnight(formValue);
-                            break;
-                        case fdS1of:
-                            config.cycleOffTime[1] = toMinsPastMidnight(formValue);
-                            break;
-                        case fdS2of:
-                            config.cycleOffTime[2] = toMinsPastMidnight(formValue);
-                            break;
-                        case fdS3of:
-                            config.cycleOffTime[3] = toMinsPastMidnight(formValue);
-                            break;
-                        case fdS4ofd:
-                            config.sunDelta[0] = formValue.toInt();
-                            break;
-                        case fdS5of:
-                            config.sunTime[1] = toMinsPastMidnight(formValue);
-                            break;
-                        case fdS6ofd:
-                            config.sunDelta[2] = formValue.toInt();
-                            break;
-                        case fdS7of:
-                            config.sunTime[3] = toMinsPastMidnight(formValue);
-                            break;
-                        case fdS0fz:
-                            config.cycleFuzz[0] = formValue.toInt();
-                            break;
-                        case fdS1fz:
-                            config.cycleFuzz[1] = formValue.toInt();
-                            break;
-                        case fdS2fz:
-                            config.cycleFuzz[2] = formValue.toInt();
-                            break;
-                        case fdS3fz:
-                            config.cycleFuzz[3] = formValue.toInt();
-                            break;
-                        case fdS4fz:
-                            config.cycleFuzz[4] = formValue.toInt();
-                            break;
-                        case fdS5fz:
-                            config.cycleFuzz[5] = formValue.toInt();
-                            break;
-                        case fdS6fz:
-                            config.cycleFuzz[6] = formValue.toInt();
-                            break;
-                        case fdS7fz:
-                            config.cycleFuzz[7] = formValue.toInt();
-                            break;
-                        default:
-                            break;
-                    }
-                }
-            }
-            // Save the new data in config to EEPROM
-            #ifdef DEBUG
-            Serial.print("\n");
-            saveConfig("[handlePost] Configuration update saved.\n");
-            ui.cancelCmd();
-            #else
-            saveConfig();
-            #endif
-            scheduleUpdated = true;     // Let followSchedule() know we've updated the schedule 
-            
-        // Deal with a query to home page that we don't understand
-        } else {
-            Serial.printf("POST request received for query we don't understand: \"%s\".\n", trQuery.c_str());
-            Serial.printf(" Client message body: \"%s\".\n", webServer->clientBody().c_str());
-            ui.cancelCmd(); // Reissue command prompt after print
-            httpClient->print(swsBadRequestResponse);
-            return;
-        }
-
-        // Tell client we're good and go look at the home page for the result.
-        httpClient->print("HTTP/1.1 303 See other\r\n"
-                          "Location: /index.html\r\n\r\n");
-        return;
-
-    // Deal with a POST to the commandline page.
-    } else if (trPath.equals("/commandline.html") || trPath.equals("/commandline.htm")) {
-
-        // Retrieve the command and the current contents of the "screen"
-        String cmdLine = webServer->getFormDatum("cmd");
-        screenContents = webServer->getFormDatum("screen");
-
-        // From the screenContents remove all "\r" chars and trailing second "\n", if present.
-        screenContents.replace("\r", "");
-        if (screenContents.endsWith("\n\n")) {
-            screenContents.remove(screenContents.length() - 1);
-        }
-
-        // Execute the command and construct the line(s) we'll display on the screen.
-        String cmdResult = String(CMD_PROMPT) + cmdLine + "\n" + wc.doCommand(cmdLine);
-
-        // Count the number of lines in the result
-        int16_t resultLines = 1;
-        int16_t ix = 0;
-        while ((ix = cmdResult.indexOf("\n", ix) + 1) <= cmdResult.lastIndexOf("\n")) {
-            resultLines++;
-        }
-
-        // Remove trailing "\n", if any.
-        if (cmdResult.endsWith("\n")) {
-            cmdResult.remove(cmdResult.length() - 1);
-        }
-
-        // As needed, remove lines from the start of the result to get the line count below what fits on the screen.
-        while (resultLines > CMD_SCREEN_LINES) {
-            cmdResult = cmdResult.substring(cmdResult.indexOf("\n") + 1);
-            resultLines--;
-        }
-
-        // Count the lines in the current screenContents.
-        int16_t screenContentLines = 1;
-        ix = 0;
-        while ((ix = screenContents.indexOf("\n", ix) + 1) < screenContents.lastIndexOf("\n")) {
-            screenContentLines++;
-        }
-        
-        // As needed, remove lines from the start of screenContents to get the line count below what
-        // together with cmdResult fits on the screen. Then add the new results to the end.
-        while (screenContentLines + resultLines > CMD_SCREEN_LINES) {
-            screenContents = screenContents.substring(screenContents.indexOf("\n") + 1);
-            screenContentLines --;
-        }
-        screenContents += cmdResult;
-
-        // Tell the client we're good and to go look at the page again for the result.
-        httpClient->print("HTTP/1.1 303 See other\r\n"
-                          "Location: /commandline.html\r\n\r\n");
-        return;
+void logEvent(eventCause_t cause, bool turnedOn, uint8_t detail = 0) {
+    if (nEventsPending == EVENT_BATCH) {
+        flushEvents();                              // The event task is late; don't lose anything
+    }
+    eventRec_t &rec = eventPending[nEventsPending++];
+    rec.when = clockIsSet ? (uint32_t)time(nullptr) : millis() / 1000;
+    rec.what = cause | (turnedOn ? EVENT_ON : 0) | (clockIsSet ? 0 : EVENT_UPTIME);
+    rec.detail = detail;
+    rec.reserved = 0;
+    rec.check = eventCheck(rec);
+    if (nEventsPending == 1) {
+        scheduler.runIn(eventTaskId, EVENT_COMMIT_MILLIS);
+    } else if (nEventsPending == EVENT_BATCH) {
+        scheduler.runIn(eventTaskId, 0);
     }
-    // The client POSTed to a page we can't deal with. Respond with "400 Bad Request" message.
-    Serial.printf("POST request received for something other than the home page. path: \"%s\" query: \"%s\".\n",
-        trPath.c_str(), trQuery.c_str());
-    Serial.printf(" Client message body: \"%s\".\n", webServer->clientBody().c_str());
-    ui.cancelCmd(); // Reissue command prompt after print
-    httpClient->print(swsBadRequestResponse);
 }
 
 /**
- * @brief Utility function to follow the schedule defined by config. 
+ * @brief   Return the number of events there are, in the log and waiting to be written to it.
  * 
+ * @return uint16_t 
  */
-void followSchedule() {
-    static minPastMidnight_t lastMinPastMidnight = 0;       // When we last noticed the time change.
+uint16_t eventCount() {
+    return eventLog.count() + nEventsPending;
+}
 
-    // The actual on and off times times we use adjusted by sunrise, sunset and cycleFuzz
-    // cycleOn[x] == cycleOff[x] means ignore this cycle
-    static minPastMidnight_t cycleOn[N_CYCLES];
-    static minPastMidnight_t cycleOff[N_CYCLES];
+/**
+ * @brief   Get the specified event. 0 is the oldest; eventCount() - 1 the newest.
+ * 
+ * @param ix        The index of the event
+ * @param rec       Where to put it
+ * @return true     Success
+ * @return false    There's no such event, it couldn't be read or it fails its check
+ */
+bool readEvent(uint16_t ix, eventRec_t* rec) {
+    uint16_t inLog = eventLog.count();
+    if (ix < inLog) {
+        return eventLog.read(ix, rec) && rec->check == eventCheck(*rec) && (rec->what & EVENT_CAUSE_MASK) < _eventCauseSize;
+    }
+    if (ix - inLog < nEventsPending) {
+        *rec = eventPending[ix - inLog];
+        return true;
+    }
+    return false;
+}
 
-    time_t curTime = time(nullptr);
-    struct tm *t;
-    t = localtime(&curTime);
-    int tm_yearNow = t->tm_year;
-    int tm_ydayNow = t->tm_yday;
-    int tm_hourNow = t->tm_hour;
-    int tm_minNow = t->tm_min;
-    int tm_wdayNow = t->tm_wday;
-    minPastMidnight_t curMinPastMidnight = tm_hourNow * 60 + tm_minNow;
-
-    // If the schedule is turned off, or the time hasn't changed and there's no new schedule, nothing to do
-    if (!config.enabled || (curMinPastMidnight == lastMinPastMidnight && !scheduleUpdated)) {
+/**
+ * @brief   Print the specified event, either for people, e.g., "2023-11-15 18:30:00  on   schedule 
+ *          (cycle 5)" or as a JSON object, e.g., {"when":1700101800,"sinceBoot":false,"on":true,
+ *          "cause":"schedule","detail":5}. For people, a schedule's detail of N_CYCLES or more is 
+ *          a rule.
+ * 
+ * @param out       Where to print it
+ * @param rec       The event
+ * @param json      True for JSON, false for people
+ */
+void printEvent(Print* out, const eventRec_t &rec, bool json) {
+    bool sinceBoot = (rec.what & EVENT_UPTIME) != 0;
+    bool turnedOn = (rec.what & EVENT_ON) != 0;
+    uint8_t cause = rec.what & EVENT_CAUSE_MASK;
+    if (json) {
+        out->printf("{\"when\":%lu,\"sinceBoot\":%s,\"on\":%s,\"cause\":\"%s\",\"detail\":%u}", (unsigned long)rec.when, 
+            sinceBoot ? "true" : "false", turnedOn ? "true" : "false", eventCauseName[cause], rec.detail);
         return;
     }
-
-    // If the schedule has been updated or it's midnight, update sunrise, sunset, cycleOn[] and cycleOff[] values
-    if (scheduleUpdated || curMinPastMidnight == 0) {
-        // Get the sunrise and set times, figure out how much they moved, and update the old times
-        ObsSite site {config.latDeg, config.lonDeg, config.elevM};
-
-        time_t timeRise = site.getSunrise(tm_yearNow, tm_ydayNow);
-        struct tm *t = localtime(&timeRise);
-        sunrise = t->tm_hour * 60 + t->tm_min;
-
-        time_t timeSet = site.getSunset(tm_yearNow, tm_ydayNow);
-        t = localtime(&timeSet);
-        sunset = t->tm_hour * 60 + t->tm_min;
-         
-        #ifdef DEBUG
-        Serial.printf("[followSchedule] Sunrise: %s, sunset: %s\n", fromMinsPastMidnight(sunrise).c_str(), fromMinsPastMidnight(sunset).c_str());
-        Serial.print("Schedule:\n        on    off   E/D\n");
-        #endif
-        
-        for (int c = 0; c < N_CYCLES; c++) {
-            if (c < N_TIMED_CYCLES) {                                               // If on-time/off-time cycle
-                cycleOn[c] = config.cycleOnTime[c];                                 //  Use specified on/off times
-                cycleOff[c] = config.cycleOffTime[c];
-            } else if (c % 2 == 0) {                                                // Else if sunrise-based cycle
-                cycleOn[c] = config.sunTime[c - N_TIMED_CYCLES];                    //  On at spec'd time, off at sunset + delta
-                cycleOff[c] = (sunrise + (MINS_PER_DAY + config.sunDelta[c - N_TIMED_CYCLES])) % MINS_PER_DAY;
-            } else {                                                                // Else it's sunset-based cycle 
-                cycleOn[c] = (sunset + (MINS_PER_DAY - config.sunDelta[c - N_TIMED_CYCLES])) % MINS_PER_DAY;
-                cycleOff[c] = config.sunTime[c-N_TIMED_CYCLES];                     //  On at sunset - delta, off at spec'd time
-            }
-            if (config.cycleFuzz[c] != 0) {                                         // If the cycle has fuzz
-                int randMax = config.cycleFuzz[c] >= 0 ? config.cycleFuzz[c] : -config.cycleFuzz[c];
-                int fuzzMins = random(2 * randMax) - randMax;                       //  figure actual fuzz for this cycle today
-                int fuzzyTime = fuzzMins + cycleOn[c];
-                if (fuzzyTime > 0) {                                                //  Update on time if not before midnight
-                    cycleOn[c] = fuzzyTime;
-                }
-                fuzzyTime = fuzzMins + cycleOff[c];                                 //  Update off time if not before midnight
-                if (fuzzyTime > 0) {
-                    cycleOff[c] = fuzzyTime;
-                }
-            }
-            #ifdef DEBUG
-            //                     on    off   E/D
-            //             Cycle 0 00:00 00:00 enabled
-            Serial.printf("Cycle %1d %s %s %s\n", 
-                c, fromMinsPastMidnight(cycleOn[c]).c_str(), fromMinsPastMidnight(cycleOff[c]).c_str(), 
-                config.cycleEnable[c] ? "enabled" : "disabled");
-            #endif
-        }
+    if (sinceBoot) {
+        out->printf("boot + %8lu s    ", (unsigned long)rec.when);
+    } else {
+        char stamp[20];
+        time_t when = rec.when;
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&when));
+        out->print(stamp);
     }
-
-    scheduleUpdated = false;
-
-    bool isWeekday = tm_wdayNow >= 1 && tm_wdayNow <= 5;
-    // Handle each of the possible on/off cycles regardless of type and whether sun-based or not
-    for (uint8_t c = 0; c < sizeof(config.cycleEnable) / sizeof(config.cycleEnable[0]); c++){
-        #ifdef DEBUG
-        Serial.printf("[followSchedule] Cycle %d is %s.\n", c, config.cycleEnable[c] ? "enabled" : "disabled");
-        #endif
-        // If cycle c is enabled, is not being ignored and is applicable today
-        if (config.cycleEnable[c] && (cycleOn[c] != cycleOff[c]) &&
-          (config.cycleType[c] == daily || 
-          (config.cycleType[c] == weekDay && isWeekday) || 
-          (config.cycleType[c] == weekEnd && !isWeekday))) {
-            // If it's time for this cycleOn to go into effect, turn the outlet on
-            if (cycleOn[c] == curMinPastMidnight) {
-                setOutletTo(OUTLET_ON);
-            }
-            // If it's time for this cycleOff to go into effect, turn the outlet off
-            if (cycleOff[c] == curMinPastMidnight) {
-                setOutletTo(OUTLET_OFF);
-            }
-        }
+    out->printf("  %-3s  %s", turnedOn ? "on" : "off", eventCauseName[cause]);
+    if (cause == ecSchedule) {
+        out->printf(rec.detail < N_CYCLES ? " (cycle %u)" : " (rule %u)", rec.detail < N_CYCLES ? rec.detail : rec.detail - N_CYCLES);
+    } else if (cause == ecBoot) {
+        out->printf(" (reset reason %u)", rec.detail);
     }
-
-    lastMinPastMidnight = curMinPastMidnight;               // We handled things for the current time
-    #ifdef DEBUG
-    ui.cancelCmd();
-    #endif
 }
 
 /**
- * @brief The "help" and "h" ui command handler. Called by ui object as needed.
+ * @brief   Utility function to copy to config what's to be kept from stored config data that has 
+ *          another of our signatures: the WiFi credentials and the known good firmware. This is 
+ *          what lets new firmware with a new config layout connect and, if it's on trial, go back.
  * 
+ * @param stored    The stored data, with the changes in the config change log applied
+ * @return true     It's ours, and what could be kept was
+ * @return false    It isn't ours (or there isn't any)
  */
-String onHelp(CommandHandlerHelper* helper) {
-   return 
-        "Help for " BANNER "\n"
-        "  help               Print this text\n"
-        "  h                  Same as 'help'\n"
-        "  ssid [<ssid>]      Print or set the ssid of the WiFi AP we should connect to\n"
-        "  pw [<password>]    Print or set the password we are to use to connect\n"
-        "  tz [<timezone>]    Print or set the POSIX time zone string for the time zone we are in\n"
-        "  loc [lat lon elev] Print or set the locale. Latitude, longitude (degrees) and elevaton (meters)\n"
-        "  name [<name>]      Print or set the outlet's name\n"
-        "  save               Save the current ssid and password and continue\n"
-        "  status             Print the status of the system\n"
-        "  restart            Restart the device. E.g., to use newly saved WiFi credentials.\n";
+bool migrateConfig(const eepromData_t &stored) {
+    const uint8_t* from = (const uint8_t*)&stored;
+    if (stored.signature < CONFIG_FIRST_SIG || stored.signature >= CONFIG_FIRST_SIG + CONFIG_SIG_COUNT || 
+        memchr(stored.ssid, '\0', sizeof(stored.ssid)) == nullptr || memchr(stored.password, '\0', sizeof(stored.password)) == nullptr) {
+        return false;
+    }
+    if (stored.signature >= CONFIG_KEPT_SIG) {
+        // Everything up to CONFIG_KEPT_LEN is where it is in ours. (Later firmware's too.)
+        memcpy((uint8_t*)&config + sizeof(config.signature), from + sizeof(stored.signature), 
+            CONFIG_KEPT_LEN - sizeof(config.signature));
+    } else {
+        // Before that, ssid and password were where they are now, and (from 0x34AA) otaUrl and 
+        // otaMd5 were at the end.
+        memcpy(config.ssid, stored.ssid, sizeof(config.ssid));
+        memcpy(config.password, stored.password, sizeof(config.password));
+        if (stored.signature == 0x34AA) {
+            memcpy(config.otaUrl, from + CONFIG_34AA_URL_AT, sizeof(config.otaUrl));
+            memcpy(config.otaMd5, from + CONFIG_34AA_MD5_AT, sizeof(config.otaMd5));
+        }
+    }
+    config.ssid[sizeof(config.ssid) - 1] = '\0';
+    config.password[sizeof(config.password) - 1] = '\0';
+    config.otaUrl[sizeof(config.otaUrl) - 1] = '\0';
+    config.otaMd5[sizeof(config.otaMd5) - 1] = '\0';
+    return true;
 }
 
 /**
- * @brief The ssid ui command handler. Called by the ui object as needed.
+ * @brief   Utility function to restore config from EEPROM and the config change log. Call once, 
+ *          from setup().
  * 
  */
-String onSsid(CommandHandlerHelper* helper) {
-    String ssid = helper->getCommandLine().substring(helper->getWord(0).length());
-    ssid.trim();
-    unsigned int ssidLen = ssid.length();
-    if (ssidLen != 0 && ssidLen < sizeof(config.ssid)) {
-        strcpy(config.ssid, ssid.c_str());
-        return String("SSID changed to \"" + ssid + "\"\n");
-    } else if (ssidLen == 0) {
-        return String("SSID is \"") + String(config.ssid) + "\"\n";
+void restoreConfig() {
+    EEPROM.begin(sizeof(eepromData_t));
+    // If EEPROM has data, get it.
+    eepromData_t storedConfig {};
+    if (EEPROM.percentUsed() != -1) {
+        EEPROM.get(0,storedConfig);
+    }
+    #ifdef DEBUG
+    Serial.printf("Got stored data. signature: 0x%x, ssid: %s.\n", storedConfig.signature, storedConfig.ssid);
+    #endif
+    bool logOk = configLog.begin();
+    // Apply the changes made since it was stored. (They're in the stored data's layout, whatever it is.)
+    uint16_t nRecs = configLog.count();
+    for (uint16_t i = 0; i < nRecs && logOk; i++) {
+        configLogRec_t rec;
+        logOk = configLog.read(i, &rec) && rec.check == configLogCheck(rec) && 
+            rec.len != 0 && rec.len <= sizeof(rec.data) && rec.offset + rec.len <= sizeof(storedConfig);
+        if (logOk) {
+            memcpy((uint8_t*)&storedConfig + rec.offset, rec.data, rec.len);
+        }
+    }
+    #ifdef DEBUG
+    Serial.printf("Applied %d config changes from the log.\n", nRecs);
+    #endif
+    // If the stored signature matches, assume the stored data is our config. If it's an earlier 
+    // one of ours, keep what can be kept and leave the rest as it is, the defaults; it's saved in 
+    // the new layout the next time config is.
+    if (storedConfig.signature == CONFIG_SIG) {
+        config = storedConfig;
+    } else if (migrateConfig(storedConfig)) {
+        Serial.printf("Kept the WiFi credentials and known good firmware from config version 0x%04X.\n", storedConfig.signature);
+        savedConfig = config;
+        return;
+    }
+    // If the log couldn't all be read (e.g., power failed while appending to it), start afresh
+    if (!logOk && config.signature == CONFIG_SIG) {
+        Serial.print("The config change log was damaged. Saving what could be recovered.\n");
+        compactConfig();
+    } else {
+        savedConfig = config;
     }
-    return String("Specified SSID is too long. Maximum length is ") + String(sizeof(config.ssid) - 1) + "\n";
 }
 
 /**
- * @brief The pw ui command handler. Called by the ui object as needed.
+ * @brief   Utility function to calculate the hash (FNV-1a) used for the WiFi connection cache.
  * 
+ * @param data      The data to be hashed.
+ * @param len       Its length.
+ * @return uint32_t 
  */
-String onPw(CommandHandlerHelper* helper) {
-    String pw = helper->getCommandLine().substring(helper->getWord(0).length());
-    pw.trim();
-    unsigned int pwLen = pw.length();
-    if (pwLen > 0 && pwLen < sizeof(config.password)) {
-        strcpy(config.password, pw.c_str());
-        return String("Password changed to \"") + pw + "\"\n";
-    } else if (pwLen == 0) {
-        return String("Password is \"") + String(config.password) + "\"\n";
+uint32_t wiFiCacheHash(const void* data, size_t len) {
+    uint32_t hash = 2166136261UL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= ((const uint8_t*)data)[i];
+        hash *= 16777619UL;
     }
-    return String("Password is too long. Maximum length is ") + String(sizeof(config.password) - 1) + ".\n";
+    return hash;
 }
 
 /**
- * @brief The tz ui command handler. Called by the ui object as needed.
+ * @brief   Read the WiFi connection cache from flash into wiFiCache, returning whether it's usable: 
+ *          intact and for the WiFi network config says to use.
  * 
+ * @return true     It can be used
+ * @return false    It can't
  */
-String onTz(CommandHandlerHelper* helper) {
-    String tz = helper->getWord(1);
-    if (tz.length() == 0) {
-        return String("Timezone is \"") + String(config.timeZone) + "\".\n";
-    } else if (tz.length() < sizeof(config.timeZone)) {
-        strcpy(config.timeZone, tz.c_str());
-        return String("Timezone changed to \"") + String(config.outletName) + "\".\n";
+bool loadWiFiCache() {
+    if (!ESP.flashRead(WIFI_CACHE_ADDR, (uint32_t*)&wiFiCache, sizeof(wiFiCache))) {
+        return false;
     }
-    return String("Time zone string too long; max length is ") + String(sizeof(config.timeZone)) + ".\n";
+    return wiFiCache.magic == WIFI_CACHE_MAGIC && 
+        wiFiCache.check == wiFiCacheHash(&wiFiCache, offsetof(wiFiCache_t, check)) && 
+        wiFiCache.ssidHash == wiFiCacheHash(config.ssid, strlen(config.ssid));
 }
 
-String onLoc(CommandHandlerHelper* helper) {
-    String l = helper->getWord(1);
-    String answer ="Location is ";
-    if (l.length() != 0) {
-        config.latDeg = l.toFloat();
-        config.lonDeg = helper->getWord(2).toFloat();
-        config.elevM = helper->getWord(3).toFloat();
-        answer = "Location changed to ";
+/**
+ * @brief   Remember the details of the current WiFi connection in the WiFi connection cache so 
+ *          the next startup can use them to connect quickly. The flash is written only if 
+ *          something has changed.
+ * 
+ */
+void saveWiFiCache() {
+    wiFiCache_t cache {};
+    cache.magic = WIFI_CACHE_MAGIC;
+    cache.ssidHash = wiFiCacheHash(config.ssid, strlen(config.ssid));
+    memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+    cache.channel = WiFi.channel();
+    cache.ip = WiFi.localIP();
+    cache.gateway = WiFi.gatewayIP();
+    cache.subnet = WiFi.subnetMask();
+    cache.dns = WiFi.dnsIP();
+    cache.check = wiFiCacheHash(&cache, offsetof(wiFiCache_t, check));
+    if (memcmp(&cache, &wiFiCache, sizeof(cache)) == 0) {
+        return;
     }
-    return answer + "Lat: " + String(config.latDeg) + " degrees, Lon: " + 
-        String(config.lonDeg) + " degrees, Elev: " + String(config.elevM) + " meters\n";
+    if (!ESP.flashEraseSector(WIFI_CACHE_ADDR / FR_SECTOR_SIZE) || 
+        !ESP.flashWrite(WIFI_CACHE_ADDR, (const uint32_t*)&cache, sizeof(cache))) {
+        Serial.print("[saveWiFiCache] Unable to write the WiFi connection cache.\n");
+        return;
+    }
+    wiFiCache = cache;
+    #ifdef DEBUG
+    Serial.printf("[saveWiFiCache] Saved BSSID %s, channel %d.\n", WiFi.BSSIDstr().c_str(), cache.channel);
+    #endif
 }
 
 /**
- * @brief The name ui command handler. Called by the ui object as needed.
+ * @brief   Set the network connection manager's state to the specified one.
  * 
+ * @param newState  The new state
  */
-String onName(CommandHandlerHelper* helper) {
-    String name = helper->getCommandLine().substring(helper->getWord(0).length());
-    name.trim();
-    unsigned int nameLen = name.length();
-    if (nameLen != 0 && nameLen < sizeof(config.outletName)) {
-        strcpy(config.outletName, name.c_str());
-        return String("Outlet name changed to \"") + name + "\"\n";
-    } else if (nameLen == 0) {
-        return String("Outlet name is \"") + String(config.outletName) + "\"\n";
-    }
-    return String("The specified outlet name is too long. Maximum length is ") + String(sizeof(config.outletName) - 1) + "\n";
+void setNetState(netState_t newState) {
+    netState = newState;
+    netStateMillis = millis();
 }
 
 /**
- * @brief The save ui command handler. Called by the ui object as needed.
+ * @brief   Start connecting to the WiFi network config says to use. If the WiFi connection cache
+ *          is for that network, try going straight to the access point and channel we used last
+ *          time (and, if WIFI_REUSE_LEASE is defined, skipping DHCP). Otherwise connect the
+ *          ordinary way, which scans for the network. netTask() takes it from there.
  * 
  */
-String onSave(CommandHandlerHelper* helper) {
-    config.signature = CONFIG_SIG;
-    saveConfig();
-    return "Configuration saved.\n";
+void startWiFi() {
+    Serial.printf("Connecting to WiFi network \"%s\".\n", config.ssid);
+    ui.cancelCmd();
+    wiFiWasFast = loadWiFiCache();
+    if (wiFiWasFast) {
+        #ifdef WIFI_REUSE_LEASE
+        if (wiFiCache.ip != 0) {
+            WiFi.config(IPAddress(wiFiCache.ip), IPAddress(wiFiCache.gateway), IPAddress(wiFiCache.subnet),
+                IPAddress(wiFiCache.dns));
+        }
+        #endif
+        WiFi.begin(config.ssid, config.password, wiFiCache.channel, wiFiCache.bssid);
+        setNetState(netFastConnecting);
+    } else {
+        WiFi.begin(config.ssid, config.password);
+        setNetState(netConnecting);
+    }
 }
 
 /**
- * @brief The restart ui command handler. Called by the ui object as needed.
+ * @brief   Deal with the WiFi having just connected: update the WiFi connection cache, have 
+ *          ntpClock sync right away and say what happened.
  * 
  */
-String onRestart(CommandHandlerHelper* helper) {
-    ESP.restart();
-    return "";      // The compiler doesn't know restart never returns
+void wiFiConnected() {
+    if (wiFiReadyMillis == 0) {
+        wiFiReadyMillis = millis();
+    }
+    saveWiFiCache();
+    ntpClock.syncSoon();
+    scheduler.runIn(clockTaskId, 0);
+    netRetryMillis = WIFI_RETRY_MIN_MILLIS;
+    Serial.printf("WiFi connected%s. IP address is %s.\n", wiFiWasFast ? " using the cached access point" : "",
+        WiFi.localIP().toString().c_str());
+    ui.cancelCmd();
+    setNetState(netUp);
 }
 
 /**
- * @brief The status ui command handler. Called by the ui object as needed.
+ * @brief   The network connection manager task. It gets the WiFi connected, and keeps it that way,
+ *          without ever waiting for anything: each run just looks at how things stand and moves
+ *          netState along. So the button, the command line and the schedule carry on no matter
+ *          what the network is doing.
+ * 
+ * @details A failed connect is retried after netRetryMillis, which doubles with each failure up
+ *          to WIFI_RETRY_MAX_MILLIS. When an established connection goes away, the WiFi stack
+ *          gets WIFI_CONN_MILLIS to get it back on its own before we start over.
  * 
+ *          The time comes from ntpClock, run by its own task, which syncs whenever it can. Once 
+ *          the clock has been set (by it or, after a reset, from RTC memory), the clock keeps 
+ *          going whether or not there's a network, so the schedule does too.
+ * 
+ *          The LED is lit while we're connected and know the time, blinks while we're
+ *          connecting and is dark otherwise.
  */
-String onStatus(CommandHandlerHelper* helper){
-    String answer = "";
-    if (running) {
+void netTask() {
+    unsigned long inStateMillis = millis() - netStateMillis;
+    bool connected = WiFi.status() == WL_CONNECTED;
+
+    if (!clockIsSet && ntpClock.isSet()) {
+        time_t nowSecs = time(nullptr);
+        clockIsSet = true;
+        randomSeed((unsigned long)nowSecs);
+        Serial.printf("The clock has been set %s. Current time: %s", 
+            ntpClock.source() == ncRestored ? "from RTC memory" : "by NTP", ctime(&nowSecs)); // ctime() appends a "\n"
+        ui.cancelCmd();
+        scheduleUpdated = true;                     // Start following the schedule
+        scheduler.runIn(scheduleTaskId, 0);
+    }
+
+    switch (netState) {
+        case netNoCredentials:
+            break;
+        case netStarting:
+            startWiFi();
+            break;
+        case netFastConnecting:
+            if (connected) {
+                wiFiConnected();
+            } else if (inStateMillis >= WIFI_FAST_CONN_MILLIS) {
+                Serial.print("The cached access point didn't answer. Scanning for the network.\n");
+                ui.cancelCmd();
+                WiFi.disconnect();
+                #ifdef WIFI_REUSE_LEASE
+                WiFi.config(IPAddress(), IPAddress(), IPAddress());    // Back to DHCP
+                #endif
+                wiFiWasFast = false;
+                WiFi.begin(config.ssid, config.password);
+                setNetState(netConnecting);
+            }
+            break;
+        case netConnecting:
+            if (connected) {
+                wiFiConnected();
+            } else if (inStateMillis >= WIFI_CONN_MILLIS) {
+                Serial.printf("Unable to connect to WiFi. Status: %d. Will try again in %lu seconds.\n",
+                    WiFi.status(), netRetryMillis / 1000);
+                ui.cancelCmd();
+                WiFi.disconnect();
+                setNetState(netRetryWait);
+            }
+            break;
+        case netRetryWait:
+            if (inStateMillis >= netRetryMillis) {
+                netRetryMillis = netRetryMillis * 2 > WIFI_RETRY_MAX_MILLIS ? WIFI_RETRY_MAX_MILLIS : netRetryMillis * 2;
+                setNetState(netStarting);
+            }
+            break;
+        case netUp:
+            if (!connected) {
+                Serial.print("Oops! The WiFi connection seems to have disappeared. Trying to get it back.\n");
+                ui.cancelCmd();
+                setNetState(netLost);
+            } else if (!clockIsSet && inStateMillis >= NTP_SET_MILLIS && inStateMillis < NTP_SET_MILLIS + NET_TASK_MILLIS) {
+                Serial.print("The time hasn't been set yet. Still waiting for NTP.\n");
+                ui.cancelCmd();
+            }
+            break;
+        case netLost:
+            if (connected) {
+                Serial.print("The WiFi connection is back.\n");
+                ui.cancelCmd();
+                setNetState(netUp);
+            } else if (inStateMillis >= WIFI_CONN_MILLIS) {
+                WiFi.disconnect();
+                setNetState(netStarting);
+            }
+            break;
+    }
+
+    if (netState == netUp) {
+        setLEDto(clockIsSet ? LED_LIT : LED_DARK);
+    } else if (netState == netFastConnecting || netState == netConnecting) {
+        toggleLED();
+    } else {
+        setLEDto(LED_DARK);
+    }
+}
+
+/**
+ * @brief Return the state of the outlet.
+ * 
+ * @return true     The outlet is turned on
+ * @return false    The outlet is turned off
+ */
+bool outletIsOn() {
+    return digitalRead(RELAY) == RELAY_CLOSED;
+}
+
+/**
+ * @brief   Put the data for a "state" event -- {"outlet": bool, "enabled": bool} -- into the 
+ *          specified buffer.
+ * 
+ * @param buf   The buffer
+ * @param size  Its size; STATE_EVENT_LEN is enough
+ */
+void stateEventData(char* buf, size_t size) {
+    snprintf(buf, size, "{\"outlet\":%s,\"enabled\":%s}", 
+        outletIsOn() ? "true" : "false", config.enabled ? "true" : "false");
+}
+
+/**
+ * @brief   Utility function to bring our DNS-SD advertisement up to date with the outlet's name 
+ *          and state: the service's instance name is the outlet's name and its TXT record says 
+ *          whether the outlet is on and whether the schedule is enabled. Only what has changed 
+ *          is updated, and only then is it announced, so a fleet can be watched by listening 
+ *          rather than polling. Call whenever any of them might have changed.
+ * 
+ */
+void updateAdvert() {
+    static int8_t lastOutlet = -1;
+    static int8_t lastEnabled = -1;
+    static char lastName[sizeof(config.outletName)] = "";
+    if (!mdnsStarted) {
+        return;
+    }
+    bool changed = false;
+    if (strcmp(lastName, config.outletName) != 0) {
+        strcpy(lastName, config.outletName);
+        MDNS.setServiceName(mdnsService, config.outletName);
+        changed = true;
+    }
+    if (lastOutlet != (int8_t)outletIsOn()) {
+        lastOutlet = outletIsOn();
+        MDNS.addServiceTxt(mdnsService, "outlet", lastOutlet ? "on" : "off");
+        changed = true;
+    }
+    if (lastEnabled != (int8_t)config.enabled) {
+        lastEnabled = config.enabled;
+        MDNS.addServiceTxt(mdnsService, "enabled", lastEnabled ? "true" : "false");
+        changed = true;
+    }
+    if (changed) {
+        MDNS.announce();
+    }
+}
+
+/**
+ * @brief   If the outlet has been turned on or off, or the schedule enabled or disabled, since the 
+ *          last time we said, send a "state" event to the clients of the web server's event 
+ *          streams. Call whenever either might have changed; if neither has, nothing is sent.
+ * 
+ */
+void pushStateEvent() {
+    updateAdvert();
+    static int8_t lastOutlet = -1;
+    static int8_t lastEnabled = -1;
+    if (lastOutlet == (int8_t)outletIsOn() && lastEnabled == (int8_t)config.enabled) {
+        return;
+    }
+    lastOutlet = outletIsOn();
+    lastEnabled = config.enabled;
+    char data[STATE_EVENT_LEN];
+    stateEventData(data, sizeof(data));
+    webServer.broadcastEvent("state", data);
+}
+
+/**
+ * @brief Invert the state of the outlet. I.e., if it was on, turn it (and the LED) off and vice versa.
+ * 
+ * @param cause     Why, for the event log
+ */
+void toggleOutlet(eventCause_t cause) {
+    uint8_t newRelayState = digitalRead(RELAY) == RELAY_CLOSED ? RELAY_OPEN : RELAY_CLOSED;
+    digitalWrite(RELAY, newRelayState);
+    logEvent(cause, newRelayState == RELAY_CLOSED);
+    pushStateEvent();
+}
+
+/**
+ * @brief   Turn the outlet on or off as specified by outletOn value
+ * 
+ * @param outletOn  true ==> outlet turns on, false ==> outlet turns off
+ * @param cause     Why, for the event log. Only an actual change is logged.
+ * @param detail    The event's detail, for the event log. See eventRec_t.
+ */
+void setOutletTo(bool outletOn, eventCause_t cause, uint8_t detail = 0) {
+    bool wasOn = outletIsOn();
+    digitalWrite(RELAY, outletOn ? RELAY_CLOSED : RELAY_OPEN);
+    if (wasOn != outletOn) {
+        logEvent(cause, outletOn, detail);
+    }
+    pushStateEvent();
+
+    #ifdef DEBUG
+    Serial.printf("  Turned outlet %s.\n", outletOn ? "on" : "off");
+    #endif
+}
+
+/**
+ * @brief   Print the specified minPastMidnight_t as "hh:mm" without building a String.
+ * 
+ * @param out               The Print to print to.
+ * @param minsPastMidnight  The time to print.
+ */
+void printMinsPastMidnight(Print* out, minPastMidnight_t minsPastMidnight) {
+    out->printf("%02u:%02u", minsPastMidnight / 60, minsPastMidnight % 60);
+}
+
+/**
+ * @brief   The SimpleWebServer::sendTemplate() variable handler for the commandline page.
+ * 
+ * @param out       The Print to print the value of the variable to.
+ * @param varName   The name of the variable whose value is to be printed.
+ */
+void commandLinePageVar(Print* out, const char* varName) {
+    if (strcmp(varName, "outletName") == 0) {
+        out->print(config.outletName);
+    } else if (strcmp(varName, "rows") == 0) {
+        out->print(WC_SCREEN_LINES);
+    } else if (strcmp(varName, "display") == 0) {
+        cmdScreen.printTo(out);
+    } else if (strcmp(varName, "prompt") == 0) {
+        out->print(CMD_PROMPT);
+    } else if (strcmp(varName, "outletBanner") == 0) {
+        out->print(BANNER);
+    }
+}
+
+/**
+ * @brief Assemble the current state of our commandline page and send it to the httpClient. 
+ * 
+ * @param httpClient    The HTTP client we are to send the assembled page to.
+ * @param chunked       Whether the page is to be sent using chunked transfer coding.
+ */
+void sendCommandLinePage(WiFiClient* httpClient, bool chunked) {
+    static const char pageTemplate[] PROGMEM = "<!doctype html>\n"
+                    "<html>\n"
+                    "<head>\n"
+                    "<meta charset=\"utf-8\">\n"
+                    "<title>WiFi Outlet Command Processor</title>\n"
+                    "<link rel=\"stylesheet\" href=\"/style.css\">\n"
+                    "</head>\n"
+                    "<body class=\"cmd\">\n"
+                    "<h1>WiFi Outlet &ldquo;@outletName&rdquo; Command Processor</h1>\n"
+                    "<p>Using this page you can interact with the Outlet's command processor.</p>\n"
+                    "<form method=\"post\">\n"
+                    "<textarea class=\"screen\" cols=\"120\" rows=\"@rows\" tabindex=\"0\" readonly>\n"
+                    "@display\n"
+                    "</textarea><br />\n"
+                    "<span class=\"screen\">@prompt </span><input type=\"text\" name=\"cmd\" maxlength=\"120\" size=\"120\" tabindex=\"0\" autofocus />\n"
+                    "<input type=\"submit\" tabindex=\"0\" hidden />\n"
+                    "</form>\n"
+                    "<p>&nbsp;</p>\n"
+                    "<p style=\"font-size: 80%\" >@outletBanner Copyright &copy; 2023 by D. L. Ehnebuske.</p>\n"
+                    "</body>\n"
+                    "</html>\r\n"
+                    "\r\n";
+
+    // Send the page, filling in all the variable informaton with the current values
+    SimpleWebServer::sendTemplate(httpClient, pageTemplate, commandLinePageVar, chunked);
+}
+
+/**
+ * @brief   Print the sunrise and sunset times for the next SUN_TIMES_DAYS days, e.g., 
+ *          "Mon 06:12/19:40; Tue 06:13/19:38; ..."
+ * 
+ * @param out   The Print to print to.
+ */
+void printSunTimes(Print* out) {
+    static const char* const dayName[7] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+    time_t curTime = time(nullptr);
+    struct tm now = *localtime(&curTime);       // A copy; ObsSite uses localtime() too
+    for (int d = 0; d < SUN_TIMES_DAYS; d++) {
+        out->print(d == 0 ? "" : "; ");
+        out->print(dayName[(now.tm_wday + d) % 7]);
+        out->print(' ');
+        printMinsPastMidnight(out, site.getSunriseMins(now.tm_year, now.tm_yday + d));
+        out->print('/');
+        printMinsPastMidnight(out, site.getSunsetMins(now.tm_year, now.tm_yday + d));
+    }
+}
+
+/**
+ * @brief   Print the specified text as a JSON string, quotes included.
+ * 
+ * @param out   The Print to print to.
+ * @param text  The text.
+ */
+void printJsonString(Print* out, const char* text) {
+    out->print('"');
+    for (const char* c = text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            out->print('\\');
+            out->print(*c);
+        } else if ((uint8_t)*c < 0x20) {
+            out->printf("\\u%04x", *c);
+        } else {
+            out->print(*c);
+        }
+    }
+    out->print('"');
+}
+
+/**
+ * @brief   Send the outlet's state to the httpClient as a JSON object: {"outletName": string, 
+ *          "banner": string, "outlet": bool, "enabled": bool, "sunTimes": string}. sunTimes is 
+ *          only there once the clock has been set (i.e., we know what day it is).
+ * 
+ * @param httpClient    The HTTP client to send to.
+ * @param chunked       Whether the content is to be sent using chunked transfer coding.
+ */
+void sendStateJson(WiFiClient* httpClient, bool chunked) {
+    swsBufferedPrint out {httpClient, chunked};
+    out.print("{\"outletName\":");
+    printJsonString(&out, config.outletName);
+    out.printf(",\"banner\":\"%s\",\"outlet\":%s,\"enabled\":%s", BANNER, 
+        outletIsOn() ? "true" : "false", config.enabled ? "true" : "false");
+    if (clockIsSet) {
+        out.print(",\"sunTimes\":\"");
+        printSunTimes(&out);
+        out.print('"');
+    }
+    out.print("}\n");
+}
+
+/**
+ * @brief   Utility function to return a pointer to the member of the specified eepromData_t that 
+ *          the specified schedule field is for. Its type depends on the field's kind.
+ * 
+ * @param cfg       The eepromData_t, e.g., &config
+ * @param field     The schedule field
+ * @return void*    The member
+ */
+inline void* schedFieldIn(eepromData_t* cfg, const schedField_t &field) {
+    return (uint8_t*)cfg + field.offset;
+}
+
+/**
+ * @brief   Utility function to return the size of the config member a schedule field of the 
+ *          specified kind is for.
+ * 
+ * @param kind      The kind of schedule field
+ * @return size_t   The size of its member
+ */
+inline size_t schedFieldSize(schedFieldKind_t kind) {
+    return kind == sfEnable ? sizeof(bool) : kind == sfType ? sizeof(cycleType_t) : 
+        kind == sfTime ? sizeof(minPastMidnight_t) : sizeof(int);
+}
+
+/**
+ * @brief   Print the specified schedule field's value in config as a JSON value: a bool for an 
+ *          enable, "dy", "wd" or "we" for a cycle's type, "hh:mm" for a time and a number 
+ *          otherwise.
+ * 
+ * @param out       The Print to print to.
+ * @param field     The schedule field.
+ */
+void printSchedField(Print* out, const schedField_t &field) {
+    const void* member = schedFieldIn(&config, field);
+    switch (field.kind) {
+        case sfEnable:
+            out->print(*(const bool*)member ? "true" : "false");
+            break;
+        case sfType:
+            out->printf("\"%s\"", cycleTypeCode[*(const cycleType_t*)member]);
+            break;
+        case sfTime:
+            out->print('"');
+            printMinsPastMidnight(out, *(const minPastMidnight_t*)member);
+            out->print('"');
+            break;
+        case sfDelta:
+        case sfFuzz:
+            out->print(*(const int*)member);
+            break;
+    }
+}
+
+/**
+ * @brief   Send the schedule to the httpClient as a JSON object. The keys are the names of the 
+ *          schedFields, e.g., "s0en" or "s5ond". A cycle's type ("s<c>ty") is one of "dy", "wd" 
+ *          or "we"; times are "hh:mm".
+ * 
+ * @param httpClient    The HTTP client to send to.
+ * @param chunked       Whether the content is to be sent using chunked transfer coding.
+ */
+void sendScheduleJson(WiFiClient* httpClient, bool chunked) {
+    swsBufferedPrint out {httpClient, chunked};
+    for (uint8_t i = 0; i < N_SCHED_FIELDS; i++) {
+        out.printf("%c\"%s\":", i == 0 ? '{' : ',', schedFields[i].name);
+        printSchedField(&out, schedFields[i]);
+    }
+    out.print("}\n");
+}
+
+/**
+ * @brief   Send the httpClient what a home page POST changed, as a JSON object: the outlet's state 
+ *          and the schedule's, {"outlet": bool, "enabled": bool}, followed by the schedule fields 
+ *          whose values in config differ from those in was, the way sendScheduleJson() sends 
+ *          them. The home page's script patches the page with it.
+ * 
+ * @param httpClient    The HTTP client to send to.
+ * @param chunked       Whether the content is to be sent using chunked transfer coding.
+ * @param was           What config was before the POST, or nullptr if the schedule's fields 
+ *                      didn't change
+ */
+void sendHomeDelta(WiFiClient* httpClient, bool chunked, eepromData_t* was) {
+    swsBufferedPrint out {httpClient, chunked};
+    out.printf("{\"outlet\":%s,\"enabled\":%s", outletIsOn() ? "true" : "false", config.enabled ? "true" : "false");
+    for (uint8_t i = 0; was != nullptr && i < N_SCHED_FIELDS; i++) {
+        const schedField_t &field = schedFields[i];
+        if (memcmp(schedFieldIn(was, field), schedFieldIn(&config, field), schedFieldSize(field.kind)) != 0) {
+            out.printf(",\"%s\":", field.name);
+            printSchedField(&out, field);
+        }
+    }
+    out.print("}\n");
+}
+
+/**
+ * @brief   Utility function to skip over JSON whitespace.
+ * 
+ * @param p             Where to start.
+ * @return const char*  The first non-whitespace character at or after p.
+ */
+const char* skipJsonSpace(const char* p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+        p++;
+    }
+    return p;
+}
+
+/**
+ * @brief   Utility function to scan the JSON string starting at p (which must be '"'), decoding 
+ *          its escapes into out as UTF-8.
+ * 
+ * @param p             The opening quote.
+ * @param out           Where to put the decoded string.
+ * @param outSize       The size of out.
+ * @return const char*  What follows the closing quote or nullptr if the string is malformed or 
+ *                      too long for out.
+ */
+const char* scanJsonString(const char* p, char* out, size_t outSize) {
+    size_t n = 0;
+    for (p++; *p != '"'; p++) {
+        unsigned int c = (uint8_t)*p;
+        bool isUnicodeEscape = false;
+        if (c < 0x20) {
+            return nullptr;                                 // Includes the end of the text
+        }
+        if (c == '\\') {
+            p++;
+            switch (*p) {
+                case '"': case '\\': case '/': c = *p; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'u':
+                    c = 0;
+                    for (uint8_t i = 0; i < 4; i++) {
+                        p++;
+                        if (!isxdigit(*p)) {
+                            return nullptr;
+                        }
+                        c = c * 16 + (isdigit(*p) ? *p - '0' : (tolower(*p) - 'a' + 10));
+                    }
+                    if (c == 0) {
+                        return nullptr;
+                    }
+                    isUnicodeEscape = true;
+                    break;
+                default:
+                    return nullptr;
+            }
+        }
+        // Put c in out as UTF-8. (Non-ASCII characters arriving unescaped are just copied.)
+        uint8_t len = !isUnicodeEscape || c < 0x80 ? 1 : c < 0x800 ? 2 : 3;
+        if (n + len >= outSize) {
+            return nullptr;
+        }
+        if (len == 1) {
+            out[n++] = c;
+        } else if (len == 2) {
+            out[n++] = 0xC0 | (c >> 6);
+            out[n++] = 0x80 | (c & 0x3F);
+        } else {
+            out[n++] = 0xE0 | (c >> 12);
+            out[n++] = 0x80 | ((c >> 6) & 0x3F);
+            out[n++] = 0x80 | (c & 0x3F);
+        }
+    }
+    out[n] = '\0';
+    return p + 1;
+}
+
+/**
+ * @brief   Parse the flat JSON object in json, calling handler for each of its members in turn. 
+ *          Member values may be strings, numbers, true, false or null, but not objects or arrays. 
+ *          Nothing is copied to the heap; keys and values are decoded into small local buffers.
+ * 
+ * @param json      The text of the JSON object.
+ * @param handler   The function to call for each member. It returns false to reject the member.
+ * @return true     The object was well formed and handler accepted each of its members.
+ * @return false    Otherwise
+ */
+bool parseJsonObject(const char* json, jsonMemberHandler handler) {
+    char key[JSON_MAX_KEY_LEN + 1];
+    char value[JSON_MAX_VALUE_LEN + 1];
+    const char* p = skipJsonSpace(json);
+    if (*p++ != '{') {
+        return false;
+    }
+    p = skipJsonSpace(p);
+    if (*p == '}') {
+        return *skipJsonSpace(p + 1) == '\0';
+    }
+    while (true) {
+        if (*p != '"' || (p = scanJsonString(p, key, sizeof(key))) == nullptr) {
+            return false;
+        }
+        p = skipJsonSpace(p);
+        if (*p++ != ':') {
+            return false;
+        }
+        p = skipJsonSpace(p);
+        bool isString = *p == '"';
+        if (isString) {
+            if ((p = scanJsonString(p, value, sizeof(value))) == nullptr) {
+                return false;
+            }
+        } else {
+            size_t n = 0;
+            while (*p != '\0' && strchr(",} \t\r\n", *p) == nullptr) {
+                if (n == JSON_MAX_VALUE_LEN || *p == '{' || *p == '[') {
+                    return false;
+                }
+                value[n++] = *p++;
+            }
+            value[n] = '\0';
+            if (n == 0) {
+                return false;
+            }
+        }
+        if (!handler(key, value, isString)) {
+            return false;
+        }
+        p = skipJsonSpace(p);
+        if (*p == '}') {
+            return *skipJsonSpace(p + 1) == '\0';
+        }
+        if (*p++ != ',') {
+            return false;
+        }
+        p = skipJsonSpace(p);
+    }
+}
+
+/**
+ * @brief   Utility function to convert a JSON member value to a bool.
+ * 
+ * @param value     The value, as passed to a jsonMemberHandler.
+ * @param isString  Whether it was a JSON string.
+ * @param answer    Where to put the answer.
+ * @return true     The value was true or false
+ * @return false    It wasn't
+ */
+bool jsonToBool(const char* value, bool isString, bool* answer) {
+    if (isString || (strcmp(value, "true") != 0 && strcmp(value, "false") != 0)) {
+        return false;
+    }
+    *answer = value[0] == 't';
+    return true;
+}
+
+/**
+ * @brief   Utility function to convert a JSON member value to an int in the specified range.
+ * 
+ * @param value     The value, as passed to a jsonMemberHandler.
+ * @param isString  Whether it was a JSON string.
+ * @param minValue  The smallest acceptable value.
+ * @param maxValue  The largest acceptable value.
+ * @param answer    Where to put the answer.
+ * @return true     The value was an integer in range
+ * @return false    It wasn't
+ */
+bool jsonToInt(const char* value, bool isString, int minValue, int maxValue, int* answer) {
+    char* end;
+    long n = strtol(value, &end, 10);
+    if (isString || *end != '\0' || end == value || n < minValue || n > maxValue) {
+        return false;
+    }
+    *answer = n;
+    return true;
+}
+
+/**
+ * @brief   Utility function to convert a JSON member value of the form "hh:mm" to minPastMidnight_t.
+ * 
+ * @param value     The value, as passed to a jsonMemberHandler.
+ * @param isString  Whether it was a JSON string.
+ * @param answer    Where to put the answer.
+ * @return true     The value was a valid time
+ * @return false    It wasn't
+ */
+bool jsonToMinsPastMidnight(const char* value, bool isString, minPastMidnight_t* answer) {
+    if (!isString || strlen(value) != 5 || !isdigit(value[0]) || !isdigit(value[1]) || value[2] != ':' || 
+        !isdigit(value[3]) || !isdigit(value[4])) {
+        return false;
+    }
+    int hh = (value[0] - '0') * 10 + value[1] - '0';
+    int mm = (value[3] - '0') * 10 + value[4] - '0';
+    if (hh > 23 || mm > 59) {
+        return false;
+    }
+    *answer = hh * 60 + mm;
+    return true;
+}
+
+/**
+ * @brief   Utility function to check a value for the specified schedule field and, if it's 
+ *          acceptable, put it in the field's member of the specified eepromData_t. The value is 
+ *          as a jsonMemberHandler gets it; see schedFieldKind_t for what's acceptable.
+ * 
+ * @param field     The schedule field
+ * @param value     The value
+ * @param isString  Whether it was a JSON string
+ * @param cfg       The eepromData_t to put it in
+ * @return true     The value was acceptable and has been put in cfg
+ * @return false    It wasn't; cfg is unchanged
+ */
+bool setSchedField(const schedField_t &field, const char* value, bool isString, eepromData_t* cfg) {
+    void* member = schedFieldIn(cfg, field);
+    switch (field.kind) {
+        case sfEnable:
+            return jsonToBool(value, isString, (bool*)member);
+        case sfType:
+            for (uint8_t t = 0; t < _cycleTypeSize; t++) {
+                if (isString && strcmp(value, cycleTypeCode[t]) == 0) {
+                    *(cycleType_t*)member = (cycleType_t)t;
+                    return true;
+                }
+            }
+            return false;
+        case sfTime:
+            return jsonToMinsPastMidnight(value, isString, (minPastMidnight_t*)member);
+        case sfDelta:
+            return jsonToInt(value, isString, 0, SCHED_MAX_DELTA, (int*)member);
+        case sfFuzz:
+            return jsonToInt(value, isString, 0, SCHED_MAX_FUZZ, (int*)member);
+    }
+    return false;
+}
+
+/**
+ * @brief   The jsonMemberHandler for updates to /api/state. Applies the member to apiConfig and 
+ *          apiOutlet.
+ * 
+ */
+bool stateMember(const char* key, const char* value, bool isString) {
+    bool b;
+    if (strcmp(key, "outlet") == 0 && jsonToBool(value, isString, &b)) {
+        apiOutlet = b ? 1 : 0;
+    } else if (strcmp(key, "enabled") == 0 && jsonToBool(value, isString, &b)) {
+        apiConfig.enabled = b;
+    } else if (strcmp(key, "outletName") == 0 && isString && value[0] != '\0' && strlen(value) < sizeof(apiConfig.outletName)) {
+        strcpy(apiConfig.outletName, value);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief   The jsonMemberHandler for updates to /api/schedule. Applies the member to apiConfig. 
+ *          The keys are the names of the schedFields.
+ * 
+ */
+bool scheduleMember(const char* key, const char* value, bool isString) {
+    for (uint8_t i = 0; i < N_SCHED_FIELDS; i++) {
+        if (strcmp(key, schedFields[i].name) == 0) {
+            return setSchedField(schedFields[i], value, isString, &apiConfig);
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief   Apply an update to /api/state or /api/schedule: a JSON object holding just the members 
+ *          to be changed. Nothing changes unless all of them are acceptable. Used for POSTs to 
+ *          the API and for group commands.
+ * 
+ * @param json          The JSON object
+ * @param isSchedule    True for /api/schedule, false for /api/state.
+ * @param cause         Where it came from, for the event log: ecApi or ecGroup
+ * @return true         The update was applied
+ * @return false        It wasn't acceptable, so nothing changed
+ */
+bool applyApiUpdate(const char* json, bool isSchedule, eventCause_t cause) {
+    apiConfig = config;
+    apiOutlet = -1;
+    if (json == nullptr || !parseJsonObject(json, isSchedule ? scheduleMember : stateMember)) {
+        return false;
+    }
+    if (apiOutlet != -1) {
+        setOutletTo(apiOutlet == 1, cause);
+    }
+    if (memcmp(&apiConfig, &config, sizeof(config)) != 0) {
+        bool scheduleChanged = isSchedule || apiConfig.enabled != config.enabled;
+        config = apiConfig;
+        saveConfigSoon();
+        pushStateEvent();
+        if (scheduleChanged) {
+            scheduleUpdated = true;             // Let followSchedule() know it needs to start over
+            scheduler.runIn(scheduleTaskId, 0);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief   Handle a POST to /api/state or /api/schedule: a JSON object holding just the members 
+ *          to be changed. The response is the resource as updated or "400 Bad Request."
+ * 
+ * @param webServer     The SimpleWebServer handling the request.
+ * @param httpClient    The HTTP client making the request.
+ * @param isSchedule    True for /api/schedule, false for /api/state.
+ */
+void handleApiUpdate(SimpleWebServer* webServer, WiFiClient* httpClient, bool isSchedule) {
+    if (!applyApiUpdate(webServer->clientBodyText(), isSchedule, ecApi)) {
+        static const char badUpdate[] = "{\"error\":\"Malformed JSON or unknown member or value\"}\n";
+        webServer->sendResponseHead(httpClient, 400, "Bad Request", "application/json", sizeof(badUpdate) - 1);
+        webServer->countSent(httpClient->print(badUpdate));
+        return;
+    }
+    bool chunked = webServer->sendResponseHead(httpClient, 200, "OK", "application/json", SWS_UNKNOWN_LENGTH, 
+        "Cache-Control: no-store\r\n");
+    if (isSchedule) {
+        sendScheduleJson(httpClient, chunked);
+    } else {
+        sendStateJson(httpClient, chunked);
+    }
+}
+
+/**
+ * @brief   Send the specified static web asset in response to a GET or HEAD request. The asset 
+ *          is sent as it was gzipped at build time, with its ETag. If the client says it already 
+ *          has that version (If-None-Match), all it gets is "304 Not Modified."
+ * 
+ * @param webServer     The SimpleWebServer handling the request.
+ * @param httpClient    The HTTP client to send to.
+ * @param asset         The asset to send.
+ */
+void sendAsset(SimpleWebServer* webServer, WiFiClient* httpClient, const webAsset_t &asset) {
+    char extraHeaders[96];
+    const char* ifNoneMatch = webServer->headerValue("If-None-Match");
+    if (ifNoneMatch != nullptr && (strstr(ifNoneMatch, asset.etag) != nullptr || strcmp(ifNoneMatch, "*") == 0)) {
+        snprintf(extraHeaders, sizeof(extraHeaders), "ETag: %s\r\nCache-Control: no-cache\r\n", asset.etag);
+        webServer->sendResponseHead(httpClient, 304, "Not Modified", nullptr, 0, extraHeaders);
+        return;
+    }
+    // Every browser takes gzip; anything that doesn't, we can't help anyway.
+    snprintf(extraHeaders, sizeof(extraHeaders), "ETag: %s\r\nCache-Control: no-cache\r\nContent-Encoding: gzip\r\n", asset.etag);
+    webServer->sendResponseHead(httpClient, 200, "OK", asset.contentType, asset.len, extraHeaders);
+    if (webServer->httpMethod() == swsGET) {
+        webServer->countSent(httpClient->write_P((PGM_P)asset.data, asset.len));
+    }
+}
+
+/**
+ * @brief   Route handler for GET and HEAD requests for the static web assets. The route's tag is 
+ *          the index in webAssets of the asset to send.
+ * 
+ * @param webServer         The SimpleWebServer for which we're acting as a route handler.
+ * @param httpClient        The HTTP Client making the request.
+ * @param trPath            The path portion of the URI of the resource being requested.
+ * @param trQuery           The query portion of the URI (if any).
+ */
+void handleAssetGet(SimpleWebServer* webServer, WiFiClient* httpClient, swsStringView trPath, swsStringView trQuery) {
+    const webAsset_t &asset = webAssets[webServer->routeTag()];
+    sendAsset(webServer, httpClient, asset);
+    #ifdef DEBUG
+    Serial.printf("%s request for %s received and processed.\n", 
+        webServer->httpMethod() == swsGET ? "GET" : "HEAD", asset.path);
+    ui.cancelCmd();
+    #endif
+}
+
+/**
+ * @brief   Route handler for GET and HEAD requests for /api/state and /api/schedule. The route's 
+ *          tag says which.
+ * 
+ * @param webServer         The SimpleWebServer for which we're acting as a route handler.
+ * @param httpClient        The HTTP Client making the request.
+ * @param trPath            The path portion of the URI of the resource being requested.
+ * @param trQuery           The query portion of the URI (if any).
+ */
+void handleApiGet(SimpleWebServer* webServer, WiFiClient* httpClient, swsStringView trPath, swsStringView trQuery) {
+    bool chunked = webServer->sendResponseHead(httpClient, 200, "OK", "application/json", SWS_UNKNOWN_LENGTH, 
+        "Cache-Control: no-store\r\n");
+    if (webServer->httpMethod() == swsGET && webServer->routeTag() == apiState) {
+        sendStateJson(httpClient, chunked);
+    } else if (webServer->httpMethod() == swsGET) {
+        sendScheduleJson(httpClient, chunked);
+    }
+}
+
+/**
+ * @brief   Utility function to get the value of a numeric parameter from a URI query, e.g., the 
+ *          20 in "start=40&count=20".
+ * 
+ * @param query     The query
+ * @param name      The parameter's name
+ * @param value     Where to put its value. Unchanged if the parameter isn't there.
+ * @return true     It's not there or it's a number from 0 to UINT16_MAX
+ * @return false    It's there but it's malformed
+ */
+bool queryNumber(swsStringView query, const char* name, uint16_t* value) {
+    uint16_t nameLen = strlen(name);
+    uint16_t at = 0;
+    while (at < query.len) {
+        uint16_t end = at;
+        while (end < query.len && query.ptr[end] != '&') {
+            end++;
+        }
+        if (end - at > nameLen && strncmp(query.ptr + at, name, nameLen) == 0 && query.ptr[at + nameLen] == '=') {
+            uint32_t n = 0;
+            uint16_t i = at + nameLen + 1;
+            if (i == end) {
+                return false;
+            }
+            for (; i < end; i++) {
+                if (!isdigit(query.ptr[i]) || (n = n * 10 + query.ptr[i] - '0') > UINT16_MAX) {
+                    return false;
+                }
+            }
+            *value = n;
+            return true;
+        }
+        at = end + 1;
+    }
+    return true;
+}
+
+/**
+ * @brief   Route handler for GET and HEAD requests for /api/log: a page of the outlet event log 
+ *          as a JSON object, e.g., {"total":120,"start":100,"events":[{"when":1700101800,
+ *          "sinceBoot":false,"on":true,"cause":"schedule","detail":5},...]}. The query's "start" 
+ *          says which event to start with (0 is the oldest) and "count" how many to send (up to 
+ *          EVENT_PAGE_MAX). By default, it's the newest EVENT_PAGE_DEFAULT. The events are read 
+ *          from flash and sent one at a time, so the log is never all in RAM. An event that 
+ *          can't be read is sent as null.
+ * 
+ * @param webServer         The SimpleWebServer for which we're acting as a route handler.
+ * @param httpClient        The HTTP Client making the request.
+ * @param trPath            The path portion of the URI of the resource being requested.
+ * @param trQuery           The query portion of the URI (if any).
+ */
+void handleLogGet(SimpleWebServer* webServer, WiFiClient* httpClient, swsStringView trPath, swsStringView trQuery) {
+    uint16_t total = eventCount();
+    uint16_t count = EVENT_PAGE_DEFAULT;
+    bool ok = queryNumber(trQuery, "count", &count);
+    if (count > EVENT_PAGE_MAX) {
+        count = EVENT_PAGE_MAX;
+    }
+    uint16_t start = total > count ? total - count : 0;
+    if (!ok || !queryNumber(trQuery, "start", &start)) {
+        static const char badQuery[] = "{\"error\":\"start and count must be numbers\"}\n";
+        webServer->sendResponseHead(httpClient, 400, "Bad Request", "application/json", sizeof(badQuery) - 1);
+        if (webServer->httpMethod() == swsGET) {
+            webServer->countSent(httpClient->print(badQuery));
+        }
+        return;
+    }
+    uint16_t end = (uint32_t)start + count < total ? start + count : total;
+    bool chunked = webServer->sendResponseHead(httpClient, 200, "OK", "application/json", SWS_UNKNOWN_LENGTH, 
+        "Cache-Control: no-store\r\n");
+    if (webServer->httpMethod() != swsGET) {
+        return;
+    }
+    swsBufferedPrint out {httpClient, chunked};
+    out.printf("{\"total\":%u,\"start\":%u,\"events\":[", total, start);
+    for (uint16_t ix = start; ix < end; ix++) {
+        eventRec_t rec;
+        if (ix != start) {
+            out.print(',');
+        }
+        if (readEvent(ix, &rec)) {
+            printEvent(&out, rec, true);
+        } else {
+            out.print("null");
+        }
+    }
+    out.print("]}\n");
+}
+
+/**
+ * @brief   Route handler for POSTs to /api/state and /api/schedule. The route's tag says which.
+ * 
+ * @param webServer         The SimpleWebServer for which we're acting as a route handler.
+ * @param httpClient        The HTTP Client making the request.
+ * @param trPath            The path portion of the URI of the resource being requested.
+ * @param trQuery           The query portion of the URI (if any).
+ */
+void handleApiPost(SimpleWebServer* webServer, WiFiClient* httpClient, swsStringView trPath, swsStringView trQuery) {
+    handleApiUpdate(webServer, httpClient, webServer->routeTag() == apiSchedule);
+}
+
+/**
+ * @brief   Route handler for GET requests for /events. The connection becomes an event stream on 
+ *          which a "state" event is sent whenever the outlet is turned on or off or the schedule 
+ *          is enabled or disabled. The first one, giving the current state, is sent right away.
+ * 
+ * @param webServer         The SimpleWebServer for which we're acting as a route handler.
+ * @param httpClient        The HTTP Client making the request.
+ * @param trPath            The path portion of the URI of the resource being requested.
+ * @param trQuery           The query portion of the URI (if any).
+ */
+void handleEventsGet(SimpleWebServer* webServer, WiFiClient* httpClient, swsStringView trPath, swsStringView trQuery) {
+    if (!webServer->beginEventStream(httpClient)) {
+        Serial.print("[handleEventsGet] Too many event streams. Sent \"503 Service Unavailable\"\n");
+        ui.cancelCmd();
+        return;
+    }
+    char data[STATE_EVENT_LEN];
+    stateEventData(data, sizeof(data));
+    webServer->countSent(SimpleWebServer::printEvent(httpClient, "state", data));
+}
+
+#ifdef METRICS
+/**
+ * @brief   Print all the metrics, the web server's and ours, to the specified Print.
+ * 
+ * @param out       Where to print them
+ * @param summary   True for a line per metric for people, false for the Prometheus text format
+ */
+void printMetrics(Print* out, bool summary) {
+    webServer.printMetrics(out, summary);
+    if (summary) {
+        loopMicros.printSummary(out, "loop()", "us");
+        configSaveMicros.printSummary(out, "Config saves", "us");
+        followMicros.printSummary(out, "followSchedule()", "us");
+        out->printf("Free heap low-water mark: %lu bytes; largest free block then %lu bytes, fragmentation %u%%.\n", 
+            (unsigned long)heapLow, (unsigned long)heapLowMaxBlock, heapLowFrag);
+        return;
+    }
+    out->print("# TYPE loop_micros histogram\n");
+    loopMicros.print(out, "loop_micros");
+    out->print("# TYPE config_save_micros histogram\n");
+    configSaveMicros.print(out, "config_save_micros");
+    out->print("# TYPE follow_schedule_micros histogram\n");
+    followMicros.print(out, "follow_schedule_micros");
+    out->printf("# TYPE heap_free_bytes gauge\nheap_free_bytes %lu\n"
+                "# TYPE heap_low_bytes gauge\nheap_low_bytes %lu\n"
+                "# TYPE heap_low_max_block_bytes gauge\nheap_low_max_block_bytes %lu\n"
+                "# TYPE heap_low_fragmentation_percent gauge\nheap_low_fragmentation_percent %u\n",
+        (unsigned long)ESP.getFreeHeap(), (unsigned long)heapLow, (unsigned long)heapLowMaxBlock, heapLowFrag);
+}
+
+/**
+ * @brief   Route handler for GET requests for /metrics: the metrics in the Prometheus text format.
+ * 
+ * @param webServer         The SimpleWebServer for which we're acting as a route handler.
+ * @param httpClient        The HTTP Client making the request.
+ * @param trPath            The path portion of the URI of the resource being requested.
+ * @param trQuery           The query portion of the URI (if any).
+ */
+void handleMetricsGet(SimpleWebServer* webServer, WiFiClient* httpClient, swsStringView trPath, swsStringView trQuery) {
+    bool chunked = webServer->sendResponseHead(httpClient, 200, "OK", "text/plain; version=0.0.4", SWS_UNKNOWN_LENGTH);
+    swsBufferedPrint out {httpClient, chunked};
+    printMetrics(&out, false);
+}
+#endif
+
+/**
+ * @brief   Route handler for GET and HEAD requests for the commandline page.
+ * 
+ * @param webServer         The SimpleWebServer for which we're acting as a route handler.
+ * @param httpClient        The HTTP Client making the request.
+ * @param trPath            The path portion of the URI of the resource being requested.
+ * @param trQuery           The query portion of the URI (if any).
+ */
+void handleCommandLineGet(SimpleWebServer* webServer, WiFiClient* httpClient, swsStringView trPath, swsStringView trQuery) {
+    bool chunked = webServer->sendResponseHead(httpClient, 200, "OK", "text/html", SWS_UNKNOWN_LENGTH);
+    if (webServer->httpMethod() == swsGET) {
+        sendCommandLinePage(httpClient, chunked);
+    #ifdef DEBUG
+        Serial.print("GET request for commandline page received and processed.\n");
+        ui.cancelCmd();
+    } else {
+        Serial.print("HEAD request for commandline page received and processed.\n");
+        ui.cancelCmd();
+    #endif
+    }
+}
+
+/**
+ * @brief   HTTP GET and HEAD method handler for webServer. It gets the GET and HEAD requests for 
+ *          which there's no route, i.e., for resources we don't have, and sends "404 Not Found."
+ * 
+ * @param webServer         The SimpleWebServer for which we're acting as the GET and HEAD handlers.
+ * @param httpClient        The HTTP Client making the request.
+ * @param trPath            The path portion of the URI of the resource being requested.
+ * @param trQuery           The trQuery (if any).
+ */
+void handleGetAndHead(SimpleWebServer* webServer, WiFiClient* httpClient, swsStringView trPath, swsStringView trQuery) {
+    webServer->countSent(httpClient->print(swsNotFoundResponse));
+    Serial.printf("GET or HEAD request received for some page we don't have: \"%.*s\". Sent \"404 not found\"\n", 
+        (int)trPath.len, trPath.ptr);
+    ui.cancelCmd();
+}
+
+/**
+ * @brief   Route handler for POSTs to the home page. What's to be done is given by the query. A 
+ *          form POST is answered with "303 See other" to the home page. A POST from the home 
+ *          page's script, which says it accepts DELTA_ACCEPT, is instead answered, on the same 
+ *          connection, with just what changed (see sendHomeDelta()).
+ * 
+ * @param webServer         The SimpleWebServer for which we're acting as a route handler.
+ * @param httpClient        The HTTP client making the request.
+ * @param trPath            The path portion of the URI of the resource being requested.
+ * @param trQuery           The trQuery portion of the URI (if any).
+ */
+void handleHomePost(SimpleWebServer* webServer, WiFiClient* httpClient, swsStringView trPath, swsStringView trQuery) {
+    const char* accept = webServer->headerValue("Accept");
+    bool wantsDelta = accept != nullptr && strstr(accept, DELTA_ACCEPT) != nullptr;
+    bool scheduleChanged = false;
+
+    // Deal with TOGGLE_QUERY -- flip the state of the outlet on --> off or vice versa
+    if (trQuery.equalsIgnoreCase(TOGGLE_QUERY)) {
+        toggleOutlet(ecHomePage);
+        #ifdef DEBUG
+        Serial.printf("[handleHomePost] Outlet has been turned %s.\n", outletIsOn() ? "on" : "off");
+        #endif
+
+    // Deal with SCHED_TOGGLE_QUERY -- flip the state of the schedule enabled --> disabled or vice versa
+    } else if (trQuery.equalsIgnoreCase(SCHED_TOGGLE_QUERY)) {
+        config.enabled = !config.enabled;
+        saveConfigSoon();
+        pushStateEvent();
+        scheduleUpdated = true;             // Let followSchedule() know it needs to start over
+        scheduler.runIn(scheduleTaskId, 0);
+        #ifdef DEBUG
+        Serial.printf("[handleHomePost] Schedule has been %s.\n", config.enabled ? "enabled" : "disabled");
+        #endif
+
+    // Deal with SCHED_UPDATE_QUERY -- store the state of the schedule in EEPROM
+    } else if (trQuery.equalsIgnoreCase(SCHED_UPDATE_QUERY)) {
+        #ifdef DEBUG
+        Serial.printf("[handleHomePost] Update schedule. Message headers: \"%s\"\nForm data: ", webServer->clientHeaders().c_str());
+        #endif
+        // One pass over schedFields, checking each value and putting it in apiConfig, a copy of 
+        // config. Fields that are missing or empty stay as they were, except that a checkbox is 
+        // only sent when it's checked. If any value is unacceptable, config isn't changed.
+        apiConfig = config;
+        for (uint8_t i = 0; i < N_SCHED_FIELDS; i++) {
+            const schedField_t &field = schedFields[i];
+            const char* formValue = webServer->formDatumValue(field.name);
+            bool ok = true;
+            if (field.kind == sfEnable) {
+                ok = setSchedField(field, formValue != nullptr && strcmp(formValue, "on") == 0 ? "true" : "false", 
+                    false, &apiConfig);
+            } else if (formValue != nullptr && *formValue != '\0') {
+                #ifdef DEBUG
+                Serial.printf("%s = \"%s\" ", field.name, formValue);
+                #endif
+                if (field.kind == sfType && strncmp(formValue, field.name, 2) == 0) {
+                    formValue += 2;                 // The radio buttons' values are "s<c>dy" etc.
+                }
+                ok = setSchedField(field, formValue, field.kind == sfType || field.kind == sfTime, &apiConfig);
+            }
+            if (!ok) {
+                Serial.printf("Schedule update rejected: \"%s\" isn't a valid %s.\n", formValue, field.name);
+                ui.cancelCmd();
+                webServer->countSent(httpClient->print(swsBadRequestResponse));
+                return;
+            }
+        }
+
+        // Save the new data in config shortly, unless nothing changed
+        if (memcmp(&apiConfig, &config, sizeof(config)) != 0) {
+            #ifdef DEBUG
+            Serial.print("\n[handleHomePost] Configuration update will be saved.\n");
+            ui.cancelCmd();
+            #endif
+            std::swap(config, apiConfig);   // So apiConfig is what config was, for sendHomeDelta()
+            scheduleChanged = true;
+            saveConfigSoon();
+            scheduleUpdated = true;         // Let followSchedule() know we've updated the schedule 
+            scheduler.runIn(scheduleTaskId, 0); // And have it look right away
+        }
+        
+    // Deal with a query to home page that we don't understand
+    } else {
+        Serial.printf("POST request received for query we don't understand: \"%.*s\".\n", (int)trQuery.len, trQuery.ptr);
+        Serial.printf(" Client message body: \"%s\".\n", webServer->clientBody().c_str());
+        ui.cancelCmd(); // Reissue command prompt after print
+        webServer->countSent(httpClient->print(swsBadRequestResponse));
+        return;
+    }
+
+    // Tell the script what changed, or tell the client we're good and go look at the home page for the result.
+    if (wantsDelta) {
+        bool chunked = webServer->sendResponseHead(httpClient, 200, "OK", "application/json", SWS_UNKNOWN_LENGTH, 
+            "Cache-Control: no-store\r\n");
+        sendHomeDelta(httpClient, chunked, scheduleChanged ? &apiConfig : nullptr);
+        return;
+    }
+    webServer->sendResponseHead(httpClient, 303, "See other", nullptr, 0, "Location: /index.html\r\n");
+}
+
+/**
+ * @brief   Route handler for POSTs to the commandline page: do the command and have the client 
+ *          look at the page again to see the result.
+ * 
+ * @param webServer         The SimpleWebServer for which we're acting as a route handler.
+ * @param httpClient        The HTTP client making the request.
+ * @param trPath            The path portion of the URI of the resource being requested.
+ * @param trQuery           The trQuery portion of the URI (if any).
+ */
+void handleCommandLinePost(SimpleWebServer* webServer, WiFiClient* httpClient, swsStringView trPath, swsStringView trQuery) {
+    // Retrieve the command. The screen is kept here; all the client sends is the command.
+    const char* cmdLine = webServer->formDatumValue("cmd");
+    if (cmdLine == nullptr) {
+        cmdLine = "";
+    }
+
+    // Execute the command and put it and its result on the screen.
+    cmdScreen.freshLine();
+    cmdScreen.print(CMD_PROMPT);
+    cmdScreen.print(cmdLine);
+    cmdScreen.print('\n');
+    cmdScreen.print(wc.doCommand({cmdLine, (uint16_t)strlen(cmdLine)}));
+    cmdScreen.freshLine();
+
+    // Tell the client we're good and to go look at the page again for the result.
+    webServer->sendResponseHead(httpClient, 303, "See other", nullptr, 0, "Location: /commandline.html\r\n");
+}
+
+/**
+ * @brief   HTTP POST method handler for webServer. It gets the POSTs for which there's no route, 
+ *          i.e., to resources we don't have, and sends "400 Bad Request."
+ * 
+ * @param webServer         The SimpleWebServer for which we're acting as the POST handler.
+ * @param httpClient        The HTTP client making the request.
+ * @param trPath            The path portion of the URI of the resource being requested.
+ * @param trQuery           The trQuery portion of the URI (if any).
+ */
+void handlePost(SimpleWebServer* webServer, WiFiClient* httpClient, swsStringView trPath, swsStringView trQuery) {
+    // The client POSTed to a page we can't deal with. Respond with "400 Bad Request" message.
+    Serial.printf("POST request received for something other than the home page. path: \"%.*s\" query: \"%.*s\".\n",
+        (int)trPath.len, trPath.ptr, (int)trQuery.len, trQuery.ptr);
+    Serial.printf(" Client message body: \"%s\".\n", webServer->clientBody().c_str());
+    ui.cancelCmd(); // Reissue command prompt after print
+    webServer->countSent(httpClient->print(swsBadRequestResponse));
+}
+
+/**
+ * @brief   Attach the method handlers and the routes for all the resources we serve to webServer.
+ * 
+ */
+void attachWebRoutes() {
+    webServer.attachMethodHandler(swsGET, handleGetAndHead);
+    webServer.attachMethodHandler(swsHEAD, handleGetAndHead);
+    webServer.attachMethodHandler(swsPOST, handlePost);
+    for (uint8_t method = swsGET; method <= swsHEAD; method++) {
+        for (uint8_t i = 0; i < N_WEB_ASSETS; i++) {
+            webServer.attachRoute((swsHttpMethod_t)method, webAssets[i].path, handleAssetGet, i);
+            if (strcmp(webAssets[i].path, "/index.html") == 0) {
+                webServer.attachRoute((swsHttpMethod_t)method, "/", handleAssetGet, i);
+                webServer.attachRoute((swsHttpMethod_t)method, "/index.htm", handleAssetGet, i);
+            }
+        }
+        webServer.attachRoute((swsHttpMethod_t)method, "/api/state", handleApiGet, apiState);
+        webServer.attachRoute((swsHttpMethod_t)method, "/api/schedule", handleApiGet, apiSchedule);
+        webServer.attachRoute((swsHttpMethod_t)method, "/api/log", handleLogGet);
+        webServer.attachRoute((swsHttpMethod_t)method, "/commandline.html", handleCommandLineGet);
+        webServer.attachRoute((swsHttpMethod_t)method, "/commandline.htm", handleCommandLineGet);
+    }
+    webServer.attachRoute(swsGET, "/events", handleEventsGet);
+    webServer.attachRoute(swsPOST, "/api/state", handleApiPost, apiState);
+    webServer.attachRoute(swsPOST, "/api/schedule", handleApiPost, apiSchedule);
+    webServer.attachRoute(swsPOST, "/", handleHomePost);
+    webServer.attachRoute(swsPOST, "/index.html", handleHomePost);
+    webServer.attachRoute(swsPOST, "/commandline.html", handleCommandLinePost);
+    webServer.attachRoute(swsPOST, "/commandline.htm", handleCommandLinePost);
+    #ifdef METRICS
+    webServer.attachRoute(swsGET, "/metrics", handleMetricsGet);
+    #endif
+}
+
+/**
+ * @brief   Utility function to express one of config's on/off cycles as a schedule rule, so that 
+ *          followSchedule() can treat the cycles and the rules in flash alike.
+ * 
+ * @param c         The cycle: 0 to N_CYCLES - 1
+ * @return srRule_t The equivalent rule
+ */
+srRule_t cycleRule(int c) {
+    srRule_t answer {};
+    answer.enabled = config.cycleEnable[c];
+    answer.days = config.cycleType[c] == weekDay ? SR_WEEKDAYS : config.cycleType[c] == weekEnd ? SR_WEEKENDS : SR_ALL_DAYS;
+    int fuzz = config.cycleFuzz[c] >= 0 ? config.cycleFuzz[c] : -config.cycleFuzz[c];
+    answer.fuzz = fuzz > SR_MAX_FUZZ ? SR_MAX_FUZZ : fuzz;
+    if (c < N_TIMED_CYCLES) {                                                       // If on-time/off-time cycle
+        answer.onAnchor = srMidnight;                                               //  Use specified on/off times
+        answer.onMins = config.cycleOnTime[c];
+        answer.offAnchor = srMidnight;
+        answer.offMins = config.cycleOffTime[c];
+    } else if (c % 2 == 0) {                                                        // Else if sunrise-based cycle
+        answer.onAnchor = srMidnight;                                               //  On at spec'd time, off at sunrise + delta
+        answer.onMins = config.sunTime[c - N_TIMED_CYCLES];
+        answer.offAnchor = srSunrise;
+        answer.offMins = config.sunDelta[c - N_TIMED_CYCLES];
+    } else {                                                                        // Else it's sunset-based cycle
+        answer.onAnchor = srSunset;                                                 //  On at sunset - delta, off at spec'd time
+        answer.onMins = -config.sunDelta[c - N_TIMED_CYCLES];
+        answer.offAnchor = srMidnight;
+        answer.offMins = config.sunTime[c - N_TIMED_CYCLES];
+    }
+    return answer;
+}
+
+/**
+ * @brief   Utility function to follow the schedule defined by config and rules. 
+ * 
+ *          Once a day, and whenever the schedule changes, the enabled cycles and rules that apply 
+ *          today are compiled into a list of the day's on/off transitions, sorted by time. After 
+ *          that, each call makes whatever transitions have come due since the last call -- 
+ *          including any that were missed because we were busy when their minute came and went 
+ *          -- and says how long it is until the next one.
+ * 
+ * @return unsigned long    The number of minutes from the current minute until followSchedule() 
+ *                          next has something to do.
+ */
+unsigned long followSchedule() {
+    static scheduleEvent_t event[2 * (N_CYCLES + SR_MAX_RULES)];   // Today's on/off transitions in the order they happen
+    static uint8_t nEvents = 0;                             // The number of transitions in event[]
+    static uint8_t nextEvent = 0;                           // The index in event[] of the next transition to make
+    static int eventsYday = -1;                             // The tm_yday event[] is for; -1 if none yet
+
+    time_t curTime = time(nullptr);
+    struct tm *t;
+    t = localtime(&curTime);
+    struct tm today = *t;
+    minPastMidnight_t curMinPastMidnight = today.tm_hour * 60 + today.tm_min;
+
+    // If the schedule is turned off, nothing to do. Turning it on sets scheduleUpdated.
+    if (!config.enabled) {
+        return MINS_PER_DAY;
+    }
+
+    // If it's a new day, any of yesterday's transitions we haven't made were missed. Make them now.
+    bool newDay = today.tm_yday != eventsYday;
+    if (newDay && !scheduleUpdated) {
+        while (nextEvent < nEvents) {
+            setOutletTo(event[nextEvent].turnOn, ecSchedule, event[nextEvent].source);
+            nextEvent++;
+        }
+    }
+
+    // If the schedule has been updated or it's a new day, recompile event[] for today
+    if (scheduleUpdated || newDay) {
+        // Get today's sunrise and set times
+        sunrise = site.getSunriseMins(today.tm_year, today.tm_yday);
+        sunset = site.getSunsetMins(today.tm_year, today.tm_yday);
+         
+        #ifdef DEBUG
+        Serial.printf("[followSchedule] Sunrise: %s, sunset: %s\n", fromMinsPastMidnight(sunrise).c_str(), fromMinsPastMidnight(sunset).c_str());
+        Serial.print("Schedule:\n         on    off   E/D\n");
+        #endif
+        
+        // Config's cycles come first, then the rules, in order
+        nEvents = 0;
+        for (int c = 0; c < N_CYCLES + rules.count(); c++) {
+            srRule_t rule = c < N_CYCLES ? cycleRule(c) : rules.get(c - N_CYCLES);
+
+            // The actual on and off times we use adjusted by sunrise, sunset and fuzz
+            // cycleOn == cycleOff means ignore this cycle
+            minPastMidnight_t cycleOn = ScheduleRules::resolve(rule.onAnchor, rule.onMins, sunrise, sunset);
+            minPastMidnight_t cycleOff = ScheduleRules::resolve(rule.offAnchor, rule.offMins, sunrise, sunset);
+            if (rule.fuzz != 0) {                                                   // If the cycle has fuzz
+                int randMax = rule.fuzz;
+                int fuzzMins = random(2 * randMax) - randMax;                       //  figure actual fuzz for this cycle today
+                int fuzzyTime = fuzzMins + cycleOn;
+                if (fuzzyTime > 0) {                                                //  Update on time if not before midnight
+                    cycleOn = fuzzyTime;
+                }
+                fuzzyTime = fuzzMins + cycleOff;                                    //  Update off time if not before midnight
+                if (fuzzyTime > 0) {
+                    cycleOff = fuzzyTime;
+                }
+            }
+            bool applies = ScheduleRules::appliesOn(rule, today);
+            #ifdef DEBUG
+            //                     on    off   E/D
+            //             Cycle  0 00:00 00:00 enabled
+            Serial.printf("%s %2d %s %s %s\n", c < N_CYCLES ? "Cycle" : "Rule ", 
+                c < N_CYCLES ? c : c - N_CYCLES, fromMinsPastMidnight(cycleOn).c_str(), fromMinsPastMidnight(cycleOff).c_str(), 
+                !rule.enabled ? "disabled" : applies ? "enabled" : "not today");
+            #endif
+
+            // If cycle c is enabled, is not being ignored and is applicable today, add its transitions
+            if (applies && cycleOn != cycleOff) {
+                event[nEvents++] = {(uint16_t)cycleOn, OUTLET_ON, (uint8_t)c};
+                event[nEvents++] = {(uint16_t)cycleOff, OUTLET_OFF, (uint8_t)c};
+            }
+        }
+
+    // Sort event[] by time. Insertion sort is stable, so when two transitions happen in the same 
+        // minute, the later cycle's wins, just as it always has.
+        for (uint8_t i = 1; i < nEvents; i++) {
+            scheduleEvent_t e = event[i];
+            uint8_t j = i;
+            for (; j > 0 && event[j - 1].when > e.when; j--) {
+                event[j] = event[j - 1];
+            }
+            event[j] = e;
+        }
+
+        // Start with the first transition for now or later. On a new day, that's the first one; 
+        // we'll make any we're already late for right below. After an update, it's as if the 
+        // earlier ones had already happened.
+        nextEvent = 0;
+        if (!newDay) {
+            while (nextEvent < nEvents && event[nextEvent].when < curMinPastMidnight) {
+                nextEvent++;
+            }
+        }
+        eventsYday = today.tm_yday;
+        scheduleUpdated = false;
+    }
+
+    // Make all the transitions that have come due
+    while (nextEvent < nEvents && event[nextEvent].when <= curMinPastMidnight) {
+        #ifdef DEBUG
+        Serial.printf("[followSchedule] %s: outlet %s.\n", 
+            fromMinsPastMidnight(event[nextEvent].when).c_str(), event[nextEvent].turnOn ? "on" : "off");
+        #endif
+        setOutletTo(event[nextEvent].turnOn, ecSchedule, event[nextEvent].source);
+        nextEvent++;
+    }
+
+    #ifdef DEBUG
+    ui.cancelCmd();
+    #endif
+    // Next thing to do is the next transition or, if there are no more today, recompiling at midnight
+    return (nextEvent < nEvents ? event[nextEvent].when : MINS_PER_DAY) - curMinPastMidnight;
+}
+
+/**
+ * @brief   Put the power mode and listen interval config says to use into effect. In modem sleep,
+ *          the SDK's default, the radio sleeps between the beacons the access point sends every 
+ *          PM_BEACON_MILLIS or so and the CPU keeps running. In light sleep, the CPU sleeps too,
+ *          whenever loop()'s delay() is long enough, and the radio can sleep through 
+ *          listenInterval beacons at a time (it takes effect at the next connect). But every task
+ *          that's due cuts a sleep short, so in light sleep the tasks that just poll for work are 
+ *          run once per beacon interval the radio sleeps, rather than every few ms. That leaves 
+ *          the scheduler free to sleep until the next thing actually due -- a schedule transition,
+ *          a clock sync, a connection check. The button task is the exception: it runs every 
+ *          PM_BUTTON_MILLIS so a click still takes effect right away. (The SDK's GPIO wake-up 
+ *          would take over the button's interrupt, which ButtonEvents needs.) That's less than 
+ *          a beacon interval, too short a gap for the SDK to light sleep in, so powerReport() 
+ *          only counts the longer gaps as light sleep. Restarts the power use figures 
+ *          powerReport() gives.
+ * 
+ */
+void applyPowerMode() {
+    static const WiFiSleepType_t sleepType[_powerModeSize] = {WIFI_MODEM_SLEEP, WIFI_LIGHT_SLEEP, WIFI_NONE_SLEEP};
+    bool light = config.powerMode == pmLight;
+    unsigned long pollMillis = PM_BEACON_MILLIS * (config.listenInterval == 0 ? 1 : config.listenInterval);
+    WiFi.setSleepMode(sleepType[config.powerMode], light ? config.listenInterval : 0);
+    scheduler.setPeriod(uiTaskId, light ? pollMillis : UI_TASK_MILLIS);
+    scheduler.setPeriod(buttonTaskId, light ? PM_BUTTON_MILLIS : BUTTON_TASK_MILLIS);
+    scheduler.setPeriod(webTaskId, light ? pollMillis : WEB_TASK_MILLIS);
+    scheduler.setPeriod(groupTaskId, light ? pollMillis : GROUP_TASK_MILLIS);
+    scheduler.setPeriod(mdnsTaskId, light ? pollMillis : MDNS_TASK_MILLIS);
+    pmAwakeMicros = pmIdleMicros = pmLongIdleMicros = pmLateMicros = 0;
+    pmLateMaxMicros = pmWakes = 0;
+    #ifdef DEBUG
+    Serial.printf("[applyPowerMode] %s sleep, listen interval %u, polling every %lu ms.\n", 
+        powerModeName[config.powerMode], config.listenInterval, light ? pollMillis : (unsigned long)UI_TASK_MILLIS);
+    #endif
+}
+
+/**
+ * @brief   Note how one pass through loop() went: how long running the tasks took and how long
+ *          the delay() that followed was asked to be and actually was. What it overran by is 
+ *          how late we woke up.
+ * 
+ * @param runMicros     micros() spent running the tasks
+ * @param idleMillis    millis() the delay() was asked for
+ * @param sleptMicros   micros() it actually took
+ */
+void notePowerUse(uint32_t runMicros, unsigned long idleMillis, uint32_t sleptMicros) {
+    pmAwakeMicros += runMicros;
+    pmIdleMicros += sleptMicros;
+    if (sleptMicros >= PM_BEACON_MILLIS * 1000UL) {
+        pmLongIdleMicros += sleptMicros;
+    }
+    if (idleMillis == 0) {
+        return;
+    }
+    uint32_t lateMicros = sleptMicros > idleMillis * 1000UL ? sleptMicros - idleMillis * 1000UL : 0;
+    pmLateMicros += lateMicros;
+    if (lateMicros > pmLateMaxMicros) {
+        pmLateMaxMicros = lateMicros;
+    }
+    pmWakes++;
+}
+
+/**
+ * @brief   Return a description of the power mode and of the power used since it was put in 
+ *          effect: the share of the time spent running tasks, the average current that implies
+ *          (modeled from datasheet figures, so only good for comparing modes with each other)
+ *          and how late, on average and at worst, we woke up from the delay()s in between.
+ * 
+ * @details Nothing says whether the chip actually got into light sleep. The SDK only gets there 
+ *          in an idle gap of a beacon interval or more, so in light sleep mode only those gaps 
+ *          are charged at the light sleep current; shorter ones -- e.g., between the button 
+ *          task's runs every PM_BUTTON_MILLIS -- are charged at the modem sleep current.
+ * 
+ * @return String 
+ */
+String powerReport() {
+    String answer = String("Power mode: ") + powerModeName[config.powerMode] + 
+        (config.powerMode == pmNone ? "; the radio never sleeps" : " sleep");
+    if (config.powerMode == pmLight) {
+        answer += config.listenInterval == 0 ? String(", listening for the AP's DTIM beacons") : 
+            ", listening for every " + String(config.listenInterval) + " beacons";
+    }
+    answer += ".\n";
+    double total = (double)(pmAwakeMicros + pmIdleMicros);
+    if (total == 0) {
+        return answer;
+    }
+    double idleCharge = pmIdleMicros * (double)PM_NONE_DMA;
+    if (config.powerMode != pmNone) {
+        double modemShare = (double)PM_BEACON_MICROS / (PM_BEACON_MILLIS * 1000.0);
+        double modemDma = PM_MODEM_DMA * (1 - modemShare) + PM_NONE_DMA * modemShare;
+        idleCharge = pmIdleMicros * modemDma;
+        if (config.powerMode == pmLight) {
+            unsigned long listen = config.listenInterval != 0 ? config.listenInterval : 1;
+            double lightShare = modemShare / listen;
+            double lightDma = PM_LIGHT_DMA * (1 - lightShare) + PM_NONE_DMA * lightShare;
+            idleCharge = pmLongIdleMicros * lightDma + (pmIdleMicros - pmLongIdleMicros) * modemDma;
+        }
+    }
+    double avgMa = (pmAwakeMicros * (double)PM_ACTIVE_DMA + idleCharge) / total / 10;
+    answer += "Running tasks " + String(100.0 * pmAwakeMicros / total, 2) + "% of the time; modeled average current " + 
+        String(avgMa, 1) + " mA.\n";
+    if (config.powerMode == pmLight) {
+        answer += "Idle gaps long enough to light sleep in: " + String(pmIdleMicros == 0 ? 0.0 : 100.0 * pmLongIdleMicros / pmIdleMicros, 2) + 
+            "% of the idle time.\n";
+    }
+    if (pmWakes != 0) {
+        answer += "Wake-up latency over " + String(pmWakes) + " idle periods: average " + 
+            String(pmLateMicros / 1000.0 / pmWakes, 2) + " ms, worst " + String(pmLateMaxMicros / 1000.0, 2) + " ms.\n";
+    }
+    return answer;
+}
+
+/**
+ * @brief   Return a description of how firmware updates stand: the one going, if there is one, 
+ *          or how the last one went; whether the firmware is on trial; and where the known good 
+ *          firmware is.
+ * 
+ * @return String 
+ */
+String otaReport() {
+    String answer = "";
+    switch (ota.state()) {
+        case ouIdle:
+            break;
+        case ouHead:
+            answer += "Updating the firmware: waiting for the server.\n";
+            break;
+        case ouBody:
+            answer += "Updating the firmware: " + String(ota.progress()) + " of " + String(ota.size()) + " bytes written.\n";
+            break;
+        case ouInstalled:
+            answer += "The firmware update is installed. Restarting to put it in place.\n";
+            break;
+        case ouFailed:
+            answer += String("The last firmware update failed: ") + ota.error() + ".\n";
+            break;
+    }
+    if (ota.boot() == ouTrial) {
+        answer += "This firmware, from " + String(ota.trialUrl()) + ", is on trial: boot " + String(ota.trialBoots()) + 
+            " of " + String(OU_TRIAL_BOOTS) + ".\n";
+    } else if (ota.boot() == ouRollback) {
+        answer += "This firmware, from " + String(ota.trialUrl()) + ", failed its trial. Going back to the known good firmware.\n";
+    }
+    answer += config.otaUrl[0] == '\0' ? String("There's no known good firmware to go back to.\n") : 
+        "The known good firmware is at " + String(config.otaUrl) + ".\n";
+    return answer;
+}
+
+/**
+ * @brief The "help" and "h" ui command handler. Called by wc as needed.
+ * 
+ */
+String onHelp(WebCmd* cmd) {
+   return 
+        "Help for " BANNER "\n"
+        "  help               Print this text\n"
+        "  h                  Same as 'help'\n"
+        "  ssid [<ssid>]      Print or set the ssid of the WiFi AP we should connect to\n"
+        "  pw [<password>]    Print or set the password we are to use to connect\n"
+        "  tz [<timezone>]    Print or set the POSIX time zone string for the time zone we are in\n"
+        "  loc [lat lon elev] Print or set the locale. Latitude, longitude (degrees) and elevaton (meters)\n"
+        "  name [<name>]      Print or set the outlet's name\n"
+        "  save               Save the current ssid and password and continue\n"
+        "  status             Print the status of the system\n"
+        "  tasks              Print the run statistics of the tasks loop() runs\n"
+        "  stats              Print the request, timing and memory metrics\n"
+        "  rule [list]        Print the schedule rules followed along with the home page's cycles\n"
+        "  rule add <rule>    Add a rule: <days> <on> <off> [<fuzz>] [<mm/dd>-<mm/dd>], e.g.,\n"
+        "                     \"-MTWTF- 06:30 sunrise+20\" or \"daily sunset-15 23:00 10 11/01-02/28\"\n"
+        "  rule del <n>       Delete rule n\n"
+        "  rule clear         Delete all the rules\n"
+        "  group [<n> <key>]  Print the group command status, or join group n using the shared key\n"
+        "  group off          Leave the group; ignore group commands\n"
+        "  log [<n>]          Print the last n (default 10) times the outlet switched on or off, and why\n"
+        "  ota [<url> <md5>]  Print the firmware update status, or update the firmware from the image at url\n"
+        "                     (http://...) with the specified MD5 digest. The new firmware is tried out;\n"
+        "                     say where to go back to with ota good first.\n"
+        "  ota good <url> <md5>  Say where an image of the known good firmware is, to go back to\n"
+        "  power [<mode>]     Print or set how to save power while idle: modem (the default), light or none\n"
+        "  power light [<n>]  Light sleep, sleeping through n beacons at a time (0 to 10; 0: the AP's DTIM).\n"
+        "                     Serial input may lose characters while asleep.\n"
+        "  restart            Restart the device. E.g., to use newly saved WiFi credentials.\n";
+}
+
+/**
+ * @brief The ssid ui command handler. Called by wc as needed.
+ * 
+ */
+String onSsid(WebCmd* cmd) {
+    swsStringView ssid = cmd->restView(1);
+    if (ssid.len != 0 && ssid.copyTo(config.ssid, sizeof(config.ssid))) {
+        return String("SSID changed to \"") + String(config.ssid) + "\"\n";
+    } else if (ssid.len == 0) {
+        return String("SSID is \"") + String(config.ssid) + "\"\n";
+    }
+    return String("Specified SSID is too long. Maximum length is ") + String(sizeof(config.ssid) - 1) + "\n";
+}
+
+/**
+ * @brief The pw ui command handler. Called by wc as needed.
+ * 
+ */
+String onPw(WebCmd* cmd) {
+    swsStringView pw = cmd->restView(1);
+    if (pw.len > 0 && pw.copyTo(config.password, sizeof(config.password))) {
+        return String("Password changed to \"") + String(config.password) + "\"\n";
+    } else if (pw.len == 0) {
+        return String("Password is \"") + String(config.password) + "\"\n";
+    }
+    return String("Password is too long. Maximum length is ") + String(sizeof(config.password) - 1) + ".\n";
+}
+
+/**
+ * @brief The tz ui command handler. Called by wc as needed.
+ * 
+ */
+String onTz(WebCmd* cmd) {
+    swsStringView tz = cmd->wordView(1);
+    if (tz.len == 0) {
+        return String("Timezone is \"") + String(config.timeZone) + "\".\n";
+    } else if (tz.copyTo(config.timeZone, sizeof(config.timeZone))) {
+        ntpClock.setTimeZone(config.timeZone);
+        site = ObsSite {config.latDeg, config.lonDeg, config.elevM};   // Its sun times table is in local time
+        scheduleUpdated = true;                 // Local times, and so the schedule, moved
+        scheduler.runIn(scheduleTaskId, 0);
+        return String("Timezone changed to \"") + String(config.timeZone) + "\".\n";
+    }
+    return String("Time zone string too long; max length is ") + String(sizeof(config.timeZone)) + ".\n";
+}
+
+String onLoc(WebCmd* cmd) {
+    swsStringView l = cmd->wordView(1);
+    String answer ="Location is ";
+    if (l.len != 0) {
+        config.latDeg = l.toFloat();
+        config.lonDeg = cmd->wordView(2).toFloat();
+        config.elevM = cmd->wordView(3).toFloat();
+        site = ObsSite {config.latDeg, config.lonDeg, config.elevM};
+        scheduleUpdated = true;                 // Let followSchedule() know the sun times changed
+        scheduler.runIn(scheduleTaskId, 0);
+        answer = "Location changed to ";
+    }
+    return answer + "Lat: " + String(config.latDeg) + " degrees, Lon: " + 
+        String(config.lonDeg) + " degrees, Elev: " + String(config.elevM) + " meters\n";
+}
+
+/**
+ * @brief The name ui command handler. Called by wc as needed.
+ * 
+ */
+String onName(WebCmd* cmd) {
+    swsStringView name = cmd->restView(1);
+    if (name.len != 0 && name.copyTo(config.outletName, sizeof(config.outletName))) {
+        updateAdvert();
+        return String("Outlet name changed to \"") + String(config.outletName) + "\"\n";
+    } else if (name.len == 0) {
+        return String("Outlet name is \"") + String(config.outletName) + "\"\n";
+    }
+    return String("The specified outlet name is too long. Maximum length is ") + String(sizeof(config.outletName) - 1) + "\n";
+}
+
+/**
+ * @brief The save ui command handler. Called by wc as needed.
+ * 
+ */
+String onSave(WebCmd* cmd) {
+    config.signature = CONFIG_SIG;
+    saveConfig();
+    if (config.ssid[0] != '\0' && config.password[0] != '\0' && netState != netUp) {
+        WiFi.disconnect();
+        netRetryMillis = WIFI_RETRY_MIN_MILLIS;
+        setNetState(netStarting);                   // Try the (perhaps new) credentials right away
+        return "Configuration saved. Connecting to WiFi.\n";
+    }
+    return "Configuration saved.\n";
+}
+
+/**
+ * @brief The restart ui command handler. Called by wc as needed.
+ * 
+ */
+String onRestart(WebCmd* cmd) {
+    flushConfig();
+    flushEvents();
+    ntpClock.save();
+    ESP.restart();
+    return "";      // The compiler doesn't know restart never returns
+}
+
+/**
+ * @brief The status ui command handler. Called by wc as needed.
+ * 
+ */
+String onStatus(WebCmd* cmd) {
+    String answer = "";
+    if (clockIsSet) {
         time_t nowSecs = time(nullptr);
         answer +=   "The time is " + String(ctime(&nowSecs)) + 
-                    "Sunrise today: " + fromMinsPastMidnight(sunrise) + ", sunset: " + fromMinsPastMidnight(sunset) + "\n" +
-                    "We're attached to WiFi SSID \"" + String(config.ssid) + "\".\n" +
+                    "Sunrise today: " + fromMinsPastMidnight(sunrise) + ", sunset: " + fromMinsPastMidnight(sunset) + "\n";
+        if (ntpClock.lastSync() != 0) {
+            answer +=   "The clock was last synced " + String((long)(nowSecs - ntpClock.lastSync())) + " s ago" + 
+                        (ntpClock.source() == ncRestored ? ", before the last reset.\n" : 
+                        ". Offset " + String(ntpClock.lastOffset()) + " us, round trip " + 
+                        String(ntpClock.lastRoundTrip()) + " us.\n") +
+                        "Its measured drift is " + String(ntpClock.drift()) + " ppb.\n";
+        }
+    } else {
+        answer +=   "The clock hasn't been set yet.\n";
+    }
+    answer +=   "The WiFi connection is " + String(netStateName[netState]) + ".\n";
+    if (netState == netUp) {
+        answer +=   "We're attached to WiFi SSID \"" + String(config.ssid) + "\".\n" +
                     "There our local IP address is " + WiFi.localIP().toString() + ".\n";
     }
-    answer +=   String("The web server is " + String(running ? "" : "not ") + "running.\n") +
+    if (wiFiReadyMillis != 0) {
+        answer +=   "The WiFi was first up " + String(wiFiReadyMillis) + " ms after boot" + 
+                    (wiFiWasFast ? " using the cached access point.\n" : ".\n");
+    }
+    if (mdnsStarted) {
+        answer +=   "We're advertised by mDNS as \"" + String(config.outletName) + "\" at http://" + 
+                    String(mdnsHost) + ".local/.\n";
+    }
+    answer +=   powerReport();
+    if (ota.state() != ouIdle || ota.boot() != ouNormal) {
+        answer +=   otaReport();
+    }
+    if (button.worstClickMicros() != 0 || button.lostEdges() != 0) {
+        answer +=   "Button clicks have taken effect within " + String(button.worstClickMicros() / 1000.0, 1) + 
+                    " ms of the button's release. Edges lost: " + String(button.lostEdges()) + ".\n";
+    }
+    if (firstRequestMillis != 0) {
+        answer +=   "The first web request was served " + String(firstRequestMillis) + " ms after boot.\n";
+    }
+    answer +=   String("The web server is " + String(netState == netUp ? "" : "not ") + "reachable.\n") +
                 "The outlet is " + String(digitalRead(RELAY) == RELAY_CLOSED ? "on" : "off") + ".\n"
                 "The schedule is " + String(config.enabled ? "enabled" : "disabled") + ".\n";
     return answer;
 }
 
 /**
- * @brief The Arduino setup function. Called once at power-on or reset.
+ * @brief The tasks ui command handler. Called by wc as needed.
  * 
  */
-void setup() {
-    // Do the basic hardware initialization.
-    Serial.begin(9600);                 // Get Serial via UART up and running.
-    delay(SERIAL_CONN_MILLIS);
-    pinMode(LED, OUTPUT);               // Initialize the LED.
-    setLEDto(LED_DARK);
-    pinMode(RELAY, OUTPUT);             // Initialize the relay.
-    digitalWrite(RELAY, RELAY_OPEN);
-    button.begin();                     // Initialize the button.
+String onTasks(WebCmd* cmd) {
+    return scheduler.statsReport();
+}
 
-    // Attach the ui command handlers
-    if (!(
-        ui.attachCmdHandler("help", onHelp) &&
-        ui.attachCmdHandler("h", onHelp) &&
-        ui.attachCmdHandler("ssid", onSsid) &&
-        ui.attachCmdHandler("pw", onPw) &&
-        ui.attachCmdHandler("tz", onTz) &&
-        ui.attachCmdHandler("loc", onLoc) &&
-        ui.attachCmdHandler("name", onName) &&
-        ui.attachCmdHandler("save", onSave) &&
-        ui.attachCmdHandler("status", onStatus) &&
-        ui.attachCmdHandler("restart", onRestart))
-        ) {
-        Serial.print("Couldn't attach all the ui command handlers.\n");
+/**
+ * @brief The rule ui command handler. Called by wc as needed.
+ * 
+ */
+String onRule(WebCmd* cmd) {
+    swsStringView verb = cmd->wordView(1);
+    if (verb.len == 0 || verb.equals("list")) {
+        if (rules.count() == 0) {
+            return "No rules. Only the home page's cycles are followed.\n";
+        }
+        StreamString answer;
+        for (uint8_t r = 0; r < rules.count(); r++) {
+            answer.printf("%2u  ", r);
+            ScheduleRules::print(&answer, rules.get(r));
+            answer.print("\n");
+        }
+        return answer;
+    }
+    if (verb.equals("add")) {
+        swsStringView specView = cmd->restView(2);
+        char spec[RULE_MAX_SPEC_LEN + 1];
+        srRule_t rule;
+        if (!specView.copyTo(spec, sizeof(spec)) || !ScheduleRules::parse(spec, &rule)) {
+            return String("Can't make sense of rule \"") + specView.toString() + "\". Say, e.g., \"rule add -MTWTF- 06:30 sunrise+20\".\n";
+        }
+        if (!rules.add(rule)) {
+            return String("Couldn't add the rule. There can be at most ") + String(SR_MAX_RULES) + " of them.\n";
+        }
+    } else if (verb.equals("del")) {
+        swsStringView ix = cmd->wordView(2);
+        if (ix.len == 0 || !isdigit(ix.ptr[0]) || !rules.remove(ix.toInt())) {
+            return String("There's no rule \"") + ix.toString() + "\".\n";
+        }
+    } else if (verb.equals("clear")) {
+        if (!rules.clear()) {
+            return "Couldn't clear the rules.\n";
+        }
+    } else {
+        return String("Unknown rule subcommand \"") + verb.toString() + "\". Use list, add, del or clear.\n";
     }
+    scheduleUpdated = true;                     // Let followSchedule() know the schedule changed
+    scheduler.runIn(scheduleTaskId, 0);
+    return String("Done. There are ") + String(rules.count()) + " rules.\n";
+}
 
-    Serial.println(BANNER);                 // Say hello.
-    screenContents = "\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n" + 
-                    String(BANNER) + "\n"
-                    "Type \"help\" for a list of commands.\n"; // Also in the web commandline page
+/**
+ * @brief The group ui command handler. Called by wc as needed.
+ * 
+ */
+String onGroup(WebCmd* cmd) {
+    swsStringView id = cmd->wordView(1);
+    if (id.equals("off")) {
+        config.groupId = 0;
+        config.groupKey[0] = '\0';
+        saveConfigSoon();
+        return "No longer in a group.\n";
+    }
+    if (id.len != 0) {
+        swsStringView key = cmd->wordView(2);
+        long n = id.toInt();
+        if (!isdigit(id.ptr[0]) || n < 1 || n >= GROUP_ALL) {
+            return String("The group must be a number from 1 to ") + String(GROUP_ALL - 1) + ".\n";
+        }
+        if (key.len < GROUP_MIN_KEY_LEN || key.len >= sizeof(config.groupKey)) {
+            return String("The key must be ") + String(GROUP_MIN_KEY_LEN) + " to " + 
+                String(sizeof(config.groupKey) - 1) + " characters long.\n";
+        }
+        config.groupId = n;
+        key.copyTo(config.groupKey, sizeof(config.groupKey));
+        saveConfigSoon();
+    }
+    if (config.groupId == 0) {
+        return "Not in a group.\n";
+    }
+    return String("In group ") + String(config.groupId) + (groupListening ? ", listening" : ", not listening yet") + 
+        ". Group commands accepted: " + String(groupAccepted) + ", repeats ignored: " + String(groupDuplicates) + 
+        ", rejected: " + String(groupRejected) + ".\n";
+}
 
-    // See if we have our configuration data available
-    EEPROM.begin(sizeof(eepromData_t));
-    // If so try to get it from EEPROM.
-    eepromData_t storedConfig;
-    if (EEPROM.percentUsed() != -1) {
-        EEPROM.get(0,storedConfig);
+/**
+ * @brief The power ui command handler. Called by wc as needed.
+ * 
+ */
+String onPower(WebCmd* cmd) {
+    swsStringView mode = cmd->wordView(1);
+    if (mode.len == 0) {
+        return powerReport();
     }
-    #ifdef DEBUG
-    Serial.printf("Got stored data. signature: 0x%x, ssid: %s.\n", storedConfig.signature, storedConfig.ssid);
-    #endif
-    // If the stored signature matches, assume the stored data is our config
-    if (storedConfig.signature == CONFIG_SIG) {
-        config = storedConfig;
+    uint8_t m = 0;
+    while (m < _powerModeSize && !mode.equals(powerModeName[m])) {
+        m++;
     }
-    // If there's an SSID and password, presume we'll get up and going
-    running = config.ssid[0] != '\0' && config.password[0] != '\0';
-    noWiFiMillis = 0;
-    if (running) {
-        // Get the WiFi connection going.
-        Serial.printf("\nConnecting to %s ", config.ssid);
-        unsigned long startMillis = millis();
-        WiFi.begin(config.ssid, config.password);
-        while (WiFi.status() != WL_CONNECTED && millis() - startMillis < WIFI_CONN_MILLIS) {
-            delay(WIFI_DELAY_MILLIS);
-            Serial.print(".");
-            toggleLED();
-        }
-        if (WiFi.status() == WL_CONNECTED) {
-            Serial.print(" WiFi connected.\nIP address is ");
-            Serial.println(WiFi.localIP());
-            // Set the system clock to the correct time
-            running = setClock();
-            wiFiServer.begin();
-            // Get the webServer going and attach the HTTP method handlers.
-            webServer.begin(wiFiServer);
-            webServer.attachMethodHandler(swsGET, handleGetAndHead);
-            webServer.attachMethodHandler(swsHEAD, handleGetAndHead);
-            webServer.attachMethodHandler(swsPOST, handlePost);
-            setLEDto(LED_LIT);
-        } else {
-            Serial.printf("Unable to connect to WiFi. Status: %d\n", WiFi.status());
-            running = false;                    // We're not running
+    if (m == _powerModeSize) {
+        return String("Unknown power mode \"") + mode.toString() + "\". Use modem, light or none.\n";
+    }
+    swsStringView listen = cmd->wordView(2);
+    long n = listen.toInt();
+    if (listen.len != 0 && (!isdigit(listen.ptr[0]) || n > PM_MAX_LISTEN)) {
+        return String("The listen interval must be a number from 0 to ") + String(PM_MAX_LISTEN) + ".\n";
+    }
+    uint8_t oldListen = config.powerMode == pmLight ? config.listenInterval : 0;
+    bool reconnect = (m == pmLight ? n : 0) != oldListen && netState == netUp;
+    config.powerMode = (powerMode_t)m;
+    config.listenInterval = n;
+    saveConfigSoon();
+    applyPowerMode();
+    if (reconnect) {
+        WiFi.disconnect();                      // The listen interval is settled when we associate
+        setNetState(netStarting);
+    }
+    return powerReport();
+}
+
+/**
+ * @brief The log ui command handler. Called by wc as needed.
+ * 
+ */
+String onLog(WebCmd* cmd) {
+    swsStringView n = cmd->wordView(1);
+    uint16_t count = EVENT_CMD_DEFAULT;
+    if (n.len != 0) {
+        if (!isdigit(n.ptr[0])) {
+            return String("The number of events to print must be a number, not \"") + n.toString() + "\".\n";
         }
-        // If we should have been able to connect and get the time, but couldn't note when it happened
-        if (!running) {
-            Serial.printf("Expected to connect to WiFi and set the time, but couldn't. Will try again in %ld minutes.\n", 
-                NOT_RUNNING_MINS);
-            noWiFiMillis = millis();
+        count = n.toInt();
+    }
+    uint16_t total = eventCount();
+    if (total == 0) {
+        return "No events logged yet.\n";
+    }
+    StreamString answer;
+    for (uint16_t ix = total > count ? total - count : 0; ix < total; ix++) {
+        eventRec_t rec;
+        answer.printf("%4u  ", ix);
+        if (readEvent(ix, &rec)) {
+            printEvent(&answer, rec, false);
         } else {
-            randomSeed((unsigned long)(time(nullptr) && 0xFFFFFFFF));
+            answer.print("(unreadable)");
         }
-    } else {
-        Serial.print("No stored WiFi credentials found.\n");
+        answer.print('\n');
     }
-    if (!running) {
-        Serial.print(
-            "Unable to get things up and running. Hopefully, the reason is clear.\n"
-            "Use command line to set the WiFi credentials if needed./n"
-            "Type \"help\" for help.\n");
+    return answer;
+}
+
+/**
+ * @brief The ota ui command handler. Called by wc as needed.
+ * 
+ */
+String onOta(WebCmd* cmd) {
+    swsStringView url = cmd->wordView(1);
+    if (url.len == 0) {
+        return otaReport();
+    }
+    bool good = url.equals("good");
+    if (good) {
+        url = cmd->wordView(2);
+    }
+    swsStringView md5 = cmd->wordView(good ? 3 : 2);
+    char urlChars[OU_MAX_URL_LEN + 1];
+    char md5Chars[OU_MD5_LEN + 1];
+    if (!url.startsWith("http://") || !url.copyTo(urlChars, sizeof(urlChars)) || 
+        !md5.copyTo(md5Chars, sizeof(md5Chars)) || !OtaUpdate::isMd5(md5Chars)) {
+        return String("Use \"ota [good] http://<host>[:<port>]/<path> <md5>\". The URL can be at most ") + 
+            String(OU_MAX_URL_LEN) + " characters; the MD5 digest is 32 hex digits.\n";
+    }
+    if (good) {
+        strcpy(config.otaUrl, urlChars);
+        strcpy(config.otaMd5, md5Chars);
+        saveConfigSoon();
+        return otaReport();
     }
+    if (config.otaUrl[0] == '\0') {
+        return "If the new firmware failed its trial, there'd be no known good firmware to go back to. Say where "
+            "that is first with \"ota good <url> <md5>\".\n";
+    }
+    if (netState != netUp) {
+        return "The WiFi isn't connected.\n";
+    }
+    if (!ota.start(urlChars, md5Chars)) {
+        return ota.state() == ouFailed ? String("Couldn't update the firmware: ") + ota.error() + ".\n" : 
+            String("A firmware update is already going.\n");
+    }
+    otaUpdating = true;
+    scheduler.runIn(otaTaskId, 0);
+    return "Updating the firmware from " + String(urlChars) + ". The outlet will restart when it's installed.\n";
 }
 
 /**
- * @brief The Arduino loop function. Called repeatedly.
+ * @brief The stats ui command handler. Called by wc as needed.
  * 
  */
-void loop() {
-    unsigned long curMillis = millis();     // millis() now
+String onStats(WebCmd* cmd) {
+    #ifdef METRICS
+    StreamString answer;
+    printMetrics(&answer, true);
+    return answer;
+    #else
+    return "Metrics aren't compiled in. Build with \"-D METRICS\" to have them.\n";
+    #endif
+}
+
+/**
+ * @brief   The commands wc does and their handlers, in order of name so wc can binary search for 
+ *          them. The whole table, names and all, is in flash.
+ * 
+ */
+static constexpr wcCommand_t uiCommands[] PROGMEM = {
+    {"group", onGroup},
+    {"h", onHelp},
+    {"help", onHelp},
+    {"loc", onLoc},
+    {"log", onLog},
+    {"name", onName},
+    {"ota", onOta},
+    {"power", onPower},
+    {"pw", onPw},
+    {"restart", onRestart},
+    {"rule", onRule},
+    {"save", onSave},
+    {"ssid", onSsid},
+    {"stats", onStats},
+    {"status", onStatus},
+    {"tasks", onTasks},
+    {"tz", onTz},
+};
+static_assert(wcIsSorted(uiCommands), "uiCommands[] must be in order of name");
+
+/**
+ * @brief   The ui's command handler, for every command. The ui just gathers the line from 
+ *          Serial; wc does it, as it does the lines from the web command page.
+ * 
+ */
+String onUiLine(CommandHandlerHelper* helper) {
+    return wc.doCommand(helper->getCommandLine());
+}
 
-    // Let the ui do its thing.
+/**
+ * @brief   The ui task. Let the ui do its thing.
+ * 
+ */
+void uiTask() {
     ui.run();
+}
+
+/**
+ * @brief   The button task. Deal with button clicks and long presses. They're timed by the 
+ *          interrupt handler, so they come out right even when the task runs late.
+ * 
+ */
+void buttonTask() {
+    // Turn the edges the button's interrupt handler has noted into clicks and long presses.
+    button.run();
 
     // Deal with button clicks: toggle outlet.
     if (button.clicked()) {
-            toggleOutlet();
+            toggleOutlet(ecButton);
     }
 
     // Deal with button long presses: reset and, because the button is down, enter "PGM from UART" mode.
     if (button.longPressed()) {
         Serial.print("Resetting for firmware update.\n");
         setLEDto(LED_DARK);
+        flushConfig();
+        flushEvents();
+        ntpClock.save();
         ESP.reset();
     }
+}
+
+/**
+ * @brief   The web server task. If the WiFi is connected, let the web server do its thing.
+ * 
+ */
+void webTask() {
+    if (WiFi.status() == WL_CONNECTED) {
+        webServer.run();
+        if (firstRequestMillis == 0 && webServer.requestsServed() != 0) {
+            firstRequestMillis = millis();
+            Serial.printf("First web request served %lu ms after boot.\n", firstRequestMillis);
+            ui.cancelCmd();
+        }
+    }
+}
+
+/**
+ * @brief   Utility function to check a group command datagram and, if it's acceptable, do what it
+ *          says. To be acceptable, it has to be well formed, for our group (or GROUP_ALL), signed 
+ *          with our group key and stamped within GROUP_MAX_SKEW_MILLIS of our clock, and later 
+ *          than the last one we accepted. So a repeat of one (a sender may send each more than 
+ *          once, in case some get lost) is ignored, as is a recording of one played back later.
+ * 
+ * @param dgram     The datagram. Its JSON gets a terminating '\0' written over the MAC after the 
+ *                  MAC has been checked.
+ * @param len       Its length
+ */
+void handleGroupDatagram(uint8_t* dgram, size_t len) {
+    groupHeader_t header;
+    if (len < sizeof(header) + GROUP_MAC_LEN) {
+        groupRejected++;
+        return;
+    }
+    memcpy(&header, dgram, sizeof(header));
+    if (header.magic != GROUP_MAGIC || header.version != GROUP_VERSION || 
+        (header.command != gcState && header.command != gcSchedule) || 
+        header.jsonLen > GROUP_MAX_JSON || len != sizeof(header) + header.jsonLen + GROUP_MAC_LEN) {
+        groupRejected++;
+        return;
+    }
+    if (header.group != config.groupId && header.group != GROUP_ALL) {
+        return;                                 // For some other group
+    }
+
+    // Check the MAC without giving away, by how long it takes, how much of it matched
+    uint8_t mac[GROUP_MAC_LEN];
+    size_t signedLen = sizeof(header) + header.jsonLen;
+    experimental::crypto::SHA256::hmac(dgram, signedLen, config.groupKey, strlen(config.groupKey), mac, sizeof(mac));
+    uint8_t diff = 0;
+    for (uint8_t i = 0; i < GROUP_MAC_LEN; i++) {
+        diff |= mac[i] ^ dgram[signedLen + i];
+    }
+    if (diff != 0) {
+        #ifdef DEBUG
+        Serial.printf("[handleGroupDatagram] Bad MAC on a datagram from %s.\n", groupUdp.remoteIP().toString().c_str());
+        #endif
+        groupRejected++;
+        return;
+    }
+
+    // Check the stamp. Without the time, there's no telling whether it's current.
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    uint64_t nowMillis = (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    int64_t skew = (int64_t)(header.stamp - nowMillis);
+    if (!clockIsSet || skew > GROUP_MAX_SKEW_MILLIS || skew < -GROUP_MAX_SKEW_MILLIS) {
+        #ifdef DEBUG
+        Serial.printf("[handleGroupDatagram] Stamp is %lld ms from our clock.\n", (long long)skew);
+        #endif
+        groupRejected++;
+        return;
+    }
+    // It mustn't be one we've seen: later than the last one accepted and, since that's forgotten 
+    // at a restart, than when we started. Otherwise one sent just before a restart could be replayed.
+    if (header.stamp <= groupLastStamp || header.stamp < nowMillis - millis()) {
+        groupDuplicates++;
+        return;
+    }
 
-    // If everything should be up and running,
-    if (running) {
-        // If the WiFi is still connected
-        if (WiFi.status() == WL_CONNECTED) {
-            webServer.run();                    // Let the web server do its thing
-            followSchedule();                   // Let the schedule follower do its thing
-            noWiFiMillis = 0;                   // We do have an internet connection
+    // Do what it says
+    dgram[signedLen] = '\0';
+    if (!applyApiUpdate((const char*)dgram + sizeof(header), header.command == gcSchedule, ecGroup)) {
+        groupRejected++;
+        return;
+    }
+    groupLastStamp = header.stamp;
+    groupAccepted++;
+    #ifdef DEBUG
+    Serial.printf("[handleGroupDatagram] Applied %s from %s.\n", (const char*)dgram + sizeof(header),
+        groupUdp.remoteIP().toString().c_str());
+    #endif
+}
 
-        // Otherwise, the WiFi connection we had isn't there anymore. If this is the first we saw that
-        } else if (noWiFiMillis == 0) {
-            Serial.printf("Oops! The WiFi connection seems to have disappeared. Will try to reconnect in %ld minutes.\n",
-                NOT_RUNNING_MINS);
-            noWiFiMillis = curMillis;           // Note when we first noticed there was no internet connection
+/**
+ * @brief   The group command listener task. While the WiFi is up and we're in a group, listen on 
+ *          the group multicast address for group command datagrams and deal with any that have 
+ *          arrived. Joining the multicast group again each time the WiFi comes back up keeps us 
+ *          in it across reconnects.
+ * 
+ */
+void groupTask() {
+    static uint8_t dgram[sizeof(groupHeader_t) + GROUP_MAX_JSON + GROUP_MAC_LEN];
+    bool wanted = netState == netUp && config.groupId != 0 && strlen(config.groupKey) >= GROUP_MIN_KEY_LEN;
+    if (wanted != groupListening) {
+        if (wanted) {
+            wanted = groupUdp.beginMulticast(WiFi.localIP(), IPAddress(GROUP_MCAST_IP), GROUP_PORT) == 1;
+        } else {
+            groupUdp.stop();
+        }
+        groupListening = wanted;
+    }
+    if (!groupListening) {
+        return;
+    }
+    for (uint8_t n = 0; n < GROUP_MAX_PER_RUN; n++) {
+        int size = groupUdp.parsePacket();
+        if (size <= 0) {
+            break;
         }
+        if ((size_t)size > sizeof(dgram)) {
+            groupUdp.flush();
+            groupRejected++;
+            continue;
+        }
+        handleGroupDatagram(dgram, groupUdp.read(dgram, size));
+    }
+}
+
+/**
+ * @brief   Utility function to start the mDNS responder and advertise our web server with DNS-SD.
+ * 
+ */
+void startAdvert() {
+    if (mdnsStarted) {
+        return;
+    }
+    snprintf(mdnsHost, sizeof(mdnsHost), MDNS_HOST_FORMAT, ESP.getChipId());
+    if (!MDNS.begin(mdnsHost)) {
+        Serial.print("[startAdvert] Couldn't start the mDNS responder.\n");
+        return;
+    }
+    mdnsService = MDNS.addService(config.outletName, "http", "tcp", 80);
+    if (mdnsService == nullptr) {
+        Serial.print("[startAdvert] Couldn't add the DNS-SD service.\n");
+        return;
+    }
+    MDNS.addServiceTxt(mdnsService, "fw", BANNER);
+    MDNS.addServiceTxt(mdnsService, "api", "/api/state");
+    mdnsStarted = true;
+    updateAdvert();
+}
+
+/**
+ * @brief   The mDNS responder task. Once the WiFi is first up, start the responder and let it 
+ *          answer queries. It keeps going across WiFi reconnects by itself.
+ * 
+ */
+void mdnsTask() {
+    if (!mdnsStarted && netState == netUp) {
+        startAdvert();
+    }
+    if (mdnsStarted) {
+        MDNS.update();
+    }
+}
+
+/**
+ * @brief   The firmware update task. While an update's going, move it along every OTA_TASK_MILLIS. 
+ *          When it's done, say how it went and, if it worked, restart to put the new firmware in 
+ *          place.
+ * 
+ * @details New firmware is on trial until it gets running: connected to the WiFi. That's all it 
+ *          takes to go back, and all it can count on reaching; an NTP server or the update server 
+ *          may be down through no fault of its own. Then it's the known good firmware. If it isn't running within OTA_TRIAL_MILLIS of 
+ *          boot, it restarts, and once it's had OU_TRIAL_BOOTS boots (crashes and watchdog resets 
+ *          count, too), ota.begin() says to go back: fetch the known good firmware again, as soon 
+ *          as the WiFi's up, and install it. Retry every OTA_RETRY_MILLIS until that works. So 
+ *          going back only works if the new firmware can at least get through setup() and connect 
+ *          to the WiFi; if it can't, the way back is the serial port.
+ */
+void otaTask() {
+    if (ota.run()) {
+        scheduler.runIn(otaTaskId, OTA_TASK_MILLIS);
+        return;
     }
-    
-    // If it looks like the internet is configured but hasn't been available for some time
-    if (noWiFiMillis != 0 && curMillis - noWiFiMillis > NOT_RUNNING_MILLIS && config.ssid[0] != '\0' && config.password[0] != '\0') {
-        Serial.print("Restarting to see if the WiFi is back.\n");
-        ESP.restart();                          // Try restarting
+    if (ota.state() == ouInstalled) {
+        Serial.print("Firmware update installed. Restarting to put it in place.\n");
+        flushConfig();
+        flushEvents();
+        ntpClock.save();
+        ESP.restart();
+        return;
+    }
+    bool justFailed = otaUpdating && ota.state() == ouFailed;
+    if (justFailed) {
+        Serial.printf("The firmware update failed: %s.\n", ota.error());
+        ui.cancelCmd();
+    }
+    otaUpdating = false;
+
+    switch (ota.boot()) {
+        case ouNormal:
+            break;
+        case ouTrial:
+            if (netState == netUp) {
+                strcpy(config.otaUrl, ota.trialUrl());
+                strcpy(config.otaMd5, ota.trialMd5());
+                saveConfigSoon();
+                ota.proven();
+                Serial.print("The new firmware is running. It's now the known good firmware.\n");
+                ui.cancelCmd();
+            } else if (millis() >= OTA_TRIAL_MILLIS) {
+                Serial.printf("The new firmware isn't running after %lu s (boot %u of %u). Restarting.\n", 
+                    OTA_TRIAL_MILLIS / 1000, ota.trialBoots(), OU_TRIAL_BOOTS);
+                flushConfig();
+                flushEvents();
+                ntpClock.save();
+                ESP.restart();
+            } else {
+                scheduler.runIn(otaTaskId, NET_TASK_MILLIS);
+            }
+            break;
+        case ouRollback:
+            if (config.otaUrl[0] == '\0') {
+                Serial.print("The new firmware failed its trial, but there's no known good firmware to go back to.\n");
+                ui.cancelCmd();
+                ota.endTrial();
+            } else if (justFailed) {
+                scheduler.runIn(otaTaskId, OTA_RETRY_MILLIS);
+            } else if (netState != netUp) {
+                scheduler.runIn(otaTaskId, NET_TASK_MILLIS);
+            } else {
+                Serial.printf("The new firmware failed its trial. Going back to %s.\n", config.otaUrl);
+                ui.cancelCmd();
+                otaUpdating = true;
+                ota.start(config.otaUrl, config.otaMd5, false);
+                scheduler.runIn(otaTaskId, ota.state() == ouFailed ? 0 : OTA_TASK_MILLIS);
+            }
+            break;
+    }
+}
+
+/**
+ * @brief   The clock task. Let ntpClock keep the clock right, and run it again when it says to.
+ * 
+ */
+void clockTask() {
+    scheduler.runIn(clockTaskId, ntpClock.run(netState == netUp));
+}
+
+/**
+ * @brief   The schedule task. Once the clock has been set, let the schedule follower do its 
+ *          thing, network or no network. Nothing in the schedule changes until the next 
+ *          transition followSchedule() reports, so the task arranges to be run next just after 
+ *          the start of that minute, or in SCHED_MAX_SLEEP_MINS if that's sooner (so clock changes 
+ *          get noticed). Things that change the schedule arrange for it to be run right away.
+ * 
+ */
+void scheduleTask() {
+    unsigned long waitMins = 1;
+    if (clockIsSet) {
+        #ifdef METRICS
+        uint32_t startMicros = micros();
+        waitMins = followSchedule();
+        followMicros.record(micros() - startMicros);
+        #else
+        waitMins = followSchedule();
+        #endif
+    }
+    if (waitMins > SCHED_MAX_SLEEP_MINS) {
+        waitMins = SCHED_MAX_SLEEP_MINS;
+    }
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    unsigned long millisIntoMinute = (tv.tv_sec % 60) * 1000UL + tv.tv_usec / 1000;
+    scheduler.runIn(scheduleTaskId, waitMins * 60000UL - millisIntoMinute + SCHED_SLOP_MILLIS);
+}
+
+/**
+ * @brief The Arduino setup function. Called once at power-on or reset.
+ * 
+ */
+void setup() {
+    // Do the basic hardware initialization.
+    Serial.begin(9600);                 // Get Serial via UART up and running.
+    delay(SERIAL_CONN_MILLIS);
+    pinMode(LED, OUTPUT);               // Initialize the LED.
+    setLEDto(LED_DARK);
+    pinMode(RELAY, OUTPUT);             // Initialize the relay.
+    digitalWrite(RELAY, RELAY_OPEN);
+    button.begin();                     // Initialize the button.
+    ota.begin();                        // If this is new firmware, count the boot of its trial.
+
+    // Give wc its commands, and have the ui hand it every line from Serial (as its default handler)
+    wc.begin(uiCommands);
+    if (!ui.attachCmdHandler("", onUiLine)) {
+        Serial.print("Couldn't attach the ui command handler.\n");
+    }
+
+    Serial.println(BANNER);                 // Say hello.
+    cmdScreen.print(BANNER "\n"
+                    "Type \"help\" for a list of commands.\n"); // Also in the web commandline page
+
+    // See if we have our configuration data available and, if so, use it
+    restoreConfig();
+    site = ObsSite {config.latDeg, config.lonDeg, config.elevM};
+    if (!rules.begin()) {
+        Serial.print("[setup] Couldn't read the schedule rules from flash.\n");
+    }
+    if (!eventLog.begin()) {
+        Serial.print("[setup] Couldn't read the event log from flash.\n");
+    }
+
+    // Get the clock going. After a reset, it's good right away; otherwise NTP will set it.
+    ntpClock.begin(config.timeZone, NTP_SERVER);
+
+    // Get the web server ready. It serves whenever the WiFi is connected.
+    wiFiServer.begin();
+    webServer.begin(wiFiServer);
+    attachWebRoutes();
+
+    // If there's an SSID and password, have netTask() get the WiFi connected. Either way, carry on.
+    if (config.ssid[0] != '\0' && config.password[0] != '\0') {
+        setNetState(netStarting);
+    } else {
+        Serial.print(
+            "No stored WiFi credentials found.\n"
+            "Use the command line to set the WiFi credentials.\n"
+            "Type \"help\" for help.\n");
+        setNetState(netNoCredentials);
+    }
+
+    // Give the scheduler the tasks loop() is to run.
+    scheduleTaskId = scheduler.addTask("schedule", scheduleTask, 0);
+    commitTaskId = scheduler.addTask("commit", flushConfig, 0);
+    clockTaskId = scheduler.addTask("clock", clockTask, 0);
+    eventTaskId = scheduler.addTask("events", flushEvents, 0);
+    otaTaskId = scheduler.addTask("ota", otaTask, 0);
+    if (!(
+        (uiTaskId = scheduler.addTask("ui", uiTask, UI_TASK_MILLIS)) != SS_NO_TASK &&
+        (buttonTaskId = scheduler.addTask("button", buttonTask, BUTTON_TASK_MILLIS)) != SS_NO_TASK &&
+        (webTaskId = scheduler.addTask("web", webTask, WEB_TASK_MILLIS)) != SS_NO_TASK &&
+        scheduler.addTask("net", netTask, NET_TASK_MILLIS) != SS_NO_TASK &&
+        (groupTaskId = scheduler.addTask("group", groupTask, GROUP_TASK_MILLIS)) != SS_NO_TASK &&
+        (mdnsTaskId = scheduler.addTask("mdns", mdnsTask, MDNS_TASK_MILLIS)) != SS_NO_TASK &&
+        scheduleTaskId != SS_NO_TASK && commitTaskId != SS_NO_TASK && clockTaskId != SS_NO_TASK && 
+        eventTaskId != SS_NO_TASK && otaTaskId != SS_NO_TASK)
+        ) {
+        Serial.print("Couldn't add all the tasks to the scheduler.\n");
+    }
+    scheduler.runIn(scheduleTaskId, 0);
+    scheduler.runIn(clockTaskId, 0);
+    if (ota.boot() != ouNormal) {
+        scheduler.runIn(otaTaskId, 0);          // Watch over the new firmware's trial
+    }
+    logEvent(ecBoot, false, ESP.getResetInfoPtr()->reason);    // The relay starts out open
+
+    // Sleep the way config says while idle. Before netTask() connects, so the listen interval counts.
+    applyPowerMode();
+}
+
+/**
+ * @brief The Arduino loop function. Called repeatedly.
+ * 
+ *        Run whatever tasks are due and then give the time until the next one is due to the 
+ *        system. delay() lets the WiFi stack run and the processor idle in the meantime. With 
+ *        METRICS defined, also note how long running the tasks took and track the free heap's 
+ *        low-water mark. Either way, note the time spent awake and idle for powerReport().
+ * 
+ */
+void loop() {
+    uint32_t startMicros = micros();
+    unsigned long idleMillis = scheduler.run();
+    uint32_t runMicros = micros() - startMicros;
+    #ifdef METRICS
+    loopMicros.record(runMicros);
+    uint32_t heap = ESP.getFreeHeap();
+    if (heap < heapLow) {
+        heapLow = heap;
+        heapLowMaxBlock = ESP.getMaxFreeBlockSize();
+        heapLowFrag = ESP.getHeapFragmentation();
     }
-}
\ No newline at end of file
+    #endif
+    uint32_t idleStart = micros();
+    delay(idleMillis);
+    notePowerUse(runMicros, idleMillis, micros() - idleStart);
+}
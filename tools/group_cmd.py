@@ -0,0 +1,66 @@
+"""
+Send a group command to every outlet in a group, in one UDP multicast datagram.
+
+The datagram carries a JSON object of the sort POSTed to /api/state or /api/schedule, e.g.,
+{"outlet":true} or {"enabled":false} or {"s0en":true,"s0on":"18:30"}, signed with the group's
+key. Each outlet that's in the group (see the "group" command) and has the key applies it, just
+as it would the POST. The format, all little-endian:
+
+    uint16  magic       0x4F57 ("WO")
+    uint8   version     1
+    uint8   command     1: the JSON is for /api/state; 2: for /api/schedule
+    uint16  group       The group number, or 0xFFFF for every group
+    uint16  jsonLen     The length of the JSON
+    uint64  stamp       Milliseconds since the epoch. Must be within 30 s of the outlets' clocks
+                        and later than the last command they accepted and than when they started
+    bytes   json
+    bytes   mac         The first 16 bytes of HMAC-SHA256(key, everything before it)
+
+Since UDP datagrams can get lost, the same one is sent a few times; outlets ignore the repeats.
+
+Usage:  python tools/group_cmd.py <group> <key> state|schedule '<json>' [--repeat N] [--ttl N]
+"""
+import argparse
+import hashlib
+import hmac
+import socket
+import struct
+import time
+
+GROUP_ADDR = "239.255.70.11"
+GROUP_PORT = 7011
+GROUP_MAGIC = 0x4F57
+GROUP_VERSION = 1
+GROUP_MAC_LEN = 16
+COMMANDS = {"state": 1, "schedule": 2}
+
+
+def make_datagram(group, key, command, json_text, stamp_ms):
+    """Return the signed datagram for the specified command."""
+    json_bytes = json_text.encode("utf-8")
+    header = struct.pack("<HBBHHQ", GROUP_MAGIC, GROUP_VERSION, COMMANDS[command], group, len(json_bytes), stamp_ms)
+    mac = hmac.new(key.encode("utf-8"), header + json_bytes, hashlib.sha256).digest()[:GROUP_MAC_LEN]
+    return header + json_bytes + mac
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Send a signed group command to WiFi outlets by UDP multicast.")
+    parser.add_argument("group", type=int, help="group number, 1 to 65534, or 65535 for all groups")
+    parser.add_argument("key", help="the group's key")
+    parser.add_argument("command", choices=COMMANDS.keys(), help="which API resource the JSON updates")
+    parser.add_argument("json", help='the JSON object, e.g., \'{"outlet":true}\'')
+    parser.add_argument("--repeat", type=int, default=3, help="times to send it (default 3)")
+    parser.add_argument("--ttl", type=int, default=1, help="multicast TTL (default 1: this subnet only)")
+    args = parser.parse_args()
+
+    datagram = make_datagram(args.group, args.key, args.command, args.json, int(time.time() * 1000))
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, args.ttl)
+    for i in range(args.repeat):
+        sock.sendto(datagram, (GROUP_ADDR, GROUP_PORT))
+        if i < args.repeat - 1:
+            time.sleep(0.02)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,74 @@
+"""
+PlatformIO pre-build script: gzip the static web assets in web/ and generate include/webAssets.h
+
+Each asset becomes a PROGMEM byte array holding its gzipped content, plus an entry in the 
+webAssets[] table giving the path it's served at, its Content-Type, its length and a strong 
+ETag derived from its content. The header is only rewritten when something changed, so it 
+doesn't cause needless rebuilds.
+
+Used from platformio.ini as "extra_scripts = pre:tools/web_assets.py". It can also be run by 
+hand: "python tools/web_assets.py".
+"""
+import gzip
+import hashlib
+import os
+
+try:
+    Import("env")                                   # noqa: F821 -- supplied by PlatformIO
+    PROJECT_DIR = env.subst("$PROJECT_DIR")         # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# (path served at, file in web/, Content-Type)
+ASSETS = [
+    ("/index.html", "index.html", "text/html"),
+    ("/app.js", "app.js", "text/javascript"),
+    ("/style.css", "style.css", "text/css"),
+]
+
+OUT_FILE = os.path.join(PROJECT_DIR, "include", "webAssets.h")
+
+
+def generate():
+    lines = [
+        "// Generated by tools/web_assets.py from the files in web/. Do not edit.",
+        "#pragma once",
+        "",
+        "struct webAsset_t {",
+        "    const char* path;                               // The path the asset is served at",
+        "    const char* contentType;                        // Its Content-Type",
+        "    const uint8_t* data;                            // Its gzipped content (PROGMEM)",
+        "    uint32_t len;                                   // The length of data",
+        "    const char* etag;                               // Its (strong) ETag, quotes included",
+        "};",
+        "",
+    ]
+    entries = []
+    for i, (path, fileName, contentType) in enumerate(ASSETS):
+        with open(os.path.join(PROJECT_DIR, "web", fileName), "rb") as f:
+            data = gzip.compress(f.read(), 9, mtime=0)
+        etag = '\\"' + hashlib.sha1(data).hexdigest()[:16] + '\\"'
+        lines.append("// %s: %d bytes gzipped" % (fileName, len(data)))
+        lines.append("static const uint8_t webAsset%d[] PROGMEM = {" % i)
+        for j in range(0, len(data), 16):
+            lines.append("    " + ", ".join("0x%02x" % b for b in data[j:j + 16]) + ",")
+        lines.append("};")
+        entries.append('    {"%s", "%s", webAsset%d, %d, "%s"},' % (path, contentType, i, len(data), etag))
+    lines.append("")
+    lines.append("static const webAsset_t webAssets[] = {")
+    lines.extend(entries)
+    lines.append("};")
+    lines.append("#define N_WEB_ASSETS        (%d)" % len(ASSETS))
+    text = "\n".join(lines) + "\n"
+
+    old = None
+    if os.path.exists(OUT_FILE):
+        with open(OUT_FILE) as f:
+            old = f.read()
+    if text != old:
+        with open(OUT_FILE, "w") as f:
+            f.write(text)
+        print("web_assets: wrote " + OUT_FILE)
+
+
+generate()
@@ -0,0 +1,61 @@
+// Fill in the home page with the outlet's current state and schedule, fetched from /api/state 
+// and /api/schedule. The page itself never changes, so the browser keeps it (and this script) 
+// cached. The form's buttons post to /index.html as they always have, but from here, asking for 
+// JSON: the answer is just what changed, which is patched into the page, rather than a redirect 
+// to the whole page. Without the script, the form works the old way.
+function show(name, text) {
+  document.querySelectorAll('[data-v="' + name + '"]').forEach(e => e.textContent = text);
+}
+
+function fill(values) {
+  for (const [k, v] of Object.entries(values)) {
+    show(k, v);
+    if (/^s\dty$/.test(k)) {
+      const r = document.querySelector('input[name="' + k + '"][value="' + k.substring(0, 2) + v + '"]');
+      if (r) r.checked = true;
+      continue;
+    }
+    document.getElementsByName(k).forEach(e => {
+      if (e.type == 'checkbox') e.checked = v; else e.value = v;
+    });
+  }
+}
+
+function showState(s) {
+  show('schedIs', s.enabled ? 'enabled' : 'disabled');
+  show('schedWillBe', s.enabled ? 'disable' : 'enable');
+  show('outletIs', s.outlet ? 'on' : 'off');
+  show('outletWillBe', s.outlet ? 'off' : 'on');
+  document.getElementById('schedButton').value = (s.enabled ? 'Disable' : 'Enable') + ' schedule';
+  document.getElementById('outletButton').value = 'Turn outlet ' + (s.outlet ? 'off' : 'on');
+}
+
+fetch('/api/schedule', {cache: 'no-store'}).then(r => r.json()).then(fill);
+fetch('/api/state', {cache: 'no-store'}).then(r => r.json()).then(s => {
+  fill(s);
+  showState(s);
+});
+
+document.querySelector('form').addEventListener('submit', e => {
+  const button = e.submitter;
+  if (!button || !window.fetch) return;
+  e.preventDefault();
+  const form = e.target;
+  const update = /schedule=update/.test(button.formAction);
+  fetch(button.formAction, {method: 'POST', headers: {'Accept': 'application/json'},
+    body: update ? new URLSearchParams(new FormData(form)) : null})
+    .then(r => r.ok ? r.json() : Promise.reject(r.status))
+    .then(d => {
+      fill(d);
+      showState(d);
+    })
+    .catch(() => {
+      form.action = button.formAction;              // Let the device explain, the old way
+      form.submit();
+    });
+});
+
+// Keep the outlet and schedule state up to date as they change, whoever changes them.
+if (window.EventSource) {
+  new EventSource('/events').addEventListener('state', e => showState(JSON.parse(e.data)));
+}